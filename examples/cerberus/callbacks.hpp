@@ -3,19 +3,25 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
-#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/trace.hpp>
-#include <hadesmem/detail/srw_lock.hpp>
 
 #include "imgui.hpp"
 
-// TODO: Fix the problem of registering/unregistring a callback from the context
-// of a callback (deadlock in current implementation, iterator invalidation if
-// recursive mutex is used).
+// TODO: Reclamation of old snapshots is deferred while any thread is in Run.
+// If some thread is always in Run (e.g. multiple render threads) they are only
+// freed on destruction. Switch to per-thread epochs if that becomes a problem.
 
 namespace hadesmem
 {
@@ -34,43 +40,108 @@ inline void LogWrapper(std::string const& s)
 #endif
 }
 
+struct CallbackTiming
+{
+  std::uint64_t num_calls;
+  std::chrono::nanoseconds total_time;
+};
+
+// Callbacks are run from an immutable snapshot which is published through an
+// atomic pointer, so Run takes no locks. Register and Unregister (which are
+// rare in comparison) copy the snapshot, publish the copy, and free the old
+// one once no thread can still be running it. This also means they are safe
+// to call from within a callback. The change is seen by the next call to Run,
+// not the current one.
 template <typename Func> class Callbacks
 {
 public:
   using Callback = std::function<Func>;
 
-  Callbacks() : srw_lock_(SRWLOCK_INIT)
+  Callbacks() : snapshot_{new Snapshot{}}
+  {
+  }
+
+  Callbacks(Callbacks const& other) = delete;
+
+  Callbacks& operator=(Callbacks const& other) = delete;
+
+  ~Callbacks()
   {
+    HADESMEM_DETAIL_ASSERT(!readers_.load());
+    delete snapshot_.load();
   }
 
-  std::size_t Register(Callback const& callback)
+  // Callbacks are run in ascending order of priority, then in the order they
+  // were registered.
+  std::size_t Register(Callback const& callback, int priority = 0)
   {
-    hadesmem::detail::AcquireSRWLock lock(
-      &srw_lock_, hadesmem::detail::SRWLockType::Exclusive);
+    std::lock_guard<std::mutex> lock{mutex_};
+
     auto const cur_id = next_id_++;
     HADESMEM_DETAIL_ASSERT(next_id_ > cur_id);
-    callbacks_[cur_id] = callback;
+
+    auto const snapshot = snapshot_.load();
+    std::unique_ptr<Snapshot> new_snapshot{new Snapshot{*snapshot}};
+    Entry entry{cur_id, priority, callback, std::make_shared<Stats>()};
+    auto const iter = std::upper_bound(
+      std::begin(new_snapshot->entries),
+      std::end(new_snapshot->entries),
+      entry,
+      [](Entry const& lhs, Entry const& rhs) {
+        return lhs.priority < rhs.priority;
+      });
+    new_snapshot->entries.insert(iter, std::move(entry));
+
+    Publish(std::move(new_snapshot));
+
     return cur_id;
   }
 
   void Unregister(std::size_t id)
   {
-    hadesmem::detail::AcquireSRWLock lock(
-      &srw_lock_, hadesmem::detail::SRWLockType::Exclusive);
-    auto const num_removed = callbacks_.erase(id);
-    HADESMEM_DETAIL_ASSERT(num_removed == 1);
-    (void)num_removed;
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto const snapshot = snapshot_.load();
+    std::unique_ptr<Snapshot> new_snapshot{new Snapshot{}};
+    new_snapshot->entries.reserve(snapshot->entries.size());
+    std::copy_if(std::begin(snapshot->entries),
+                 std::end(snapshot->entries),
+                 std::back_inserter(new_snapshot->entries),
+                 [&](Entry const& entry) { return entry.id != id; });
+    HADESMEM_DETAIL_ASSERT(new_snapshot->entries.size() + 1 ==
+                           snapshot->entries.size());
+
+    Publish(std::move(new_snapshot));
   }
 
   template <typename... Args> void Run(Args&&... args) const noexcept
   {
-    hadesmem::detail::AcquireSRWLock lock(
-      &srw_lock_, hadesmem::detail::SRWLockType::Shared);
-    for (auto const& c : callbacks_)
+    // Must be announced before the snapshot is loaded, see Publish.
+    readers_.fetch_add(1);
+    auto const snapshot = snapshot_.load();
+
+    bool const timing = timing_enabled_.load(std::memory_order_relaxed);
+    for (auto const& c : snapshot->entries)
     {
       try
       {
-        c.second(std::forward<Args>(args)...);
+        if (timing)
+        {
+          auto const start = std::chrono::high_resolution_clock::now();
+          c.callback(std::forward<Args>(args)...);
+          auto const elapsed =
+            std::chrono::high_resolution_clock::now() - start;
+          c.stats->num_calls.fetch_add(1, std::memory_order_relaxed);
+          c.stats->total_ns.fetch_add(
+            static_cast<std::uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                .count()),
+            std::memory_order_relaxed);
+        }
+        else
+        {
+          c.callback(std::forward<Args>(args)...);
+        }
       }
       catch (...)
       {
@@ -80,13 +151,102 @@ public:
           boost::current_exception_diagnostic_information());
       }
     }
+
+    if (readers_.fetch_sub(1) == 1 && has_retired_.load())
+    {
+      // Don't wait for the lock. If someone else has it they will either
+      // reclaim the retired snapshots themselves or leave them to the next
+      // reader out. The reader count has to be checked again under the lock,
+      // as a writer may have retired a snapshot that a new reader is using in
+      // between.
+      std::unique_lock<std::mutex> lock{mutex_, std::try_to_lock};
+      if (lock.owns_lock() && !readers_.load())
+      {
+        ReclaimRetired();
+      }
+    }
+  }
+
+  // Timing is off by default, as it costs two clock reads per callback.
+  void SetTimingEnabled(bool enabled) noexcept
+  {
+    timing_enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  CallbackTiming GetTiming(std::size_t id) const
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto const& entries = snapshot_.load()->entries;
+    auto const iter = std::find_if(
+      std::begin(entries), std::end(entries), [&](Entry const& entry) {
+        return entry.id == id;
+      });
+    HADESMEM_DETAIL_ASSERT(iter != std::end(entries));
+    if (iter == std::end(entries))
+    {
+      return CallbackTiming{};
+    }
+
+    return CallbackTiming{
+      iter->stats->num_calls.load(std::memory_order_relaxed),
+      std::chrono::nanoseconds{static_cast<std::chrono::nanoseconds::rep>(
+        iter->stats->total_ns.load(std::memory_order_relaxed))}};
   }
 
 private:
-  mutable SRWLOCK srw_lock_;
+  struct Stats
+  {
+    std::atomic<std::uint64_t> num_calls{};
+    std::atomic<std::uint64_t> total_ns{};
+  };
+
+  struct Entry
+  {
+    std::size_t id;
+    int priority;
+    Callback callback;
+    // Shared between snapshots so it survives other callbacks being
+    // registered or unregistered.
+    std::shared_ptr<Stats> stats;
+  };
+
+  struct Snapshot
+  {
+    std::vector<Entry> entries;
+  };
+
+  // Requires mutex_.
+  void Publish(std::unique_ptr<Snapshot> new_snapshot)
+  {
+    retired_.reserve(retired_.size() + 1);
+    retired_.emplace_back(snapshot_.exchange(new_snapshot.release()));
+    has_retired_.store(true);
+
+    // A reader increments readers_ before loading snapshot_, so if there are
+    // no readers after the new snapshot is published then nobody can be using
+    // a retired one. Otherwise it's left for the last reader out (or the next
+    // writer).
+    if (!readers_.load())
+    {
+      ReclaimRetired();
+    }
+  }
+
+  // Requires mutex_.
+  void ReclaimRetired() const noexcept
+  {
+    retired_.clear();
+    has_retired_.store(false);
+  }
+
+  std::atomic<Snapshot*> snapshot_;
+  mutable std::atomic<std::size_t> readers_{};
+  mutable std::atomic<bool> has_retired_{};
+  std::atomic<bool> timing_enabled_{};
+  mutable std::mutex mutex_;
+  mutable std::vector<std::unique_ptr<Snapshot>> retired_;
   std::size_t next_id_ = std::size_t{};
-  std::map<std::size_t, Callback> callbacks_;
-  std::map<std::size_t, Callback> pending_;
 };
 }
 }
@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include <windows.h>
@@ -20,6 +21,7 @@
 #include <hadesmem/detail/winternl.hpp>
 #include <hadesmem/find_procedure.hpp>
 #include <hadesmem/module.hpp>
+#include <hadesmem/module_index.hpp>
 #include <hadesmem/patcher.hpp>
 #include <hadesmem/process.hpp>
 
@@ -37,6 +39,68 @@ std::pair<void*, SIZE_T>& GetNtdllModule() noexcept
   return module;
 }
 
+std::mutex& GetModuleIndexMutex() noexcept
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Built on first use, after which it's kept up to date by our hooks.
+// Requires GetModuleIndexMutex.
+std::unique_ptr<hadesmem::ModuleIndex>& GetModuleIndex() noexcept
+{
+  static std::unique_ptr<hadesmem::ModuleIndex> index;
+  return index;
+}
+
+hadesmem::ModuleIndex& GetOrCreateModuleIndex()
+{
+  auto& index = GetModuleIndex();
+  if (!index)
+  {
+    index = std::make_unique<hadesmem::ModuleIndex>(
+      hadesmem::cerberus::GetThisProcess());
+  }
+
+  return *index;
+}
+
+void RefreshModuleIndex() noexcept
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock{GetModuleIndexMutex()};
+    if (auto& index = GetModuleIndex())
+    {
+      index->Refresh();
+    }
+  }
+  catch (...)
+  {
+    HADESMEM_DETAIL_TRACE_A(
+      boost::current_exception_diagnostic_information().c_str());
+    HADESMEM_DETAIL_ASSERT(false);
+  }
+}
+
+void RemoveFromModuleIndex(HMODULE module) noexcept
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock{GetModuleIndexMutex()};
+    if (auto& index = GetModuleIndex())
+    {
+      index->Remove(module);
+    }
+  }
+  catch (...)
+  {
+    HADESMEM_DETAIL_TRACE_A(
+      boost::current_exception_diagnostic_information().c_str());
+    HADESMEM_DETAIL_ASSERT(false);
+  }
+}
+
 hadesmem::cerberus::Callbacks<hadesmem::cerberus::OnMapCallback>&
   GetOnMapCallbacks()
 {
@@ -122,6 +186,24 @@ public:
     auto& callbacks = GetOnUnloadCallbacks();
     return callbacks.Unregister(id);
   }
+
+  virtual hadesmem::detail::Optional<hadesmem::Module>
+    FindModule(std::wstring const& name) final
+  {
+    std::lock_guard<std::mutex> lock{GetModuleIndexMutex()};
+    auto const module = GetOrCreateModuleIndex().Find(name);
+    return module ? hadesmem::detail::Optional<hadesmem::Module>{*module}
+                  : hadesmem::detail::Optional<hadesmem::Module>{};
+  }
+
+  virtual hadesmem::detail::Optional<hadesmem::Module>
+    FindModuleByAddress(void const* address) final
+  {
+    std::lock_guard<std::mutex> lock{GetModuleIndexMutex()};
+    auto const module = GetOrCreateModuleIndex().FindByAddress(address);
+    return module ? hadesmem::detail::Optional<hadesmem::Module>{*module}
+                  : hadesmem::detail::Optional<hadesmem::Module>{};
+  }
 };
 
 extern "C" NTSTATUS WINAPI
@@ -332,6 +414,8 @@ extern "C" NTSTATUS WINAPI NtUnmapViewOfSectionDetour(
 
   HADESMEM_DETAIL_TRACE_NOISY_A("Succeeded. Current process.");
 
+  RemoveFromModuleIndex(reinterpret_cast<HMODULE>(base));
+
   auto& callbacks = GetOnUnmapCallbacks();
   callbacks.Run(reinterpret_cast<HMODULE>(base));
 
@@ -392,6 +476,9 @@ extern "C" NTSTATUS WINAPI LdrLoadDllDetour(hadesmem::PatchDetourBase* detour,
 
   HADESMEM_DETAIL_TRACE_NOISY_A("Succeeded.");
 
+  // Only new entries are read, so this is cheap.
+  RefreshModuleIndex();
+
   auto& callbacks = GetOnLoadCallbacks();
   callbacks.Run(reinterpret_cast<HMODULE>(*handle),
                 path,
@@ -9,6 +9,8 @@
 #include <windows.h>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/optional.hpp>
+#include <hadesmem/module.hpp>
 
 namespace hadesmem
 {
@@ -54,6 +56,14 @@ public:
     RegisterOnUnload(std::function<OnUnloadCallback> const& callback) = 0;
 
   virtual void UnregisterOnUnload(std::size_t id) = 0;
+
+  // Looked up in an index of the loaded modules which is kept up to date by
+  // the load/unload hooks, rather than by taking a snapshot.
+  virtual hadesmem::detail::Optional<hadesmem::Module>
+    FindModule(std::wstring const& name) = 0;
+
+  virtual hadesmem::detail::Optional<hadesmem::Module>
+    FindModuleByAddress(void const* address) = 0;
 };
 
 ModuleInterface& GetModuleInterface() noexcept;
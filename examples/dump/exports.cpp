@@ -125,7 +125,7 @@ void DumpExports(hadesmem::Process const& process,
 
     if (e.ByName())
     {
-      auto const name = e.GetName();
+      auto const name = e.GetNameView();
       // Sample: dllweirdexp.dll
       HandleLongOrUnprintableString(
         L"Name", L"export name", 3, WarningType::kSuspicious, name);
@@ -135,7 +135,7 @@ void DumpExports(hadesmem::Process const& process,
       // before performing a search.
       // Sample: None ("Import name hint" section of "Undocumented PECOFF"
       // whitepaper).
-      if (!export_names.insert(name).second)
+      if (!export_names.insert(name.to_string()).second)
       {
         WriteNormal(out, L"WARNING! Detected duplicate export name.", 3);
         WarnForCurrentFile(WarningType::kSuspicious);
@@ -147,11 +147,10 @@ void DumpExports(hadesmem::Process const& process,
 
     if (e.IsForwarded())
     {
-      WriteNamedNormal(out, L"Forwarder", e.GetForwarder().c_str(), 3);
+      WriteNamedNormal(out, L"Forwarder", e.GetForwarderView(), 3);
+      WriteNamedNormal(out, L"ForwarderModule", e.GetForwarderModuleView(), 3);
       WriteNamedNormal(
-        out, L"ForwarderModule", e.GetForwarderModule().c_str(), 3);
-      WriteNamedNormal(
-        out, L"ForwarderFunction", e.GetForwarderFunction().c_str(), 3);
+        out, L"ForwarderFunction", e.GetForwarderFunctionView(), 3);
       WriteNamedNormal(
         out, L"IsForwardedByOrdinal", e.IsForwardedByOrdinal(), 3);
       if (e.IsForwardedByOrdinal())
@@ -3,13 +3,24 @@
 
 #include "filesystem.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
 #include <vector>
 
 #include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/mapped_file.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/pelib/nt_headers.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
@@ -26,11 +37,47 @@ void DumpFile(std::wstring const& path)
 
     SetCurrentFilePath(path);
 
-    std::vector<char> buf;
+    // Map the file rather than reading it in, so only the parts which are
+    // actually looked at are brought into memory. Files which aren't on a
+    // local drive are read in instead, as touching a view of them faults
+    // (rather than throwing) if the share or device goes away.
+    std::unique_ptr<hadesmem::detail::MappedFile> file;
+    try
+    {
+      file = std::make_unique<hadesmem::detail::MappedFile>(path);
+    }
+    catch (...)
+    {
+      return;
+    }
 
+    hadesmem::detail::MappedFileView view;
+    std::vector<char> buf;
+    void* base = nullptr;
+    std::size_t size = 0;
     try
     {
-      buf = hadesmem::detail::PeFileToBuffer(path);
+      if (file->IsLocal())
+      {
+        view = file->MapPeView();
+        base = view.GetBase();
+        size = view.GetSize();
+      }
+      else
+      {
+        // Check the signature first, so files on a share which aren't PE
+        // files aren't read in their entirety.
+        auto const signature = file->Read(0, 2);
+        if (signature.size() < 2 || signature[0] != 'M' ||
+            signature[1] != 'Z')
+        {
+          return;
+        }
+
+        buf = file->ReadPe();
+        base = buf.data();
+        size = buf.size();
+      }
     }
     catch (std::bad_alloc const&)
     {
@@ -39,7 +86,26 @@ void DumpFile(std::wstring const& path)
       WarnForCurrentFile(WarningType::kUnsupported);
       return;
     }
-    catch (...)
+    catch (hadesmem::Error const& e)
+    {
+      // Running out of address space is the only failure which means the
+      // file is too large. Anything else is reported as an error below.
+      auto const last_error_ptr =
+        boost::get_error_info<hadesmem::ErrorCodeWinLast>(e);
+      if (!last_error_ptr || (*last_error_ptr != ERROR_NOT_ENOUGH_MEMORY &&
+                              *last_error_ptr != ERROR_COMMITMENT_LIMIT))
+      {
+        throw;
+      }
+
+      WriteNewline(out);
+      WriteNormal(out, L"WARNING! File too large.", 0);
+      WarnForCurrentFile(WarningType::kUnsupported);
+      return;
+    }
+
+    auto const data_beg = static_cast<char const*>(base);
+    if (size < 2 || data_beg[0] != 'M' || data_beg[1] != 'Z')
     {
       return;
     }
@@ -47,9 +113,10 @@ void DumpFile(std::wstring const& path)
     hadesmem::Process const process(GetCurrentProcessId());
 
     hadesmem::PeFile const pe_file(process,
-                                   buf.data(),
+                                   base,
                                    hadesmem::PeFileType::kData,
-                                   static_cast<DWORD>(buf.size()));
+                                   static_cast<DWORD>(size),
+                                   hadesmem::PeFileFlags::kLocalBuffer);
 
     try
     {
@@ -77,13 +144,236 @@ void DumpFile(std::wstring const& path)
   }
 }
 
-void DumpDir(std::wstring const& path, hadesmem::detail::ThreadPool& pool)
+namespace
+{
+// Bounds the total size of the files being dumped at once, so that lots of
+// threads each working on a large file can't exhaust RAM.
+class InflightBudget
+{
+public:
+  void SetMax(std::uint64_t max_bytes)
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    max_bytes_ = max_bytes;
+  }
+
+  // Takes bytes from the budget if they fit. Otherwise returns false, and
+  // calls retry once some of the budget has been given back, so the caller can
+  // requeue its work rather than blocking a worker until then. A file is
+  // always let through when nothing else is in flight, otherwise a file larger
+  // than the budget could never be dumped.
+  bool TryAcquire(std::uint64_t bytes, std::function<void()> retry)
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (max_bytes_ && inflight_bytes_ &&
+        (inflight_bytes_ > max_bytes_ ||
+         bytes > max_bytes_ - inflight_bytes_))
+    {
+      retries_.emplace_back(std::move(retry));
+      return false;
+    }
+
+    inflight_bytes_ += bytes;
+    return true;
+  }
+
+  void Release(std::uint64_t bytes)
+  {
+    std::vector<std::function<void()>> retries;
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      inflight_bytes_ -= bytes;
+      retries.swap(retries_);
+    }
+
+    for (auto const& retry : retries)
+    {
+      retry();
+    }
+  }
+
+private:
+  std::mutex mutex_;
+  std::uint64_t max_bytes_{};
+  std::uint64_t inflight_bytes_{};
+  std::vector<std::function<void()>> retries_;
+};
+
+InflightBudget& GetInflightBudget()
+{
+  static InflightBudget budget;
+  return budget;
+}
+
+// Gives bytes which have been acquired back to the budget.
+class InflightBudgetLease
+{
+public:
+  explicit InflightBudgetLease(std::uint64_t bytes) noexcept : bytes_{bytes}
+  {
+  }
+
+  InflightBudgetLease(InflightBudgetLease const& other) = delete;
+
+  InflightBudgetLease& operator=(InflightBudgetLease const& other) = delete;
+
+  ~InflightBudgetLease()
+  {
+    GetInflightBudget().Release(bytes_);
+  }
+
+private:
+  std::uint64_t bytes_;
+};
+
+// Dumping a PE file can end up touching most of it, so a file counts against
+// the budget for as much of it as DumpFile maps or reads in. This is checked
+// before the file is opened, so nothing is mapped while waiting.
+std::uint64_t GetBudgetSize(std::wstring const& path)
+{
+  WIN32_FILE_ATTRIBUTE_DATA data{};
+  if (!::GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+  {
+    return 0;
+  }
+
+  std::uint64_t const size =
+    (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) |
+    data.nFileSizeLow;
+  return (std::min)(
+    size, static_cast<std::uint64_t>((std::numeric_limits<DWORD>::max)()));
+}
+
+// Files are handed to the scheduler in batches to amortize the cost of a task
+// over directories full of small files.
+std::size_t const kFileBatchSize = 64;
+
+// Number of directories which may be queued per worker before subdirectories
+// are walked inline instead, so very wide trees can't flood the queue.
+std::size_t const kMaxQueuedDirsPerThread = 4;
+
+// Number of batches of files which may be outstanding (queued, or waiting on
+// the budget) per worker before walkers stop to help with them.
+std::size_t const kMaxQueuedBatchesPerThread = 4;
+
+struct DirWalk
+{
+  hadesmem::detail::TaskScheduler* scheduler;
+  hadesmem::detail::TaskGroup* group;
+  std::size_t max_queued_dirs;
+  std::atomic<std::size_t> queued_dirs;
+  std::size_t max_queued_batches;
+  std::atomic<std::size_t> queued_batches;
+  // Bumped whenever a batch finishes or is requeued, so walkers waiting in
+  // QueueFileBatch can tell that something has changed.
+  std::atomic<std::size_t> batch_events;
+  std::mutex batch_mutex;
+  std::condition_variable batch_cv;
+};
+
+void DumpDirImpl(std::wstring const& path, DirWalk& walk);
+
+void NotifyBatchWaiters(DirWalk& walk)
+{
+  ++walk.batch_events;
+  {
+    std::lock_guard<std::mutex> lock{walk.batch_mutex};
+  }
+  walk.batch_cv.notify_all();
+}
+
+void QueueDir(std::wstring const& path, DirWalk& walk)
+{
+  if (walk.queued_dirs.fetch_add(1) >= walk.max_queued_dirs)
+  {
+    --walk.queued_dirs;
+    DumpDirImpl(path, walk);
+    return;
+  }
+
+  walk.group->Run([path, &walk]() {
+    --walk.queued_dirs;
+    DumpDirImpl(path, walk);
+  });
+}
+
+// Dumps the files in the batch from index on. If a file has to wait for the
+// budget the rest of the batch is requeued once it might fit, rather than
+// blocking the worker.
+void DumpFileBatch(std::shared_ptr<std::vector<std::wstring>> const& paths,
+                   std::size_t index,
+                   DirWalk& walk)
+{
+  for (; index < paths->size(); ++index)
+  {
+    std::wstring const& path = (*paths)[index];
+    std::uint64_t const size = GetBudgetSize(path);
+    bool const acquired =
+      GetInflightBudget().TryAcquire(size, [paths, index, &walk]() {
+        walk.group->Run(
+          [paths, index, &walk]() { DumpFileBatch(paths, index, walk); });
+        NotifyBatchWaiters(walk);
+      });
+    if (!acquired)
+    {
+      return;
+    }
+
+    InflightBudgetLease const budget_lease{size};
+    DumpFile(path);
+  }
+
+  --walk.queued_batches;
+  NotifyBatchWaiters(walk);
+}
+
+void QueueFileBatch(std::vector<std::wstring>& batch, DirWalk& walk)
+{
+  if (batch.empty())
+  {
+    return;
+  }
+
+  // Walkers on the workers aren't throttled by the scheduler, so bound the
+  // number of outstanding batches here. Help run the queued work until there's
+  // room, and only block once there's nothing left to help with (everything
+  // outstanding is either running or waiting on the budget). A batch finishing
+  // or being requeued wakes us, so a worker can't be left blocked while there's
+  // work which only it could run.
+  for (;;)
+  {
+    std::size_t const batch_events = walk.batch_events.load();
+    if (walk.queued_batches.load() < walk.max_queued_batches)
+    {
+      break;
+    }
+
+    if (walk.scheduler->TryRunOne())
+    {
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock{walk.batch_mutex};
+    walk.batch_cv.wait(
+      lock, [&]() { return walk.batch_events.load() != batch_events; });
+  }
+
+  ++walk.queued_batches;
+  auto const paths =
+    std::make_shared<std::vector<std::wstring>>(std::move(batch));
+  batch.clear();
+  walk.group->Run([paths, &walk]() { DumpFileBatch(paths, 0, walk); });
+}
+
+void DumpDirImpl(std::wstring const& path, DirWalk& walk)
 {
   std::wostream& out = GetOutputStreamW();
 
   WriteNewline(out);
   WriteNormal(out, L"Entering dir: \"" + path + L"\".", 0);
 
+  std::vector<std::wstring> batch;
+
   auto const f = [&](std::wstring const& cur_file) {
     std::wstring const cur_path = hadesmem::detail::MakeExtendedPath(
       hadesmem::detail::CombinePath(path, cur_file));
@@ -102,17 +392,16 @@ void DumpDir(std::wstring const& path, hadesmem::detail::ThreadPool& pool)
         }
         else
         {
-          DumpDir(cur_path, pool);
+          QueueDir(cur_path, walk);
         }
       }
       else
       {
-        auto const task = [cur_path]() { DumpFile(cur_path); };
-
-        do
+        batch.emplace_back(cur_path);
+        if (batch.size() >= kFileBatchSize)
         {
-          pool.WaitForSlot();
-        } while (!pool.QueueTask(task));
+          QueueFileBatch(batch, walk);
+        }
       }
     }
     catch (hadesmem::Error const& e)
@@ -150,6 +439,8 @@ void DumpDir(std::wstring const& path, hadesmem::detail::ThreadPool& pool)
   bool access_denied = false;
   hadesmem::detail::EnumDir(path, f, &empty, &access_denied);
 
+  QueueFileBatch(batch, walk);
+
   if (empty)
   {
     WriteNewline(out);
@@ -164,3 +455,28 @@ void DumpDir(std::wstring const& path, hadesmem::detail::ThreadPool& pool)
     return;
   }
 }
+}
+
+void DumpDir(std::wstring const& path,
+             hadesmem::detail::TaskScheduler& scheduler)
+{
+  // Subdirectories and batches of files are run as tasks in the group, so the
+  // walk itself is spread across the workers rather than being limited to the
+  // calling thread.
+  hadesmem::detail::TaskGroup group{scheduler};
+  std::size_t const num_threads = scheduler.GetNumThreads();
+  DirWalk walk{&scheduler,
+               &group,
+               num_threads * kMaxQueuedDirsPerThread,
+               {},
+               num_threads * kMaxQueuedBatchesPerThread,
+               {},
+               {}};
+  DumpDirImpl(path, walk);
+  group.Wait();
+}
+
+void SetMaxInflightBytes(std::uint64_t max_bytes)
+{
+  GetInflightBudget().SetMax(max_bytes);
+}
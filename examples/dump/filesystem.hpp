@@ -3,10 +3,16 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
-#include <hadesmem/detail/thread_pool.hpp>
+#include <hadesmem/detail/task_scheduler.hpp>
 
 void DumpFile(std::wstring const& path);
 
-void DumpDir(std::wstring const& path, hadesmem::detail::ThreadPool& pool);
+void DumpDir(std::wstring const& path,
+             hadesmem::detail::TaskScheduler& scheduler);
+
+// Limits the total size of files being dumped concurrently. Zero means no
+// limit.
+void SetMaxInflightBytes(std::uint64_t max_bytes);
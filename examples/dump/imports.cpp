@@ -3,14 +3,16 @@
 
 #include "imports.hpp"
 
+#include <cstddef>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <string>
 
 #include <hadesmem/pelib/bound_import_desc_list.hpp>
 #include <hadesmem/pelib/import_dir.hpp>
 #include <hadesmem/pelib/import_dir_list.hpp>
-#include <hadesmem/pelib/import_thunk.hpp>
-#include <hadesmem/pelib/import_thunk_list.hpp>
+#include <hadesmem/pelib/import_thunk_span.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
 #include <hadesmem/process.hpp>
 
@@ -62,7 +64,9 @@ bool HasValidNonEmptyBoundImportDescList(hadesmem::Process const& process,
   return (std::begin(bound_import_dirs) != std::end(bound_import_dirs));
 }
 
-void DumpImportThunk(hadesmem::ImportThunk const& thunk, bool is_bound)
+void DumpImportThunk(hadesmem::ImportThunkSpan const& thunks,
+                     hadesmem::ImportThunkEntry const& thunk,
+                     bool is_bound)
 {
   std::wostream& out = GetOutputStreamW();
 
@@ -86,8 +90,9 @@ void DumpImportThunk(hadesmem::ImportThunk const& thunk, bool is_bound)
     try
     {
       WriteNamedHex(out, L"AddressOfData", thunk.GetAddressOfData(), 3);
-      WriteNamedHex(out, L"Hint", thunk.GetHint(), 3);
-      auto const name = thunk.GetName();
+      WriteNamedHex(out, L"Hint", thunks.GetHint(thunk), 3);
+      std::string name_storage;
+      auto const name = thunks.GetNameView(thunk, name_storage);
       // Sample: dllweirdexp-ld.exe
       HandleLongOrUnprintableString(
         L"Name", L"import thunk name data", 3, WarningType::kSuspicious, name);
@@ -186,8 +191,8 @@ void DumpImports(hadesmem::Process const& process,
       // be invalid because it's ignored. Note that we simply skip here rather
       // than terminate, because it's possible to have such 'invalid' entries
       // in-between real entries.
-      hadesmem::ImportThunkList const iat_thunks(process, pe_file, iat);
-      if (std::begin(iat_thunks) == std::end(iat_thunks))
+      hadesmem::ImportThunkSpan const iat_thunks(process, pe_file, iat, 1);
+      if (iat_thunks.empty())
       {
         if (!ilt_valid)
         {
@@ -215,10 +220,14 @@ void DumpImports(hadesmem::Process const& process,
       }
     }
 
+    // Some legitimate PE files have well over 1000 imports from a single
+    // module (e.g. idaq64.exe importing QtGui4.dll).
+    std::size_t const kMaxThunks = 10000U;
     bool const use_ilt = !!ilt && ilt != iat;
-    hadesmem::ImportThunkList const ilt_thunks(
-      process, pe_file, use_ilt ? ilt : iat);
-    bool const ilt_empty = std::begin(ilt_thunks) == std::end(ilt_thunks);
+    // One extra so we can tell when we've hit the limit.
+    hadesmem::ImportThunkSpan const ilt_thunks(
+      process, pe_file, use_ilt ? ilt : iat, kMaxThunks + 1);
+    bool const ilt_empty = ilt_thunks.empty();
 
     // Apparently it's okay for the ILT to be invalid and 0xFFFFFFFF or 0. This
     // is handled below in our ILT valid/empty checks (after dumping the dir
@@ -273,7 +282,8 @@ void DumpImports(hadesmem::Process const& process,
 
     try
     {
-      auto imp_desc_name = dir.GetName();
+      std::string imp_desc_name_storage;
+      auto const imp_desc_name = dir.GetNameView(imp_desc_name_storage);
       HandleLongOrUnprintableString(L"Name",
                                     L"import descriptor name",
                                     2,
@@ -326,9 +336,7 @@ void DumpImports(hadesmem::Process const& process,
     std::size_t count = 0U;
     for (auto const& thunk : ilt_thunks)
     {
-      // Some legitimate PE files have well over 1000 imports from a single
-      // module (e.g. idaq64.exe importing QtGui4.dll).
-      if (count++ == 10000)
+      if (count++ == kMaxThunks)
       {
         WriteNewline(out);
         WriteNormal(
@@ -346,7 +354,7 @@ void DumpImports(hadesmem::Process const& process,
       // from in the IAT (which is bound).
       bool const is_image_iat =
         (pe_file.GetType() == hadesmem::PeFileType::kImage && !use_ilt);
-      DumpImportThunk(thunk, is_image_iat);
+      DumpImportThunk(ilt_thunks, thunk, is_image_iat);
     }
 
     // Windows will load PE files that have an invalid RVA for the ILT (lies
@@ -354,9 +362,13 @@ void DumpImports(hadesmem::Process const& process,
     // case.
     if (use_ilt && iat)
     {
-      hadesmem::ImportThunkList const iat_thunks(
-        process, pe_file, dir.GetFirstThunk());
-      if (std::begin(iat_thunks) != std::end(iat_thunks))
+      // We stop after one more thunk than the ILT has when it's valid.
+      hadesmem::ImportThunkSpan const iat_thunks(
+        process,
+        pe_file,
+        dir.GetFirstThunk(),
+        ilt_valid ? count + 1 : (std::numeric_limits<std::size_t>::max)());
+      if (!iat_thunks.empty())
       {
         WriteNewline(out);
         WriteNormal(out, L"Import Thunks (IAT)", 2);
@@ -395,7 +407,8 @@ void DumpImports(hadesmem::Process const& process,
         // bound, even though it actually isn't (and XP will apparently load
         // such a module). See tinygui.exe from the Corkami PE corpus for an
         // example.
-        DumpImportThunk(thunk, (is_iat_bound && ilt_valid) || !ilt_empty);
+        DumpImportThunk(
+          iat_thunks, thunk, (is_iat_bound && ilt_valid) || !ilt_empty);
       }
     }
   }
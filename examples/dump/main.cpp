@@ -31,7 +31,7 @@
 #include <hadesmem/detail/filesystem.hpp>
 #include <hadesmem/detail/self_path.hpp>
 #include <hadesmem/detail/str_conv.hpp>
-#include <hadesmem/detail/thread_pool.hpp>
+#include <hadesmem/detail/task_scheduler.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/module.hpp>
 #include <hadesmem/module_list.hpp>
@@ -310,6 +310,9 @@ void DumpProcessEntry(hadesmem::ProcessEntry const& process_entry,
   try
   {
     process = std::make_unique<hadesmem::Process>(process_entry.GetId());
+    // We only ever read from the target, and re-read the same headers many
+    // times while walking modules, so it's worth caching pages.
+    process->EnableReadCache();
   }
   catch (std::exception const& /*e*/)
   {
@@ -484,7 +487,7 @@ void HandleLongOrUnprintableString(std::wstring const& name,
                                    std::wstring const& description,
                                    std::size_t tabs,
                                    WarningType warning_type,
-                                   std::string value)
+                                   hadesmem::detail::StringView value)
 {
   std::wostream& out = GetOutputStreamW();
 
@@ -493,14 +496,14 @@ void HandleLongOrUnprintableString(std::wstring const& name,
   // read.
   auto const unprintable = FindFirstUnprintableClassicLocale(value);
   std::size_t const kMaxNameLength = 1024;
-  if (unprintable != std::string::npos)
+  if (unprintable != hadesmem::detail::StringView::npos)
   {
     WriteNormal(out,
                 L"WARNING! Detected unprintable " + description +
                   L". Truncating.",
                 tabs);
     WarnForCurrentFile(warning_type);
-    value.erase(unprintable);
+    value = value.substr(0, unprintable);
   }
   else if (value.size() > kMaxNameLength)
   {
@@ -509,9 +512,9 @@ void HandleLongOrUnprintableString(std::wstring const& name,
                   L". Truncating.",
                 tabs);
     WarnForCurrentFile(warning_type);
-    value.erase(kMaxNameLength);
+    value = value.substr(0, kMaxNameLength);
   }
-  WriteNamedNormal(out, name, value.c_str(), tabs);
+  WriteNamedNormal(out, name, value, tabs);
 }
 
 // TODO: Use hadesmem::detail::TimestampToStringUtc instead.
@@ -591,6 +594,14 @@ int main(int argc, char* argv[])
       "", "threads", "Number of threads", false, 0, "size_t", cmd);
     TCLAP::ValueArg<std::size_t> queue_factor_arg(
       "", "queue-factor", "Thread queue factor", false, 0, "size_t", cmd);
+    TCLAP::ValueArg<std::uint64_t> max_inflight_bytes_arg(
+      "",
+      "max-inflight-bytes",
+      "Maximum total size of files being dumped at once",
+      false,
+      0,
+      "uint64_t",
+      cmd);
     TCLAP::SwitchArg strings_arg("", "strings", "Dump strings", cmd);
     TCLAP::SwitchArg use_disk_headers_arg(
       "",
@@ -732,7 +743,12 @@ int main(int argc, char* argv[])
     auto const threads = threads_arg.isSet() ? threads_arg.getValue() : 1;
     auto const queue_factor =
       queue_factor_arg.isSet() ? queue_factor_arg.getValue() : 1;
-    hadesmem::detail::ThreadPool thread_pool{threads, queue_factor};
+    hadesmem::detail::TaskScheduler scheduler{threads, threads * queue_factor};
+
+    if (max_inflight_bytes_arg.isSet())
+    {
+      SetMaxInflightBytes(max_inflight_bytes_arg.getValue());
+    }
 
     if (pid_arg.isSet())
     {
@@ -773,7 +789,7 @@ int main(int argc, char* argv[])
         auto const path_wide = hadesmem::detail::MultiByteToWideChar(path);
         if (hadesmem::detail::IsDirectory(path_wide))
         {
-          DumpDir(path_wide, thread_pool);
+          DumpDir(path_wide, scheduler);
         }
         else
         {
@@ -792,10 +808,10 @@ int main(int argc, char* argv[])
       // TODO: Enumerate all volumes.
       std::wstring const self_path = hadesmem::detail::GetSelfPath();
       std::wstring const root_path = hadesmem::detail::GetRootPath(self_path);
-      DumpDir(root_path, thread_pool);
+      DumpDir(root_path, scheduler);
     }
 
-    thread_pool.WaitForEmpty();
+    scheduler.WaitForIdle();
 
     if (GetWarningsEnabled())
     {
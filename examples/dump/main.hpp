@@ -12,6 +12,8 @@
 #include <string>
 #include <vector>
 
+#include <hadesmem/detail/string_view.hpp>
+
 #include "warning.hpp"
 
 namespace hadesmem
@@ -36,13 +38,14 @@ void HandleLongOrUnprintableString(std::wstring const& name,
                                    std::wstring const& description,
                                    std::size_t tabs,
                                    WarningType warning_type,
-                                   std::string value);
+                                   hadesmem::detail::StringView value);
 
 bool ConvertTimeStamp(std::time_t time, std::wstring& str);
 
 template <typename CharT>
-typename std::basic_string<CharT>::size_type
-  FindFirstUnprintableClassicLocale(std::basic_string<CharT> const& s)
+typename hadesmem::detail::BasicStringView<CharT>::size_type
+  FindFirstUnprintableClassicLocale(
+    hadesmem::detail::BasicStringView<CharT> s)
 {
   auto const i = std::find_if(std::begin(s),
                               std::end(s),
@@ -50,7 +53,7 @@ typename std::basic_string<CharT>::size_type
                               {
     return !std::isprint(c, std::locale::classic());
   });
-  return i == std::end(s) ? std::basic_string<CharT>::npos
+  return i == std::end(s) ? hadesmem::detail::BasicStringView<CharT>::npos
                           : std::distance(std::begin(s), i);
 }
 
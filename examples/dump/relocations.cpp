@@ -7,10 +7,7 @@
 
 #include <hadesmem/pelib/nt_headers.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
-#include <hadesmem/pelib/relocation.hpp>
-#include <hadesmem/pelib/relocation_list.hpp>
-#include <hadesmem/pelib/relocation_block.hpp>
-#include <hadesmem/pelib/relocation_block_list.hpp>
+#include <hadesmem/pelib/relocation_block_span.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/read.hpp>
 
@@ -54,8 +51,8 @@ void DumpRelocations(hadesmem::Process const& process,
 
   WriteNewline(out);
 
-  hadesmem::RelocationBlockList const reloc_blocks(process, pe_file);
-  if (std::begin(reloc_blocks) != std::end(reloc_blocks))
+  hadesmem::RelocationBlockSpan const reloc_blocks(process, pe_file);
+  if (!reloc_blocks.empty())
   {
     WriteNormal(out, L"Relocation Blocks:", 1);
   }
@@ -87,11 +84,7 @@ void DumpRelocations(hadesmem::Process const& process,
 
     WriteNormal(out, L"Relocations:", 2);
 
-    hadesmem::RelocationList const relocs(process,
-                                          pe_file,
-                                          block.GetRelocationDataStart(),
-                                          block.GetNumberOfRelocations());
-    for (auto const& reloc : relocs)
+    for (auto const& reloc : block)
     {
       WriteNewline(out);
 
@@ -20,11 +20,17 @@ namespace detail
 {
 inline PVOID TryAlloc(Process const& process, SIZE_T size, PVOID base = nullptr)
 {
-  return ::VirtualAllocEx(process.GetHandle(),
-                          base,
-                          size,
-                          MEM_COMMIT | MEM_RESERVE,
-                          PAGE_EXECUTE_READWRITE);
+  PVOID const address = ::VirtualAllocEx(process.GetHandle(),
+                                         base,
+                                         size,
+                                         MEM_COMMIT | MEM_RESERVE,
+                                         PAGE_EXECUTE_READWRITE);
+  if (address)
+  {
+    process.InvalidateRegionMap(address, size);
+  }
+
+  return address;
 }
 }
 
@@ -43,11 +49,18 @@ inline PVOID Alloc(Process const& process, SIZE_T size, PVOID base = nullptr)
                                     << ErrorCodeWinLast{last_error});
   }
 
+  process.InvalidateRegionMap(address, size);
+
   return address;
 }
 
 inline void Free(Process const& process, LPVOID address)
 {
+  // We don't know the size of the allocation without querying it, and this
+  // is rare enough that it's not worth it.
+  process.InvalidateReadCache();
+  process.InvalidateRegionMapAllocation(address);
+
   if (!::VirtualFreeEx(process.GetHandle(), address, 0, MEM_RELEASE))
   {
     DWORD const last_error = ::GetLastError();
@@ -8,6 +8,9 @@
 #include <cstdint>
 #include <cstring>
 #include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -29,6 +32,7 @@
 #include <hadesmem/detail/alias_cast.hpp>
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/remote_thread.hpp>
+#include <hadesmem/detail/scope_warden.hpp>
 #include <hadesmem/detail/smart_handle.hpp>
 #include <hadesmem/detail/static_assert.hpp>
 #include <hadesmem/detail/trace.hpp>
@@ -41,11 +45,7 @@
 #include <hadesmem/read.hpp>
 #include <hadesmem/write.hpp>
 
-// TODO: Rewrite to use a static binary blob insted of a JIT. The design will
-// need to change to pull data from an external source instead of being
-// regenerated for every call.
-
-// TODO: Consolidate memory allocations where possible.
+// TODO: Rewrite to use a static binary blob insted of a JIT.
 
 // TODO: Add support for 'custom' calling conventions (e.g. in PGO-generated
 // code, 'private' functions, obfuscated code, etc).
@@ -400,18 +400,126 @@ inline std::uint32_t GetHigh32(std::uint64_t i)
   return static_cast<std::uint32_t>((i >> 32) & 0xFFFFFFFFUL);
 }
 
+// Kinds of argument, as far as generating code is concerned.
+enum class CallArgKind : std::uint8_t
+{
+  kInt32,
+  kInt64,
+  kFloat32,
+  kFloat64
+};
+
+class ArgKindVisitor
+{
+public:
+  void operator()(std::uint32_t /*arg*/) noexcept
+  {
+    kind_ = CallArgKind::kInt32;
+  }
+
+  void operator()(std::uint64_t /*arg*/) noexcept
+  {
+    kind_ = CallArgKind::kInt64;
+  }
+
+  void operator()(float /*arg*/) noexcept
+  {
+    kind_ = CallArgKind::kFloat32;
+  }
+
+  void operator()(double /*arg*/) noexcept
+  {
+    kind_ = CallArgKind::kFloat64;
+  }
+
+  CallArgKind GetKind() const noexcept
+  {
+    return kind_;
+  }
+
+private:
+  CallArgKind kind_{};
+};
+
+inline CallArgKind GetCallArgKind(CallArg const& arg)
+{
+  ArgKindVisitor visitor;
+  arg.Apply(std::ref(visitor));
+  return visitor.GetKind();
+}
+
+// Call stubs don't contain any argument values or target addresses. Instead
+// they are read from a data block (passed as the thread parameter), which
+// has an entry for each call:
+//   DWORD64 address;
+//   DWORD64 args[num_args];
+//   CallResultRemote result;
+// Every argument gets a 64-bit slot regardless of its kind. 32-bit values
+// are zero extended, and floats are stored in the low 32 bits.
+inline std::size_t GetCallDataArgsOffset() noexcept
+{
+  return sizeof(DWORD64);
+}
+
+inline std::size_t GetCallDataResultOffset(std::size_t num_args) noexcept
+{
+  return GetCallDataArgsOffset() + num_args * sizeof(DWORD64);
+}
+
+inline std::size_t GetCallDataSize(std::size_t num_args) noexcept
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(sizeof(CallResultRemote) % 8 == 0);
+  return GetCallDataResultOffset(num_args) + sizeof(CallResultRemote);
+}
+
+class ArgDataVisitor
+{
+public:
+  explicit ArgDataVisitor(std::uint8_t* slot) noexcept : slot_{slot}
+  {
+  }
+
+  void operator()(std::uint32_t arg) noexcept
+  {
+    (*this)(static_cast<std::uint64_t>(arg));
+  }
+
+  void operator()(std::uint64_t arg) noexcept
+  {
+    std::memcpy(slot_, &arg, sizeof(arg));
+    slot_ += sizeof(DWORD64);
+  }
+
+  void operator()(float arg) noexcept
+  {
+    (*this)(static_cast<std::uint64_t>(AliasCast<std::uint32_t>(arg)));
+  }
+
+  void operator()(double arg) noexcept
+  {
+    (*this)(AliasCast<std::uint64_t>(arg));
+  }
+
+private:
+  std::uint8_t* slot_;
+};
+
 class ArgVisitor32
 {
 public:
   ArgVisitor32(asmjit::X86Assembler* assembler,
                std::size_t num_args,
-               CallConv call_conv) noexcept : assembler_{assembler},
-                                              cur_arg_{num_args},
-                                              call_conv_{call_conv}
+               CallConv call_conv,
+               asmjit::GpReg const& data,
+               std::int32_t args_offs) noexcept : assembler_{assembler},
+                                                  cur_arg_{num_args},
+                                                  call_conv_{call_conv},
+                                                  data_{data},
+                                                  args_offs_{args_offs}
   {
   }
 
-  void operator()(std::uint32_t arg) noexcept
+  void operator()(std::uint32_t /*arg*/) noexcept
   {
     asmjit::GpReg const regs[] = {asmjit::x86::ecx, asmjit::x86::edx};
     auto const num_reg_args =
@@ -420,186 +528,175 @@ public:
         : 0UL;
     if (cur_arg_ > 0 && cur_arg_ <= num_reg_args)
     {
-      assembler_->mov(regs[cur_arg_ - 1], asmjit::imm_u(arg));
+      assembler_->mov(regs[cur_arg_ - 1],
+                      asmjit::x86::dword_ptr(data_, GetSlotOffset()));
     }
     else
     {
-      assembler_->mov(asmjit::x86::eax, asmjit::imm_u(arg));
-      assembler_->push(asmjit::x86::eax);
+      assembler_->push(asmjit::x86::dword_ptr(data_, GetSlotOffset()));
     }
 
     --cur_arg_;
   }
 
-  void operator()(std::uint64_t arg) noexcept
+  void operator()(std::uint64_t /*arg*/) noexcept
   {
-    assembler_->mov(asmjit::x86::eax, asmjit::imm_u(GetHigh32(arg)));
-    assembler_->push(asmjit::x86::eax);
-
-    assembler_->mov(asmjit::x86::eax, asmjit::imm_u(GetLow32(arg)));
-    assembler_->push(asmjit::x86::eax);
-
-    --cur_arg_;
+    PushSlot64();
   }
 
-  void operator()(float arg) noexcept
+  void operator()(float /*arg*/) noexcept
   {
     HADESMEM_DETAIL_STATIC_ASSERT(sizeof(float) == 4);
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(float) == sizeof(std::uint32_t));
 
-    auto const arg_conv = AliasCast<std::uint32_t>(arg);
-
-    assembler_->mov(asmjit::x86::eax, asmjit::imm_u(arg_conv));
-    assembler_->push(asmjit::x86::eax);
+    assembler_->push(asmjit::x86::dword_ptr(data_, GetSlotOffset()));
 
     --cur_arg_;
   }
 
-  void operator()(double arg) noexcept
+  void operator()(double /*arg*/) noexcept
   {
     HADESMEM_DETAIL_STATIC_ASSERT(sizeof(double) == 8);
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(double) == sizeof(std::uint64_t));
 
-    auto const arg_conv = AliasCast<std::uint64_t>(arg);
+    PushSlot64();
+  }
 
-    assembler_->mov(asmjit::x86::eax, asmjit::imm_u(GetHigh32(arg_conv)));
-    assembler_->push(asmjit::x86::eax);
+private:
+  std::int32_t GetSlotOffset() const noexcept
+  {
+    return args_offs_ + static_cast<std::int32_t>((cur_arg_ - 1) * 8);
+  }
 
-    assembler_->mov(asmjit::x86::eax, asmjit::imm_u(GetLow32(arg_conv)));
-    assembler_->push(asmjit::x86::eax);
+  void PushSlot64() noexcept
+  {
+    assembler_->push(asmjit::x86::dword_ptr(data_, GetSlotOffset() + 4));
+    assembler_->push(asmjit::x86::dword_ptr(data_, GetSlotOffset()));
 
     --cur_arg_;
   }
 
-private:
   asmjit::X86Assembler* assembler_;
   std::size_t cur_arg_;
   CallConv call_conv_;
+  asmjit::GpReg data_;
+  std::int32_t args_offs_;
 };
 
 class ArgVisitor64
 {
 public:
-  ArgVisitor64(asmjit::X86Assembler* assembler, std::size_t num_args) noexcept
-    : assembler_{assembler},
-      num_args_{num_args},
-      cur_arg_{num_args}
+  ArgVisitor64(asmjit::X86Assembler* assembler,
+               std::size_t num_args,
+               asmjit::GpReg const& data,
+               std::int32_t args_offs) noexcept : assembler_{assembler},
+                                                  cur_arg_{num_args},
+                                                  data_{data},
+                                                  args_offs_{args_offs}
   {
   }
 
-  void operator()(std::uint32_t arg) noexcept
+  void operator()(std::uint32_t /*arg*/) noexcept
   {
-    return (*this)(static_cast<std::uint64_t>(arg));
+    return (*this)(std::uint64_t{});
   }
 
-  void operator()(std::uint64_t arg) noexcept
+  void operator()(std::uint64_t /*arg*/) noexcept
   {
-    std::int32_t const stack_offs =
-      static_cast<std::int32_t>((cur_arg_ - 1) * 8);
-
     if (cur_arg_ > 0 && cur_arg_ <= 4)
     {
       asmjit::GpReg const regs[] = {
         asmjit::x86::rcx, asmjit::x86::rdx, asmjit::x86::r8, asmjit::x86::r9};
-      assembler_->mov(regs[cur_arg_ - 1], asmjit::imm_u(arg));
+      assembler_->mov(regs[cur_arg_ - 1],
+                      asmjit::x86::qword_ptr(data_, GetSlotOffset()));
     }
     else
     {
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, stack_offs),
-                      asmjit::imm_u(GetLow32(arg)));
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, stack_offs + 4),
-                      asmjit::imm_u(GetHigh32(arg)));
+      CopySlotToStack();
     }
 
     --cur_arg_;
   }
 
-  void operator()(float arg) noexcept
+  void operator()(float /*arg*/) noexcept
   {
     HADESMEM_DETAIL_STATIC_ASSERT(sizeof(float) == 4);
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(float) == sizeof(std::uint32_t));
-
-    auto const arg_conv = AliasCast<std::uint32_t>(arg);
-
-    std::int32_t const scratch_offs = static_cast<std::int32_t>(num_args_ * 8);
-    std::int32_t const stack_offs =
-      static_cast<std::int32_t>((cur_arg_ - 1) * 8);
 
     if (cur_arg_ > 0 && cur_arg_ <= 4)
     {
-      asmjit::XmmReg const regs[] = {asmjit::x86::xmm0,
-                                     asmjit::x86::xmm1,
-                                     asmjit::x86::xmm2,
-                                     asmjit::x86::xmm3};
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, scratch_offs),
-                      asmjit::imm_u(arg_conv));
-      assembler_->movss(regs[cur_arg_ - 1],
-                        asmjit::x86::dword_ptr(asmjit::x86::rsp, scratch_offs));
+      assembler_->movss(GetXmmReg(),
+                        asmjit::x86::dword_ptr(data_, GetSlotOffset()));
     }
     else
     {
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, stack_offs),
-                      asmjit::imm_u(arg_conv));
+      CopySlotToStack();
     }
 
     --cur_arg_;
   }
 
-  void operator()(double arg) noexcept
+  void operator()(double /*arg*/) noexcept
   {
     HADESMEM_DETAIL_STATIC_ASSERT(sizeof(double) == 8);
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(double) == sizeof(std::uint64_t));
-
-    auto const arg_conv = AliasCast<std::uint64_t>(arg);
-
-    std::int32_t const scratch_offs = static_cast<std::int32_t>(num_args_ * 8);
-    std::int32_t const stack_offs =
-      static_cast<std::int32_t>((cur_arg_ - 1) * 8);
 
     if (cur_arg_ > 0 && cur_arg_ <= 4)
     {
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, scratch_offs),
-                      asmjit::imm_u(GetLow32(arg_conv)));
-      assembler_->mov(
-        asmjit::x86::dword_ptr(asmjit::x86::rsp, scratch_offs + 4),
-        asmjit::imm_u(GetHigh32(arg_conv)));
-      asmjit::XmmReg const regs[] = {asmjit::x86::xmm0,
-                                     asmjit::x86::xmm1,
-                                     asmjit::x86::xmm2,
-                                     asmjit::x86::xmm3};
-      assembler_->movsd(regs[cur_arg_ - 1],
-                        asmjit::x86::qword_ptr(asmjit::x86::rsp, scratch_offs));
+      assembler_->movsd(GetXmmReg(),
+                        asmjit::x86::qword_ptr(data_, GetSlotOffset()));
     }
     else
     {
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, stack_offs),
-                      asmjit::imm_u(GetLow32(arg_conv)));
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, stack_offs + 4),
-                      asmjit::imm_u(GetHigh32(arg_conv)));
+      CopySlotToStack();
     }
 
     --cur_arg_;
   }
 
 private:
+  std::int32_t GetSlotOffset() const noexcept
+  {
+    return args_offs_ + static_cast<std::int32_t>((cur_arg_ - 1) * 8);
+  }
+
+  asmjit::XmmReg GetXmmReg() const noexcept
+  {
+    asmjit::XmmReg const regs[] = {asmjit::x86::xmm0,
+                                   asmjit::x86::xmm1,
+                                   asmjit::x86::xmm2,
+                                   asmjit::x86::xmm3};
+    return regs[cur_arg_ - 1];
+  }
+
+  // Only RAX is used as a scratch register, so register arguments which have
+  // already been loaded are left alone.
+  void CopySlotToStack() noexcept
+  {
+    std::int32_t const stack_offs =
+      static_cast<std::int32_t>((cur_arg_ - 1) * 8);
+    assembler_->mov(asmjit::x86::rax,
+                    asmjit::x86::qword_ptr(data_, GetSlotOffset()));
+    assembler_->mov(asmjit::x86::qword_ptr(asmjit::x86::rsp, stack_offs),
+                    asmjit::x86::rax);
+  }
+
   asmjit::X86Assembler* assembler_;
-  std::size_t num_args_;
   std::size_t cur_arg_;
+  asmjit::GpReg data_;
+  std::int32_t args_offs_;
 };
 
-template <typename AddressesForwardIterator,
-          typename ConvForwardIterator,
-          typename ArgsForwardIterator>
+struct CallImports
+{
+  DWORD_PTR get_last_error;
+  DWORD_PTR set_last_error;
+  DWORD_PTR is_debugger_present;
+  DWORD_PTR debug_break;
+};
+
+template <typename ConvForwardIterator, typename ArgsForwardIterator>
 inline void GenerateCallCode32(asmjit::X86Assembler* assembler,
-                               AddressesForwardIterator addresses_beg,
-                               AddressesForwardIterator addresses_end,
                                ConvForwardIterator call_convs_beg,
                                ArgsForwardIterator args_full_beg,
-                               DWORD_PTR get_last_error,
-                               DWORD_PTR set_last_error,
-                               DWORD_PTR is_debugger_present,
-                               DWORD_PTR debug_break,
-                               PVOID return_values_remote)
+                               std::size_t num_calls,
+                               CallImports const& imports)
 {
   HADESMEM_DETAIL_TRACE_A("GenerateCallCode32 called.");
 
@@ -607,26 +704,29 @@ inline void GenerateCallCode32(asmjit::X86Assembler* assembler,
 
   assembler->push(asmjit::x86::ebp);
   assembler->mov(asmjit::x86::ebp, asmjit::x86::esp);
+  assembler->push(asmjit::x86::ebx);
+
+  // Data block is the thread parameter.
+  assembler->mov(asmjit::x86::ebx, asmjit::x86::dword_ptr(asmjit::x86::ebp, 8));
 
-  assembler->mov(asmjit::x86::eax, asmjit::imm_u(is_debugger_present));
+  assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.is_debugger_present));
   assembler->call(asmjit::x86::eax);
 
   assembler->test(asmjit::x86::eax, asmjit::x86::eax);
   assembler->jz(label_nodebug);
 
-  assembler->mov(asmjit::x86::eax, asmjit::imm_u(debug_break));
+  assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.debug_break));
   assembler->call(asmjit::x86::eax);
 
   assembler->bind(label_nodebug);
 
   assembler->push(0x0);
-  assembler->mov(asmjit::x86::eax, asmjit::imm_u(set_last_error));
+  assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.set_last_error));
   assembler->call(asmjit::x86::eax);
 
-  for (std::size_t i = 0; addresses_beg != addresses_end;
-       ++addresses_beg, ++call_convs_beg, ++args_full_beg, ++i)
+  std::size_t data_offs = 0;
+  for (std::size_t i = 0; i < num_calls; ++i, ++call_convs_beg, ++args_full_beg)
   {
-    void* const address = *addresses_beg;
     CallConv const call_conv = *call_convs_beg;
     // TODO: Remove dependency on ArgsForwardIterator being an iterator with
     // value_type of std::vector<CallArg> (or rather, any container supporting
@@ -635,54 +735,74 @@ inline void GenerateCallCode32(asmjit::X86Assembler* assembler,
     auto const& args = *args_full_beg;
     std::size_t const num_args = args.size();
 
-    ArgVisitor32 arg_visitor{assembler, num_args, call_conv};
+    ArgVisitor32 arg_visitor{
+      assembler,
+      num_args,
+      call_conv,
+      asmjit::x86::ebx,
+      static_cast<std::int32_t>(data_offs + GetCallDataArgsOffset())};
     std::for_each(args.rbegin(), args.rend(), [&](CallArg const& arg) {
       arg.Apply(std::ref(arg_visitor));
     });
 
-    assembler->mov(asmjit::x86::eax,
-                   asmjit::imm_u(reinterpret_cast<std::uintptr_t>(address)));
+    assembler->mov(
+      asmjit::x86::eax,
+      asmjit::x86::dword_ptr(asmjit::x86::ebx,
+                             static_cast<std::int32_t>(data_offs)));
     assembler->call(asmjit::x86::eax);
 
-    DWORD_PTR const current_return_value_remote =
-      reinterpret_cast<DWORD_PTR>(return_values_remote) +
-      i * sizeof(detail::CallResultRemote);
+    auto const result_offs =
+      static_cast<std::int32_t>(data_offs + GetCallDataResultOffset(num_args));
 
     assembler->mov(
-      asmjit::x86::ecx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_i64)));
-    assembler->mov(asmjit::x86::dword_ptr(asmjit::x86::ecx), asmjit::x86::eax);
-    assembler->mov(asmjit::x86::dword_ptr(asmjit::x86::ecx, 4),
-                   asmjit::x86::edx);
-
-    assembler->mov(
-      asmjit::x86::ecx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_float)));
-    assembler->fst(asmjit::x86::dword_ptr(asmjit::x86::ecx));
-
+      asmjit::x86::dword_ptr(
+        asmjit::x86::ebx,
+        result_offs +
+          static_cast<std::int32_t>(
+            offsetof(detail::CallResultRemote, return_i64))),
+      asmjit::x86::eax);
     assembler->mov(
-      asmjit::x86::ecx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_double)));
-    assembler->fst(asmjit::x86::qword_ptr(asmjit::x86::ecx));
-
-    assembler->mov(asmjit::x86::eax, asmjit::imm_u(get_last_error));
+      asmjit::x86::dword_ptr(
+        asmjit::x86::ebx,
+        result_offs +
+          static_cast<std::int32_t>(
+            offsetof(detail::CallResultRemote, return_i64)) +
+          4),
+      asmjit::x86::edx);
+
+    assembler->fst(asmjit::x86::dword_ptr(
+      asmjit::x86::ebx,
+      result_offs +
+        static_cast<std::int32_t>(
+          offsetof(detail::CallResultRemote, return_float))));
+
+    assembler->fst(asmjit::x86::qword_ptr(
+      asmjit::x86::ebx,
+      result_offs +
+        static_cast<std::int32_t>(
+          offsetof(detail::CallResultRemote, return_double))));
+
+    assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.get_last_error));
     assembler->call(asmjit::x86::eax);
 
     assembler->mov(
-      asmjit::x86::ecx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, last_error)));
-    assembler->mov(asmjit::x86::dword_ptr(asmjit::x86::ecx), asmjit::x86::eax);
+      asmjit::x86::dword_ptr(
+        asmjit::x86::ebx,
+        result_offs +
+          static_cast<std::int32_t>(
+            offsetof(detail::CallResultRemote, last_error))),
+      asmjit::x86::eax);
 
     if (call_conv == CallConv::kDefault || call_conv == CallConv::kCdecl)
     {
       assembler->add(asmjit::x86::esp, asmjit::imm_u(num_args * sizeof(void*)));
     }
+
+    data_offs += GetCallDataSize(num_args);
   }
 
+  assembler->mov(asmjit::x86::ebx,
+                 asmjit::x86::dword_ptr(asmjit::x86::ebp, -4));
   assembler->mov(asmjit::x86::esp, asmjit::x86::ebp);
   assembler->pop(asmjit::x86::ebp);
 
@@ -698,174 +818,318 @@ struct ContainerSizeComparer
   }
 };
 
-template <typename AddressesForwardIterator,
-          typename ConvForwardIterator,
-          typename ArgsForwardIterator>
+template <typename ConvForwardIterator, typename ArgsForwardIterator>
 inline void GenerateCallCode64(asmjit::X86Assembler* assembler,
-                               AddressesForwardIterator addresses_beg,
-                               AddressesForwardIterator addresses_end,
                                ConvForwardIterator call_convs_beg,
                                ArgsForwardIterator args_full_beg,
-                               DWORD_PTR get_last_error,
-                               DWORD_PTR set_last_error,
-                               DWORD_PTR is_debugger_present,
-                               DWORD_PTR debug_break,
-                               PVOID return_values_remote)
+                               std::size_t num_calls,
+                               CallImports const& imports)
 {
   HADESMEM_DETAIL_TRACE_A("GenerateCallCode64 called.");
 
+  (void)call_convs_beg;
+
   asmjit::Label label_nodebug(assembler->newLabel());
 
-  std::size_t const num_addresses = std::distance(addresses_beg, addresses_end);
   auto const max_args_list = std::max_element(
-    args_full_beg, args_full_beg + num_addresses, ContainerSizeComparer());
+    args_full_beg, args_full_beg + num_calls, ContainerSizeComparer());
   std::size_t const max_num_args = max_args_list->size();
 
   std::size_t const stack_offset = [&]() {
     // Minimum 0x20 bytes of ghost space for spilling args.
     std::size_t const ghost_size = 0x20UL;
     std::size_t stack_offs_tmp = (std::max)(ghost_size, max_num_args * 0x8);
-    // Add scratch space for use when converting args etc.
-    stack_offs_tmp += 16;
-    // Align the stack for the return address.
-    stack_offs_tmp += (stack_offs_tmp % 16) ? 0 : 8;
+    // Align the stack for the return address and the saved RBX.
+    stack_offs_tmp += (stack_offs_tmp % 16) ? 8 : 0;
     return stack_offs_tmp;
   }();
 
+  assembler->push(asmjit::x86::rbx);
   assembler->sub(asmjit::x86::rsp, asmjit::imm_u(stack_offset));
 
-  assembler->mov(asmjit::x86::rax, asmjit::imm_u(is_debugger_present));
+  // Data block is the thread parameter.
+  assembler->mov(asmjit::x86::rbx, asmjit::x86::rcx);
+
+  assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.is_debugger_present));
   assembler->call(asmjit::x86::rax);
 
   assembler->test(asmjit::x86::rax, asmjit::x86::rax);
   assembler->jz(label_nodebug);
 
-  assembler->mov(asmjit::x86::rax, asmjit::imm_u(debug_break));
+  assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.debug_break));
   assembler->call(asmjit::x86::rax);
 
   assembler->bind(label_nodebug);
 
   assembler->mov(asmjit::x86::rcx, 0);
-  assembler->mov(asmjit::x86::rax, asmjit::imm_u(set_last_error));
+  assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.set_last_error));
   assembler->call(asmjit::x86::rax);
 
-  for (std::size_t i = 0; addresses_beg != addresses_end;
-       ++addresses_beg, ++call_convs_beg, ++args_full_beg, ++i)
+  std::size_t data_offs = 0;
+  for (std::size_t i = 0; i < num_calls; ++i, ++args_full_beg)
   {
-    void* const address = *addresses_beg;
     auto const& args = *args_full_beg;
     std::size_t const num_args = args.size();
 
-    ArgVisitor64 arg_visitor{assembler, num_args};
+    ArgVisitor64 arg_visitor{
+      assembler,
+      num_args,
+      asmjit::x86::rbx,
+      static_cast<std::int32_t>(data_offs + GetCallDataArgsOffset())};
     std::for_each(
       std::crbegin(args), std::crend(args), [&](CallArg const& arg) {
         arg.Apply(std::ref(arg_visitor));
       });
 
-    assembler->mov(asmjit::x86::rax,
-                   asmjit::imm_u(reinterpret_cast<DWORD_PTR>(address)));
-    assembler->call(asmjit::x86::rax);
-
-    DWORD_PTR const current_return_value_remote =
-      reinterpret_cast<DWORD_PTR>(return_values_remote) +
-      i * sizeof(detail::CallResultRemote);
-
     assembler->mov(
-      asmjit::x86::rcx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_i64)));
-    assembler->mov(asmjit::x86::qword_ptr(asmjit::x86::rcx), asmjit::x86::rax);
+      asmjit::x86::rax,
+      asmjit::x86::qword_ptr(asmjit::x86::rbx,
+                             static_cast<std::int32_t>(data_offs)));
+    assembler->call(asmjit::x86::rax);
 
-    assembler->mov(
-      asmjit::x86::rcx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_float)));
-    assembler->movss(asmjit::x86::dword_ptr(asmjit::x86::rcx),
-                     asmjit::x86::xmm0);
+    auto const result_offs =
+      static_cast<std::int32_t>(data_offs + GetCallDataResultOffset(num_args));
 
     assembler->mov(
-      asmjit::x86::rcx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_double)));
-    assembler->movsd(asmjit::x86::qword_ptr(asmjit::x86::rcx),
-                     asmjit::x86::xmm0);
-
-    assembler->mov(asmjit::x86::rax, asmjit::imm_u(get_last_error));
+      asmjit::x86::qword_ptr(
+        asmjit::x86::rbx,
+        result_offs +
+          static_cast<std::int32_t>(
+            offsetof(detail::CallResultRemote, return_i64))),
+      asmjit::x86::rax);
+
+    assembler->movss(
+      asmjit::x86::dword_ptr(
+        asmjit::x86::rbx,
+        result_offs +
+          static_cast<std::int32_t>(
+            offsetof(detail::CallResultRemote, return_float))),
+      asmjit::x86::xmm0);
+
+    assembler->movsd(
+      asmjit::x86::qword_ptr(
+        asmjit::x86::rbx,
+        result_offs +
+          static_cast<std::int32_t>(
+            offsetof(detail::CallResultRemote, return_double))),
+      asmjit::x86::xmm0);
+
+    assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.get_last_error));
     assembler->call(asmjit::x86::rax);
 
     assembler->mov(
-      asmjit::x86::rcx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, last_error)));
-    assembler->mov(asmjit::x86::dword_ptr(asmjit::x86::rcx), asmjit::x86::eax);
+      asmjit::x86::dword_ptr(
+        asmjit::x86::rbx,
+        result_offs +
+          static_cast<std::int32_t>(
+            offsetof(detail::CallResultRemote, last_error))),
+      asmjit::x86::eax);
+
+    data_offs += GetCallDataSize(num_args);
   }
 
   assembler->add(asmjit::x86::rsp, asmjit::imm_u(stack_offset));
+  assembler->pop(asmjit::x86::rbx);
 
   assembler->ret();
 }
 
-template <typename AddressesForwardIterator,
-          typename ConvForwardIterator,
-          typename ArgsForwardIterator>
-inline Allocator GenerateCallCode(Process const& process,
-                                  AddressesForwardIterator addresses_beg,
-                                  AddressesForwardIterator addresses_end,
-                                  ConvForwardIterator call_convs_beg,
-                                  ArgsForwardIterator args_full_beg,
-                                  PVOID return_values_remote)
+// Identifies the code generated for a set of calls. Covers everything the
+// code depends on (calling conventions and argument kinds), but not the
+// argument values or target addresses, which are read from the data block.
+// The return type doesn't matter as all the return registers are saved.
+template <typename ConvForwardIterator, typename ArgsForwardIterator>
+inline std::vector<std::uint8_t> GetCallStubKey(
+  ConvForwardIterator call_convs_beg,
+  ArgsForwardIterator args_full_beg,
+  std::size_t num_calls)
+{
+  std::vector<std::uint8_t> key;
+  for (std::size_t i = 0; i < num_calls; ++i, ++call_convs_beg, ++args_full_beg)
+  {
+    key.push_back(static_cast<std::uint8_t>(*call_convs_beg));
+    auto const& args = *args_full_beg;
+    HADESMEM_DETAIL_ASSERT(args.size() <= 0xFF);
+    key.push_back(static_cast<std::uint8_t>(args.size()));
+    for (auto const& arg : args)
+    {
+      key.push_back(static_cast<std::uint8_t>(GetCallArgKind(arg)));
+    }
+  }
+
+  return key;
+}
+
+template <typename AddressesForwardIterator, typename ArgsForwardIterator>
+inline std::vector<std::uint8_t>
+  BuildCallData(AddressesForwardIterator addresses_beg,
+                AddressesForwardIterator addresses_end,
+                ArgsForwardIterator args_full_beg)
 {
-  HADESMEM_DETAIL_TRACE_A("GenerateCallCode called.");
-
-  Module const kernel32{process, L"kernel32.dll"};
-  auto const get_last_error = reinterpret_cast<DWORD_PTR>(
-    FindProcedure(process, kernel32, "GetLastError"));
-  auto const set_last_error = reinterpret_cast<DWORD_PTR>(
-    FindProcedure(process, kernel32, "SetLastError"));
-  auto const is_debugger_present = reinterpret_cast<DWORD_PTR>(
-    FindProcedure(process, kernel32, "IsDebuggerPresent"));
-  auto const debug_break =
-    reinterpret_cast<DWORD_PTR>(FindProcedure(process, kernel32, "DebugBreak"));
-
-  asmjit::JitRuntime runtime;
-  asmjit::X86Assembler assembler{&runtime};
+  std::vector<std::uint8_t> data;
+  for (; addresses_beg != addresses_end; ++addresses_beg, ++args_full_beg)
+  {
+    auto const& args = *args_full_beg;
+    std::size_t const data_offs = data.size();
+    data.resize(data_offs + GetCallDataSize(args.size()));
+
+    auto const address =
+      static_cast<DWORD64>(reinterpret_cast<DWORD_PTR>(*addresses_beg));
+    std::memcpy(&data[data_offs], &address, sizeof(address));
+
+    ArgDataVisitor arg_visitor{&data[data_offs + GetCallDataArgsOffset()]};
+    for (auto const& arg : args)
+    {
+      arg.Apply(std::ref(arg_visitor));
+    }
+  }
+
+  return data;
+}
+
+// Stubs are generated once per key and kept for the lifetime of the cache, so
+// repeated calls with the same signature (e.g. calling the same export over
+// and over) only need to write their data block.
+class CallStubCache
+{
+public:
+  explicit CallStubCache(Process const& process) : process_{process}
+  {
+    // Our copy mustn't keep the cache alive, or it would never be freed.
+    process_.FlushCallStubCache();
+  }
+
+  explicit CallStubCache(Process const&& process) = delete;
+
+  CallStubCache(CallStubCache const& other) = delete;
+
+  CallStubCache& operator=(CallStubCache const& other) = delete;
+
+  ~CallStubCache()
+  {
+    for (auto const& stub : stubs_)
+    {
+      if (!stub.second)
+      {
+        continue;
+      }
+
+      try
+      {
+        ::hadesmem::Free(process_, stub.second);
+      }
+      catch (...)
+      {
+        // The process may well be gone by now, so don't assert.
+        HADESMEM_DETAIL_TRACE_A(
+          boost::current_exception_diagnostic_information().c_str());
+      }
+    }
+  }
+
+  template <typename ConvForwardIterator, typename ArgsForwardIterator>
+  void* GetStub(ConvForwardIterator call_convs_beg,
+                ArgsForwardIterator args_full_beg,
+                std::size_t num_calls)
+  {
+    auto key = GetCallStubKey(call_convs_beg, args_full_beg, num_calls);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto& stub = stubs_[std::move(key)];
+    if (!stub)
+    {
+      stub = GenerateStub(call_convs_beg, args_full_beg, num_calls);
+    }
+
+    return stub;
+  }
+
+  std::size_t GetNumStubs()
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return stubs_.size();
+  }
+
+private:
+  template <typename ConvForwardIterator, typename ArgsForwardIterator>
+  void* GenerateStub(ConvForwardIterator call_convs_beg,
+                     ArgsForwardIterator args_full_beg,
+                     std::size_t num_calls)
+  {
+    HADESMEM_DETAIL_TRACE_A("Generating call stub.");
+
+    if (!imports_.get_last_error)
+    {
+      Module const kernel32{process_, L"kernel32.dll"};
+      imports_.get_last_error = reinterpret_cast<DWORD_PTR>(
+        FindProcedure(process_, kernel32, "GetLastError"));
+      imports_.set_last_error = reinterpret_cast<DWORD_PTR>(
+        FindProcedure(process_, kernel32, "SetLastError"));
+      imports_.is_debugger_present = reinterpret_cast<DWORD_PTR>(
+        FindProcedure(process_, kernel32, "IsDebuggerPresent"));
+      imports_.debug_break = reinterpret_cast<DWORD_PTR>(
+        FindProcedure(process_, kernel32, "DebugBreak"));
+    }
+
+    asmjit::JitRuntime runtime;
+    asmjit::X86Assembler assembler{&runtime};
 #if defined(HADESMEM_DETAIL_ARCH_X64)
-  GenerateCallCode64(
+    GenerateCallCode64(
 #elif defined(HADESMEM_DETAIL_ARCH_X86)
-  GenerateCallCode32(
+    GenerateCallCode32(
 #else
 #error "[HadesMem] Unsupported architecture."
 #endif
-    &assembler,
-    addresses_beg,
-    addresses_end,
-    call_convs_beg,
-    args_full_beg,
-    get_last_error,
-    set_last_error,
-    is_debugger_present,
-    debug_break,
-    return_values_remote);
+      &assembler,
+      call_convs_beg,
+      args_full_beg,
+      num_calls,
+      imports_);
+
+    DWORD_PTR const stub_size = assembler.getCodeSize();
+
+    HADESMEM_DETAIL_TRACE_A("Allocating memory for remote stub.");
 
-  DWORD_PTR const stub_size = assembler.getCodeSize();
+    void* const stub_mem_remote = Alloc(process_, stub_size);
+    auto const free_stub = [&]() {
+      ::hadesmem::Free(process_, stub_mem_remote);
+    };
+    auto scope_free_stub = MakeScopeWarden(free_stub);
 
-  HADESMEM_DETAIL_TRACE_A("Allocating memory for remote stub.");
+    HADESMEM_DETAIL_TRACE_A("Performing code relocation.");
 
-  Allocator stub_mem_remote{process, stub_size};
+    std::vector<BYTE> code_real(stub_size);
+    assembler.relocCode(code_real.data(),
+                        reinterpret_cast<DWORD_PTR>(stub_mem_remote));
 
-  HADESMEM_DETAIL_TRACE_A("Performing code relocation.");
+    HADESMEM_DETAIL_TRACE_A("Writing remote code stub.");
 
-  std::vector<BYTE> code_real(stub_size);
-  assembler.relocCode(code_real.data(),
-                      reinterpret_cast<DWORD_PTR>(stub_mem_remote.GetBase()));
+    WriteVector(process_, stub_mem_remote, code_real);
 
-  HADESMEM_DETAIL_TRACE_A("Writing remote code stub.");
+    FlushInstructionCache(process_, stub_mem_remote, stub_size);
 
-  WriteVector(process, stub_mem_remote.GetBase(), code_real);
+    scope_free_stub.Dismiss();
 
-  FlushInstructionCache(process, stub_mem_remote.GetBase(), stub_size);
+    return stub_mem_remote;
+  }
+
+  std::mutex mutex_;
+  Process process_;
+  CallImports imports_{};
+  std::map<std::vector<std::uint8_t>, void*> stubs_;
+};
 
-  return stub_mem_remote;
+// The cache lives in the Process (and is shared by its copies), so stubs are
+// freed when the last copy goes away, or when it's flushed.
+inline std::shared_ptr<CallStubCache> GetCallStubCache(Process const& process)
+{
+  if (auto cache = process.GetCallStubCache())
+  {
+    return cache;
+  }
+
+  return process.SetCallStubCache(std::make_shared<CallStubCache>(process));
 }
 }
 
@@ -910,42 +1174,46 @@ inline void CallMulti(Process const& process,
   auto const num_addresses =
     static_cast<NumAddressesUnsigned>(num_addresses_signed);
 
-  HADESMEM_DETAIL_TRACE_A("Allocating memory for return values.");
-
-  Allocator const return_values_remote{
-    process, sizeof(detail::CallResultRemote) * num_addresses};
-
-  HADESMEM_DETAIL_TRACE_A("Allocating memory for code stub.");
+  HADESMEM_DETAIL_TRACE_A("Looking up code stub.");
 
-  Allocator const code_remote{
-    detail::GenerateCallCode(process,
-                             addresses_beg,
-                             addresses_end,
-                             call_convs_beg,
-                             args_full_beg,
-                             return_values_remote.GetBase())};
+  // Held until the call returns, in case the cache is flushed meanwhile.
+  auto const stub_cache = detail::GetCallStubCache(process);
+  void* const code_remote =
+    stub_cache->GetStub(call_convs_beg, args_full_beg, num_addresses);
   LPTHREAD_START_ROUTINE code_remote_pfn =
     reinterpret_cast<LPTHREAD_START_ROUTINE>(
-      reinterpret_cast<DWORD_PTR>(code_remote.GetBase()));
+      reinterpret_cast<DWORD_PTR>(code_remote));
+
+  HADESMEM_DETAIL_TRACE_A("Writing call data.");
+
+  std::vector<std::uint8_t> const data =
+    detail::BuildCallData(addresses_beg, addresses_end, args_full_beg);
+  Allocator const data_remote{process, data.size()};
+  WriteVector(process, data_remote.GetBase(), data);
 
   HADESMEM_DETAIL_TRACE_A("Creating remote thread and waiting.");
 
-  detail::CreateRemoteThreadAndWait(process, code_remote_pfn);
+  detail::CreateRemoteThreadAndWait(
+    process, code_remote_pfn, INFINITE, data_remote.GetBase());
 
   HADESMEM_DETAIL_TRACE_A("Reading return values.");
 
-  std::vector<detail::CallResultRemote> const return_vals_remote =
-    ReadVector<detail::CallResultRemote>(
-      process, return_values_remote.GetBase(), num_addresses);
-
-  std::vector<CallResultRaw> return_vals;
-  return_vals.reserve(num_addresses);
-  std::transform(std::begin(return_vals_remote),
-                 std::end(return_vals_remote),
-                 results,
-                 [](detail::CallResultRemote const& r) {
-                   return static_cast<CallResultRaw>(r);
-                 });
+  std::vector<std::uint8_t> const data_out =
+    ReadVector<std::uint8_t>(process, data_remote.GetBase(), data.size());
+
+  std::size_t data_offs = 0;
+  for (NumAddressesUnsigned i = 0; i < num_addresses; ++i, ++args_full_beg)
+  {
+    std::size_t const num_args = args_full_beg->size();
+    detail::CallResultRemote result;
+    std::memcpy(
+      &result,
+      &data_out[data_offs + detail::GetCallDataResultOffset(num_args)],
+      sizeof(result));
+    *results = static_cast<CallResultRaw>(result);
+    ++results;
+    data_offs += detail::GetCallDataSize(num_args);
+  }
 }
 
 template <typename ArgsForwardIterator>
@@ -0,0 +1,1060 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <set>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/alloc.hpp>
+#include <hadesmem/call.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/alias_cast.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/detail/type_traits.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/find_procedure.hpp>
+#include <hadesmem/flush.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+#include <hadesmem/write.hpp>
+
+// TODO: Map the ring into both processes (e.g. a shared section) instead of
+// going through ReadProcessMemory/WriteProcessMemory for every request.
+
+// TODO: Configurable timeout. Same problems as Call.
+
+// TODO: Support multiple server threads.
+
+// TODO: Make the x86 FPU/SSE state handling more robust against callees which
+// leave the FPU in a bad state.
+
+namespace hadesmem
+{
+namespace detail
+{
+std::size_t const kCallServerMaxArgSlots = 16;
+
+// Shared with the remote server code, so offsets matter.
+struct CallServerControl
+{
+  // Sequence number of the next request to be written. Only written by us.
+  DWORD_PTR head;
+  // Sequence number of the next request to be run. Only written by the server.
+  DWORD_PTR tail;
+  DWORD_PTR shutdown;
+};
+
+HADESMEM_DETAIL_STATIC_ASSERT(std::is_pod<CallServerControl>::value);
+
+struct CallServerRequest
+{
+  DWORD_PTR address;
+  // x64: Number of arguments (one slot each).
+  // x86: Number of stack words.
+  DWORD_PTR num_args;
+  // x86 only: ECX and EDX for __thiscall and __fastcall.
+  DWORD_PTR reg_args[2];
+  DWORD_PTR args[kCallServerMaxArgSlots];
+  CallResultRemote result;
+};
+
+HADESMEM_DETAIL_STATIC_ASSERT(std::is_pod<CallServerRequest>::value);
+
+class CallServerArgVisitor32
+{
+public:
+  CallServerArgVisitor32(CallServerRequest* request,
+                         std::size_t num_args,
+                         CallConv call_conv) noexcept
+    : request_{request},
+      num_reg_args_{(call_conv == CallConv::kThisCall ||
+                     call_conv == CallConv::kFastCall)
+                      ? ((call_conv == CallConv::kThisCall) ? 1UL : 2UL)
+                      : 0UL}
+  {
+    HADESMEM_DETAIL_ASSERT(num_args <= kCallServerMaxArgSlots);
+    (void)num_args;
+  }
+
+  // Must match ArgVisitor32.
+  void operator()(std::uint32_t arg)
+  {
+    ++cur_arg_;
+    if (cur_arg_ <= num_reg_args_)
+    {
+      request_->reg_args[cur_arg_ - 1] = arg;
+    }
+    else
+    {
+      AddStackWord(arg);
+    }
+  }
+
+  void operator()(std::uint64_t arg)
+  {
+    ++cur_arg_;
+    AddStackWord(GetLow32(arg));
+    AddStackWord(GetHigh32(arg));
+  }
+
+  void operator()(float arg)
+  {
+    ++cur_arg_;
+    AddStackWord(AliasCast<std::uint32_t>(arg));
+  }
+
+  void operator()(double arg)
+  {
+    ++cur_arg_;
+    auto const arg_conv = AliasCast<std::uint64_t>(arg);
+    AddStackWord(GetLow32(arg_conv));
+    AddStackWord(GetHigh32(arg_conv));
+  }
+
+private:
+  void AddStackWord(std::uint32_t word)
+  {
+    if (request_->num_args == kCallServerMaxArgSlots)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Too many arguments for call server."});
+    }
+
+    request_->args[request_->num_args++] = word;
+  }
+
+  CallServerRequest* request_;
+  std::size_t num_reg_args_;
+  std::size_t cur_arg_{};
+};
+
+class CallServerArgVisitor64
+{
+public:
+  explicit CallServerArgVisitor64(CallServerRequest* request) noexcept
+    : request_{request}
+  {
+  }
+
+  void operator()(std::uint32_t arg)
+  {
+    AddSlot(arg);
+  }
+
+  void operator()(std::uint64_t arg)
+  {
+    AddSlot(arg);
+  }
+
+  // The server loads the first four slots into both the integer and XMM
+  // registers, so floats only need their bits in the low part of the slot.
+  void operator()(float arg)
+  {
+    AddSlot(AliasCast<std::uint32_t>(arg));
+  }
+
+  void operator()(double arg)
+  {
+    AddSlot(AliasCast<std::uint64_t>(arg));
+  }
+
+private:
+  void AddSlot(std::uint64_t slot)
+  {
+    if (request_->num_args == kCallServerMaxArgSlots)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Too many arguments for call server."});
+    }
+
+    request_->args[request_->num_args++] = static_cast<DWORD_PTR>(slot);
+  }
+
+  CallServerRequest* request_;
+};
+
+template <typename ArgsForwardIterator>
+inline CallServerRequest MarshalCallServerRequest(void* address,
+                                                  CallConv call_conv,
+                                                  ArgsForwardIterator args_beg,
+                                                  ArgsForwardIterator args_end)
+{
+  CallServerRequest request{};
+  request.address = reinterpret_cast<DWORD_PTR>(address);
+
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  (void)call_conv;
+  CallServerArgVisitor64 arg_visitor{&request};
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+  CallServerArgVisitor32 arg_visitor{
+    &request,
+    static_cast<std::size_t>(std::distance(args_beg, args_end)),
+    call_conv};
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+  std::for_each(args_beg, args_end, [&](CallArg const& arg) {
+    arg.Apply(std::ref(arg_visitor));
+  });
+
+  return request;
+}
+
+struct CallServerImports
+{
+  DWORD_PTR wait_for_single_object;
+  DWORD_PTR set_event;
+  DWORD_PTR get_last_error;
+  DWORD_PTR set_last_error;
+};
+
+// The server runs requests from the ring until it is empty (signalling the
+// response event after each one), then waits on the request event. It exits
+// when the ring is empty and the shutdown flag is set.
+inline void GenerateCallServerCode32(asmjit::X86Assembler* assembler,
+                                     CallServerImports const& imports,
+                                     DWORD_PTR control,
+                                     DWORD_PTR requests,
+                                     DWORD_PTR ring_mask,
+                                     HANDLE request_event,
+                                     HANDLE response_event)
+{
+  HADESMEM_DETAIL_TRACE_A("GenerateCallServerCode32 called.");
+
+  asmjit::Label label_wait(assembler->newLabel());
+  asmjit::Label label_next(assembler->newLabel());
+  asmjit::Label label_push(assembler->newLabel());
+  asmjit::Label label_push_done(assembler->newLabel());
+  asmjit::Label label_fpu_empty(assembler->newLabel());
+  asmjit::Label label_idle(assembler->newLabel());
+
+  auto const tail_offs =
+    static_cast<std::int32_t>(offsetof(CallServerControl, tail));
+  auto const result_offs =
+    static_cast<std::int32_t>(offsetof(CallServerRequest, result));
+
+  assembler->push(asmjit::x86::ebp);
+  assembler->mov(asmjit::x86::ebp, asmjit::x86::esp);
+  assembler->push(asmjit::x86::ebx);
+  assembler->push(asmjit::x86::esi);
+  assembler->push(asmjit::x86::edi);
+
+  assembler->mov(asmjit::x86::ebx, asmjit::imm_u(control));
+
+  assembler->bind(label_wait);
+
+  assembler->push(asmjit::imm_u(INFINITE));
+  assembler->push(
+    asmjit::imm_u(reinterpret_cast<DWORD_PTR>(request_event)));
+  assembler->mov(asmjit::x86::eax,
+                 asmjit::imm_u(imports.wait_for_single_object));
+  assembler->call(asmjit::x86::eax);
+
+  assembler->bind(label_next);
+
+  assembler->mov(asmjit::x86::eax,
+                 asmjit::x86::dword_ptr(asmjit::x86::ebx, tail_offs));
+  assembler->cmp(
+    asmjit::x86::eax,
+    asmjit::x86::dword_ptr(
+      asmjit::x86::ebx,
+      static_cast<std::int32_t>(offsetof(CallServerControl, head))));
+  assembler->je(label_idle);
+
+  assembler->and_(asmjit::x86::eax, asmjit::imm_u(ring_mask));
+  assembler->imul(asmjit::x86::eax, asmjit::imm_u(sizeof(CallServerRequest)));
+  assembler->mov(asmjit::x86::esi, asmjit::imm_u(requests));
+  assembler->add(asmjit::x86::esi, asmjit::x86::eax);
+
+  assembler->push(0x0);
+  assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.set_last_error));
+  assembler->call(asmjit::x86::eax);
+
+  // Cleans up after both __cdecl and callee-cleanup conventions.
+  assembler->mov(asmjit::x86::edi, asmjit::x86::esp);
+
+  assembler->mov(
+    asmjit::x86::ecx,
+    asmjit::x86::dword_ptr(
+      asmjit::x86::esi,
+      static_cast<std::int32_t>(offsetof(CallServerRequest, num_args))));
+
+  assembler->bind(label_push);
+  assembler->test(asmjit::x86::ecx, asmjit::x86::ecx);
+  assembler->jz(label_push_done);
+  assembler->dec(asmjit::x86::ecx);
+  assembler->push(asmjit::x86::dword_ptr(
+    asmjit::x86::esi,
+    asmjit::x86::ecx,
+    2,
+    static_cast<std::int32_t>(offsetof(CallServerRequest, args))));
+  assembler->jmp(label_push);
+  assembler->bind(label_push_done);
+
+  assembler->mov(
+    asmjit::x86::ecx,
+    asmjit::x86::dword_ptr(
+      asmjit::x86::esi,
+      static_cast<std::int32_t>(offsetof(CallServerRequest, reg_args))));
+  assembler->mov(
+    asmjit::x86::edx,
+    asmjit::x86::dword_ptr(
+      asmjit::x86::esi,
+      static_cast<std::int32_t>(offsetof(CallServerRequest, reg_args) + 4)));
+  assembler->mov(
+    asmjit::x86::eax,
+    asmjit::x86::dword_ptr(
+      asmjit::x86::esi,
+      static_cast<std::int32_t>(offsetof(CallServerRequest, address))));
+  assembler->call(asmjit::x86::eax);
+
+  assembler->mov(asmjit::x86::esp, asmjit::x86::edi);
+
+  assembler->mov(
+    asmjit::x86::dword_ptr(
+      asmjit::x86::esi,
+      result_offs +
+        static_cast<std::int32_t>(offsetof(CallResultRemote, return_i64))),
+    asmjit::x86::eax);
+  assembler->mov(
+    asmjit::x86::dword_ptr(
+      asmjit::x86::esi,
+      result_offs +
+        static_cast<std::int32_t>(offsetof(CallResultRemote, return_i64)) +
+        4),
+    asmjit::x86::edx);
+
+  // Unlike a one-off call we can't leave a value on the FPU stack, or it will
+  // eventually overflow, so only store (and pop) ST(0) if it's not empty.
+  // FXAM reports empty as C3 and C0 set, regardless of C2, so C2 is masked
+  // out along with everything else.
+  assembler->fxam();
+  assembler->fnstsw(asmjit::x86::ax);
+  assembler->and_(asmjit::x86::eax, asmjit::imm_u(0x4100));
+  assembler->cmp(asmjit::x86::eax, asmjit::imm_u(0x4100));
+  assembler->je(label_fpu_empty);
+  assembler->fst(asmjit::x86::dword_ptr(
+    asmjit::x86::esi,
+    result_offs +
+      static_cast<std::int32_t>(offsetof(CallResultRemote, return_float))));
+  assembler->fstp(asmjit::x86::qword_ptr(
+    asmjit::x86::esi,
+    result_offs +
+      static_cast<std::int32_t>(offsetof(CallResultRemote, return_double))));
+  assembler->bind(label_fpu_empty);
+
+  assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.get_last_error));
+  assembler->call(asmjit::x86::eax);
+
+  assembler->mov(
+    asmjit::x86::dword_ptr(
+      asmjit::x86::esi,
+      result_offs +
+        static_cast<std::int32_t>(offsetof(CallResultRemote, last_error))),
+    asmjit::x86::eax);
+
+  assembler->inc(asmjit::x86::dword_ptr(asmjit::x86::ebx, tail_offs));
+
+  assembler->push(
+    asmjit::imm_u(reinterpret_cast<DWORD_PTR>(response_event)));
+  assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.set_event));
+  assembler->call(asmjit::x86::eax);
+
+  assembler->jmp(label_next);
+
+  assembler->bind(label_idle);
+
+  assembler->cmp(
+    asmjit::x86::dword_ptr(
+      asmjit::x86::ebx,
+      static_cast<std::int32_t>(offsetof(CallServerControl, shutdown))),
+    asmjit::imm_u(0));
+  assembler->je(label_wait);
+
+  assembler->pop(asmjit::x86::edi);
+  assembler->pop(asmjit::x86::esi);
+  assembler->pop(asmjit::x86::ebx);
+  assembler->mov(asmjit::x86::esp, asmjit::x86::ebp);
+  assembler->pop(asmjit::x86::ebp);
+
+  assembler->xor_(asmjit::x86::eax, asmjit::x86::eax);
+  assembler->ret(0x4);
+}
+
+inline void GenerateCallServerCode64(asmjit::X86Assembler* assembler,
+                                     CallServerImports const& imports,
+                                     DWORD_PTR control,
+                                     DWORD_PTR requests,
+                                     DWORD_PTR ring_mask,
+                                     HANDLE request_event,
+                                     HANDLE response_event)
+{
+  HADESMEM_DETAIL_TRACE_A("GenerateCallServerCode64 called.");
+
+  asmjit::Label label_wait(assembler->newLabel());
+  asmjit::Label label_next(assembler->newLabel());
+  asmjit::Label label_copy(assembler->newLabel());
+  asmjit::Label label_copy_done(assembler->newLabel());
+  asmjit::Label label_idle(assembler->newLabel());
+
+  auto const tail_offs =
+    static_cast<std::int32_t>(offsetof(CallServerControl, tail));
+  auto const args_offs =
+    static_cast<std::int32_t>(offsetof(CallServerRequest, args));
+  auto const result_offs =
+    static_cast<std::int32_t>(offsetof(CallServerRequest, result));
+
+  // Ghost space plus room for every stack argument. Four pushes plus the
+  // return address leave the stack 8 bytes off alignment.
+  std::size_t const stack_offset = kCallServerMaxArgSlots * 8 + 8;
+
+  assembler->push(asmjit::x86::rbx);
+  assembler->push(asmjit::x86::rsi);
+  assembler->push(asmjit::x86::rdi);
+  assembler->push(asmjit::x86::r12);
+  assembler->sub(asmjit::x86::rsp, asmjit::imm_u(stack_offset));
+
+  assembler->mov(asmjit::x86::rbx, asmjit::imm_u(control));
+
+  assembler->bind(label_wait);
+
+  assembler->mov(asmjit::x86::rcx,
+                 asmjit::imm_u(reinterpret_cast<DWORD_PTR>(request_event)));
+  assembler->mov(asmjit::x86::rdx, asmjit::imm_u(INFINITE));
+  assembler->mov(asmjit::x86::rax,
+                 asmjit::imm_u(imports.wait_for_single_object));
+  assembler->call(asmjit::x86::rax);
+
+  assembler->bind(label_next);
+
+  assembler->mov(asmjit::x86::rax,
+                 asmjit::x86::qword_ptr(asmjit::x86::rbx, tail_offs));
+  assembler->cmp(
+    asmjit::x86::rax,
+    asmjit::x86::qword_ptr(
+      asmjit::x86::rbx,
+      static_cast<std::int32_t>(offsetof(CallServerControl, head))));
+  assembler->je(label_idle);
+
+  assembler->and_(asmjit::x86::rax, asmjit::imm_u(ring_mask));
+  assembler->imul(asmjit::x86::rax, asmjit::imm_u(sizeof(CallServerRequest)));
+  assembler->mov(asmjit::x86::rsi, asmjit::imm_u(requests));
+  assembler->add(asmjit::x86::rsi, asmjit::x86::rax);
+
+  assembler->mov(asmjit::x86::rcx, 0);
+  assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.set_last_error));
+  assembler->call(asmjit::x86::rax);
+
+  // Copy the stack arguments (i.e. everything after the first four) to just
+  // above the ghost space.
+  assembler->mov(
+    asmjit::x86::r12,
+    asmjit::x86::qword_ptr(
+      asmjit::x86::rsi,
+      static_cast<std::int32_t>(offsetof(CallServerRequest, num_args))));
+  assembler->mov(asmjit::x86::rdi, asmjit::imm_u(4));
+  assembler->bind(label_copy);
+  assembler->cmp(asmjit::x86::rdi, asmjit::x86::r12);
+  assembler->jae(label_copy_done);
+  assembler->mov(
+    asmjit::x86::rax,
+    asmjit::x86::qword_ptr(asmjit::x86::rsi, asmjit::x86::rdi, 3, args_offs));
+  assembler->mov(asmjit::x86::qword_ptr(asmjit::x86::rsp, asmjit::x86::rdi, 3),
+                 asmjit::x86::rax);
+  assembler->inc(asmjit::x86::rdi);
+  assembler->jmp(label_copy);
+  assembler->bind(label_copy_done);
+
+  asmjit::GpReg const regs[] = {
+    asmjit::x86::rcx, asmjit::x86::rdx, asmjit::x86::r8, asmjit::x86::r9};
+  asmjit::XmmReg const xmm_regs[] = {asmjit::x86::xmm0,
+                                     asmjit::x86::xmm1,
+                                     asmjit::x86::xmm2,
+                                     asmjit::x86::xmm3};
+  for (std::int32_t i = 0; i < 4; ++i)
+  {
+    assembler->mov(regs[i],
+                   asmjit::x86::qword_ptr(asmjit::x86::rsi, args_offs + i * 8));
+    assembler->movsd(
+      xmm_regs[i], asmjit::x86::qword_ptr(asmjit::x86::rsi, args_offs + i * 8));
+  }
+
+  assembler->mov(
+    asmjit::x86::rax,
+    asmjit::x86::qword_ptr(
+      asmjit::x86::rsi,
+      static_cast<std::int32_t>(offsetof(CallServerRequest, address))));
+  assembler->call(asmjit::x86::rax);
+
+  assembler->mov(
+    asmjit::x86::qword_ptr(
+      asmjit::x86::rsi,
+      result_offs +
+        static_cast<std::int32_t>(offsetof(CallResultRemote, return_i64))),
+    asmjit::x86::rax);
+  assembler->movss(
+    asmjit::x86::dword_ptr(
+      asmjit::x86::rsi,
+      result_offs +
+        static_cast<std::int32_t>(offsetof(CallResultRemote, return_float))),
+    asmjit::x86::xmm0);
+  assembler->movsd(
+    asmjit::x86::qword_ptr(
+      asmjit::x86::rsi,
+      result_offs +
+        static_cast<std::int32_t>(offsetof(CallResultRemote, return_double))),
+    asmjit::x86::xmm0);
+
+  assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.get_last_error));
+  assembler->call(asmjit::x86::rax);
+
+  assembler->mov(
+    asmjit::x86::dword_ptr(
+      asmjit::x86::rsi,
+      result_offs +
+        static_cast<std::int32_t>(offsetof(CallResultRemote, last_error))),
+    asmjit::x86::eax);
+
+  assembler->inc(asmjit::x86::qword_ptr(asmjit::x86::rbx, tail_offs));
+
+  assembler->mov(asmjit::x86::rcx,
+                 asmjit::imm_u(reinterpret_cast<DWORD_PTR>(response_event)));
+  assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.set_event));
+  assembler->call(asmjit::x86::rax);
+
+  assembler->jmp(label_next);
+
+  assembler->bind(label_idle);
+
+  assembler->cmp(
+    asmjit::x86::qword_ptr(
+      asmjit::x86::rbx,
+      static_cast<std::int32_t>(offsetof(CallServerControl, shutdown))),
+    asmjit::imm_u(0));
+  assembler->je(label_wait);
+
+  assembler->add(asmjit::x86::rsp, asmjit::imm_u(stack_offset));
+  assembler->pop(asmjit::x86::r12);
+  assembler->pop(asmjit::x86::rdi);
+  assembler->pop(asmjit::x86::rsi);
+  assembler->pop(asmjit::x86::rbx);
+
+  assembler->xor_(asmjit::x86::eax, asmjit::x86::eax);
+  assembler->ret();
+}
+
+inline SmartHandle CreateEventChecked()
+{
+  SmartHandle event{::CreateEventW(nullptr, FALSE, FALSE, nullptr)};
+  if (!event.GetHandle())
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"CreateEventW failed."}
+                                    << ErrorCodeWinLast{last_error});
+  }
+
+  return event;
+}
+
+inline void SetEventChecked(HANDLE event)
+{
+  if (!::SetEvent(event))
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{"SetEvent failed."}
+                                            << ErrorCodeWinLast{last_error});
+  }
+}
+
+// Handle owned by (and only valid in) another process.
+class RemoteHandle
+{
+public:
+  explicit RemoteHandle(Process const& process, HANDLE local_handle)
+    : process_{&process}
+  {
+    if (!::DuplicateHandle(::GetCurrentProcess(),
+                           local_handle,
+                           process.GetHandle(),
+                           &handle_,
+                           0,
+                           FALSE,
+                           DUPLICATE_SAME_ACCESS))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"DuplicateHandle failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+  }
+
+  RemoteHandle(RemoteHandle const& other) = delete;
+
+  RemoteHandle& operator=(RemoteHandle const& other) = delete;
+
+  ~RemoteHandle()
+  {
+    if (!::DuplicateHandle(process_->GetHandle(),
+                           handle_,
+                           nullptr,
+                           nullptr,
+                           0,
+                           FALSE,
+                           DUPLICATE_CLOSE_SOURCE))
+    {
+      // WARNING: Handle in remote process is leaked if closing it fails.
+      HADESMEM_DETAIL_TRACE_A("Failed to close remote handle.");
+    }
+  }
+
+  HANDLE GetHandle() const noexcept
+  {
+    return handle_;
+  }
+
+private:
+  Process const* process_;
+  HANDLE handle_{};
+};
+}
+
+class CallServer;
+
+// Result of a call which may not have completed yet. Must not outlive the
+// CallServer it came from.
+class CallFuture
+{
+public:
+  CallFuture(CallFuture const& other) = delete;
+
+  CallFuture& operator=(CallFuture const& other) = delete;
+
+  CallFuture(CallFuture&& other) noexcept : server_{other.server_},
+                                            sequence_{other.sequence_}
+  {
+    other.server_ = nullptr;
+  }
+
+  CallFuture& operator=(CallFuture&& other) noexcept
+  {
+    Abandon();
+
+    server_ = other.server_;
+    other.server_ = nullptr;
+    sequence_ = other.sequence_;
+
+    return *this;
+  }
+
+  ~CallFuture()
+  {
+    Abandon();
+  }
+
+  bool IsReady() const;
+
+  // Blocks until the call has completed. Can only be called once.
+  CallResultRaw Get();
+
+private:
+  friend class CallServer;
+
+  explicit CallFuture(CallServer& server, DWORD_PTR sequence) noexcept
+    : server_{&server},
+      sequence_{sequence}
+  {
+  }
+
+  void Abandon() noexcept;
+
+  CallServer* server_;
+  DWORD_PTR sequence_;
+};
+
+// Runs calls on a single long-lived thread in the remote process, rather than
+// creating a thread (and allocating a data block) for every call like
+// Call/CallMulti.
+// Requests are queued in a fixed size ring in remote memory, so queueing a
+// call doesn't allocate (in the remote process) or create threads. Calls are
+// run in the order they are queued.
+// Not thread-safe. Calls which never return will hang the server (and the
+// destructor).
+class CallServer
+{
+public:
+  // Ring size must be a power of two.
+  explicit CallServer(Process const& process, std::size_t ring_size = 64)
+    : process_{&process},
+      ring_size_{ring_size},
+      request_event_{detail::CreateEventChecked()},
+      response_event_{detail::CreateEventChecked()},
+      request_event_remote_{process, request_event_.GetHandle()},
+      response_event_remote_{process, response_event_.GetHandle()},
+      ring_remote_{process,
+                   sizeof(detail::CallServerControl) +
+                     ring_size * sizeof(detail::CallServerRequest)}
+  {
+    if (!ring_size || (ring_size & (ring_size - 1)))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Ring size must be a power of two."});
+    }
+
+    Write(process, ring_remote_.GetBase(), detail::CallServerControl{});
+
+    code_remote_ = GenerateServerCode();
+
+    thread_ = detail::SmartHandle{::CreateRemoteThread(
+      process.GetHandle(),
+      nullptr,
+      0,
+      reinterpret_cast<LPTHREAD_START_ROUTINE>(
+        reinterpret_cast<DWORD_PTR>(code_remote_->GetBase())),
+      nullptr,
+      0,
+      nullptr)};
+    if (!thread_.GetHandle())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"CreateRemoteThread failed."}
+                << ErrorCodeWinLast{last_error});
+    }
+  }
+
+  explicit CallServer(Process const&& process,
+                      std::size_t ring_size = 64) = delete;
+
+  CallServer(CallServer const& other) = delete;
+
+  CallServer& operator=(CallServer const& other) = delete;
+
+  ~CallServer()
+  {
+    try
+    {
+      Write(*process_,
+            GetControlRemote() + offsetof(detail::CallServerControl, shutdown),
+            static_cast<DWORD_PTR>(1));
+      detail::SetEventChecked(request_event_.GetHandle());
+      ::WaitForSingleObject(thread_.GetHandle(), INFINITE);
+    }
+    catch (...)
+    {
+      // WARNING: Remote memory is freed while the server may still be
+      // running if this fails.
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+    }
+  }
+
+  template <typename ArgsForwardIterator>
+  CallFuture CallRawAsync(void* address,
+                          CallConv call_conv,
+                          ArgsForwardIterator args_beg,
+                          ArgsForwardIterator args_end)
+  {
+    auto const sequence = Enqueue(address, call_conv, args_beg, args_end);
+    Notify();
+    return CallFuture{*this, sequence};
+  }
+
+  template <typename ArgsForwardIterator>
+  CallResultRaw CallRaw(void* address,
+                        CallConv call_conv,
+                        ArgsForwardIterator args_beg,
+                        ArgsForwardIterator args_end)
+  {
+    return CallRawAsync(address, call_conv, args_beg, args_end).Get();
+  }
+
+  template <typename FuncT, typename... Args>
+  CallResult<detail::FuncResultT<FuncT>>
+    Call(void* address, CallConv call_conv, Args&&... args)
+  {
+    HADESMEM_DETAIL_STATIC_ASSERT(detail::FuncArity<FuncT>::value ==
+                                  sizeof...(args));
+
+    std::vector<CallArg> call_args;
+    call_args.reserve(sizeof...(args));
+    detail::BuildCallArgs<FuncT, 0>(std::back_inserter(call_args),
+                                    std::forward<Args>(args)...);
+
+    CallResultRaw const ret =
+      CallRaw(address, call_conv, std::begin(call_args), std::end(call_args));
+    using ResultT = detail::FuncResultT<FuncT>;
+    return detail::CallResultRawToCallResult<ResultT>(ret);
+  }
+
+  template <typename FuncT, typename... Args>
+  CallResult<detail::FuncResultT<FuncT>>
+    Call(FuncT address, CallConv call_conv, Args&&... args)
+  {
+    HADESMEM_DETAIL_STATIC_ASSERT(detail::IsFunction<FuncT>::value);
+
+    return Call<FuncT>(detail::FuncToPointer(address),
+                       call_conv,
+                       std::forward<Args>(args)...);
+  }
+
+  // Same interface as hadesmem::CallMulti. The whole batch is queued before
+  // the server is woken.
+  template <typename AddressesForwardIterator,
+            typename ConvForwardIterator,
+            typename ArgsForwardIterator,
+            typename ResultsOutputIterator>
+  void CallMulti(AddressesForwardIterator addresses_beg,
+                 AddressesForwardIterator addresses_end,
+                 ConvForwardIterator call_convs_beg,
+                 ArgsForwardIterator args_full_beg,
+                 ResultsOutputIterator results)
+  {
+    std::vector<CallFuture> futures;
+    for (; addresses_beg != addresses_end;
+         ++addresses_beg, ++call_convs_beg, ++args_full_beg)
+    {
+      auto const& args = *args_full_beg;
+      // Enqueue only wakes the server if the ring is full.
+      futures.emplace_back(
+        CallFuture{*this,
+                   Enqueue(*addresses_beg,
+                           *call_convs_beg,
+                           std::begin(args),
+                           std::end(args))});
+    }
+
+    Notify();
+
+    for (auto& future : futures)
+    {
+      *results = future.Get();
+      ++results;
+    }
+  }
+
+private:
+  friend class CallFuture;
+
+  PBYTE GetControlRemote() const noexcept
+  {
+    return static_cast<PBYTE>(ring_remote_.GetBase());
+  }
+
+  PBYTE GetRequestRemote(DWORD_PTR sequence) const noexcept
+  {
+    return GetControlRemote() + sizeof(detail::CallServerControl) +
+           (sequence & (ring_size_ - 1)) * sizeof(detail::CallServerRequest);
+  }
+
+  std::unique_ptr<Allocator> GenerateServerCode() const
+  {
+    Module const kernel32{*process_, L"kernel32.dll"};
+    detail::CallServerImports const imports{
+      reinterpret_cast<DWORD_PTR>(
+        FindProcedure(*process_, kernel32, "WaitForSingleObject")),
+      reinterpret_cast<DWORD_PTR>(
+        FindProcedure(*process_, kernel32, "SetEvent")),
+      reinterpret_cast<DWORD_PTR>(
+        FindProcedure(*process_, kernel32, "GetLastError")),
+      reinterpret_cast<DWORD_PTR>(
+        FindProcedure(*process_, kernel32, "SetLastError"))};
+
+    asmjit::JitRuntime runtime;
+    asmjit::X86Assembler assembler{&runtime};
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+    detail::GenerateCallServerCode64(
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+    detail::GenerateCallServerCode32(
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+      &assembler,
+      imports,
+      reinterpret_cast<DWORD_PTR>(GetControlRemote()),
+      reinterpret_cast<DWORD_PTR>(GetRequestRemote(0)),
+      static_cast<DWORD_PTR>(ring_size_ - 1),
+      request_event_remote_.GetHandle(),
+      response_event_remote_.GetHandle());
+
+    DWORD_PTR const stub_size = assembler.getCodeSize();
+
+    auto stub_mem_remote = std::make_unique<Allocator>(*process_, stub_size);
+
+    std::vector<BYTE> code_real(stub_size);
+    assembler.relocCode(
+      code_real.data(),
+      reinterpret_cast<DWORD_PTR>(stub_mem_remote->GetBase()));
+
+    WriteVector(*process_, stub_mem_remote->GetBase(), code_real);
+
+    FlushInstructionCache(*process_, stub_mem_remote->GetBase(), stub_size);
+
+    return stub_mem_remote;
+  }
+
+  template <typename ArgsForwardIterator>
+  DWORD_PTR Enqueue(void* address,
+                    CallConv call_conv,
+                    ArgsForwardIterator args_beg,
+                    ArgsForwardIterator args_end)
+  {
+    auto const request = detail::MarshalCallServerRequest(
+      address, call_conv, args_beg, args_end);
+
+    // Slots are only reused once their results have been collected.
+    while (head_ - collected_ == ring_size_)
+    {
+      Notify();
+      WaitForProgress();
+    }
+
+    DWORD_PTR const sequence = head_;
+    Write(*process_, GetRequestRemote(sequence), request);
+    Write(*process_,
+          GetControlRemote() + offsetof(detail::CallServerControl, head),
+          ++head_);
+    wanted_.insert(sequence);
+    return sequence;
+  }
+
+  void Notify()
+  {
+    detail::SetEventChecked(request_event_.GetHandle());
+  }
+
+  // Copies the results of any newly completed calls which are still wanted
+  // out of the ring, freeing up their slots.
+  void Collect()
+  {
+    auto const tail = Read<DWORD_PTR>(
+      *process_,
+      GetControlRemote() + offsetof(detail::CallServerControl, tail));
+    for (; collected_ != tail; ++collected_)
+    {
+      if (wanted_.erase(collected_))
+      {
+        auto const result = Read<detail::CallResultRemote>(
+          *process_,
+          GetRequestRemote(collected_) +
+            offsetof(detail::CallServerRequest, result));
+        results_.emplace(collected_, CallResultRaw{result});
+      }
+    }
+  }
+
+  void WaitForProgress()
+  {
+    DWORD_PTR const collected = collected_;
+    for (;;)
+    {
+      Collect();
+      if (collected_ != collected)
+      {
+        return;
+      }
+
+      HANDLE const handles[] = {response_event_.GetHandle(),
+                                thread_.GetHandle()};
+      DWORD const wait_res =
+        ::WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+      if (wait_res == WAIT_OBJECT_0 + 1)
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Call server thread terminated."});
+      }
+
+      if (wait_res != WAIT_OBJECT_0)
+      {
+        DWORD const last_error = ::GetLastError();
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"WaitForMultipleObjects failed."}
+                  << ErrorCodeWinLast{last_error});
+      }
+    }
+  }
+
+  bool IsComplete(DWORD_PTR sequence)
+  {
+    if (sequence - collected_ < head_ - collected_)
+    {
+      Collect();
+    }
+
+    return sequence - collected_ >= head_ - collected_;
+  }
+
+  CallResultRaw GetResult(DWORD_PTR sequence)
+  {
+    while (!IsComplete(sequence))
+    {
+      WaitForProgress();
+    }
+
+    auto const iter = results_.find(sequence);
+    HADESMEM_DETAIL_ASSERT(iter != std::end(results_));
+    auto const result = iter->second;
+    results_.erase(iter);
+    return result;
+  }
+
+  void Abandon(DWORD_PTR sequence) noexcept
+  {
+    wanted_.erase(sequence);
+    results_.erase(sequence);
+  }
+
+  Process const* process_;
+  std::size_t ring_size_;
+  detail::SmartHandle request_event_;
+  detail::SmartHandle response_event_;
+  detail::RemoteHandle request_event_remote_;
+  detail::RemoteHandle response_event_remote_;
+  Allocator ring_remote_;
+  std::unique_ptr<Allocator> code_remote_;
+  detail::SmartHandle thread_;
+  DWORD_PTR head_{};
+  DWORD_PTR collected_{};
+  std::set<DWORD_PTR> wanted_;
+  std::map<DWORD_PTR, CallResultRaw> results_;
+};
+
+inline bool CallFuture::IsReady() const
+{
+  HADESMEM_DETAIL_ASSERT(server_);
+  return server_->IsComplete(sequence_);
+}
+
+inline CallResultRaw CallFuture::Get()
+{
+  HADESMEM_DETAIL_ASSERT(server_);
+  auto const result = server_->GetResult(sequence_);
+  server_ = nullptr;
+  return result;
+}
+
+inline void CallFuture::Abandon() noexcept
+{
+  if (server_)
+  {
+    server_->Abandon(sequence_);
+    server_ = nullptr;
+  }
+}
+}
@@ -0,0 +1,174 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+#include <intrin.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+// Cheap rejection of pointer-sized values which can't lie in any of a set of
+// address ranges, four values (4 bytes apart, so they overlap on x64) at a
+// time. Only one dword of each value is compared (the high dword on x64, the
+// whole value on x86), against at most kMaxRanges ranges formed by merging the
+// real ones across their smallest gaps. So there are false positives, but
+// never false negatives, and callers still need to do an exact lookup.
+class AddressRangeFilter
+{
+public:
+  static std::size_t const kMaxRanges = 8;
+
+  // Number of bytes read by Match(p), which tests the values at p, p + 4,
+  // p + 8 and p + 12.
+  static std::size_t const kMatchSize = 12 + sizeof(void*);
+
+  // Ranges are [first, second), and don't need to be sorted or disjoint.
+  explicit AddressRangeFilter(
+    std::vector<std::pair<std::uintptr_t, std::uintptr_t>> ranges)
+  {
+    std::sort(std::begin(ranges), std::end(ranges));
+
+    // Keys are monotonic in the address, so sorting by address also sorts by
+    // key, and overlapping ranges have overlapping keys.
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> keys;
+    for (auto const& range : ranges)
+    {
+      if (range.second <= range.first)
+      {
+        continue;
+      }
+
+      std::uint32_t const lo = GetKey(range.first);
+      std::uint32_t const hi = GetKey(range.second - 1);
+      if (!keys.empty() &&
+          static_cast<std::uint64_t>(lo) <=
+            static_cast<std::uint64_t>(keys.back().second) + 1)
+      {
+        keys.back().second = (std::max)(keys.back().second, hi);
+      }
+      else
+      {
+        keys.emplace_back(lo, hi);
+      }
+    }
+
+    if (keys.size() > kMaxRanges)
+    {
+      MergeSmallestGaps(keys);
+    }
+
+    HADESMEM_DETAIL_ASSERT(keys.size() <= kMaxRanges);
+    for (auto const& key : keys)
+    {
+      lo_[num_ranges_] = key.first;
+      hi_[num_ranges_] = key.second;
+      ++num_ranges_;
+    }
+  }
+
+  // Bit n is set if the value at p + n * 4 may be in range.
+  std::uint32_t Match(std::uint8_t const* p) const noexcept
+  {
+    // SSE2 only has signed compares, so flip the top bit of everything to
+    // get unsigned ones.
+    __m128i const bias = _mm_set1_epi32(INT_MIN);
+    __m128i const keys = _mm_xor_si128(
+      _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + kKeyOffset)), bias);
+    __m128i out = _mm_set1_epi32(-1);
+    for (std::size_t i = 0; i < num_ranges_; ++i)
+    {
+      __m128i const lo = _mm_set1_epi32(static_cast<int>(lo_[i] ^ 0x80000000U));
+      __m128i const hi = _mm_set1_epi32(static_cast<int>(hi_[i] ^ 0x80000000U));
+      out = _mm_and_si128(
+        out,
+        _mm_or_si128(_mm_cmpgt_epi32(lo, keys), _mm_cmpgt_epi32(keys, hi)));
+    }
+
+    return ~static_cast<std::uint32_t>(
+             _mm_movemask_ps(_mm_castsi128_ps(out))) &
+           0xF;
+  }
+
+  // Same test as Match, for a single value. For the tail of a buffer.
+  bool Match(std::uintptr_t value) const noexcept
+  {
+    std::uint32_t const key = GetKey(value);
+    for (std::size_t i = 0; i < num_ranges_; ++i)
+    {
+      if (key >= lo_[i] && key <= hi_[i])
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+private:
+  // Little endian, so the high dword is the second one.
+  static std::size_t const kKeyOffset = sizeof(void*) - 4;
+
+  static std::uint32_t GetKey(std::uintptr_t value) noexcept
+  {
+    return static_cast<std::uint32_t>(static_cast<std::uint64_t>(value) >>
+                                      ((sizeof(void*) - 4) * CHAR_BIT));
+  }
+
+  // Splits are kept at the kMaxRanges - 1 largest gaps, and everything else
+  // is merged.
+  static void MergeSmallestGaps(
+    std::vector<std::pair<std::uint32_t, std::uint32_t>>& keys)
+  {
+    std::vector<std::pair<std::uint32_t, std::size_t>> gaps;
+    gaps.reserve(keys.size() - 1);
+    for (std::size_t i = 1; i < keys.size(); ++i)
+    {
+      gaps.emplace_back(keys[i].first - keys[i - 1].second, i);
+    }
+
+    std::nth_element(std::begin(gaps),
+                     std::begin(gaps) + (kMaxRanges - 1),
+                     std::end(gaps),
+                     [](std::pair<std::uint32_t, std::size_t> const& lhs,
+                        std::pair<std::uint32_t, std::size_t> const& rhs) {
+                       return lhs.first > rhs.first;
+                     });
+    std::vector<std::size_t> splits;
+    for (std::size_t i = 0; i < kMaxRanges - 1; ++i)
+    {
+      splits.push_back(gaps[i].second);
+    }
+    std::sort(std::begin(splits), std::end(splits));
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> merged;
+    std::size_t beg = 0;
+    splits.push_back(keys.size());
+    for (auto const split : splits)
+    {
+      merged.emplace_back(keys[beg].first, keys[split - 1].second);
+      beg = split;
+    }
+
+    keys = std::move(merged);
+  }
+
+  std::uint32_t lo_[kMaxRanges]{};
+  std::uint32_t hi_[kMaxRanges]{};
+  std::size_t num_ranges_{};
+};
+}
+}
@@ -0,0 +1,244 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/reader_epoch.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+// Read-mostly map from addresses to pointers, for lookups from places which
+// can't (or shouldn't) take a lock, such as exception handlers. Lookups take
+// no locks: a bounded probe of an open-addressed table, bracketed by entering
+// and leaving a ReaderEpoch. Writers are serialized by a mutex.
+// A key's slot is never reused for a different key (erasing just clears the
+// value), so a reader can never see a value belonging to some other key.
+// Resizing builds a new table and publishes it with a single store, then waits
+// on the epoch for readers which may still be probing the old table before
+// freeing it. So Insert must not be called while a reader may be suspended (or
+// from a reader).
+template <typename T> class AddressTable
+{
+public:
+  AddressTable() : table_{NewTable(kMinCapacity)}
+  {
+  }
+
+  AddressTable(AddressTable const& other) = delete;
+
+  AddressTable& operator=(AddressTable const& other) = delete;
+
+  ~AddressTable()
+  {
+    delete table_.load(std::memory_order_relaxed);
+  }
+
+  T* Find(void const* key) const noexcept
+  {
+    ReaderEpochGuard const epoch_guard{epoch_};
+
+    Table const* const table = table_.load(std::memory_order_acquire);
+    auto const k = reinterpret_cast<std::uintptr_t>(key);
+    for (std::size_t i = Hash(k) & table->mask, n = 0; n <= table->mask;
+         i = (i + 1) & table->mask, ++n)
+    {
+      std::uintptr_t const slot_key =
+        table->slots[i].key.load(std::memory_order_acquire);
+      if (slot_key == k)
+      {
+        return table->slots[i].value.load(std::memory_order_acquire);
+      }
+
+      if (!slot_key)
+      {
+        break;
+      }
+    }
+
+    return nullptr;
+  }
+
+  // Returns false (and does nothing) if the key is already present.
+  bool Insert(void const* key, T* value)
+  {
+    HADESMEM_DETAIL_ASSERT(key != nullptr);
+    HADESMEM_DETAIL_ASSERT(value != nullptr);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto const k = reinterpret_cast<std::uintptr_t>(key);
+    Table* table = table_.load(std::memory_order_relaxed);
+    if (Slot* const slot = FindSlot(*table, k))
+    {
+      if (slot->value.load(std::memory_order_relaxed))
+      {
+        return false;
+      }
+
+      slot->value.store(value, std::memory_order_release);
+      ++size_;
+      return true;
+    }
+
+    // Keep at least half the slots empty so probes stay short, and so there
+    // is always an empty slot to terminate a probe.
+    if ((table->used + 1) * 2 > table->mask + 1)
+    {
+      table = Rebuild(*table);
+    }
+
+    Slot& slot = FindEmptySlot(*table, k);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.key.store(k, std::memory_order_release);
+    ++table->used;
+    ++size_;
+    return true;
+  }
+
+  // Returns false if the key was not present.
+  bool Erase(void const* key)
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    Slot* const slot = FindSlot(*table_.load(std::memory_order_relaxed),
+                                reinterpret_cast<std::uintptr_t>(key));
+    if (!slot || !slot->value.load(std::memory_order_relaxed))
+    {
+      return false;
+    }
+
+    slot->value.store(nullptr, std::memory_order_release);
+    --size_;
+    return true;
+  }
+
+  std::size_t GetSize() const
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return size_;
+  }
+
+private:
+  static std::size_t const kMinCapacity = 16;
+
+  struct Slot
+  {
+    std::atomic<std::uintptr_t> key{};
+    std::atomic<T*> value{};
+  };
+
+  struct Table
+  {
+    explicit Table(std::size_t capacity)
+      : mask{capacity - 1}, slots{new Slot[capacity]}
+    {
+    }
+
+    std::size_t const mask;
+    // Number of slots with a key (including those whose value has since been
+    // erased). Only touched by writers.
+    std::size_t used{};
+    std::unique_ptr<Slot[]> const slots;
+  };
+
+  static Table* NewTable(std::size_t capacity)
+  {
+    HADESMEM_DETAIL_ASSERT(capacity && !(capacity & (capacity - 1)));
+    return new Table{capacity};
+  }
+
+  static std::size_t Hash(std::uintptr_t k) noexcept
+  {
+    // Hook addresses are often aligned, so mix the high bits down before
+    // masking.
+    k ^= k >> 17;
+    k *= static_cast<std::uintptr_t>(0x9E3779B97F4A7C15ULL);
+    k ^= k >> 15;
+    return static_cast<std::size_t>(k);
+  }
+
+  static Slot* FindSlot(Table const& table, std::uintptr_t k) noexcept
+  {
+    for (std::size_t i = Hash(k) & table.mask, n = 0; n <= table.mask;
+         i = (i + 1) & table.mask, ++n)
+    {
+      std::uintptr_t const slot_key =
+        table.slots[i].key.load(std::memory_order_relaxed);
+      if (slot_key == k)
+      {
+        return &table.slots[i];
+      }
+
+      if (!slot_key)
+      {
+        break;
+      }
+    }
+
+    return nullptr;
+  }
+
+  static Slot& FindEmptySlot(Table const& table, std::uintptr_t k) noexcept
+  {
+    std::size_t i = Hash(k) & table.mask;
+    while (table.slots[i].key.load(std::memory_order_relaxed))
+    {
+      i = (i + 1) & table.mask;
+    }
+
+    return table.slots[i];
+  }
+
+  Table* Rebuild(Table& old_table)
+  {
+    // Sized for the live entries only, so the keys of erased entries are
+    // dropped here.
+    std::size_t capacity = kMinCapacity;
+    while (capacity < (size_ + 1) * 4)
+    {
+      capacity *= 2;
+    }
+
+    std::unique_ptr<Table> new_table{NewTable(capacity)};
+    for (std::size_t i = 0; i <= old_table.mask; ++i)
+    {
+      T* const value = old_table.slots[i].value.load(std::memory_order_relaxed);
+      if (value)
+      {
+        std::uintptr_t const k =
+          old_table.slots[i].key.load(std::memory_order_relaxed);
+        Slot& slot = FindEmptySlot(*new_table, k);
+        slot.value.store(value, std::memory_order_relaxed);
+        slot.key.store(k, std::memory_order_relaxed);
+        ++new_table->used;
+      }
+    }
+
+    table_.store(new_table.get(), std::memory_order_release);
+    Table* const table = new_table.release();
+
+    // Leaked rather than freed if this throws, as a reader may still be
+    // probing it.
+    epoch_.Synchronize();
+    delete &old_table;
+
+    return table;
+  }
+
+  std::atomic<Table*> table_;
+  mutable std::mutex mutex_;
+  mutable ReaderEpoch epoch_;
+  std::size_t size_{};
+};
+}
+}
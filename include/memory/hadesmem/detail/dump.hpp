@@ -3,19 +3,28 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <map>
 #include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <windows.h>
 #include <psapi.h>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/address_range_filter.hpp>
 #include <hadesmem/detail/filesystem.hpp>
 #include <hadesmem/detail/peb.hpp>
+#include <hadesmem/detail/query_region.hpp>
 #include <hadesmem/detail/str_conv.hpp>
 #include <hadesmem/find_procedure.hpp>
 #include <hadesmem/pelib/dos_header.hpp>
@@ -323,7 +332,8 @@ struct ModuleLight
       PeFile pe_file{local_process,
                      buffer.data(),
                      PeFileType::kData,
-                     static_cast<DWORD>(buffer.size())};
+                     static_cast<DWORD>(buffer.size()),
+                     PeFileFlags::kLocalBuffer};
       NtHeaders nt_headers{local_process, pe_file};
       return true;
     }
@@ -354,6 +364,289 @@ struct ExportLight
   DWORD ordinal_;
 };
 
+// Export VA -> exports at that VA, for the memory scan. Exports are added,
+// then Build must be called before looking anything up. The exports are
+// flattened into one array sorted by VA (then by module priority, lowest to
+// highest) and indexed by an open addressed hash table, because the scan does
+// a lookup for every 4 bytes of the image and a node based map spends most of
+// that time chasing pointers.
+// Pointers to exports are stable after Build.
+class ExportMap
+{
+public:
+  class Range
+  {
+  public:
+    Range() noexcept
+    {
+    }
+
+    Range(ExportLight const* beg, ExportLight const* end) noexcept
+      : beg_{beg}, end_{end}
+    {
+    }
+
+    ExportLight const* begin() const noexcept
+    {
+      return beg_;
+    }
+
+    ExportLight const* end() const noexcept
+    {
+      return end_;
+    }
+
+    bool empty() const noexcept
+    {
+      return beg_ == end_;
+    }
+
+    ExportLight const& back() const noexcept
+    {
+      HADESMEM_DETAIL_ASSERT(!empty());
+      return *(end_ - 1);
+    }
+
+  private:
+    ExportLight const* beg_{};
+    ExportLight const* end_{};
+  };
+
+  void Add(void* va, ExportLight const& e)
+  {
+    HADESMEM_DETAIL_ASSERT(vas_.empty());
+    pending_.emplace_back(reinterpret_cast<std::uintptr_t>(va), e);
+  }
+
+  void Build()
+  {
+    std::stable_sort(std::begin(pending_),
+                     std::end(pending_),
+                     [](std::pair<std::uintptr_t, ExportLight> const& lhs,
+                        std::pair<std::uintptr_t, ExportLight> const& rhs) {
+                       return lhs.first != rhs.first
+                                ? lhs.first < rhs.first
+                                : lhs.second.module_->priority_ <
+                                    rhs.second.module_->priority_;
+                     });
+
+    exports_.reserve(pending_.size());
+    for (auto& e : pending_)
+    {
+      if (vas_.empty() || vas_.back() != e.first)
+      {
+        vas_.push_back(e.first);
+        firsts_.push_back(exports_.size());
+      }
+
+      exports_.push_back(std::move(e.second));
+    }
+    firsts_.push_back(exports_.size());
+    pending_.clear();
+    pending_.shrink_to_fit();
+
+    // At most half full, so probe sequences stay short.
+    std::size_t capacity = 16;
+    shift_ = 64 - 4;
+    while (capacity < vas_.size() * 2)
+    {
+      capacity *= 2;
+      --shift_;
+    }
+
+    table_.assign(capacity, 0);
+    for (std::size_t i = 0; i < vas_.size(); ++i)
+    {
+      std::size_t slot = Hash(vas_[i]);
+      while (table_[slot])
+      {
+        slot = (slot + 1) & (capacity - 1);
+      }
+
+      table_[slot] = static_cast<std::uint32_t>(i + 1);
+    }
+  }
+
+  Range Find(void const* va) const noexcept
+  {
+    if (table_.empty())
+    {
+      return {};
+    }
+
+    auto const key = reinterpret_cast<std::uintptr_t>(va);
+    for (std::size_t slot = Hash(key);; slot = (slot + 1) & (table_.size() - 1))
+    {
+      std::uint32_t const index = table_[slot];
+      if (!index)
+      {
+        return {};
+      }
+
+      if (vas_[index - 1] == key)
+      {
+        return {exports_.data() + firsts_[index - 1],
+                exports_.data() + firsts_[index]};
+      }
+    }
+  }
+
+  // Sorted, without duplicates.
+  std::vector<std::uintptr_t> const& GetVas() const noexcept
+  {
+    return vas_;
+  }
+
+  std::size_t size() const noexcept
+  {
+    return vas_.size();
+  }
+
+private:
+  // Fibonacci hashing. The low bits of export VAs are heavily biased by
+  // function alignment, so they need mixing into the high bits we keep.
+  std::size_t Hash(std::uintptr_t va) const noexcept
+  {
+    return static_cast<std::size_t>(
+      (static_cast<std::uint64_t>(va) * 0x9E3779B97F4A7C15ULL) >> shift_);
+  }
+
+  std::vector<std::pair<std::uintptr_t, ExportLight>> pending_;
+  std::vector<std::uintptr_t> vas_;
+  // Index of the first export for each VA, plus one past the end.
+  std::vector<std::size_t> firsts_;
+  std::vector<ExportLight> exports_;
+  // Index into vas_ plus one, or zero for an empty slot.
+  std::vector<std::uint32_t> table_;
+  unsigned int shift_{};
+};
+
+// Executable memory in the target, for resolving redirected imports. The
+// regions are captured once, so that most candidates are rejected without a
+// query, and memory is read (and kept) a page at a time, so that neighbouring
+// stubs don't each need their own read. Pages inside the image being dumped
+// are served from the copy we already have.
+class CodePageCache
+{
+public:
+  explicit CodePageCache(Process const& process,
+                         void const* image_base,
+                         std::vector<std::uint8_t> const& image)
+    : process_{&process},
+      image_beg_{reinterpret_cast<std::uintptr_t>(image_base)},
+      image_{&image}
+  {
+    SYSTEM_INFO sys_info{};
+    ::GetSystemInfo(&sys_info);
+    page_size_ = sys_info.dwPageSize;
+
+    RegionList const regions(process);
+    for (auto const& region : regions)
+    {
+      MEMORY_BASIC_INFORMATION mbi{};
+      mbi.State = region.GetState();
+      mbi.Protect = region.GetProtect();
+      if (!CanExecute(mbi) || IsBadProtect(mbi))
+      {
+        continue;
+      }
+
+      auto const beg = reinterpret_cast<std::uintptr_t>(region.GetBase());
+      regions_.emplace_back(beg, beg + region.GetSize());
+    }
+  }
+
+  explicit CodePageCache(Process const&& process,
+                         void const* image_base,
+                         std::vector<std::uint8_t> const& image) = delete;
+
+  CodePageCache(CodePageCache const& other) = delete;
+
+  CodePageCache& operator=(CodePageCache const& other) = delete;
+
+  // Sorted by address.
+  std::vector<std::pair<std::uintptr_t, std::uintptr_t>> const&
+    GetRegions() const noexcept
+  {
+    return regions_;
+  }
+
+  // Fails if any of the data isn't executable or can't be read.
+  bool Read(void const* address, void* out, std::size_t len)
+  {
+    auto cur = reinterpret_cast<std::uintptr_t>(address);
+    auto dst = static_cast<std::uint8_t*>(out);
+    while (len)
+    {
+      std::uintptr_t const page = cur & ~(page_size_ - 1);
+      auto const data = GetPage(page);
+      if (!data)
+      {
+        return false;
+      }
+
+      std::size_t const offset = cur - page;
+      std::size_t const n = (std::min)(len, page_size_ - offset);
+      std::memcpy(dst, data + offset, n);
+      dst += n;
+      cur += n;
+      len -= n;
+    }
+
+    return true;
+  }
+
+private:
+  bool IsExecutable(std::uintptr_t address) const noexcept
+  {
+    auto const iter = std::upper_bound(
+      std::begin(regions_),
+      std::end(regions_),
+      std::make_pair(address, (std::numeric_limits<std::uintptr_t>::max)()));
+    return iter != std::begin(regions_) && address < std::prev(iter)->second;
+  }
+
+  std::uint8_t const* GetPage(std::uintptr_t page)
+  {
+    if (!IsExecutable(page))
+    {
+      return nullptr;
+    }
+
+    if (page >= image_beg_ && page - image_beg_ <= image_->size() &&
+        page_size_ <= image_->size() - (page - image_beg_))
+    {
+      return image_->data() + (page - image_beg_);
+    }
+
+    auto iter = pages_.find(page);
+    if (iter == std::end(pages_))
+    {
+      std::vector<std::uint8_t> data;
+      try
+      {
+        data = ReadVector<std::uint8_t>(
+          *process_, reinterpret_cast<void*>(page), page_size_);
+      }
+      catch (...)
+      {
+        // Kept (empty) anyway, so we don't try again.
+      }
+
+      iter = pages_.emplace(page, std::move(data)).first;
+    }
+
+    return iter->second.empty() ? nullptr : iter->second.data();
+  }
+
+  Process const* process_;
+  std::uintptr_t image_beg_;
+  std::vector<std::uint8_t> const* image_;
+  std::size_t page_size_{};
+  std::vector<std::pair<std::uintptr_t, std::uintptr_t>> regions_;
+  std::unordered_map<std::uintptr_t, std::vector<std::uint8_t>> pages_;
+};
+
 struct ProcessLight
 {
   ProcessLight() = default;
@@ -364,7 +657,7 @@ struct ProcessLight
   ~ProcessLight() = default;
 
   std::vector<ModuleLight> modules_;
-  std::map<void*, std::vector<ExportLight>> export_map_;
+  ExportMap export_map_;
 };
 
 struct PeDumper
@@ -650,37 +943,30 @@ private:
 
         HADESMEM_DETAIL_TRACE_A("Adding to export map.");
 
-        process_info.export_map_[va].emplace_back(ExportLight{
-          resolved_module, e.ByName(), e.GetName(), e.GetProcedureNumber()});
+        process_info.export_map_.Add(
+          va,
+          ExportLight{resolved_module,
+                      e.ByName(),
+                      e.GetName(),
+                      e.GetProcedureNumber()});
       }
     }
 
+    HADESMEM_DETAIL_TRACE_A("Indexing export map.");
+
+    // Also sorts the exports at each VA by module priority.
+    process_info.export_map_.Build();
+
     HADESMEM_DETAIL_TRACE_FORMAT_A("Num Modules: [%Iu].",
                                    process_info.modules_.size());
     HADESMEM_DETAIL_TRACE_FORMAT_A("Num Export VAs: [%Iu].",
                                    process_info.export_map_.size());
   }
 
-  void SortExportMapModules(ProcessLight& process_info)
-  {
-    HADESMEM_DETAIL_TRACE_A("Sorting export map modules by priority.");
-
-    for (auto& i : process_info.export_map_)
-    {
-      auto& modules = i.second;
-      std::sort(std::begin(modules),
-                std::end(modules),
-                [](ExportLight const& lhs, ExportLight const& rhs) {
-                  return lhs.module_->priority_ < rhs.module_->priority_;
-                });
-    }
-  }
-
   ProcessLight MakeProcessLight()
   {
     auto process_info = BuildModuleList();
     BuildExportMap(process_info);
-    SortExportMapModules(process_info);
     return process_info;
   }
 
@@ -857,7 +1143,8 @@ private:
 
   std::map<DWORD, ExportLight const*>
     DoMemoryScan(std::vector<std::uint8_t>& raw_new,
-                 std::map<void*, std::vector<ExportLight>> const& export_map,
+                 std::vector<std::uint8_t> const& raw,
+                 ExportMap const& export_map,
                  void* base,
                  std::size_t pe_size,
                  Process const& local_process,
@@ -865,6 +1152,18 @@ private:
   {
     HADESMEM_DETAIL_TRACE_A("Performing memory scan.");
 
+    // A value can only be a fixup if it's an export, or a redirection stub
+    // (which must be executable), so everything else is rejected a block at a
+    // time before doing any lookups. Most of the image is code, strings and
+    // small integers, so that's most of it.
+    CodePageCache code_pages{*process_, base, raw};
+    auto ranges = code_pages.GetRegions();
+    for (auto const va : export_map.GetVas())
+    {
+      ranges.emplace_back(va, va + 1);
+    }
+    AddressRangeFilter const filter{std::move(ranges)};
+
     // TODO: Support other scanning algorithms.
     // TODO: Be smarter about deciding which imports are legitimate and which
     // are false positives.
@@ -873,20 +1172,48 @@ private:
     // TODO: Check section characteristics as an additional heuristic?
     std::map<DWORD, ExportLight const*> fixup_map;
     bool fixup_adjacent = false;
-    for (auto p = raw_new.data(); p < raw_new.data() + raw_new.size() - 3;
+    auto const raw_end = raw_new.data() + raw_new.size();
+    // Bit n is the filter result for block_beg + n * 4.
+    std::uint8_t* block_beg = raw_new.data();
+    std::uint8_t* block_end = raw_new.data();
+    std::uint32_t block_mask = 0;
+    for (auto p = raw_new.data();
+         static_cast<std::size_t>(raw_end - p) >= sizeof(void*);
          p += 4)
     {
+      if (p >= block_end)
+      {
+        block_beg = p;
+        if (static_cast<std::size_t>(raw_end - p) >=
+            AddressRangeFilter::kMatchSize)
+        {
+          block_mask = filter.Match(p);
+          block_end = p + 16;
+        }
+        else
+        {
+          block_mask = filter.Match(*reinterpret_cast<std::uintptr_t*>(p));
+          block_end = p + 4;
+        }
+      }
+
+      if (!((block_mask >> ((p - block_beg) / 4)) & 1))
+      {
+        fixup_adjacent = false;
+        continue;
+      }
+
       auto const offset =
         static_cast<DWORD>(reinterpret_cast<std::uintptr_t>(p) -
                            reinterpret_cast<std::uintptr_t>(raw_new.data()));
 
       auto va = *reinterpret_cast<void**>(p);
-      auto i = export_map.find(va);
-      if (i == std::end(export_map))
+      auto exports = export_map.Find(va);
+      if (exports.empty())
       {
         // TODO: Make sure this doesn't overlap with any previous fixups,
         // redirected or otherwise?
-        auto const resolved_va = ResolveRedirectedImport(va);
+        auto const resolved_va = ResolveRedirectedImport(va, code_pages);
         if (!resolved_va)
         {
           fixup_adjacent = false;
@@ -898,8 +1225,8 @@ private:
           va,
           resolved_va);
 
-        i = export_map.find(resolved_va);
-        if (i == std::end(export_map))
+        exports = export_map.Find(resolved_va);
+        if (exports.empty())
         {
           HADESMEM_DETAIL_TRACE_A("WARNING! Successfully resolved redirected "
                                   "import, but then failed to match it to an "
@@ -919,7 +1246,7 @@ private:
       }
 
       {
-        auto const e = i->second.back();
+        auto const& e = exports.back();
         HADESMEM_DETAIL_TRACE_FORMAT_W(
           L"Found matching VA. Logging last entry only. Offset: [%08X]. VA: "
           L"[%p]. Module: [%s]. Name: [%hs]. Ordinal: [%lu]. ByName: [%d].",
@@ -942,9 +1269,8 @@ private:
       // TODO: Add a config flag to control this behavior.
       if (!(reinterpret_cast<std::uintptr_t>(va) % 0x1000) && !fixup_adjacent)
       {
-        auto const next_va = *reinterpret_cast<void**>(p + 8);
-        auto const next_e = export_map.find(next_va);
-        if (next_e == std::end(export_map))
+        if (static_cast<std::size_t>(raw_end - p) < 8 + sizeof(void*) ||
+            export_map.Find(*reinterpret_cast<void**>(p + 8)).empty())
         {
           HADESMEM_DETAIL_TRACE_A("WARNING! Skipping page aligned VA.");
           continue;
@@ -955,7 +1281,7 @@ private:
 
       // Modules are sorted by priority. Lowest to highest.
       auto& fixup_export = fixup_map[rva];
-      fixup_export = &i->second.back();
+      fixup_export = &exports.back();
 
       // Try and match to use the same module as the previous adjacent fixup
       // if possible (there could be a different match because of forwarded
@@ -972,7 +1298,7 @@ private:
           : prev_fixup_iter->second->module_->pe_file_.GetBase();
       if (prev_module_base)
       {
-        for (auto& e : i->second)
+        for (auto const& e : exports)
         {
           if (fixup_export != &e &&
               e.module_->pe_file_.GetBase() == prev_module_base)
@@ -1052,7 +1378,8 @@ private:
         std::make_unique<PeFile>(local_process,
                                  pe_file_disk_data.data(),
                                  PeFileType::kData,
-                                 static_cast<DWORD>(pe_file_disk_data.size()));
+                                 static_cast<DWORD>(pe_file_disk_data.size()),
+                                 PeFileFlags::kLocalBuffer);
       return std::make_tuple(
         true, std::move(pe_file_disk_data), std::move(pe_file_disk));
     }
@@ -1101,7 +1428,8 @@ private:
     PeFile const pe_file(local_process,
                          raw.data(),
                          PeFileType::kImage,
-                         static_cast<DWORD>(raw.size()));
+                         static_cast<DWORD>(raw.size()),
+                         PeFileFlags::kLocalBuffer);
 
     bool has_disk_headers = !!(flags_ & DumpFlags::kUseDiskHeaders);
 
@@ -1173,7 +1501,7 @@ private:
                                        nt_headers_new.GetSectionAlignment()));
 
       auto const fixup_map = DoMemoryScan(
-        raw_new, export_map, base, pe_size, local_process, pe_file_new);
+        raw_new, raw, export_map, base, pe_size, local_process, pe_file_new);
 
       auto coalesced_fixup_map = CoalesceImportDescriptors(fixup_map);
 
@@ -1829,59 +2157,53 @@ private:
   // for its original purpose it still serves as an example of how to extend the
   // import redirection resolution code.
   // TODO: This should be a plugin/extension/whatever.
-  // TODO: Further perf improvements by using the buffer and memory region info
-  // we already have in the memory scanning function, rather than duplicating
-  // work here (and in other 'extensions').
-  void* ResolveRedirectedImportForOverwatch(void* va) const
+  void* ResolveRedirectedImportForOverwatch(void* va,
+                                            CodePageCache& code_pages) const
   {
 #if defined(HADESMEM_DETAIL_ARCH_X64)
-    try
+    std::uint8_t stub_buf[0x12];
+    if (!code_pages.Read(va, stub_buf, sizeof(stub_buf)))
     {
-      auto const stub = static_cast<std::uint8_t*>(va);
-      if (!CanExecute(*process_, stub))
-      {
-        return nullptr;
-      }
-
-      const auto stub_buf = ReadVector<std::uint8_t>(*process_, stub, 0x11);
-
-      // mov rax, imm64
-      if (stub_buf[0] != 0x48 || stub_buf[1] != 0xB8)
-      {
-        return nullptr;
-      }
-
-      // add rax, imm32
-      if (stub_buf[0xA] != 0x48 || stub_buf[0xB] != 0x05)
-      {
-        return nullptr;
-      }
-
-      // jmp rax
-      if (stub_buf[0x10] != 0xFF || stub_buf[0x11] != 0xE0)
-      {
-        return nullptr;
-      }
+      return nullptr;
+    }
 
-      auto const o = *reinterpret_cast<std::uint8_t* const*>(&stub_buf[2]);
-      auto const n = *reinterpret_cast<std::uint32_t const*>(&stub_buf[0xc]);
+    // mov rax, imm64
+    if (stub_buf[0] != 0x48 || stub_buf[1] != 0xB8)
+    {
+      return nullptr;
+    }
 
-      return o + n;
+    // add rax, imm32
+    if (stub_buf[0xA] != 0x48 || stub_buf[0xB] != 0x05)
+    {
+      return nullptr;
     }
-    catch (...)
+
+    // jmp rax
+    if (stub_buf[0x10] != 0xFF || stub_buf[0x11] != 0xE0)
     {
       return nullptr;
     }
+
+    std::uint8_t* o;
+    std::uint32_t n;
+    std::memcpy(&o, &stub_buf[2], sizeof(o));
+    std::memcpy(&n, &stub_buf[0xC], sizeof(n));
+
+    return o + n;
 #else // #if defined(HADESMEM_DETAIL_ARCH_X64)
     (void)va;
+    (void)code_pages;
     return nullptr;
 #endif
   }
 
-  void* ResolveRedirectedImport(void* va) const
+  // Extensions should read through code_pages rather than the process, as
+  // this is called for every executable address in the image.
+  void* ResolveRedirectedImport(void* va, CodePageCache& code_pages) const
   {
     // Just hardcode one for now. Needs proper plugin support.
-    return ResolveRedirectedImportForOverwatch(va);
+    return ResolveRedirectedImportForOverwatch(va, code_pages);
   }
 
   Process const* process_{};
@@ -3,18 +3,26 @@
 
 #pragma once
 
-#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <tuple>
 
 #include <windows.h>
 
-#include <hadesmem/pelib/export_list.hpp>
 #include <hadesmem/detail/alias_cast.hpp>
+#include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/static_assert.hpp>
 #include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/detail/string_view.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/module.hpp>
 #include <hadesmem/pelib/export.hpp>
+#include <hadesmem/pelib/export_index.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
 #include <hadesmem/process.hpp>
 
@@ -22,70 +30,204 @@ namespace hadesmem
 {
 namespace detail
 {
-inline FARPROC GetProcAddressFromExport(Process const& process,
-                                        Export const& e);
+inline FARPROC GetProcAddressInternal(Process const& process,
+                                      HMODULE module,
+                                      std::string const& name);
+
+inline FARPROC
+  GetProcAddressInternal(Process const& process, HMODULE module, WORD ordinal);
+
+// Caches export indexes per (process, module base, timestamp) so repeated
+// lookups against the same module (e.g. resolving dozens of functions when
+// installing hooks or injecting) don't rebuild the index every time. The
+// timestamp check ensures we notice a module being unloaded and something
+// else loaded at the same base.
+class ExportIndexCache
+{
+public:
+  static std::size_t const kMaxEntries = 0x100;
+
+  ExportIndexCache() = default;
+
+  ExportIndexCache(ExportIndexCache const& other) = delete;
+
+  ExportIndexCache& operator=(ExportIndexCache const& other) = delete;
+
+  std::shared_ptr<ExportIndex const> Get(Process const& process,
+                                         PeFile const& pe_file)
+  {
+    HADESMEM_DETAIL_ASSERT(pe_file.GetType() == PeFileType::kImage);
+
+    NtHeaders const nt_headers{process, pe_file};
+    Key const key{process.GetId(),
+                  reinterpret_cast<std::uintptr_t>(pe_file.GetBase()),
+                  nt_headers.GetTimeDateStamp()};
+
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      auto const iter = cache_.find(key);
+      if (iter != std::end(cache_))
+      {
+        return iter->second;
+      }
+    }
+
+    // Build outside the lock. Worst case two threads build the same index and
+    // one of them wins.
+    auto const index = std::make_shared<ExportIndex const>(process, pe_file);
 
-template <typename Pred>
-inline FARPROC GetProcAddressInternalFromPred(Process const& process,
-                                              HMODULE module,
-                                              Pred pred)
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (cache_.size() >= kMaxEntries)
+    {
+      cache_.clear();
+    }
+    cache_[key] = index;
+    return index;
+  }
+
+  void Clear()
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    cache_.clear();
+  }
+
+private:
+  using Key = std::tuple<DWORD, std::uintptr_t, DWORD>;
+
+  std::map<Key, std::shared_ptr<ExportIndex const>> cache_;
+  std::mutex mutex_;
+};
+
+inline ExportIndexCache& GetExportIndexCache()
+{
+  static ExportIndexCache cache;
+  return cache;
+}
+
+// Resolves a forwarded export (i.e. "Module.Function" or "Module.#Ordinal",
+// already split at the last dot) by looking it up in the forwarder module.
+inline FARPROC GetProcAddressFromForwarder(Process const& process,
+                                           StringView module_name,
+                                           StringView function)
+{
+  // TODO: What is the correct logic here? Remember we don't want to get
+  // fooled by seeing Foo.DLL.DLL instead of Foo.DLL or something stupid like
+  // that...
+  std::string forwarder_module_name = module_name.to_string();
+  if (forwarder_module_name.find('.') == std::string::npos)
+  {
+    forwarder_module_name += ".DLL";
+  }
+  Module const forwarder_module{process,
+                                MultiByteToWideChar(forwarder_module_name)};
+
+  if (!function.empty() && function[0] == '#')
+  {
+    WORD forwarder_ordinal = 0;
+    try
+    {
+      forwarder_ordinal = StrToNum<WORD>(function.substr(1).to_string());
+    }
+    catch (Error const& /*e*/)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid forwarder ordinal detected."});
+    }
+
+    return GetProcAddressInternal(
+      process, forwarder_module.GetHandle(), forwarder_ordinal);
+  }
+
+  return GetProcAddressInternal(
+    process, forwarder_module.GetHandle(), function.to_string());
+}
+
+inline FARPROC GetProcAddressFromIndex(Process const& process,
+                                       PeFile const& pe_file,
+                                       ExportIndex const& index,
+                                       WORD ordinal_number)
+{
+  if (index.IsForwarded(ordinal_number))
+  {
+    std::string const forwarder = index.GetForwarder(ordinal_number);
+    std::string::size_type const split_pos = forwarder.rfind('.');
+    if (split_pos == std::string::npos)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid forwarder string format."});
+    }
+
+    StringView const forwarder_view{forwarder};
+    return GetProcAddressFromForwarder(process,
+                                       forwarder_view.substr(0, split_pos),
+                                       forwarder_view.substr(split_pos + 1));
+  }
+
+  DWORD const rva = index.GetFunctionRva(ordinal_number);
+  if (!rva)
+  {
+    return nullptr;
+  }
+
+  return AliasCast<FARPROC>(RvaToVa(process, pe_file, rva));
+}
+
+// NameOrOrdinalT is either a name or a (biased) procedure number.
+template <typename NameOrOrdinalT>
+inline FARPROC GetProcAddressInternalImpl(Process const& process,
+                                          HMODULE module,
+                                          NameOrOrdinalT const& name_or_ordinal)
 {
   HADESMEM_DETAIL_STATIC_ASSERT(sizeof(FARPROC) == sizeof(void*));
 
+  // Not a local buffer (PeFileFlags::kLocalBuffer), even in our own process
+  // (e.g. Cerberus resolving the functions it hooks). A loaded image isn't
+  // guaranteed to be readable in its entirety, and another thread can unload
+  // the module under us, so a bad page has to be an exception rather than a
+  // crash in the host. ExportIndex reads the export directory in bulk anyway,
+  // so there would be little left to save.
   PeFile const pe_file{process, module, PeFileType::kImage, 0};
 
-  ExportList const exports{process, pe_file};
-  auto const iter = std::find_if(std::begin(exports), std::end(exports), pred);
-  if (iter != std::end(exports))
+  // Modules without an export directory (or with one we can't parse) are
+  // treated the same as a module which doesn't export the function.
+  std::shared_ptr<ExportIndex const> index;
+  try
+  {
+    index = GetExportIndexCache().Get(process, pe_file);
+  }
+  catch (Error const& /*e*/)
   {
-    return GetProcAddressFromExport(process, *iter);
+    return nullptr;
   }
 
-  return nullptr;
+  WORD ordinal_number = 0;
+  if (!index->FindOrdinalNumber(name_or_ordinal, &ordinal_number))
+  {
+    return nullptr;
+  }
+
+  return GetProcAddressFromIndex(process, pe_file, *index, ordinal_number);
 }
 
 inline FARPROC GetProcAddressInternal(Process const& process,
                                       HMODULE module,
                                       std::string const& name)
 {
-  auto const pred = [&](Export const& e) {
-    return e.ByName() && e.GetName() == name;
-  };
-  return GetProcAddressInternalFromPred(process, module, pred);
+  return GetProcAddressInternalImpl(process, module, name);
 }
 
 inline FARPROC
   GetProcAddressInternal(Process const& process, HMODULE module, WORD ordinal)
 {
-  auto const pred = [&](Export const& e) {
-    return e.ByOrdinal() && e.GetProcedureNumber() == ordinal;
-  };
-  return GetProcAddressInternalFromPred(process, module, pred);
+  return GetProcAddressInternalImpl(process, module, ordinal);
 }
 
 inline FARPROC GetProcAddressFromExport(Process const& process, Export const& e)
 {
   if (e.IsForwarded())
   {
-    auto forwarder_module_name = e.GetForwarderModule();
-    // TODO: What is the correct logic here? Remember we don't want to get
-    // fooled by seeing Foo.DLL.DLL instead of Foo.DLL or something stupid like
-    // that...
-    forwarder_module_name = forwarder_module_name.find('.') != std::string::npos
-                              ? forwarder_module_name
-                              : (forwarder_module_name + ".DLL");
-    Module const forwarder_module{process,
-                                  MultiByteToWideChar(forwarder_module_name)};
-    if (e.IsForwardedByOrdinal())
-    {
-      return GetProcAddressInternal(
-        process, forwarder_module.GetHandle(), e.GetForwarderOrdinal());
-    }
-    else
-    {
-      return GetProcAddressInternal(
-        process, forwarder_module.GetHandle(), e.GetForwarderFunction());
-    }
+    return GetProcAddressFromForwarder(
+      process, e.GetForwarderModuleView(), e.GetForwarderFunctionView());
   }
 
   return AliasCast<FARPROC>(e.GetVa());
@@ -0,0 +1,271 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/error.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+// A read-only view of part of a MappedFile. Pages are only brought in when they
+// are touched, and are backed by the file rather than the page file, so they
+// can be discarded under memory pressure. A view remains valid after the
+// MappedFile it came from has been destroyed.
+class MappedFileView
+{
+public:
+  MappedFileView() = default;
+
+  explicit MappedFileView(SmartMappedFileHandle&& view,
+                          std::size_t adjust,
+                          std::size_t size) noexcept
+    : view_{std::move(view)}, adjust_{adjust}, size_{size}
+  {
+  }
+
+  MappedFileView(MappedFileView&& other) noexcept
+    : view_{std::move(other.view_)},
+      adjust_{other.adjust_},
+      size_{other.size_}
+  {
+  }
+
+  MappedFileView& operator=(MappedFileView&& other) noexcept
+  {
+    view_ = std::move(other.view_);
+    adjust_ = other.adjust_;
+    size_ = other.size_;
+    return *this;
+  }
+
+  // Non-const for convenience with APIs such as PeFile, however the view is
+  // read-only so any attempt to write through it will fault.
+  void* GetBase() const noexcept
+  {
+    return static_cast<std::uint8_t*>(view_.GetHandle()) + adjust_;
+  }
+
+  std::size_t GetSize() const noexcept
+  {
+    return size_;
+  }
+
+private:
+  SmartMappedFileHandle view_;
+  std::size_t adjust_{};
+  std::size_t size_{};
+};
+
+// Read-only file mapping with 64-bit sizes. Unlike reading the file into a
+// buffer, nothing is committed up front, and files which are too large to map
+// in their entirety (e.g. multi-GB files in a 32-bit process) can be accessed
+// a window at a time.
+// The file is opened without FILE_SHARE_WRITE, so it can't be truncated while
+// it's mapped. However touching a view of a file on a network share or
+// removable media raises EXCEPTION_IN_PAGE_ERROR (rather than throwing) if the
+// device goes away, so callers should use Read for files where IsLocal is
+// false.
+class MappedFile
+{
+public:
+  explicit MappedFile(std::wstring const& path)
+    : file_{::CreateFileW(path.c_str(),
+                          GENERIC_READ,
+                          FILE_SHARE_READ,
+                          nullptr,
+                          OPEN_EXISTING,
+                          FILE_FLAG_RANDOM_ACCESS,
+                          nullptr)}
+  {
+    if (!file_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"CreateFileW failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    LARGE_INTEGER size{};
+    if (!::GetFileSizeEx(file_.GetHandle(), &size))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"GetFileSizeEx failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    // Can't map an empty file.
+    if (size.QuadPart <= 0)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Empty or invalid file."});
+    }
+
+    size_ = static_cast<std::uint64_t>(size.QuadPart);
+
+    // Anything we can't identify is assumed not to be local.
+    std::vector<wchar_t> volume_path(
+      (std::max)(path.size(), static_cast<std::size_t>(MAX_PATH)) + 1);
+    if (::GetVolumePathNameW(path.c_str(),
+                             volume_path.data(),
+                             static_cast<DWORD>(volume_path.size())))
+    {
+      UINT const drive_type = ::GetDriveTypeW(volume_path.data());
+      is_local_ = drive_type == DRIVE_FIXED || drive_type == DRIVE_RAMDISK;
+    }
+
+    mapping_ = SmartHandle{::CreateFileMappingW(
+      file_.GetHandle(), nullptr, PAGE_READONLY, 0, 0, nullptr)};
+    if (!mapping_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"CreateFileMappingW failed."}
+                << ErrorCodeWinLast{last_error});
+    }
+  }
+
+  std::uint64_t GetSize() const noexcept
+  {
+    return size_;
+  }
+
+  // Whether the file is on a fixed local drive, and so can safely be accessed
+  // through a view.
+  bool IsLocal() const noexcept
+  {
+    return is_local_;
+  }
+
+  // Maps [offset, offset + size) of the file, clamped to the end of the file.
+  // The offset does not need to be aligned to anything.
+  MappedFileView MapView(std::uint64_t offset, std::size_t size) const
+  {
+    if (offset >= size_ || !size)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid view offset or size."});
+    }
+
+    if (size > size_ - offset)
+    {
+      size = static_cast<std::size_t>(size_ - offset);
+    }
+
+    SYSTEM_INFO sys_info{};
+    ::GetSystemInfo(&sys_info);
+    std::uint64_t const granularity = sys_info.dwAllocationGranularity;
+    std::uint64_t const aligned_offset = offset - (offset % granularity);
+    auto const adjust = static_cast<std::size_t>(offset - aligned_offset);
+    if (size > (std::numeric_limits<std::size_t>::max)() - adjust)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Invalid view size."});
+    }
+
+    SmartMappedFileHandle view{
+      ::MapViewOfFile(mapping_.GetHandle(),
+                      FILE_MAP_READ,
+                      static_cast<DWORD>(aligned_offset >> 32),
+                      static_cast<DWORD>(aligned_offset & 0xFFFFFFFFUL),
+                      size + adjust)};
+    if (!view.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"MapViewOfFile failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    return MappedFileView{std::move(view), adjust, size};
+  }
+
+  // Maps as much of the start of the file as a PeFile can address. PE offsets
+  // and sizes are 32-bit, so anything past that is overlay data which PeLib
+  // never looks at.
+  MappedFileView MapPeView() const
+  {
+    std::uint64_t const max_size = (std::numeric_limits<DWORD>::max)();
+    return MapView(0, static_cast<std::size_t>((std::min)(size_, max_size)));
+  }
+
+  // Reads [offset, offset + size) of the file into a buffer, clamped to the
+  // end of the file. Unlike touching a view, a read which fails (e.g. the
+  // share has gone away) is reported as an error.
+  std::vector<char> Read(std::uint64_t offset, std::size_t size) const
+  {
+    if (offset >= size_ || !size)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid read offset or size."});
+    }
+
+    if (size > size_ - offset)
+    {
+      size = static_cast<std::size_t>(size_ - offset);
+    }
+
+    std::vector<char> buf(size);
+    for (std::size_t done = 0; done < size;)
+    {
+      std::uint64_t const cur = offset + done;
+      OVERLAPPED overlapped{};
+      overlapped.Offset = static_cast<DWORD>(cur & 0xFFFFFFFFUL);
+      overlapped.OffsetHigh = static_cast<DWORD>(cur >> 32);
+      auto const len = static_cast<DWORD>(
+        (std::min)(size - done, static_cast<std::size_t>(kMaxReadSize)));
+      DWORD num_read = 0;
+      if (!::ReadFile(
+            file_.GetHandle(), buf.data() + done, len, &num_read, &overlapped))
+      {
+        DWORD const last_error = ::GetLastError();
+        HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                        << ErrorString{"ReadFile failed."}
+                                        << ErrorCodeWinLast{last_error});
+      }
+
+      if (!num_read)
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Unexpected end of file."});
+      }
+
+      done += num_read;
+    }
+
+    return buf;
+  }
+
+  // Reads the same part of the file as MapPeView.
+  std::vector<char> ReadPe() const
+  {
+    std::uint64_t const max_size = (std::numeric_limits<DWORD>::max)();
+    return Read(0, static_cast<std::size_t>((std::min)(size_, max_size)));
+  }
+
+private:
+  // Maximum number of bytes read by each ReadFile call.
+  static DWORD const kMaxReadSize = 0x1000000;
+
+  SmartFileHandle file_;
+  SmartHandle mapping_;
+  std::uint64_t size_{};
+  bool is_local_{};
+};
+}
+}
@@ -0,0 +1,177 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/detail/type_traits.hpp>
+#include <hadesmem/error.hpp>
+
+// TODO: Remove the dependency on config.hpp and error.hpp (and therefore
+// windows.h) so this can be used by OS-independent code.
+
+namespace hadesmem
+{
+namespace detail
+{
+// Non-owning view of a buffer in our own address space (e.g. a file which has
+// been read or mapped into memory). Reads are bounds-checked plain loads, so
+// there is no need to go through VirtualQueryEx/ReadProcessMemory/etc. The
+// caller is responsible for ensuring the entire buffer is committed and
+// readable for the lifetime of the span.
+class MemorySpan
+{
+public:
+  MemorySpan() noexcept = default;
+
+  explicit MemorySpan(void const* base, std::size_t size) noexcept
+    : base_{static_cast<std::uint8_t const*>(base)}, size_{size}
+  {
+    HADESMEM_DETAIL_ASSERT(base_ != nullptr || !size_);
+  }
+
+  bool IsValid() const noexcept
+  {
+    return base_ != nullptr;
+  }
+
+  void const* GetBase() const noexcept
+  {
+    return base_;
+  }
+
+  void const* GetEnd() const noexcept
+  {
+    return base_ + size_;
+  }
+
+  std::size_t GetSize() const noexcept
+  {
+    return size_;
+  }
+
+  bool Contains(void const* address, std::size_t len = 1) const noexcept
+  {
+    auto const p = static_cast<std::uint8_t const*>(address);
+    // Written to avoid any pointer arithmetic outside the buffer (and overflow
+    // when len is attacker controlled).
+    return p >= base_ && p <= base_ + size_ &&
+           len <= static_cast<std::size_t>((base_ + size_) - p);
+  }
+
+  void Read(void const* address, void* data, std::size_t len) const
+  {
+    HADESMEM_DETAIL_ASSERT(data != nullptr || !len);
+
+    if (!len)
+    {
+      return;
+    }
+
+    if (!Contains(address, len))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Attempt to read outside of memory span."});
+    }
+
+    std::memcpy(data, address, len);
+  }
+
+  template <typename T> T Read(void const* address) const
+  {
+    HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+    HADESMEM_DETAIL_STATIC_ASSERT(std::is_default_constructible<T>::value);
+
+    T data;
+    Read(address, std::addressof(data), sizeof(data));
+    return data;
+  }
+
+  template <typename T, typename Alloc = std::allocator<T>>
+  std::vector<T, Alloc> ReadVector(void const* address, std::size_t count) const
+  {
+    HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+    HADESMEM_DETAIL_STATIC_ASSERT(std::is_default_constructible<T>::value);
+
+    if (!count)
+    {
+      return {};
+    }
+
+    if (count > static_cast<std::size_t>(-1) / sizeof(T))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Attempt to read outside of memory span."});
+    }
+
+    std::vector<T, Alloc> data(count);
+    Read(address, data.data(), count * sizeof(T));
+    return data;
+  }
+
+  // Returns the number of characters before the terminator (or the end of the
+  // span/upper bound if there is no terminator). Throws if the string does not
+  // start inside the span.
+  template <typename CharT>
+  std::size_t GetStringLength(void const* address,
+                              void const* upper_bound = nullptr) const
+  {
+    HADESMEM_DETAIL_STATIC_ASSERT(detail::IsCharType<CharT>::value);
+
+    if (!Contains(address, sizeof(CharT)))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Attempt to read outside of memory span."});
+    }
+
+    auto const beg = static_cast<std::uint8_t const*>(address);
+    auto end = base_ + size_;
+    if (upper_bound && Contains(upper_bound, 0))
+    {
+      end = (std::max)(beg, static_cast<std::uint8_t const*>(upper_bound));
+    }
+
+    std::size_t const max_len =
+      static_cast<std::size_t>(end - beg) / sizeof(CharT);
+    for (std::size_t i = 0; i < max_len; ++i)
+    {
+      CharT c;
+      std::memcpy(&c, beg + i * sizeof(CharT), sizeof(c));
+      if (c == CharT())
+      {
+        return i;
+      }
+    }
+
+    return max_len;
+  }
+
+  template <typename CharT,
+            typename Traits = std::char_traits<CharT>,
+            typename Alloc = std::allocator<CharT>>
+  std::basic_string<CharT, Traits, Alloc>
+    ReadString(void const* address, void const* upper_bound = nullptr) const
+  {
+    std::size_t const len = GetStringLength<CharT>(address, upper_bound);
+    std::basic_string<CharT, Traits, Alloc> data(len, CharT());
+    Read(address, &data[0], len * sizeof(CharT));
+    return data;
+  }
+
+private:
+  std::uint8_t const* base_{};
+  std::size_t size_{};
+};
+}
+}
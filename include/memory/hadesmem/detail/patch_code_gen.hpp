@@ -16,6 +16,7 @@
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/patch_detour_stub.hpp>
 #include <hadesmem/detail/scope_warden.hpp>
+#include <hadesmem/detail/trampoline_heap.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/type_traits.hpp>
 #include <hadesmem/detail/winternl.hpp>
@@ -44,91 +45,10 @@ struct PatchConstants
 #else
 #error "[HadesMem] Unsupported architecture."
 #endif
+  // Enough for the largest stub gate plus the jump to the stub.
+  static std::size_t const kStubGateSize = 0x100;
 };
 
-// Inspired by EasyHook.
-inline std::unique_ptr<Allocator> AllocatePageNear(Process const& process,
-                                                   void* address)
-{
-  SYSTEM_INFO sys_info{};
-  GetSystemInfo(&sys_info);
-  DWORD const page_size = sys_info.dwPageSize;
-
-#if defined(HADESMEM_DETAIL_ARCH_X64)
-  std::intptr_t const search_beg = (std::max)(
-    reinterpret_cast<std::intptr_t>(address) - 0x7FFFFF00LL,
-    reinterpret_cast<std::intptr_t>(sys_info.lpMinimumApplicationAddress));
-  std::intptr_t const search_end = (std::min)(
-    reinterpret_cast<std::intptr_t>(address) + 0x7FFFFF00LL,
-    reinterpret_cast<std::intptr_t>(sys_info.lpMaximumApplicationAddress));
-
-  std::unique_ptr<Allocator> trampoline;
-
-  auto const allocate_tramp = [](Process const& process,
-                                 PVOID addr,
-                                 SIZE_T size) -> std::unique_ptr<Allocator> {
-    auto const new_addr = detail::TryAlloc(process, size, addr);
-    return new_addr ? std::make_unique<Allocator>(process, size, new_addr, true)
-                    : std::unique_ptr<Allocator>();
-  };
-
-  // NOTE: The issue described below now appears to be fixed (the mov is now a
-  // movsxd), but it doesn't hurt to keep the logic this way (especially since
-  // it's a fairly generic problem that other hooking libraries are likely to
-  // have at some point or another).
-  // Do two separate passes when looking for trampolines, ensuring to scan
-  // forwards first. This is because there is a bug in Steam's overlay (last
-  // checked and confirmed in SteamOverlayRender64.dll v2.50.25.37) where
-  // negative displacements are not correctly sign-extended when cast to
-  // 64-bits, resulting in a crash when they attempt to resolve the jump.
-  // .text:0000000180082956                 cmp     al, 0FFh
-  // .text:0000000180082958                 jnz     short loc_180082971
-  // .text:000000018008295A                 cmp     byte ptr [r13+1], 25h
-  // .text:000000018008295F                 jnz     short loc_180082971
-  // ; Notice how the displacement is not being sign extended.
-  // .text:0000000180082961                 mov     eax, [r13+2]
-  // .text:0000000180082965                 lea     rcx, [rax+r13]
-  // .text:0000000180082969                 mov     r13, [rcx+6]
-
-  for (std::intptr_t base = reinterpret_cast<std::intptr_t>(address), index = 0;
-       base + index < search_end && !trampoline;
-       index += page_size)
-  {
-    trampoline =
-      allocate_tramp(process, reinterpret_cast<void*>(base + index), page_size);
-  }
-
-  if (!trampoline)
-  {
-    HADESMEM_DETAIL_TRACE_A(
-      "WARNING! Failed to find a viable trampoline "
-      "page in forward scan, falling back to backward scan. This may cause "
-      "incompatibilty with some other overlays.");
-  }
-
-  for (std::intptr_t base = reinterpret_cast<std::intptr_t>(address), index = 0;
-       base - index > search_beg && !trampoline;
-       index += page_size)
-  {
-    trampoline =
-      allocate_tramp(process, reinterpret_cast<void*>(base - index), page_size);
-  }
-
-  if (!trampoline)
-  {
-    HADESMEM_DETAIL_THROW_EXCEPTION(
-      Error{} << ErrorString{"Failed to find trampoline memory block."});
-  }
-
-  return trampoline;
-#elif defined(HADESMEM_DETAIL_ARCH_X86)
-  (void)address;
-  return std::make_unique<Allocator>(process, page_size);
-#else
-#error "[HadesMem] Unsupported architecture."
-#endif
-}
-
 inline bool IsNear(void* address, void* target) noexcept
 {
 #if defined(HADESMEM_DETAIL_ARCH_X64)
@@ -239,12 +159,14 @@ inline std::vector<std::uint8_t> GenPush64Ret(void* target)
   return buf;
 }
 
-inline std::size_t
-  WriteJump(Process const& process,
-            void* address,
-            void* target,
-            bool push_ret_fallback,
-            std::vector<std::unique_ptr<Allocator>>* trampolines)
+// Generates the jump that WriteJump would write, without writing it (though a
+// trampoline the jump goes through is allocated and written).
+inline std::vector<std::uint8_t>
+  GenJump(Process const& process,
+          void* address,
+          void* target,
+          bool push_ret_fallback,
+          std::vector<std::unique_ptr<TrampolineBlock>>* trampolines)
 {
   HADESMEM_DETAIL_TRACE_FORMAT_A(
     "Address = %p, Target = %p, Push Ret Fallback = %u.",
@@ -263,13 +185,14 @@ inline std::size_t
   }
   else
   {
-    std::unique_ptr<Allocator> trampoline;
+    std::unique_ptr<TrampolineBlock> trampoline;
 
     if (trampolines)
     {
       try
       {
-        trampoline = AllocatePageNear(process, address);
+        trampoline =
+          AllocateTrampolineNear(process, address, sizeof(void*));
       }
       catch (std::exception const& /*e*/)
       {
@@ -331,6 +254,19 @@ inline std::size_t
 #error "[HadesMem] Unsupported architecture."
 #endif
 
+  return jump_buf;
+}
+
+inline std::size_t
+  WriteJump(Process const& process,
+            void* address,
+            void* target,
+            bool push_ret_fallback,
+            std::vector<std::unique_ptr<TrampolineBlock>>* trampolines)
+{
+  auto const jump_buf =
+    GenJump(process, address, target, push_ret_fallback, trampolines);
+
   WriteVector(process, address, jump_buf);
 
   return jump_buf.size();
@@ -340,7 +276,7 @@ inline std::size_t
   WriteCall(Process const& process,
             void* address,
             void* target,
-            std::vector<std::unique_ptr<Allocator>>& trampolines)
+            std::vector<std::unique_ptr<TrampolineBlock>>& trampolines)
 {
   HADESMEM_DETAIL_TRACE_FORMAT_A("Address = %p, Target = %p", address, target);
 
@@ -348,7 +284,8 @@ inline std::size_t
 
 // TODO: Avoid using a trampoline where possible.
 #if defined(HADESMEM_DETAIL_ARCH_X64)
-  std::unique_ptr<Allocator> trampoline = AllocatePageNear(process, address);
+  std::unique_ptr<TrampolineBlock> trampoline =
+    AllocateTrampolineNear(process, address, sizeof(void*));
 
   PVOID tramp_addr = trampoline->GetBase();
 
@@ -560,6 +497,15 @@ inline void WriteStubGate(Process const& process,
     GenStubGate32(stub, get_orig_user_ptr_ptr_fn, get_ret_address_ptr_ptr_fn);
 #else
 #error "[HadesMem] Unsupported architecture."
+#endif
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  HADESMEM_DETAIL_ASSERT(stub_gate.size() + PatchConstants::kPushRetSize64 <=
+                         PatchConstants::kStubGateSize);
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+  HADESMEM_DETAIL_ASSERT(stub_gate.size() + PatchConstants::kJmpSize32 <=
+                         PatchConstants::kStubGateSize);
+#else
+#error "[HadesMem] Unsupported architecture."
 #endif
   WriteVector(process, address, stub_gate);
   WriteJump(process,
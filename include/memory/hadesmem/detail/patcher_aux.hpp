@@ -3,12 +3,20 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <initializer_list>
+#include <set>
+#include <utility>
+#include <vector>
 
 #include <windows.h>
 
+#include <hadesmem/detail/protect_guard.hpp>
+#include <hadesmem/detail/query_region.hpp>
 #include <hadesmem/detail/thread_aux.hpp>
 #include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
 #include <hadesmem/thread_list.hpp>
 #include <hadesmem/thread_helpers.hpp>
 
@@ -38,5 +46,121 @@ inline void VerifyPatchThreads(DWORD pid, void* target, std::size_t len)
     }
   }
 }
+
+// Same as above, but for threads which have already been suspended, so that
+// nothing needs to be allocated (or thrown) while they are, as one of them may
+// be holding the heap lock. Returns the ID of the first thread which is
+// executing one of the ranges (or whose context couldn't be read, in which
+// case last_error is set), or zero if there isn't one.
+inline DWORD FindThreadInPatchRanges(
+  SuspendedProcess const& suspended_process,
+  std::vector<std::pair<void*, std::size_t>> const& ranges,
+  DWORD& last_error) noexcept
+{
+  last_error = ERROR_SUCCESS;
+  for (auto const& thread : suspended_process.GetThreads())
+  {
+    CONTEXT context{};
+    context.ContextFlags = CONTEXT_CONTROL;
+    if (!::GetThreadContext(thread.GetHandle(), &context))
+    {
+      last_error = ::GetLastError();
+      return thread.GetId();
+    }
+
+    auto const ip = GetThreadContextIp(context);
+    for (auto const& range : ranges)
+    {
+      auto const beg = reinterpret_cast<std::uintptr_t>(range.first);
+      if (ip >= beg && ip - beg < range.second)
+      {
+        return thread.GetId();
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Reports a thread found by FindThreadInPatchRanges, once the threads have
+// been resumed.
+inline void ThrowThreadInPatchRanges(DWORD last_error)
+{
+  if (last_error != ERROR_SUCCESS)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"GetThreadContext failed."}
+                                    << ErrorCodeWinLast{last_error});
+  }
+
+  HADESMEM_DETAIL_THROW_EXCEPTION(
+    Error{} << ErrorString{"Thread is currently executing patch target."});
+}
+
+// Makes every region touched by the ranges writable, so the patches can be
+// written with WriteUncheckedNoThrow while other threads are suspended. Must be
+// called before suspending them, as it may throw. Each region is only changed
+// once however many patches it holds (e.g. hooking a large number of functions
+// in ntdll is one change rather than one per function). Restored when the
+// guards are destroyed.
+inline std::vector<ProtectGuard> ProtectPatchRanges(
+  Process const& process,
+  std::vector<std::pair<void*, std::size_t>> const& ranges)
+{
+  std::vector<MEMORY_BASIC_INFORMATION> regions;
+  std::set<void*> bases;
+  for (auto const& range : ranges)
+  {
+    if (!range.second)
+    {
+      continue;
+    }
+
+    // A patch may straddle two regions.
+    void* const range_last =
+      static_cast<std::uint8_t*>(range.first) + range.second - 1;
+    for (auto const address : {range.first, range_last})
+    {
+      auto const mbi = Query(process, address);
+      if (bases.insert(mbi.BaseAddress).second)
+      {
+        regions.push_back(mbi);
+      }
+    }
+  }
+
+  std::vector<ProtectGuard> guards;
+  guards.reserve(regions.size());
+  for (auto const& mbi : regions)
+  {
+    guards.emplace_back(process, mbi, ProtectGuardType::kWrite);
+  }
+
+  return guards;
+}
+
+// WriteUncheckedNoThrow leaves the read cache and region map alone, as
+// invalidating them may allocate. Once the threads have been resumed (and the
+// guards from ProtectPatchRanges restored), this drops anything they hold for
+// the patched ranges.
+inline void InvalidatePatchRanges(
+  Process const& process,
+  std::vector<std::pair<void*, std::size_t>> const& ranges)
+{
+  for (auto const& range : ranges)
+  {
+    process.InvalidateReadCache(range.first, range.second);
+    process.InvalidateRegionMap(range.first, range.second);
+  }
+}
+
+// Reports a write which failed while the threads were suspended, once they
+// have been resumed.
+inline void ThrowPatchWriteFailed(DWORD last_error)
+{
+  HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                  << ErrorString{"WriteProcessMemory failed."}
+                                  << ErrorCodeWinLast{last_error});
+}
 }
 }
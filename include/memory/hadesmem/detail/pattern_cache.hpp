@@ -0,0 +1,259 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <pugixml.hpp>
+#include <pugixml.cpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/pugixml_helpers.hpp>
+#include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/error.hpp>
+
+// TODO: Optionally validate against a hash of the in-memory sections too, for
+// packed modules whose code is only decrypted at runtime (the file hashes can't
+// see changes to those).
+
+// TODO: Share a single cache file between multiple processes safely (file
+// locking, or write to a temporary file and rename over the original).
+
+namespace hadesmem
+{
+namespace detail
+{
+struct PatternCacheRegion
+{
+  std::wstring hash;
+  DWORD size;
+};
+
+// The raw match (i.e. before any manipulators are applied or the address is
+// made relative) is stored, so that manipulators which depend on the current
+// state of the process (e.g. Lea) are still re-evaluated on every run.
+struct PatternCacheEntry
+{
+  std::wstring data;
+  std::uint32_t flags;
+  std::uintptr_t start_rva;
+  bool found;
+  std::size_t region;
+  std::uintptr_t rva;
+};
+
+struct PatternCacheModule
+{
+  DWORD time_date_stamp;
+  DWORD size_of_image;
+  std::uint64_t file_size;
+  std::uint64_t last_write_time;
+  std::vector<PatternCacheRegion> code_regions;
+  std::vector<PatternCacheRegion> data_regions;
+  std::map<std::wstring, PatternCacheEntry> patterns;
+};
+
+// On-disk cache of FindPattern results, keyed by module name and validated
+// against the module's headers and per-section hashes. The cache is purely an
+// optimization, so a missing, corrupt, or out of date file just results in an
+// empty cache (and everything being rescanned) rather than an error.
+class PatternCache
+{
+public:
+  static std::uint32_t const kVersion = 1;
+
+  void Load(std::wstring const& path)
+  {
+    modules_.clear();
+
+    if (!DoesFileExist(path))
+    {
+      return;
+    }
+
+    try
+    {
+      LoadImpl(path);
+    }
+    catch (std::exception const& /*e*/)
+    {
+      modules_.clear();
+    }
+  }
+
+  void Save(std::wstring const& path) const
+  {
+    pugi::xml_document doc;
+    auto root = doc.append_child(L"HadesMemPatternCache");
+    root.append_attribute(L"Version") = NumToStr<wchar_t>(kVersion).c_str();
+
+    for (auto const& module_pair : modules_)
+    {
+      auto const& module = module_pair.second;
+      auto module_node = root.append_child(L"Module");
+      // Same as the pattern file, the main module has no name.
+      if (!module_pair.first.empty())
+      {
+        module_node.append_attribute(L"Name") = module_pair.first.c_str();
+      }
+      module_node.append_attribute(L"TimeDateStamp") =
+        NumToStr<wchar_t>(module.time_date_stamp, true).c_str();
+      module_node.append_attribute(L"SizeOfImage") =
+        NumToStr<wchar_t>(module.size_of_image, true).c_str();
+      module_node.append_attribute(L"FileSize") =
+        NumToStr<wchar_t>(module.file_size, true).c_str();
+      module_node.append_attribute(L"LastWriteTime") =
+        NumToStr<wchar_t>(module.last_write_time, true).c_str();
+
+      SaveRegions(module_node, L"Code", module.code_regions);
+      SaveRegions(module_node, L"Data", module.data_regions);
+
+      for (auto const& pattern_pair : module.patterns)
+      {
+        auto const& pattern = pattern_pair.second;
+        auto pattern_node = module_node.append_child(L"Pattern");
+        pattern_node.append_attribute(L"Name") = pattern_pair.first.c_str();
+        pattern_node.append_attribute(L"Data") = pattern.data.c_str();
+        pattern_node.append_attribute(L"Flags") =
+          NumToStr<wchar_t>(pattern.flags, true).c_str();
+        pattern_node.append_attribute(L"StartRVA") =
+          NumToStr<wchar_t>(pattern.start_rva, true).c_str();
+        if (pattern.found)
+        {
+          pattern_node.append_attribute(L"Region") =
+            NumToStr<wchar_t>(pattern.region, true).c_str();
+          pattern_node.append_attribute(L"RVA") =
+            NumToStr<wchar_t>(pattern.rva, true).c_str();
+        }
+      }
+    }
+
+    if (!doc.save_file(path.c_str()))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Saving pattern cache failed."});
+    }
+  }
+
+  PatternCacheModule const* GetModule(std::wstring const& name) const
+  {
+    auto const iter = modules_.find(name);
+    return iter != std::end(modules_) ? &iter->second : nullptr;
+  }
+
+  void SetModule(std::wstring const& name, PatternCacheModule&& module)
+  {
+    modules_[name] = std::move(module);
+  }
+
+private:
+  void LoadImpl(std::wstring const& path)
+  {
+    pugi::xml_document doc;
+    if (!doc.load_file(path.c_str()))
+    {
+      return;
+    }
+
+    auto const root = doc.child(L"HadesMemPatternCache");
+    if (!root || StrToNum<std::uint32_t>(pugixml::GetAttributeValue(
+                   root, L"Version")) != kVersion)
+    {
+      return;
+    }
+
+    for (auto const& module_node : root.children(L"Module"))
+    {
+      PatternCacheModule module{};
+      module.time_date_stamp =
+        ReadHexAttribute<DWORD>(module_node, L"TimeDateStamp");
+      module.size_of_image =
+        ReadHexAttribute<DWORD>(module_node, L"SizeOfImage");
+      module.file_size =
+        ReadHexAttribute<std::uint64_t>(module_node, L"FileSize");
+      module.last_write_time =
+        ReadHexAttribute<std::uint64_t>(module_node, L"LastWriteTime");
+
+      for (auto const& region_node : module_node.children(L"Region"))
+      {
+        auto const type = pugixml::GetAttributeValue(region_node, L"Type");
+        PatternCacheRegion region{
+          pugixml::GetAttributeValue(region_node, L"Sha1"),
+          ReadHexAttribute<DWORD>(region_node, L"Size")};
+        if (type == L"Code")
+        {
+          module.code_regions.emplace_back(std::move(region));
+        }
+        else if (type == L"Data")
+        {
+          module.data_regions.emplace_back(std::move(region));
+        }
+        else
+        {
+          HADESMEM_DETAIL_THROW_EXCEPTION(
+            Error{} << ErrorString{"Unknown 'Type' value."});
+        }
+      }
+
+      for (auto const& pattern_node : module_node.children(L"Pattern"))
+      {
+        PatternCacheEntry pattern{};
+        pattern.data = pugixml::GetAttributeValue(pattern_node, L"Data");
+        pattern.flags =
+          ReadHexAttribute<std::uint32_t>(pattern_node, L"Flags");
+        pattern.start_rva =
+          ReadHexAttribute<std::uintptr_t>(pattern_node, L"StartRVA");
+        pattern.found = !!pattern_node.attribute(L"RVA");
+        if (pattern.found)
+        {
+          pattern.region =
+            ReadHexAttribute<std::size_t>(pattern_node, L"Region");
+          pattern.rva = ReadHexAttribute<std::uintptr_t>(pattern_node, L"RVA");
+        }
+
+        module.patterns[pugixml::GetAttributeValue(pattern_node, L"Name")] =
+          std::move(pattern);
+      }
+
+      modules_[pugixml::GetOptionalAttributeValue(module_node, L"Name")] =
+        std::move(module);
+    }
+  }
+
+  template <typename T>
+  static T ReadHexAttribute(pugi::xml_node const& node,
+                            std::wstring const& name)
+  {
+    return StrToNum<T>(pugixml::GetAttributeValue(node, name), true);
+  }
+
+  static void SaveRegions(pugi::xml_node& module_node,
+                          wchar_t const* type,
+                          std::vector<PatternCacheRegion> const& regions)
+  {
+    for (auto const& region : regions)
+    {
+      auto region_node = module_node.append_child(L"Region");
+      region_node.append_attribute(L"Type") = type;
+      region_node.append_attribute(L"Sha1") = region.hash.c_str();
+      region_node.append_attribute(L"Size") =
+        NumToStr<wchar_t>(region.size, true).c_str();
+    }
+  }
+
+  std::map<std::wstring, PatternCacheModule> modules_;
+};
+}
+}
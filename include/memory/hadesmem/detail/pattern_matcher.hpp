@@ -0,0 +1,522 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+#include <intrin.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+
+// TODO: Use the frequency of bytes in the actual haystack (or at least the
+// module being scanned) rather than a static table when choosing anchors.
+
+// TODO: AVX-512 path.
+
+// TODO: Aligned loads for the anchor compares (peel the first few bytes).
+
+namespace hadesmem
+{
+namespace detail
+{
+// A mask of 0xFF is an exact match, 0x00 is a full wildcard, and 0x0F/0xF0 are
+// nibble wildcards. Data is always stored pre-masked.
+struct PatternDataByte
+{
+  std::uint8_t data;
+  std::uint8_t mask;
+};
+
+struct PatternMatcherFlags
+{
+  enum : std::uint32_t
+  {
+    kNone = 0,
+    kNoAvx2 = 1 << 0,
+    kNoSimd = 1 << 1,
+    kInvalidFlagMaxValue = 1 << 2
+  };
+};
+
+inline bool IsSse2Supported() noexcept
+{
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  return true;
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+  return !!::IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+}
+
+inline bool IsAvx2Supported() noexcept
+{
+  int cpu_info[4] = {};
+  __cpuid(cpu_info, 0);
+  if (cpu_info[0] < 7)
+  {
+    return false;
+  }
+
+  // OSXSAVE and AVX, then check the OS actually saves the YMM state.
+  __cpuid(cpu_info, 1);
+  int const kOsxsaveAvx = (1 << 27) | (1 << 28);
+  if ((cpu_info[2] & kOsxsaveAvx) != kOsxsaveAvx)
+  {
+    return false;
+  }
+
+  if ((_xgetbv(0) & 0x6) != 0x6)
+  {
+    return false;
+  }
+
+  __cpuidex(cpu_info, 7, 0);
+  return !!(cpu_info[1] & (1 << 5));
+}
+
+// Compiled search plan for a wildcard pattern. The rarest two exact bytes of
+// the needle are used as anchors, which are compared against 16 or 32
+// candidate positions at a time (similar to a vectorized memchr), and only
+// positions where both anchors match are verified with masked vector compares
+// against the full needle.
+class PatternMatcher
+{
+public:
+  template <typename NeedleIterator>
+  explicit PatternMatcher(NeedleIterator n_beg,
+                          NeedleIterator n_end,
+                          std::uint32_t flags = PatternMatcherFlags::kNone)
+  {
+    HADESMEM_DETAIL_ASSERT(
+      !(flags & ~(PatternMatcherFlags::kInvalidFlagMaxValue - 1UL)));
+
+    for (; n_beg != n_end; ++n_beg)
+    {
+      PatternDataByte const& cur = *n_beg;
+      data_.push_back(static_cast<std::uint8_t>(cur.data & cur.mask));
+      mask_.push_back(cur.mask);
+    }
+
+    size_ = data_.size();
+    HADESMEM_DETAIL_ASSERT(size_ != 0);
+
+    ChooseAnchors();
+
+    if (!(flags & PatternMatcherFlags::kNoSimd) && IsSse2Supported())
+    {
+      isa_ = Isa::kSse2;
+      if (!(flags & PatternMatcherFlags::kNoAvx2) && IsAvx2Supported())
+      {
+        isa_ = Isa::kAvx2;
+      }
+    }
+  }
+
+  std::size_t GetSize() const noexcept
+  {
+    return size_;
+  }
+
+  // Gets the rarest exact byte in the needle. Returns false if there are no
+  // exact bytes (i.e. the needle is entirely wildcards).
+  bool GetAnchor(std::size_t* offset, std::uint8_t* value) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(offset != nullptr && value != nullptr);
+
+    if (!num_anchors_)
+    {
+      return false;
+    }
+
+    *offset = anchors_[0];
+    *value = data_[anchors_[0]];
+    return true;
+  }
+
+  // Returns the first match in [beg, end), or nullptr if there is none.
+  std::uint8_t const* Search(std::uint8_t const* beg,
+                             std::uint8_t const* end) const
+  {
+    HADESMEM_DETAIL_ASSERT(beg <= end);
+
+    std::size_t const len = static_cast<std::size_t>(end - beg);
+    if (len < size_)
+    {
+      return nullptr;
+    }
+
+    std::size_t const num_positions = len - size_ + 1;
+    if (!num_anchors_)
+    {
+      return SearchNoAnchor(beg, num_positions);
+    }
+
+    std::size_t pos = 0;
+    std::uint8_t const* result = nullptr;
+    if (isa_ == Isa::kAvx2)
+    {
+      result = SearchAvx2(beg, num_positions, &pos);
+    }
+    else if (isa_ == Isa::kSse2)
+    {
+      result = SearchSse2(beg, num_positions, &pos);
+    }
+
+    return result ? result : SearchScalar(beg, num_positions, pos);
+  }
+
+  // Caller is responsible for ensuring there are at least GetSize() bytes
+  // readable at p.
+  bool Matches(std::uint8_t const* p) const noexcept
+  {
+    std::size_t i = 0;
+
+    if (isa_ != Isa::kScalar)
+    {
+      for (; i + 16 <= size_; i += 16)
+      {
+        __m128i const h =
+          _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+        __m128i const m =
+          _mm_loadu_si128(reinterpret_cast<__m128i const*>(&mask_[i]));
+        __m128i const d =
+          _mm_loadu_si128(reinterpret_cast<__m128i const*>(&data_[i]));
+        __m128i const eq = _mm_cmpeq_epi8(_mm_and_si128(h, m), d);
+        if (_mm_movemask_epi8(eq) != 0xFFFF)
+        {
+          return false;
+        }
+      }
+    }
+
+    return MatchesScalar(p, i);
+  }
+
+private:
+  enum class Isa
+  {
+    kScalar,
+    kSse2,
+    kAvx2
+  };
+
+  // Rough ranking of the most common bytes in x86/x64 code and data, most
+  // common first. Bytes not in the list are assumed to be rare.
+  static std::size_t GetByteCommonness(std::uint8_t b) noexcept
+  {
+    static std::uint8_t const kCommonBytes[] = {
+      0x00, 0xFF, 0xCC, 0x48, 0x8B, 0x89, 0x24, 0x4C, 0x44, 0x0F, 0x83, 0x01,
+      0x8D, 0xE8, 0x45, 0x85, 0xC0, 0x74, 0x41, 0x08, 0x10, 0x75, 0x33, 0xC3,
+      0x20, 0x90, 0x40, 0x49, 0x4D, 0x02, 0x04, 0x28, 0x18, 0x30, 0x50, 0xC7,
+      0x3B, 0x80, 0x84, 0xEB, 0x5C, 0x54, 0x8C, 0x38, 0x0C, 0xF8, 0xC9, 0xD2};
+    std::size_t const num_common =
+      sizeof(kCommonBytes) / sizeof(kCommonBytes[0]);
+    for (std::size_t i = 0; i < num_common; ++i)
+    {
+      if (kCommonBytes[i] == b)
+      {
+        return num_common - i;
+      }
+    }
+
+    return 0;
+  }
+
+  void ChooseAnchors()
+  {
+    // Prefer rare bytes, and on a tie prefer the first anchor to be as early
+    // and the second to be as late as possible, so the anchors are less
+    // likely to be correlated.
+    std::size_t best_score[2] = {static_cast<std::size_t>(-1),
+                                 static_cast<std::size_t>(-1)};
+    for (std::size_t i = 0; i < size_; ++i)
+    {
+      if (mask_[i] != 0xFF)
+      {
+        continue;
+      }
+
+      std::size_t const score = GetByteCommonness(data_[i]);
+      if (!num_anchors_ || score < best_score[0])
+      {
+        if (num_anchors_)
+        {
+          anchors_[1] = anchors_[0];
+          best_score[1] = best_score[0];
+        }
+        anchors_[0] = i;
+        best_score[0] = score;
+        num_anchors_ = num_anchors_ ? 2 : 1;
+      }
+      else if (num_anchors_ == 1 || score <= best_score[1])
+      {
+        anchors_[1] = i;
+        best_score[1] = score;
+        num_anchors_ = 2;
+      }
+    }
+
+    // Simplifies the scan loops.
+    if (num_anchors_ == 1)
+    {
+      anchors_[1] = anchors_[0];
+    }
+  }
+
+  bool MatchesScalar(std::uint8_t const* p, std::size_t i = 0) const noexcept
+  {
+    for (; i < size_; ++i)
+    {
+      if ((p[i] & mask_[i]) != data_[i])
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  std::uint8_t const* SearchNoAnchor(std::uint8_t const* beg,
+                                     std::size_t num_positions) const
+  {
+    for (std::size_t pos = 0; pos < num_positions; ++pos)
+    {
+      if (Matches(beg + pos))
+      {
+        return beg + pos;
+      }
+    }
+
+    return nullptr;
+  }
+
+  std::uint8_t const* SearchScalar(std::uint8_t const* beg,
+                                   std::size_t num_positions,
+                                   std::size_t pos) const
+  {
+    std::uint8_t const a0 = data_[anchors_[0]];
+    std::uint8_t const a1 = data_[anchors_[1]];
+    while (pos < num_positions)
+    {
+      auto const hit = static_cast<std::uint8_t const*>(std::memchr(
+        beg + pos + anchors_[0], a0, num_positions - pos));
+      if (!hit)
+      {
+        return nullptr;
+      }
+
+      pos = static_cast<std::size_t>(hit - beg) - anchors_[0];
+      if (beg[pos + anchors_[1]] == a1 && Matches(beg + pos))
+      {
+        return beg + pos;
+      }
+
+      ++pos;
+    }
+
+    return nullptr;
+  }
+
+  // Scans whole blocks of 16 candidate positions, setting *pos to the first
+  // position which was not scanned.
+  std::uint8_t const* SearchSse2(std::uint8_t const* beg,
+                                 std::size_t num_positions,
+                                 std::size_t* pos) const
+  {
+    __m128i const a0 = _mm_set1_epi8(static_cast<char>(data_[anchors_[0]]));
+    __m128i const a1 = _mm_set1_epi8(static_cast<char>(data_[anchors_[1]]));
+    std::uint8_t const* const p0 = beg + anchors_[0];
+    std::uint8_t const* const p1 = beg + anchors_[1];
+
+    std::size_t i = 0;
+    for (; i + 16 <= num_positions; i += 16)
+    {
+      __m128i const h0 =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(p0 + i));
+      __m128i const h1 =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(p1 + i));
+      unsigned long bits = static_cast<unsigned long>(_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(h0, a0), _mm_cmpeq_epi8(h1, a1))));
+      while (bits)
+      {
+        unsigned long index = 0;
+        _BitScanForward(&index, bits);
+        if (Matches(beg + i + index))
+        {
+          return beg + i + index;
+        }
+        bits &= bits - 1;
+      }
+    }
+
+    *pos = i;
+    return nullptr;
+  }
+
+  std::uint8_t const* SearchAvx2(std::uint8_t const* beg,
+                                 std::size_t num_positions,
+                                 std::size_t* pos) const
+  {
+    __m256i const a0 =
+      _mm256_set1_epi8(static_cast<char>(data_[anchors_[0]]));
+    __m256i const a1 =
+      _mm256_set1_epi8(static_cast<char>(data_[anchors_[1]]));
+    std::uint8_t const* const p0 = beg + anchors_[0];
+    std::uint8_t const* const p1 = beg + anchors_[1];
+
+    std::uint8_t const* result = nullptr;
+    std::size_t i = 0;
+    for (; !result && i + 32 <= num_positions; i += 32)
+    {
+      __m256i const h0 =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p0 + i));
+      __m256i const h1 =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p1 + i));
+      // Go via uint32_t so we don't sign extend when long is 64-bit.
+      unsigned long bits = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(h0, a0),
+                                              _mm256_cmpeq_epi8(h1, a1))));
+      while (bits)
+      {
+        unsigned long index = 0;
+        _BitScanForward(&index, bits);
+        // Verify without SSE so we don't pay for AVX-SSE transitions.
+        if (MatchesScalar(beg + i + index))
+        {
+          result = beg + i + index;
+          break;
+        }
+        bits &= bits - 1;
+      }
+    }
+
+    _mm256_zeroupper();
+
+    if (result)
+    {
+      return result;
+    }
+
+    *pos = i;
+    return SearchSse2Tail(beg, num_positions, pos);
+  }
+
+  std::uint8_t const* SearchSse2Tail(std::uint8_t const* beg,
+                                     std::size_t num_positions,
+                                     std::size_t* pos) const
+  {
+    std::size_t const done = *pos;
+    std::uint8_t const* const result =
+      SearchSse2(beg + done, num_positions - done, pos);
+    *pos += done;
+    return result;
+  }
+
+  std::vector<std::uint8_t> data_;
+  std::vector<std::uint8_t> mask_;
+  std::size_t size_{};
+  std::size_t anchors_[2] = {};
+  std::size_t num_anchors_{};
+  Isa isa_{Isa::kScalar};
+};
+
+// Finds the first match of many needles in a single pass over the haystack.
+// Each needle is bucketed by its anchor byte, so every haystack byte costs a
+// table lookup and only needles anchored on that byte are verified. Needles
+// are removed from their bucket once found.
+class MultiPatternMatcher
+{
+public:
+  static std::size_t const kInactive = static_cast<std::size_t>(-1);
+
+  explicit MultiPatternMatcher(std::vector<PatternMatcher> matchers)
+    : matchers_(std::move(matchers)), anchor_offsets_(matchers_.size())
+  {
+  }
+
+  std::size_t GetCount() const noexcept
+  {
+    return matchers_.size();
+  }
+
+  // Needle i is only matched at or after beg + begin_offsets[i], or not at
+  // all if its offset is kInactive. results must be the same size as the
+  // number of needles. Only results for active needles are written.
+  void Search(std::uint8_t const* beg,
+              std::uint8_t const* end,
+              std::vector<std::size_t> const& begin_offsets,
+              std::vector<std::uint8_t const*>* results)
+  {
+    HADESMEM_DETAIL_ASSERT(beg <= end);
+    HADESMEM_DETAIL_ASSERT(begin_offsets.size() == matchers_.size());
+    HADESMEM_DETAIL_ASSERT(results && results->size() == matchers_.size());
+
+    std::size_t const len = static_cast<std::size_t>(end - beg);
+
+    std::vector<std::size_t> buckets[256];
+    std::size_t remaining = 0;
+    for (std::size_t i = 0; i < matchers_.size(); ++i)
+    {
+      if (begin_offsets[i] == kInactive)
+      {
+        continue;
+      }
+
+      (*results)[i] = nullptr;
+
+      auto const& matcher = matchers_[i];
+      std::uint8_t anchor = 0;
+      if (!matcher.GetAnchor(&anchor_offsets_[i], &anchor))
+      {
+        // Nothing to anchor on, and almost certainly going to match
+        // immediately anyway.
+        if (begin_offsets[i] <= len)
+        {
+          (*results)[i] = matcher.Search(beg + begin_offsets[i], end);
+        }
+        continue;
+      }
+
+      buckets[anchor].push_back(i);
+      ++remaining;
+    }
+
+    for (std::size_t pos = 0; remaining && pos < len; ++pos)
+    {
+      auto& bucket = buckets[beg[pos]];
+      for (std::size_t j = 0; j < bucket.size();)
+      {
+        std::size_t const i = bucket[j];
+        std::size_t const anchor_offset = anchor_offsets_[i];
+        auto const& matcher = matchers_[i];
+        if (pos < anchor_offset || pos - anchor_offset < begin_offsets[i] ||
+            len - (pos - anchor_offset) < matcher.GetSize() ||
+            !matcher.Matches(beg + pos - anchor_offset))
+        {
+          ++j;
+          continue;
+        }
+
+        (*results)[i] = beg + pos - anchor_offset;
+        bucket[j] = bucket.back();
+        bucket.pop_back();
+        --remaining;
+      }
+    }
+  }
+
+private:
+  std::vector<PatternMatcher> matchers_;
+  std::vector<std::size_t> anchor_offsets_;
+};
+}
+}
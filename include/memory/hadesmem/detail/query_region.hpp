@@ -6,6 +6,7 @@
 #include <windows.h>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/region_map.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
 
@@ -13,16 +14,41 @@ namespace hadesmem
 {
 namespace detail
 {
+// Same as Query, except it returns false rather than throwing past the end of
+// the address space.
+inline bool TryQuery(Process const& process,
+                     LPCVOID address,
+                     MEMORY_BASIC_INFORMATION* mbi)
+{
+  detail::VirtualQueryFn const query{process.GetHandle()};
+  if (RegionMap* const region_map = process.GetRegionMap())
+  {
+    return region_map->Find(address, mbi, query);
+  }
+
+  return query(address, mbi);
+}
+
 inline MEMORY_BASIC_INFORMATION Query(Process const& process, LPCVOID address)
 {
   MEMORY_BASIC_INFORMATION mbi{};
-  if (::VirtualQueryEx(process.GetHandle(), address, &mbi, sizeof(mbi)) !=
-      sizeof(mbi))
+  if (!process.GetRegionMap())
+  {
+    if (::VirtualQueryEx(process.GetHandle(), address, &mbi, sizeof(mbi)) !=
+        sizeof(mbi))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"VirtualQueryEx failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+  }
+  else if (!TryQuery(process, address, &mbi))
   {
-    DWORD const last_error = ::GetLastError();
-    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                    << ErrorString{"VirtualQueryEx failed."}
-                                    << ErrorCodeWinLast{last_error});
+    // Same error VirtualQueryEx gives, as RegionIterator relies on it.
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"VirtualQueryEx failed."}
+              << ErrorCodeWinLast{static_cast<DWORD>(ERROR_INVALID_PARAMETER)});
   }
 
   return mbi;
@@ -0,0 +1,295 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/detail/assert.hpp>
+
+// TODO: Invalidate automatically when memory is changed by something other
+// than our own Write/Protect/Free (e.g. the target itself). For now the cache
+// is strictly opt-in and it is up to the user to invalidate it.
+
+// TODO: Per-thread caches or a reader-writer lock if contention ever shows up.
+// Hits mutate the LRU list so we currently take an exclusive lock.
+
+namespace hadesmem
+{
+struct ReadCacheStats
+{
+  std::uint64_t hits;
+  std::uint64_t misses;
+  std::uint64_t evictions;
+  std::uint64_t invalidations;
+};
+
+namespace detail
+{
+// Page-granular cache of remote memory along with the region info for the
+// pages it holds. Only stores committed and readable (possibly after a
+// protection change) pages. The read logic lives in read_impl.hpp, this is
+// just the storage.
+class ReadCache
+{
+public:
+  static std::size_t const kDefaultMaxPages = 0x400;
+
+  explicit ReadCache(std::size_t max_pages, std::size_t page_size)
+    : max_pages_{max_pages}, page_size_{page_size}
+  {
+    HADESMEM_DETAIL_ASSERT(max_pages_ != 0);
+    HADESMEM_DETAIL_ASSERT(page_size_ != 0);
+    HADESMEM_DETAIL_ASSERT(!(page_size_ & (page_size_ - 1)));
+  }
+
+  ReadCache(ReadCache const& other) = delete;
+
+  ReadCache& operator=(ReadCache const& other) = delete;
+
+  std::size_t GetPageSize() const noexcept
+  {
+    return page_size_;
+  }
+
+  std::size_t GetMaxPages() const noexcept
+  {
+    return max_pages_;
+  }
+
+  std::uintptr_t GetPageBase(void const* address) const noexcept
+  {
+    return reinterpret_cast<std::uintptr_t>(address) & ~(page_size_ - 1);
+  }
+
+  // Copies [offset, offset + len) of the page at page_base into data on a hit.
+  bool Read(std::uintptr_t page_base,
+            std::size_t offset,
+            void* data,
+            std::size_t len)
+  {
+    HADESMEM_DETAIL_ASSERT(offset + len <= page_size_);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto const iter = page_map_.find(page_base);
+    if (iter == std::end(page_map_))
+    {
+      ++stats_.misses;
+      return false;
+    }
+
+    ++stats_.hits;
+    lru_.splice(std::begin(lru_), lru_, iter->second);
+    std::memcpy(data, iter->second->data_.data() + offset, len);
+    return true;
+  }
+
+  bool Contains(std::uintptr_t page_base) const
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return page_map_.find(page_base) != std::end(page_map_);
+  }
+
+  // Inserts num_pages consecutive pages starting at page_base, copied from
+  // data. Pages which are already present are refreshed.
+  void Insert(std::uintptr_t page_base, void const* data, std::size_t num_pages)
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto const src = static_cast<std::uint8_t const*>(data);
+    for (std::size_t i = 0; i < num_pages; ++i)
+    {
+      std::uintptr_t const cur_base = page_base + i * page_size_;
+      auto const cur_src = src + i * page_size_;
+
+      auto const iter = page_map_.find(cur_base);
+      if (iter != std::end(page_map_))
+      {
+        std::copy(cur_src, cur_src + page_size_, iter->second->data_.begin());
+        lru_.splice(std::begin(lru_), lru_, iter->second);
+        continue;
+      }
+
+      if (page_map_.size() >= max_pages_)
+      {
+        // Recycle the least recently used page's buffer.
+        auto const last = std::prev(std::end(lru_));
+        page_map_.erase(last->base_);
+        last->base_ = cur_base;
+        std::copy(cur_src, cur_src + page_size_, last->data_.begin());
+        lru_.splice(std::begin(lru_), lru_, last);
+        ++stats_.evictions;
+      }
+      else
+      {
+        lru_.emplace_front(cur_base, cur_src, cur_src + page_size_);
+      }
+
+      page_map_[cur_base] = std::begin(lru_);
+    }
+  }
+
+  bool FindRegion(void const* address, MEMORY_BASIC_INFORMATION* mbi) const
+  {
+    HADESMEM_DETAIL_ASSERT(mbi != nullptr);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto const address_num = reinterpret_cast<std::uintptr_t>(address);
+    auto iter = regions_.upper_bound(address_num);
+    if (iter == std::begin(regions_))
+    {
+      return false;
+    }
+
+    --iter;
+    auto const& region = iter->second;
+    auto const region_beg =
+      reinterpret_cast<std::uintptr_t>(region.BaseAddress);
+    if (address_num - region_beg >= region.RegionSize)
+    {
+      return false;
+    }
+
+    *mbi = region;
+    return true;
+  }
+
+  void InsertRegion(MEMORY_BASIC_INFORMATION const& mbi)
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    // Region info is tiny compared to the pages, so just bound it loosely.
+    if (regions_.size() >= max_pages_)
+    {
+      regions_.clear();
+    }
+
+    regions_[reinterpret_cast<std::uintptr_t>(mbi.BaseAddress)] = mbi;
+  }
+
+  void Invalidate()
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    page_map_.clear();
+    lru_.clear();
+    regions_.clear();
+    ++stats_.invalidations;
+  }
+
+  // Drops all cached pages and region info overlapping [address, address +
+  // len).
+  void Invalidate(void const* address, std::size_t len)
+  {
+    if (!len)
+    {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto const beg = reinterpret_cast<std::uintptr_t>(address);
+    auto const end = beg + len;
+
+    // Walk whichever is smaller, the range or the cache.
+    std::uintptr_t const first_page = GetPageBase(address);
+    std::uintptr_t const last_page =
+      GetPageBase(reinterpret_cast<void const*>(end - 1));
+    if ((last_page - first_page) / page_size_ < page_map_.size())
+    {
+      for (std::uintptr_t page = first_page;; page += page_size_)
+      {
+        auto const iter = page_map_.find(page);
+        if (iter != std::end(page_map_))
+        {
+          lru_.erase(iter->second);
+          page_map_.erase(iter);
+        }
+
+        if (page == last_page)
+        {
+          break;
+        }
+      }
+    }
+    else
+    {
+      for (auto iter = std::begin(lru_); iter != std::end(lru_);)
+      {
+        if (iter->base_ >= first_page && iter->base_ <= last_page)
+        {
+          page_map_.erase(iter->base_);
+          iter = lru_.erase(iter);
+        }
+        else
+        {
+          ++iter;
+        }
+      }
+    }
+
+    for (auto iter = std::begin(regions_); iter != std::end(regions_);)
+    {
+      auto const region_beg = iter->first;
+      auto const region_end = region_beg + iter->second.RegionSize;
+      if (region_beg < end && beg < region_end)
+      {
+        iter = regions_.erase(iter);
+      }
+      else
+      {
+        ++iter;
+      }
+    }
+
+    ++stats_.invalidations;
+  }
+
+  ReadCacheStats GetStats() const
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return stats_;
+  }
+
+  void ResetStats()
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stats_ = ReadCacheStats{};
+  }
+
+private:
+  struct Page
+  {
+    Page(std::uintptr_t base, std::uint8_t const* beg, std::uint8_t const* end)
+      : base_{base}, data_(beg, end)
+    {
+    }
+
+    std::uintptr_t base_;
+    std::vector<std::uint8_t> data_;
+  };
+
+  std::size_t max_pages_;
+  std::size_t page_size_;
+  std::list<Page> lru_;
+  std::unordered_map<std::uintptr_t, std::list<Page>::iterator> page_map_;
+  std::map<std::uintptr_t, MEMORY_BASIC_INFORMATION> regions_;
+  ReadCacheStats stats_ = ReadCacheStats{};
+  mutable std::mutex mutex_;
+};
+}
+}
@@ -6,12 +6,14 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 #include <windows.h>
 
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/protect_guard.hpp>
 #include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/detail/read_cache.hpp>
 #include <hadesmem/detail/type_traits.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
@@ -56,11 +58,11 @@ inline void ReadUnchecked(Process const& process,
   }
 }
 
-inline void ReadImpl(Process const& process,
-                     void* address,
-                     void* data,
-                     std::size_t len,
-                     std::uint32_t flags = ReadFlags::kNone)
+inline void ReadImplUncached(Process const& process,
+                             void* address,
+                             void* data,
+                             std::size_t len,
+                             std::uint32_t flags = ReadFlags::kNone)
 {
   HADESMEM_DETAIL_ASSERT(len ? address != nullptr : true);
   HADESMEM_DETAIL_ASSERT(data != nullptr);
@@ -124,6 +126,112 @@ inline void ReadImpl(Process const& process,
   }
 }
 
+// Fetches the run of consecutive uncached pages starting at page_base (capped
+// at max_pages and the end of the region) into the cache. Returns false if the
+// page can't be cached (e.g. reserved or guard pages) in which case the caller
+// should fall back to an uncached read so it gets the usual semantics.
+inline bool FetchPagesCached(Process const& process,
+                             ReadCache& cache,
+                             std::uintptr_t page_base,
+                             std::size_t max_pages)
+{
+  std::size_t const page_size = cache.GetPageSize();
+  void* const page_ptr = reinterpret_cast<void*>(page_base);
+
+  MEMORY_BASIC_INFORMATION mbi{};
+  if (!cache.FindRegion(page_ptr, &mbi))
+  {
+    mbi = Query(process, page_ptr);
+    if (mbi.State != MEM_COMMIT || IsBadProtect(mbi))
+    {
+      return false;
+    }
+
+    cache.InsertRegion(mbi);
+  }
+
+  auto const region_end =
+    reinterpret_cast<std::uintptr_t>(mbi.BaseAddress) + mbi.RegionSize;
+  std::size_t num_pages = 1;
+  while (num_pages < max_pages &&
+         page_base + (num_pages + 1) * page_size <= region_end &&
+         !cache.Contains(page_base + num_pages * page_size))
+  {
+    ++num_pages;
+  }
+
+  std::vector<std::uint8_t> buf(num_pages * page_size);
+  ProtectGuard protect_guard{process, mbi, ProtectGuardType::kRead};
+  ReadUnchecked(process, page_ptr, buf.data(), buf.size());
+  protect_guard.Restore();
+
+  cache.Insert(page_base, buf.data(), num_pages);
+
+  return true;
+}
+
+inline void ReadImplCached(Process const& process,
+                           ReadCache& cache,
+                           void* address,
+                           void* data,
+                           std::size_t len,
+                           std::uint32_t flags)
+{
+  std::size_t const page_size = cache.GetPageSize();
+
+  while (len)
+  {
+    std::uintptr_t const page_base = cache.GetPageBase(address);
+    std::size_t const offset =
+      reinterpret_cast<std::uintptr_t>(address) - page_base;
+    std::size_t const len_cur = (std::min)(len, page_size - offset);
+
+    if (!cache.Read(page_base, offset, data, len_cur))
+    {
+      // Read ahead as far as the request goes, but never more than half the
+      // cache so a large read can't flush everything else out.
+      std::size_t const pages_left = (offset + len + page_size - 1) / page_size;
+      std::size_t const max_pages =
+        (std::max)(std::size_t{1},
+                   (std::min)(pages_left, cache.GetMaxPages() / 2));
+      if (!FetchPagesCached(process, cache, page_base, max_pages) ||
+          !cache.Read(page_base, offset, data, len_cur))
+      {
+        ReadImplUncached(process, address, data, len, flags);
+        return;
+      }
+    }
+
+    address = static_cast<std::uint8_t*>(address) + len_cur;
+    data = static_cast<std::uint8_t*>(data) + len_cur;
+    len -= len_cur;
+  }
+}
+
+inline void ReadImpl(Process const& process,
+                     void* address,
+                     void* data,
+                     std::size_t len,
+                     std::uint32_t flags = ReadFlags::kNone)
+{
+  HADESMEM_DETAIL_ASSERT(len ? address != nullptr : true);
+  HADESMEM_DETAIL_ASSERT(data != nullptr);
+
+  if (!len)
+  {
+    return;
+  }
+
+  if (ReadCache* const cache = process.GetReadCache())
+  {
+    ReadImplCached(process, *cache, address, data, len, flags);
+  }
+  else
+  {
+    ReadImplUncached(process, address, data, len, flags);
+  }
+}
+
 template <typename T>
 T ReadUnsafeImpl(Process const& process,
                  void* address,
@@ -0,0 +1,98 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include <hadesmem/config.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+// Lets a writer wait until no reader can still be using something it has
+// just unpublished (e.g. erased from an AddressTable), without readers taking
+// a lock. Readers bracket their use with Enter/Leave, which costs a couple of
+// atomic operations. Synchronize waits for every reader which entered before
+// it was called to leave. Readers which enter afterwards are counted against
+// the other epoch, so a steady stream of them can't hold it up forever.
+// Synchronize must not be called while a reader may be suspended (or from a
+// reader), as it would never return.
+class ReaderEpoch
+{
+public:
+  ReaderEpoch() = default;
+
+  ReaderEpoch(ReaderEpoch const& other) = delete;
+
+  ReaderEpoch& operator=(ReaderEpoch const& other) = delete;
+
+  // Returns the token to pass to Leave.
+  std::size_t Enter() noexcept
+  {
+    for (;;)
+    {
+      std::size_t const epoch = epoch_.load() & 1;
+      readers_[epoch].fetch_add(1);
+      // If the epoch has moved on then Synchronize may already have checked
+      // this counter, so we'd be invisible to it.
+      if ((epoch_.load() & 1) == epoch)
+      {
+        return epoch;
+      }
+
+      readers_[epoch].fetch_sub(1);
+    }
+  }
+
+  void Leave(std::size_t epoch) noexcept
+  {
+    readers_[epoch].fetch_sub(1, std::memory_order_release);
+  }
+
+  void Synchronize()
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    std::size_t const old_epoch = epoch_.fetch_add(1) & 1;
+    while (readers_[old_epoch].load(std::memory_order_acquire))
+    {
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  std::atomic<std::uint32_t> epoch_{};
+  std::atomic<std::uint32_t> readers_[2]{};
+  std::mutex mutex_;
+};
+
+// Leaves the epoch on scope exit.
+class ReaderEpochGuard
+{
+public:
+  explicit ReaderEpochGuard(ReaderEpoch& reader_epoch) noexcept
+    : reader_epoch_{&reader_epoch}, epoch_{reader_epoch.Enter()}
+  {
+  }
+
+  ReaderEpochGuard(ReaderEpochGuard const& other) = delete;
+
+  ReaderEpochGuard& operator=(ReaderEpochGuard const& other) = delete;
+
+  ~ReaderEpochGuard()
+  {
+    reader_epoch_->Leave(epoch_);
+  }
+
+private:
+  ReaderEpoch* reader_epoch_;
+  std::size_t epoch_;
+};
+}
+}
@@ -0,0 +1,313 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/srw_lock.hpp>
+#include <hadesmem/error.hpp>
+
+// TODO: Invalidate automatically when the address space is changed by
+// something other than our own Alloc/Free/Protect. For now the map is strictly
+// opt-in and it is up to the user to refresh it.
+
+namespace hadesmem
+{
+namespace detail
+{
+// VirtualQueryEx, in the form RegionMap wants. Returns false past the end of
+// the address space.
+struct VirtualQueryFn
+{
+  bool operator()(void const* address, MEMORY_BASIC_INFORMATION* mbi) const
+  {
+    if (::VirtualQueryEx(process, address, mbi, sizeof(*mbi)) == sizeof(*mbi))
+    {
+      return true;
+    }
+
+    DWORD const last_error = ::GetLastError();
+    if (last_error == ERROR_INVALID_PARAMETER)
+    {
+      return false;
+    }
+
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"VirtualQueryEx failed."}
+                                    << ErrorCodeWinLast{last_error});
+  }
+
+  HANDLE process;
+};
+
+// Snapshot of an address space as a sorted vector of non-overlapping regions,
+// so region lookups are a binary search rather than a system call. Parts of
+// the address space which aren't in the map (never captured, or invalidated)
+// are queried on demand and added. Results are in the same form VirtualQueryEx
+// gives (i.e. starting at the page containing the address).
+// The walking logic is templated on the query function so that it can be
+// tested against a synthetic address space. query(address, &mbi) should
+// behave as VirtualQueryFn does.
+class RegionMap
+{
+public:
+  explicit RegionMap(std::size_t page_size) : page_size_{page_size}
+  {
+    HADESMEM_DETAIL_ASSERT(page_size_ != 0);
+    HADESMEM_DETAIL_ASSERT(!(page_size_ & (page_size_ - 1)));
+  }
+
+  RegionMap(RegionMap const& other) = delete;
+
+  RegionMap& operator=(RegionMap const& other) = delete;
+
+  // Replaces the map with a walk of the entire address space.
+  template <typename QueryFn> void Capture(QueryFn const& query)
+  {
+    std::vector<MEMORY_BASIC_INFORMATION> regions;
+    MEMORY_BASIC_INFORMATION mbi{};
+    for (std::uintptr_t address = 0;
+         query(reinterpret_cast<void const*>(address), &mbi);)
+    {
+      regions.push_back(mbi);
+      std::uintptr_t const next = GetEnd(mbi);
+      if (next <= address)
+      {
+        break;
+      }
+
+      address = next;
+    }
+
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+    regions_ = std::move(regions);
+  }
+
+  // Re-queries just the regions overlapping [address, address + len).
+  template <typename QueryFn>
+  void Refresh(void const* address, std::size_t len, QueryFn const& query)
+  {
+    if (!len)
+    {
+      return;
+    }
+
+    auto const beg = reinterpret_cast<std::uintptr_t>(address);
+    auto const end = beg + len;
+
+    std::vector<MEMORY_BASIC_INFORMATION> regions;
+    MEMORY_BASIC_INFORMATION mbi{};
+    for (std::uintptr_t cur = beg;
+         cur < end && query(reinterpret_cast<void const*>(cur), &mbi);)
+    {
+      regions.push_back(mbi);
+      std::uintptr_t const next = GetEnd(mbi);
+      if (next <= cur)
+      {
+        break;
+      }
+
+      cur = next;
+    }
+
+    // The new regions cover the whole range, so anything they overlap is
+    // replaced (or trimmed) as they're inserted.
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+    for (auto const& region : regions)
+    {
+      InsertUnlocked(region);
+    }
+  }
+
+  // Returns false past the end of the address space.
+  template <typename QueryFn>
+  bool Find(void const* address,
+            MEMORY_BASIC_INFORMATION* mbi,
+            QueryFn const& query)
+  {
+    if (Find(address, mbi))
+    {
+      return true;
+    }
+
+    if (!query(address, mbi))
+    {
+      return false;
+    }
+
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+    InsertUnlocked(*mbi);
+    return true;
+  }
+
+  // Looks only in the map. Returns false if the address isn't in it.
+  bool Find(void const* address, MEMORY_BASIC_INFORMATION* mbi) const
+  {
+    HADESMEM_DETAIL_ASSERT(mbi != nullptr);
+
+    auto const address_num = reinterpret_cast<std::uintptr_t>(address);
+
+    AcquireSRWLock const lock{&lock_, SRWLockType::Shared};
+
+    auto const iter = FindUnlocked(address_num);
+    if (iter == std::end(regions_))
+    {
+      return false;
+    }
+
+    // Trim to the page containing the address, as VirtualQueryEx would.
+    *mbi = *iter;
+    std::uintptr_t const page_base = address_num & ~(page_size_ - 1);
+    std::uintptr_t const region_beg = GetBase(*iter);
+    if (page_base > region_beg)
+    {
+      mbi->BaseAddress = reinterpret_cast<PVOID>(page_base);
+      mbi->RegionSize -= page_base - region_beg;
+    }
+
+    return true;
+  }
+
+  void Invalidate()
+  {
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+    regions_.clear();
+  }
+
+  // Drops every region overlapping [address, address + len), to be queried
+  // again when next needed.
+  void Invalidate(void const* address, std::size_t len)
+  {
+    if (!len)
+    {
+      return;
+    }
+
+    auto const beg = reinterpret_cast<std::uintptr_t>(address);
+
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+    EraseUnlocked(beg, beg + len);
+  }
+
+  // For when the size of the allocation isn't known (e.g. VirtualFreeEx with
+  // MEM_RELEASE).
+  void InvalidateAllocation(void const* allocation_base)
+  {
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+    regions_.erase(
+      std::remove_if(std::begin(regions_),
+                     std::end(regions_),
+                     [&](MEMORY_BASIC_INFORMATION const& region) {
+                       return region.AllocationBase == allocation_base ||
+                              region.BaseAddress == allocation_base;
+                     }),
+      std::end(regions_));
+  }
+
+  std::vector<MEMORY_BASIC_INFORMATION> GetRegions() const
+  {
+    AcquireSRWLock const lock{&lock_, SRWLockType::Shared};
+    return regions_;
+  }
+
+private:
+  using RegionIter = std::vector<MEMORY_BASIC_INFORMATION>::iterator;
+  using RegionConstIter = std::vector<MEMORY_BASIC_INFORMATION>::const_iterator;
+
+  static std::uintptr_t GetBase(MEMORY_BASIC_INFORMATION const& mbi) noexcept
+  {
+    return reinterpret_cast<std::uintptr_t>(mbi.BaseAddress);
+  }
+
+  static std::uintptr_t GetEnd(MEMORY_BASIC_INFORMATION const& mbi) noexcept
+  {
+    return GetBase(mbi) + mbi.RegionSize;
+  }
+
+  RegionConstIter FindUnlocked(std::uintptr_t address) const
+  {
+    auto const iter = std::upper_bound(
+      std::begin(regions_),
+      std::end(regions_),
+      address,
+      [](std::uintptr_t lhs, MEMORY_BASIC_INFORMATION const& rhs) {
+        return lhs < GetBase(rhs);
+      });
+    if (iter == std::begin(regions_))
+    {
+      return std::end(regions_);
+    }
+
+    auto const prev = std::prev(iter);
+    return address - GetBase(*prev) < prev->RegionSize ? prev
+                                                        : std::end(regions_);
+  }
+
+  // Returns the range of regions overlapping [beg, end).
+  std::pair<RegionIter, RegionIter> GetOverlapUnlocked(std::uintptr_t beg,
+                                                       std::uintptr_t end)
+  {
+    auto const first = std::partition_point(
+      std::begin(regions_),
+      std::end(regions_),
+      [&](MEMORY_BASIC_INFORMATION const& r) { return GetEnd(r) <= beg; });
+    auto const last = std::partition_point(
+      first, std::end(regions_), [&](MEMORY_BASIC_INFORMATION const& r) {
+        return GetBase(r) < end;
+      });
+    return {first, last};
+  }
+
+  void EraseUnlocked(std::uintptr_t beg, std::uintptr_t end)
+  {
+    auto const overlap = GetOverlapUnlocked(beg, end);
+    regions_.erase(overlap.first, overlap.second);
+  }
+
+  // Regions partially covered by the new one are trimmed rather than dropped,
+  // as what we know about the rest of them is still valid.
+  void InsertUnlocked(MEMORY_BASIC_INFORMATION const& mbi)
+  {
+    std::uintptr_t const beg = GetBase(mbi);
+    std::uintptr_t const end = GetEnd(mbi);
+    auto const overlap = GetOverlapUnlocked(beg, end);
+
+    std::vector<MEMORY_BASIC_INFORMATION> replacement;
+    if (overlap.first != overlap.second && GetBase(*overlap.first) < beg)
+    {
+      MEMORY_BASIC_INFORMATION head = *overlap.first;
+      head.RegionSize = beg - GetBase(head);
+      replacement.push_back(head);
+    }
+
+    replacement.push_back(mbi);
+
+    if (overlap.first != overlap.second &&
+        GetEnd(*std::prev(overlap.second)) > end)
+    {
+      MEMORY_BASIC_INFORMATION tail = *std::prev(overlap.second);
+      tail.RegionSize = GetEnd(tail) - end;
+      tail.BaseAddress = reinterpret_cast<PVOID>(end);
+      replacement.push_back(tail);
+    }
+
+    auto const iter = regions_.erase(overlap.first, overlap.second);
+    regions_.insert(iter, std::begin(replacement), std::end(replacement));
+  }
+
+  std::size_t page_size_;
+  mutable SRWLOCK lock_ = SRWLOCK_INIT;
+  std::vector<MEMORY_BASIC_INFORMATION> regions_;
+};
+}
+}
@@ -15,10 +15,11 @@ namespace detail
 {
 inline SmartHandle CreateRemoteThreadAndWait(Process const& process,
                                              LPTHREAD_START_ROUTINE func,
-                                             DWORD timeout = INFINITE)
+                                             DWORD timeout = INFINITE,
+                                             LPVOID param = nullptr)
 {
   SmartHandle remote_thread{::CreateRemoteThread(
-    process.GetHandle(), nullptr, 0, func, nullptr, 0, nullptr)};
+    process.GetHandle(), nullptr, 0, func, param, 0, nullptr)};
   if (!remote_thread.GetHandle())
   {
     DWORD const last_error = ::GetLastError();
@@ -0,0 +1,476 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <windows.h>
+#include <intrin.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/pattern_matcher.hpp>
+
+// TODO: AVX2 path. The compares are cheap enough next to ReadProcessMemory
+// that it hasn't been worth it yet.
+
+// TODO: 64-bit integer compares are scalar, as SSE2 has no 64-bit compare
+// (pcmpeqq/pcmpgtq are SSE4.1/SSE4.2).
+
+namespace hadesmem
+{
+enum class ScanCompare
+{
+  // Compared against the given value(s).
+  kEqual,
+  kNotEqual,
+  kGreater,
+  kLess,
+  kBetween,
+  // Matches everything. Only useful as a first scan, to be filtered later by
+  // one of the relative compares.
+  kUnknown,
+  // Compared against the value from the previous scan.
+  kChanged,
+  kUnchanged,
+  kIncreased,
+  kDecreased,
+  kIncreasedBy,
+  kDecreasedBy
+};
+
+namespace detail
+{
+inline bool IsRelativeScanCompare(ScanCompare compare) noexcept
+{
+  return compare >= ScanCompare::kChanged;
+}
+
+inline std::size_t PopCount64(std::uint64_t v) noexcept
+{
+  v = v - ((v >> 1) & 0x5555555555555555ULL);
+  v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+  v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return static_cast<std::size_t>((v * 0x0101010101010101ULL) >> 56);
+}
+
+// Signed integer overflow is undefined, so do the arithmetic in the unsigned
+// type and let it wrap (which is what the target will have done).
+template <typename T>
+std::enable_if_t<std::is_integral<T>::value, T> ScanAdd(T lhs, T rhs) noexcept
+{
+  using U = std::make_unsigned_t<T>;
+  return static_cast<T>(static_cast<U>(lhs) + static_cast<U>(rhs));
+}
+
+template <typename T>
+std::enable_if_t<std::is_floating_point<T>::value, T> ScanAdd(T lhs,
+                                                               T rhs) noexcept
+{
+  return lhs + rhs;
+}
+
+template <typename T>
+std::enable_if_t<std::is_integral<T>::value, T> ScanSub(T lhs, T rhs) noexcept
+{
+  using U = std::make_unsigned_t<T>;
+  return static_cast<T>(static_cast<U>(lhs) - static_cast<U>(rhs));
+}
+
+template <typename T>
+std::enable_if_t<std::is_floating_point<T>::value, T> ScanSub(T lhs,
+                                                               T rhs) noexcept
+{
+  return lhs - rhs;
+}
+
+template <typename T>
+std::enable_if_t<std::is_integral<T>::value, bool>
+  ScanEqual(T lhs, T rhs, T /*epsilon*/) noexcept
+{
+  return lhs == rhs;
+}
+
+// NaN never compares equal (even to itself), same as the vector path.
+template <typename T>
+std::enable_if_t<std::is_floating_point<T>::value, bool>
+  ScanEqual(T lhs, T rhs, T epsilon) noexcept
+{
+  return std::abs(lhs - rhs) <= epsilon;
+}
+
+// Everything needed to evaluate a compare, other than the values themselves.
+// For kBetween the range is [value, value2] (inclusive). For kIncreasedBy and
+// kDecreasedBy the amount is value. The epsilon only applies to floating
+// point equality (including kChanged, kUnchanged, etc.).
+template <typename T> struct ScanPredicate
+{
+  ScanCompare compare;
+  T value;
+  T value2;
+  T epsilon;
+};
+
+template <typename T>
+bool ScanMatch(ScanPredicate<T> const& pred, T cur, T prev) noexcept
+{
+  switch (pred.compare)
+  {
+  case ScanCompare::kEqual:
+    return ScanEqual(cur, pred.value, pred.epsilon);
+  case ScanCompare::kNotEqual:
+    return !ScanEqual(cur, pred.value, pred.epsilon);
+  case ScanCompare::kGreater:
+    return cur > pred.value;
+  case ScanCompare::kLess:
+    return cur < pred.value;
+  case ScanCompare::kBetween:
+    return cur >= pred.value && cur <= pred.value2;
+  case ScanCompare::kUnknown:
+    return true;
+  case ScanCompare::kChanged:
+    return !ScanEqual(cur, prev, pred.epsilon);
+  case ScanCompare::kUnchanged:
+    return ScanEqual(cur, prev, pred.epsilon);
+  case ScanCompare::kIncreased:
+    return cur > prev;
+  case ScanCompare::kDecreased:
+    return cur < prev;
+  case ScanCompare::kIncreasedBy:
+    return ScanEqual(cur, ScanAdd(prev, pred.value), pred.epsilon);
+  case ScanCompare::kDecreasedBy:
+    return ScanEqual(cur, ScanSub(prev, pred.value), pred.epsilon);
+  }
+
+  HADESMEM_DETAIL_ASSERT(false);
+  return false;
+}
+
+template <std::size_t Size> struct ScanSimdIntOps;
+
+template <> struct ScanSimdIntOps<1>
+{
+  static __m128i Set1(std::uint32_t v) noexcept
+  {
+    return _mm_set1_epi8(static_cast<char>(v));
+  }
+
+  static __m128i Eq(__m128i lhs, __m128i rhs) noexcept
+  {
+    return _mm_cmpeq_epi8(lhs, rhs);
+  }
+
+  static __m128i Gt(__m128i lhs, __m128i rhs) noexcept
+  {
+    return _mm_cmpgt_epi8(lhs, rhs);
+  }
+
+  static std::uint32_t Mask(__m128i m) noexcept
+  {
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(m));
+  }
+};
+
+template <> struct ScanSimdIntOps<2>
+{
+  static __m128i Set1(std::uint32_t v) noexcept
+  {
+    return _mm_set1_epi16(static_cast<short>(v));
+  }
+
+  static __m128i Eq(__m128i lhs, __m128i rhs) noexcept
+  {
+    return _mm_cmpeq_epi16(lhs, rhs);
+  }
+
+  static __m128i Gt(__m128i lhs, __m128i rhs) noexcept
+  {
+    return _mm_cmpgt_epi16(lhs, rhs);
+  }
+
+  // Lanes are all ones or all zeros, so packing with signed saturation keeps
+  // them intact and gives one byte per lane.
+  static std::uint32_t Mask(__m128i m) noexcept
+  {
+    return static_cast<std::uint32_t>(
+             _mm_movemask_epi8(_mm_packs_epi16(m, _mm_setzero_si128()))) &
+           0xFF;
+  }
+};
+
+template <> struct ScanSimdIntOps<4>
+{
+  static __m128i Set1(std::uint32_t v) noexcept
+  {
+    return _mm_set1_epi32(static_cast<int>(v));
+  }
+
+  static __m128i Eq(__m128i lhs, __m128i rhs) noexcept
+  {
+    return _mm_cmpeq_epi32(lhs, rhs);
+  }
+
+  static __m128i Gt(__m128i lhs, __m128i rhs) noexcept
+  {
+    return _mm_cmpgt_epi32(lhs, rhs);
+  }
+
+  static std::uint32_t Mask(__m128i m) noexcept
+  {
+    return static_cast<std::uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(m)));
+  }
+};
+
+// SSE2 only has signed compares, so unsigned values are biased into the
+// signed range by flipping the top bit first.
+template <typename T> class ScanSimdInt
+{
+public:
+  static bool const kSupported = true;
+  static std::size_t const kLanes = 16 / sizeof(T);
+
+  explicit ScanSimdInt(ScanPredicate<T> const& pred) noexcept
+    : compare_{pred.compare},
+      bias_{Ops::Set1(std::is_signed<T>::value
+                        ? 0U
+                        : 1U << (sizeof(T) * CHAR_BIT - 1))},
+      value_{Bias(Ops::Set1(static_cast<std::uint32_t>(pred.value)))},
+      value2_{Bias(Ops::Set1(static_cast<std::uint32_t>(pred.value2)))}
+  {
+  }
+
+  std::uint32_t Compare(std::uint8_t const* p) const noexcept
+  {
+    __m128i const cur =
+      Bias(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p)));
+    switch (compare_)
+    {
+    case ScanCompare::kEqual:
+      return Ops::Mask(Ops::Eq(cur, value_));
+    case ScanCompare::kNotEqual:
+      return ~Ops::Mask(Ops::Eq(cur, value_)) & kAllLanes;
+    case ScanCompare::kGreater:
+      return Ops::Mask(Ops::Gt(cur, value_));
+    case ScanCompare::kLess:
+      return Ops::Mask(Ops::Gt(value_, cur));
+    case ScanCompare::kBetween:
+      return ~Ops::Mask(_mm_or_si128(Ops::Gt(value_, cur),
+                                     Ops::Gt(cur, value2_))) &
+             kAllLanes;
+    default:
+      HADESMEM_DETAIL_ASSERT(compare_ == ScanCompare::kUnknown);
+      return kAllLanes;
+    }
+  }
+
+private:
+  using Ops = ScanSimdIntOps<sizeof(T)>;
+
+  static std::uint32_t const kAllLanes = (1U << kLanes) - 1;
+
+  __m128i Bias(__m128i v) const noexcept
+  {
+    return _mm_xor_si128(v, bias_);
+  }
+
+  ScanCompare compare_;
+  __m128i bias_;
+  __m128i value_;
+  __m128i value2_;
+};
+
+class ScanSimdFloat
+{
+public:
+  static bool const kSupported = true;
+  static std::size_t const kLanes = 4;
+
+  explicit ScanSimdFloat(ScanPredicate<float> const& pred) noexcept
+    : compare_{pred.compare},
+      value_{_mm_set1_ps(pred.value)},
+      value2_{_mm_set1_ps(pred.value2)},
+      epsilon_{_mm_set1_ps(pred.epsilon)},
+      abs_mask_{_mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF))}
+  {
+  }
+
+  std::uint32_t Compare(std::uint8_t const* p) const noexcept
+  {
+    __m128 const cur = _mm_loadu_ps(reinterpret_cast<float const*>(p));
+    switch (compare_)
+    {
+    case ScanCompare::kEqual:
+      return Mask(_mm_cmple_ps(Diff(cur), epsilon_));
+    case ScanCompare::kNotEqual:
+      return Mask(_mm_cmpnle_ps(Diff(cur), epsilon_));
+    case ScanCompare::kGreater:
+      return Mask(_mm_cmpgt_ps(cur, value_));
+    case ScanCompare::kLess:
+      return Mask(_mm_cmplt_ps(cur, value_));
+    case ScanCompare::kBetween:
+      return Mask(
+        _mm_and_ps(_mm_cmpge_ps(cur, value_), _mm_cmple_ps(cur, value2_)));
+    default:
+      HADESMEM_DETAIL_ASSERT(compare_ == ScanCompare::kUnknown);
+      return 0xF;
+    }
+  }
+
+private:
+  static std::uint32_t Mask(__m128 m) noexcept
+  {
+    return static_cast<std::uint32_t>(_mm_movemask_ps(m));
+  }
+
+  __m128 Diff(__m128 cur) const noexcept
+  {
+    return _mm_and_ps(_mm_sub_ps(cur, value_), abs_mask_);
+  }
+
+  ScanCompare compare_;
+  __m128 value_;
+  __m128 value2_;
+  __m128 epsilon_;
+  __m128 abs_mask_;
+};
+
+class ScanSimdDouble
+{
+public:
+  static bool const kSupported = true;
+  static std::size_t const kLanes = 2;
+
+  explicit ScanSimdDouble(ScanPredicate<double> const& pred) noexcept
+    : compare_{pred.compare},
+      value_{_mm_set1_pd(pred.value)},
+      value2_{_mm_set1_pd(pred.value2)},
+      epsilon_{_mm_set1_pd(pred.epsilon)},
+      abs_mask_{_mm_castsi128_pd(
+        _mm_set_epi32(0x7FFFFFFF, -1, 0x7FFFFFFF, -1))}
+  {
+  }
+
+  std::uint32_t Compare(std::uint8_t const* p) const noexcept
+  {
+    __m128d const cur = _mm_loadu_pd(reinterpret_cast<double const*>(p));
+    switch (compare_)
+    {
+    case ScanCompare::kEqual:
+      return Mask(_mm_cmple_pd(Diff(cur), epsilon_));
+    case ScanCompare::kNotEqual:
+      return Mask(_mm_cmpnle_pd(Diff(cur), epsilon_));
+    case ScanCompare::kGreater:
+      return Mask(_mm_cmpgt_pd(cur, value_));
+    case ScanCompare::kLess:
+      return Mask(_mm_cmplt_pd(cur, value_));
+    case ScanCompare::kBetween:
+      return Mask(
+        _mm_and_pd(_mm_cmpge_pd(cur, value_), _mm_cmple_pd(cur, value2_)));
+    default:
+      HADESMEM_DETAIL_ASSERT(compare_ == ScanCompare::kUnknown);
+      return 0x3;
+    }
+  }
+
+private:
+  static std::uint32_t Mask(__m128d m) noexcept
+  {
+    return static_cast<std::uint32_t>(_mm_movemask_pd(m));
+  }
+
+  __m128d Diff(__m128d cur) const noexcept
+  {
+    return _mm_and_pd(_mm_sub_pd(cur, value_), abs_mask_);
+  }
+
+  ScanCompare compare_;
+  __m128d value_;
+  __m128d value2_;
+  __m128d epsilon_;
+  __m128d abs_mask_;
+};
+
+template <typename T> struct ScanSimdUnsupported
+{
+  static bool const kSupported = false;
+  static std::size_t const kLanes = 1;
+
+  explicit ScanSimdUnsupported(ScanPredicate<T> const& /*pred*/) noexcept
+  {
+  }
+
+  std::uint32_t Compare(std::uint8_t const* /*p*/) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(false);
+    return 0;
+  }
+};
+
+template <typename T>
+using ScanSimd = std::conditional_t<
+  std::is_same<T, float>::value,
+  ScanSimdFloat,
+  std::conditional_t<
+    std::is_same<T, double>::value,
+    ScanSimdDouble,
+    std::conditional_t<std::is_integral<T>::value && sizeof(T) <= 4,
+                       ScanSimdInt<T>,
+                       ScanSimdUnsupported<T>>>>;
+
+// Evaluates an absolute compare against num_slots values, starting at data
+// and stride bytes apart, setting bit i of bits (which must be zeroed, and
+// hold at least num_slots bits) for each value i which matches. data must
+// hold (num_slots - 1) * stride + sizeof(T) bytes. Returns the number of
+// matches. Values are compared 16 bytes at a time when they are packed (i.e.
+// stride is sizeof(T)).
+template <typename T>
+std::size_t ScanValues(std::uint8_t const* data,
+                       std::size_t num_slots,
+                       std::size_t stride,
+                       ScanPredicate<T> const& pred,
+                       std::uint64_t* bits,
+                       bool use_simd = IsSse2Supported())
+{
+  HADESMEM_DETAIL_ASSERT(!IsRelativeScanCompare(pred.compare));
+  HADESMEM_DETAIL_ASSERT(stride != 0);
+
+  std::size_t count = 0;
+  std::size_t i = 0;
+
+  using Simd = ScanSimd<T>;
+  if (Simd::kSupported && use_simd && stride == sizeof(T))
+  {
+    // kLanes divides 64, so a group of lanes never straddles two words.
+    Simd const simd{pred};
+    for (; i + Simd::kLanes <= num_slots; i += Simd::kLanes)
+    {
+      std::uint32_t const mask = simd.Compare(data + i * sizeof(T));
+      if (mask)
+      {
+        bits[i / 64] |= std::uint64_t{mask} << (i % 64);
+        count += PopCount64(mask);
+      }
+    }
+  }
+
+  for (; i < num_slots; ++i)
+  {
+    T cur;
+    std::memcpy(&cur, data + i * stride, sizeof(T));
+    if (ScanMatch(pred, cur, cur))
+    {
+      bits[i / 64] |= std::uint64_t{1} << (i % 64);
+      ++count;
+    }
+  }
+
+  return count;
+}
+}
+}
@@ -0,0 +1,240 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+// Non-owning reference to a string, for returning names without copying them
+// out of a buffer. Same interface as the corresponding subset of
+// std::basic_string_view, which isn't available on all supported compilers.
+// The referenced string does not have to be null-terminated.
+// TODO: Replace with std::basic_string_view when we require C++17.
+template <typename CharT, typename Traits = std::char_traits<CharT>>
+class BasicStringView
+{
+public:
+  using traits_type = Traits;
+  using value_type = CharT;
+  using const_pointer = CharT const*;
+  using const_reference = CharT const&;
+  using const_iterator = CharT const*;
+  using iterator = const_iterator;
+  using size_type = std::size_t;
+
+  static constexpr size_type npos = static_cast<size_type>(-1);
+
+  constexpr BasicStringView() noexcept
+  {
+  }
+
+  constexpr BasicStringView(CharT const* data, size_type size) noexcept
+    : data_{data}, size_{size}
+  {
+  }
+
+  BasicStringView(CharT const* data) noexcept
+    : data_{data}, size_{Traits::length(data)}
+  {
+  }
+
+  template <typename Alloc>
+  BasicStringView(std::basic_string<CharT, Traits, Alloc> const& str) noexcept
+    : data_{str.data()}, size_{str.size()}
+  {
+  }
+
+  constexpr const_iterator begin() const noexcept
+  {
+    return data_;
+  }
+
+  constexpr const_iterator cbegin() const noexcept
+  {
+    return data_;
+  }
+
+  constexpr const_iterator end() const noexcept
+  {
+    return data_ + size_;
+  }
+
+  constexpr const_iterator cend() const noexcept
+  {
+    return data_ + size_;
+  }
+
+  constexpr const_pointer data() const noexcept
+  {
+    return data_;
+  }
+
+  constexpr size_type size() const noexcept
+  {
+    return size_;
+  }
+
+  constexpr size_type length() const noexcept
+  {
+    return size_;
+  }
+
+  constexpr bool empty() const noexcept
+  {
+    return size_ == 0;
+  }
+
+  const_reference operator[](size_type pos) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(pos < size_);
+    return data_[pos];
+  }
+
+  const_reference front() const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(size_ != 0);
+    return data_[0];
+  }
+
+  const_reference back() const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(size_ != 0);
+    return data_[size_ - 1];
+  }
+
+  // Unlike std::basic_string_view::substr, pos is clamped rather than
+  // throwing if it's out of range.
+  BasicStringView substr(size_type pos = 0, size_type count = npos) const
+    noexcept
+  {
+    pos = (std::min)(pos, size_);
+    return {data_ + pos, (std::min)(count, size_ - pos)};
+  }
+
+  int compare(BasicStringView other) const noexcept
+  {
+    int const result =
+      Traits::compare(data_, other.data_, (std::min)(size_, other.size_));
+    if (result != 0)
+    {
+      return result;
+    }
+
+    return size_ == other.size_ ? 0 : (size_ < other.size_ ? -1 : 1);
+  }
+
+  size_type find(CharT c, size_type pos = 0) const noexcept
+  {
+    for (; pos < size_; ++pos)
+    {
+      if (Traits::eq(data_[pos], c))
+      {
+        return pos;
+      }
+    }
+
+    return npos;
+  }
+
+  size_type rfind(CharT c, size_type pos = npos) const noexcept
+  {
+    if (!size_)
+    {
+      return npos;
+    }
+
+    for (pos = (std::min)(pos, size_ - 1);; --pos)
+    {
+      if (Traits::eq(data_[pos], c))
+      {
+        return pos;
+      }
+
+      if (!pos)
+      {
+        return npos;
+      }
+    }
+  }
+
+  std::basic_string<CharT, Traits> to_string() const
+  {
+    return {data_, size_};
+  }
+
+  // Defined inline (rather than as templates at namespace scope) so that
+  // implicit conversions from strings and string literals apply to either
+  // side.
+  friend bool operator==(BasicStringView lhs, BasicStringView rhs) noexcept
+  {
+    return lhs.size_ == rhs.size_ && lhs.compare(rhs) == 0;
+  }
+
+  friend bool operator!=(BasicStringView lhs, BasicStringView rhs) noexcept
+  {
+    return !(lhs == rhs);
+  }
+
+  friend bool operator<(BasicStringView lhs, BasicStringView rhs) noexcept
+  {
+    return lhs.compare(rhs) < 0;
+  }
+
+  friend bool operator>(BasicStringView lhs, BasicStringView rhs) noexcept
+  {
+    return rhs < lhs;
+  }
+
+  friend bool operator<=(BasicStringView lhs, BasicStringView rhs) noexcept
+  {
+    return !(rhs < lhs);
+  }
+
+  friend bool operator>=(BasicStringView lhs, BasicStringView rhs) noexcept
+  {
+    return !(lhs < rhs);
+  }
+
+  friend std::basic_ostream<CharT, Traits>&
+    operator<<(std::basic_ostream<CharT, Traits>& out, BasicStringView str)
+  {
+    return out.write(str.data_, static_cast<std::streamsize>(str.size_));
+  }
+
+private:
+  CharT const* data_{};
+  size_type size_{};
+};
+
+template <typename CharT, typename Traits>
+constexpr typename BasicStringView<CharT, Traits>::size_type
+  BasicStringView<CharT, Traits>::npos;
+
+// Widens each character, same as streaming a narrow C string to a wide
+// stream.
+template <typename Traits>
+inline std::wostream& operator<<(std::wostream& out,
+                                 BasicStringView<char, Traits> str)
+{
+  for (auto const c : str)
+  {
+    out.put(out.widen(c));
+  }
+
+  return out;
+}
+
+using StringView = BasicStringView<char>;
+using WideStringView = BasicStringView<wchar_t>;
+}
+}
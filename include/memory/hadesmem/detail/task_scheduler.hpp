@@ -0,0 +1,636 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+// TODO: Lock-free (Chase-Lev) deques if the per-worker locks ever show up in
+// profiles. They are almost never contended now (only by thieves), so it
+// hasn't been worth the complexity.
+
+namespace hadesmem
+{
+namespace detail
+{
+// One thread per hardware thread.
+inline std::size_t GetDefaultThreadCount() noexcept
+{
+  return (std::max)(std::thread::hardware_concurrency(), 1U);
+}
+
+// Move-only type-erased nullary callable. Unlike std::function it doesn't
+// require the callable to be copyable, and small callables (which is nearly
+// all of them, e.g. lambdas capturing a few pointers or a string) are stored
+// inline rather than on the heap.
+class Task
+{
+public:
+  static std::size_t const kInlineSize = 6 * sizeof(void*);
+
+  Task() noexcept = default;
+
+  template <typename Func,
+            typename = std::enable_if_t<
+              !std::is_same<std::decay_t<Func>, Task>::value>>
+  Task(Func&& func)
+  {
+    using FuncT = std::decay_t<Func>;
+    Construct<FuncT>(std::forward<Func>(func), IsInline<FuncT>{});
+  }
+
+  Task(Task const& other) = delete;
+
+  Task& operator=(Task const& other) = delete;
+
+  Task(Task&& other) noexcept
+  {
+    MoveFrom(other);
+  }
+
+  Task& operator=(Task&& other) noexcept
+  {
+    if (this != &other)
+    {
+      Reset();
+      MoveFrom(other);
+    }
+
+    return *this;
+  }
+
+  ~Task()
+  {
+    Reset();
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return ops_ != nullptr;
+  }
+
+  void operator()()
+  {
+    HADESMEM_DETAIL_ASSERT(ops_ != nullptr);
+    ops_->invoke(&storage_);
+  }
+
+  void Reset() noexcept
+  {
+    if (ops_)
+    {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+private:
+  using Storage =
+    std::aligned_storage_t<kInlineSize, std::alignment_of<void*>::value * 2>;
+
+  template <typename FuncT>
+  using IsInline = std::integral_constant<
+    bool,
+    sizeof(FuncT) <= sizeof(Storage) &&
+      std::alignment_of<Storage>::value % std::alignment_of<FuncT>::value ==
+        0 &&
+      std::is_nothrow_move_constructible<FuncT>::value>;
+
+  struct Ops
+  {
+    void (*invoke)(void* storage);
+    void (*move)(void* dst, void* src) noexcept;
+    void (*destroy)(void* storage) noexcept;
+  };
+
+  template <typename FuncT> struct InlineOps
+  {
+    static void Invoke(void* storage)
+    {
+      (*static_cast<FuncT*>(storage))();
+    }
+
+    static void Move(void* dst, void* src) noexcept
+    {
+      new (dst) FuncT(std::move(*static_cast<FuncT*>(src)));
+      static_cast<FuncT*>(src)->~FuncT();
+    }
+
+    static void Destroy(void* storage) noexcept
+    {
+      static_cast<FuncT*>(storage)->~FuncT();
+    }
+
+    static Ops const* Get() noexcept
+    {
+      static Ops const ops = {&Invoke, &Move, &Destroy};
+      return &ops;
+    }
+  };
+
+  template <typename FuncT> struct HeapOps
+  {
+    static void Invoke(void* storage)
+    {
+      (**static_cast<FuncT**>(storage))();
+    }
+
+    static void Move(void* dst, void* src) noexcept
+    {
+      *static_cast<FuncT**>(dst) = *static_cast<FuncT**>(src);
+    }
+
+    static void Destroy(void* storage) noexcept
+    {
+      delete *static_cast<FuncT**>(storage);
+    }
+
+    static Ops const* Get() noexcept
+    {
+      static Ops const ops = {&Invoke, &Move, &Destroy};
+      return &ops;
+    }
+  };
+
+  template <typename FuncT, typename Func>
+  void Construct(Func&& func, std::true_type /*is_inline*/)
+  {
+    new (&storage_) FuncT(std::forward<Func>(func));
+    ops_ = InlineOps<FuncT>::Get();
+  }
+
+  template <typename FuncT, typename Func>
+  void Construct(Func&& func, std::false_type /*is_inline*/)
+  {
+    *reinterpret_cast<FuncT**>(&storage_) = new FuncT(std::forward<Func>(func));
+    ops_ = HeapOps<FuncT>::Get();
+  }
+
+  void MoveFrom(Task& other) noexcept
+  {
+    if (other.ops_)
+    {
+      other.ops_->move(&storage_, &other.storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  Storage storage_;
+  Ops const* ops_{};
+};
+
+// Work-stealing task scheduler. Each worker has its own deque which it pushes
+// to and pops from at the back (so recently spawned, cache-hot work is run
+// first), and which idle workers steal from at the front. Tasks submitted from
+// outside the pool are spread across the workers' deques.
+//
+// If max_queued is non-zero, submitting from outside the pool blocks while
+// that many tasks are queued (but not yet running), which bounds memory use
+// when the producer is faster than the workers (e.g. walking a directory tree
+// faster than the files can be processed). Submitting from a worker never
+// blocks, as that could deadlock.
+//
+// Tasks run directly (via Submit) are expected to do their own EH. Use a
+// TaskGroup to have exceptions propagated to the waiter.
+class TaskScheduler
+{
+public:
+  explicit TaskScheduler(std::size_t num_threads, std::size_t max_queued = 0)
+    : max_queued_{max_queued}
+  {
+    if (!num_threads)
+    {
+      num_threads = GetDefaultThreadCount();
+    }
+
+    for (std::size_t i = 0; i < num_threads; ++i)
+    {
+      queues_.emplace_back(std::make_unique<WorkerQueue>());
+    }
+
+    for (std::size_t i = 0; i < num_threads; ++i)
+    {
+      threads_.emplace_back(&TaskScheduler::WorkerMain, this, i);
+    }
+  }
+
+  TaskScheduler(TaskScheduler const& other) = delete;
+
+  TaskScheduler& operator=(TaskScheduler const& other) = delete;
+
+  // Runs everything which has already been submitted before returning.
+  ~TaskScheduler()
+  {
+    {
+      std::lock_guard<std::mutex> lock{state_mutex_};
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    space_cv_.notify_all();
+
+    try
+    {
+      for (auto& t : threads_)
+      {
+        t.join();
+      }
+    }
+    catch (...)
+    {
+    }
+  }
+
+  std::size_t GetNumThreads() const noexcept
+  {
+    return threads_.size();
+  }
+
+  void Submit(Task task)
+  {
+    HADESMEM_DETAIL_ASSERT(!!task);
+
+    std::size_t index = GetCurrentWorkerIndex();
+    if (index == kNoWorker)
+    {
+      WaitForSlot();
+      index = next_queue_++ % queues_.size();
+    }
+
+    // Counted before the task is visible so the counts can never go
+    // negative.
+    ++outstanding_;
+    ++queued_;
+    {
+      auto& queue = *queues_[index];
+      std::lock_guard<std::mutex> lock{queue.mutex};
+      queue.tasks.emplace_back(std::move(task));
+    }
+
+    if (sleepers_.load())
+    {
+      {
+        std::lock_guard<std::mutex> lock{state_mutex_};
+      }
+      work_cv_.notify_one();
+    }
+  }
+
+  // Runs a single queued task on the calling thread if there is one. Used by
+  // waiters so they help out rather than just blocking.
+  bool TryRunOne()
+  {
+    Task task;
+    std::size_t const index = GetCurrentWorkerIndex();
+    bool const is_worker = index != kNoWorker;
+    std::size_t const start = is_worker ? index : next_queue_.load();
+    if (!FindTask(start % queues_.size(), is_worker, &task))
+    {
+      return false;
+    }
+
+    RunTask(task);
+    return true;
+  }
+
+  // Blocks until every submitted task (including any they submit) has
+  // finished. Must not be called from a worker.
+  void WaitForIdle()
+  {
+    HADESMEM_DETAIL_ASSERT(GetCurrentWorkerIndex() == kNoWorker);
+
+    std::unique_lock<std::mutex> lock{state_mutex_};
+    ++idle_waiters_;
+    idle_cv_.wait(lock, [&]() { return outstanding_.load() == 0; });
+    --idle_waiters_;
+  }
+
+private:
+  static std::size_t const kNoWorker = static_cast<std::size_t>(-1);
+
+  struct WorkerQueue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  struct CurrentWorker
+  {
+    TaskScheduler const* scheduler;
+    std::size_t index;
+  };
+
+  static CurrentWorker& GetCurrentWorker() noexcept
+  {
+    static thread_local CurrentWorker current_worker{nullptr, kNoWorker};
+    return current_worker;
+  }
+
+  std::size_t GetCurrentWorkerIndex() const noexcept
+  {
+    auto const& current_worker = GetCurrentWorker();
+    return current_worker.scheduler == this ? current_worker.index : kNoWorker;
+  }
+
+  void WaitForSlot()
+  {
+    if (!max_queued_ || queued_.load() < max_queued_)
+    {
+      return;
+    }
+
+    // Wait for the queue to drain to the low water mark rather than for a
+    // single slot, so the producer isn't woken for every task.
+    std::unique_lock<std::mutex> lock{state_mutex_};
+    ++space_waiters_;
+    space_cv_.wait(lock, [&]() {
+      return queued_.load() <= GetLowWaterMark() || stopping_;
+    });
+    --space_waiters_;
+  }
+
+  std::size_t GetLowWaterMark() const noexcept
+  {
+    return max_queued_ / 2;
+  }
+
+  // Pops from the back of our own queue (if we have one), otherwise steals
+  // from the front of everyone else's.
+  bool FindTask(std::size_t index, bool is_worker, Task* task)
+  {
+    if (is_worker)
+    {
+      auto& queue = *queues_[index];
+      std::lock_guard<std::mutex> lock{queue.mutex};
+      if (!queue.tasks.empty())
+      {
+        *task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        OnTaskDequeued();
+        return true;
+      }
+    }
+
+    std::size_t const num_queues = queues_.size();
+    for (std::size_t i = is_worker ? 1 : 0; i < num_queues; ++i)
+    {
+      auto& queue = *queues_[(index + i) % num_queues];
+      std::lock_guard<std::mutex> lock{queue.mutex};
+      if (!queue.tasks.empty())
+      {
+        *task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        OnTaskDequeued();
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void OnTaskDequeued()
+  {
+    if (--queued_ == GetLowWaterMark() && space_waiters_.load())
+    {
+      {
+        std::lock_guard<std::mutex> lock{state_mutex_};
+      }
+      space_cv_.notify_all();
+    }
+  }
+
+  void RunTask(Task& task)
+  {
+    try
+    {
+      task();
+    }
+    catch (...)
+    {
+      // Tasks should be doing their own EH.
+      HADESMEM_DETAIL_ASSERT(false);
+    }
+
+    // Destroy the callable (and anything it captured) before we count the
+    // task as finished, so WaitForIdle really does mean idle.
+    task.Reset();
+
+    if (--outstanding_ == 0 && idle_waiters_.load())
+    {
+      {
+        std::lock_guard<std::mutex> lock{state_mutex_};
+      }
+      idle_cv_.notify_all();
+    }
+  }
+
+  void WorkerMain(std::size_t index)
+  {
+    GetCurrentWorker() = CurrentWorker{this, index};
+
+    for (;;)
+    {
+      Task task;
+      if (FindTask(index, true, &task))
+      {
+        RunTask(task);
+        continue;
+      }
+
+      // The waiter counts are incremented under the lock before the
+      // predicate is checked, and the notifiers check them after updating
+      // the counts the predicates depend on, so a wakeup can't be lost.
+      std::unique_lock<std::mutex> lock{state_mutex_};
+      ++sleepers_;
+      work_cv_.wait(lock, [&]() { return queued_.load() != 0 || stopping_; });
+      --sleepers_;
+      if (stopping_ && queued_.load() == 0)
+      {
+        break;
+      }
+    }
+  }
+
+  std::size_t max_queued_;
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<std::size_t> next_queue_{0};
+  std::atomic<std::size_t> queued_{0};
+  std::atomic<std::size_t> outstanding_{0};
+  std::atomic<std::size_t> sleepers_{0};
+  std::atomic<std::size_t> space_waiters_{0};
+  std::atomic<std::size_t> idle_waiters_{0};
+  bool stopping_{false};
+  std::mutex state_mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable space_cv_;
+  std::condition_variable idle_cv_;
+};
+
+// A set of tasks which can be waited on as a whole. Waiting helps run queued
+// tasks rather than just blocking, so groups can be nested (i.e. a task can
+// create a group and wait on it) without starving the pool. The first
+// exception thrown by a task in the group is rethrown by Wait.
+class TaskGroup
+{
+public:
+  explicit TaskGroup(TaskScheduler& scheduler) noexcept : scheduler_{&scheduler}
+  {
+  }
+
+  TaskGroup(TaskGroup const& other) = delete;
+
+  TaskGroup& operator=(TaskGroup const& other) = delete;
+
+  ~TaskGroup()
+  {
+    try
+    {
+      Wait();
+    }
+    catch (...)
+    {
+    }
+  }
+
+  template <typename Func> void Run(Func&& func)
+  {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      ++pending_;
+    }
+
+    scheduler_->Submit(
+      [ this, func = std::forward<Func>(func) ]() mutable {
+        try
+        {
+          func();
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock{mutex_};
+          if (!error_)
+          {
+            error_ = std::current_exception();
+          }
+        }
+
+        // The waiter can't return (and destroy the group) until it has seen
+        // pending_ hit zero under the lock, so it's safe to touch the group up
+        // until we release it.
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (--pending_ == 0)
+        {
+          cv_.notify_all();
+        }
+      });
+  }
+
+  void Wait()
+  {
+    for (;;)
+    {
+      {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (!pending_)
+        {
+          break;
+        }
+      }
+
+      if (scheduler_->TryRunOne())
+      {
+        continue;
+      }
+
+      // Nothing to help with, so the rest of the group is running on other
+      // threads. Time out occasionally in case they queue more work which we
+      // could be helping with.
+      std::unique_lock<std::mutex> lock{mutex_};
+      cv_.wait_for(
+        lock, std::chrono::milliseconds(1), [&]() { return !pending_; });
+    }
+
+    std::exception_ptr error;
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      std::swap(error, error_);
+    }
+
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+  TaskScheduler* scheduler_;
+  std::size_t pending_{};
+  std::exception_ptr error_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+// Calls func(chunk_beg, chunk_end) for each grain sized chunk of [beg, end) in
+// parallel, and waits for them all to finish.
+template <typename Func>
+void ParallelFor(TaskScheduler& scheduler,
+                 std::size_t beg,
+                 std::size_t end,
+                 std::size_t grain,
+                 Func const& func)
+{
+  HADESMEM_DETAIL_ASSERT(grain != 0);
+
+  TaskGroup group{scheduler};
+  for (std::size_t i = beg; i < end;)
+  {
+    std::size_t const chunk_end = end - i > grain ? i + grain : end;
+    group.Run([&func, i, chunk_end]() { func(i, chunk_end); });
+    i = chunk_end;
+  }
+
+  group.Wait();
+}
+
+// Process-wide scheduler for library code which parallelizes a single call
+// (e.g. FindParallel), with one worker per hardware thread. Only a weak
+// reference is kept here, so its lifetime is owned by the callers: it's
+// created when first needed and destroyed (joining the workers) when the last
+// holder releases it. Nothing is left to join at static destruction, which
+// would deadlock under the loader lock if the module were unloaded with
+// FreeLibrary. To avoid paying for creating and joining the threads on every
+// call, hold a reference for as long as the workers should be reused, and
+// release it before unloading (not from DllMain).
+inline std::shared_ptr<TaskScheduler> GetSharedTaskScheduler()
+{
+  static std::mutex mutex;
+  static std::weak_ptr<TaskScheduler> weak_scheduler;
+
+  std::lock_guard<std::mutex> lock{mutex};
+  auto scheduler = weak_scheduler.lock();
+  if (!scheduler)
+  {
+    scheduler = std::make_shared<TaskScheduler>(GetDefaultThreadCount());
+    weak_scheduler = scheduler;
+  }
+
+  return scheduler;
+}
+}
+}
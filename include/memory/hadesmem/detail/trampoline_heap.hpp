@@ -0,0 +1,430 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/alloc.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+
+// TODO: Release granules which become completely empty (need to be careful
+// about threads which may still be executing in a trampoline which was just
+// freed though, see the comments in PatchDetour::Apply).
+
+namespace hadesmem
+{
+namespace detail
+{
+class TrampolineHeap;
+
+// A slot in a TrampolineHeap. The slot is returned to the heap (not to the OS)
+// when the block is destroyed.
+class TrampolineBlock
+{
+public:
+  explicit TrampolineBlock(std::shared_ptr<TrampolineHeap> heap,
+                           void* base,
+                           std::size_t size) noexcept
+    : heap_{std::move(heap)}, base_{base}, size_{size}
+  {
+  }
+
+  TrampolineBlock(TrampolineBlock const& other) = delete;
+
+  TrampolineBlock& operator=(TrampolineBlock const& other) = delete;
+
+  ~TrampolineBlock();
+
+  void* GetBase() const noexcept
+  {
+    return base_;
+  }
+
+  std::size_t GetSize() const noexcept
+  {
+    return size_;
+  }
+
+private:
+  std::shared_ptr<TrampolineHeap> heap_;
+  void* base_;
+  std::size_t size_;
+};
+
+// Inspired by EasyHook.
+// Sub-allocates small executable blocks (trampolines, stub gates, jump
+// targets, etc.) out of allocation granules, so hooking a large number of
+// functions doesn't cost a separate allocation (and a mostly empty 64K
+// reservation) per block. On x64 blocks are always within +/- 2GB of the
+// requested address so they can be reached with a 32-bit displacement.
+class TrampolineHeap : public std::enable_shared_from_this<TrampolineHeap>
+{
+public:
+  // Blocks are aligned (and sized) to this, which keeps any code in them
+  // nicely aligned.
+  static std::size_t const kMinBlockSize = 0x10;
+
+  explicit TrampolineHeap(Process const& process) : process_{process}
+  {
+    // Don't keep another heap alive through our copy of the Process.
+    process_.FlushTrampolineHeap();
+
+    SYSTEM_INFO sys_info{};
+    ::GetSystemInfo(&sys_info);
+    granularity_ = sys_info.dwAllocationGranularity;
+    min_address_ =
+      reinterpret_cast<std::uintptr_t>(sys_info.lpMinimumApplicationAddress);
+    max_address_ =
+      reinterpret_cast<std::uintptr_t>(sys_info.lpMaximumApplicationAddress);
+  }
+
+  TrampolineHeap(TrampolineHeap const& other) = delete;
+
+  TrampolineHeap& operator=(TrampolineHeap const& other) = delete;
+
+  ~TrampolineHeap()
+  {
+    for (auto const& granule : granules_)
+    {
+      try
+      {
+        ::hadesmem::Free(process_, reinterpret_cast<void*>(granule.base));
+      }
+      catch (...)
+      {
+        HADESMEM_DETAIL_TRACE_A(
+          boost::current_exception_diagnostic_information().c_str());
+        HADESMEM_DETAIL_ASSERT(false);
+      }
+    }
+  }
+
+  std::unique_ptr<TrampolineBlock> Allocate(void* address, std::size_t size)
+  {
+    std::size_t const block_size = GetBlockSize(size);
+    if (!block_size)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid trampoline size."});
+    }
+
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto const target = reinterpret_cast<std::uintptr_t>(address);
+
+    // Prefer blocks above the target, same as when looking for a new granule
+    // (see the comments in AllocateGranule).
+    Granule* granule = FindExistingGranule(target, block_size, true);
+    if (!granule)
+    {
+      granule = FindExistingGranule(target, block_size, false);
+    }
+
+    if (!granule)
+    {
+      granules_.emplace_back(Granule{AllocateGranule(target), 0, {}});
+      granule = &granules_.back();
+    }
+
+    void* const base = AllocateFromGranule(*granule, block_size);
+    HADESMEM_DETAIL_ASSERT(base);
+    return std::make_unique<TrampolineBlock>(
+      shared_from_this(), base, block_size);
+  }
+
+  void Free(void* base, std::size_t size) noexcept
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto const address = reinterpret_cast<std::uintptr_t>(base);
+    for (auto& granule : granules_)
+    {
+      if (address >= granule.base && address < granule.base + granularity_)
+      {
+        granule.free_lists[size].push_back(base);
+        return;
+      }
+    }
+
+    HADESMEM_DETAIL_ASSERT(false);
+  }
+
+  std::size_t GetNumGranules() const
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return granules_.size();
+  }
+
+private:
+  struct Granule
+  {
+    std::uintptr_t base;
+    std::size_t used;
+    std::map<std::size_t, std::vector<void*>> free_lists;
+  };
+
+  std::size_t GetBlockSize(std::size_t size) const noexcept
+  {
+    if (!size || size > granularity_)
+    {
+      return 0;
+    }
+
+    // Power of two size classes so freed blocks are likely to be reused.
+    std::size_t block_size = kMinBlockSize;
+    while (block_size < size)
+    {
+      block_size *= 2;
+    }
+
+    return block_size;
+  }
+
+  bool IsNear(std::uintptr_t target, std::uintptr_t base) const noexcept
+  {
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+    // The whole granule must be in range, not just its start. Leaves a little
+    // slack for the size of the instruction.
+    std::uintptr_t const kMaxDistance = 0x7FFFFF00ULL;
+    std::uintptr_t const end = base + granularity_;
+    return base >= target ? end - target < kMaxDistance
+                          : target - base < kMaxDistance;
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+    (void)target;
+    (void)base;
+    return true;
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+  }
+
+  bool HasSpace(Granule const& granule, std::size_t block_size) const
+  {
+    auto const iter = granule.free_lists.find(block_size);
+    return (iter != std::end(granule.free_lists) && !iter->second.empty()) ||
+           granularity_ - granule.used >= block_size;
+  }
+
+  Granule* FindExistingGranule(std::uintptr_t target,
+                               std::size_t block_size,
+                               bool forward)
+  {
+    for (auto& granule : granules_)
+    {
+      if ((granule.base >= target) == forward &&
+          IsNear(target, granule.base) && HasSpace(granule, block_size))
+      {
+        return &granule;
+      }
+    }
+
+    return nullptr;
+  }
+
+  void* AllocateFromGranule(Granule& granule, std::size_t block_size)
+  {
+    auto const iter = granule.free_lists.find(block_size);
+    if (iter != std::end(granule.free_lists) && !iter->second.empty())
+    {
+      void* const base = iter->second.back();
+      iter->second.pop_back();
+      return base;
+    }
+
+    HADESMEM_DETAIL_ASSERT(granularity_ - granule.used >= block_size);
+    void* const base = reinterpret_cast<void*>(granule.base + granule.used);
+    granule.used += block_size;
+    return base;
+  }
+
+  std::uintptr_t AllocateGranule(std::uintptr_t target)
+  {
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+    std::uintptr_t const kMaxDistance = 0x7FFFFF00ULL;
+    std::uintptr_t const search_beg =
+      target > min_address_ + kMaxDistance ? target - kMaxDistance
+                                           : min_address_;
+    std::uintptr_t const search_end =
+      max_address_ - target > kMaxDistance ? target + kMaxDistance
+                                           : max_address_;
+
+    // NOTE: The issue described below now appears to be fixed (the mov is now
+    // a movsxd), but it doesn't hurt to keep the logic this way (especially
+    // since it's a fairly generic problem that other hooking libraries are
+    // likely to have at some point or another).
+    // Do two separate passes when looking for trampolines, ensuring to scan
+    // forwards first. This is because there is a bug in Steam's overlay (last
+    // checked and confirmed in SteamOverlayRender64.dll v2.50.25.37) where
+    // negative displacements are not correctly sign-extended when cast to
+    // 64-bits, resulting in a crash when they attempt to resolve the jump.
+    // .text:0000000180082956                 cmp     al, 0FFh
+    // .text:0000000180082958                 jnz     short loc_180082971
+    // .text:000000018008295A                 cmp     byte ptr [r13+1], 25h
+    // .text:000000018008295F                 jnz     short loc_180082971
+    // ; Notice how the displacement is not being sign extended.
+    // .text:0000000180082961                 mov     eax, [r13+2]
+    // .text:0000000180082965                 lea     rcx, [rax+r13]
+    // .text:0000000180082969                 mov     r13, [rcx+6]
+    std::uintptr_t granule = FindGranuleForward(target, search_end);
+    if (!granule)
+    {
+      HADESMEM_DETAIL_TRACE_A(
+        "WARNING! Failed to find a viable trampoline "
+        "granule in forward scan, falling back to backward scan. This may "
+        "cause incompatibilty with some other overlays.");
+      granule = FindGranuleBackward(target, search_beg);
+    }
+
+    if (!granule)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Failed to find trampoline memory block."});
+    }
+
+    return granule;
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+    (void)target;
+    return reinterpret_cast<std::uintptr_t>(Alloc(process_, granularity_));
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+  }
+
+  // Walks the regions above the target rather than probing every page with
+  // VirtualAllocEx, so each allocated (or free but too small) region costs a
+  // single query (or a lookup, if the process has a region map).
+  std::uintptr_t FindGranuleForward(std::uintptr_t target,
+                                    std::uintptr_t search_end)
+  {
+    std::uintptr_t cur = AlignUp(target);
+    while (cur < search_end && search_end - cur >= granularity_)
+    {
+      MEMORY_BASIC_INFORMATION mbi{};
+      if (!TryQuery(process_, reinterpret_cast<void*>(cur), &mbi))
+      {
+        break;
+      }
+
+      auto const region_beg =
+        reinterpret_cast<std::uintptr_t>(mbi.BaseAddress);
+      std::uintptr_t const region_end = region_beg + mbi.RegionSize;
+      if (mbi.State == MEM_FREE && region_end - cur >= granularity_ &&
+          IsNear(target, cur))
+      {
+        if (TryAlloc(process_, granularity_, reinterpret_cast<void*>(cur)))
+        {
+          return cur;
+        }
+
+        // Someone else probably grabbed it first.
+        cur += granularity_;
+        continue;
+      }
+
+      cur = AlignUp(region_end);
+    }
+
+    return 0;
+  }
+
+  // Free regions can't be walked backwards a region at a time (querying an
+  // address in a free region only tells us about the part above it), so step
+  // a granule at a time through free memory, and a whole allocation at a time
+  // through everything else.
+  std::uintptr_t FindGranuleBackward(std::uintptr_t target,
+                                     std::uintptr_t search_beg)
+  {
+    std::uintptr_t cur = AlignDown(target);
+    while (cur > search_beg && cur - search_beg >= granularity_)
+    {
+      std::uintptr_t const candidate = cur - granularity_;
+
+      MEMORY_BASIC_INFORMATION mbi{};
+      if (!TryQuery(process_, reinterpret_cast<void*>(candidate), &mbi))
+      {
+        break;
+      }
+
+      if (mbi.State != MEM_FREE)
+      {
+        auto const allocation_base =
+          reinterpret_cast<std::uintptr_t>(mbi.AllocationBase);
+        cur = allocation_base && allocation_base < candidate
+                ? AlignDown(allocation_base)
+                : candidate;
+        continue;
+      }
+
+      if (mbi.RegionSize >= granularity_ && IsNear(target, candidate) &&
+          TryAlloc(process_, granularity_, reinterpret_cast<void*>(candidate)))
+      {
+        return candidate;
+      }
+
+      cur = candidate;
+    }
+
+    return 0;
+  }
+
+  std::uintptr_t AlignUp(std::uintptr_t address) const noexcept
+  {
+    return AlignDown(address + granularity_ - 1);
+  }
+
+  std::uintptr_t AlignDown(std::uintptr_t address) const noexcept
+  {
+    return address - (address % granularity_);
+  }
+
+  Process process_;
+  std::size_t granularity_{};
+  std::uintptr_t min_address_{};
+  std::uintptr_t max_address_{};
+  mutable std::mutex mutex_;
+  // Granules are only released when the heap is destroyed.
+  std::vector<Granule> granules_;
+};
+
+inline TrampolineBlock::~TrampolineBlock()
+{
+  if (heap_)
+  {
+    heap_->Free(base_, size_);
+  }
+}
+
+// The heap lives in the Process (and is shared by its copies), so it's freed
+// along with the last copy. Blocks hold a reference to their heap, so it's safe
+// for a block to outlive the Process (e.g. a hook which is a global).
+inline std::shared_ptr<TrampolineHeap> GetTrampolineHeap(Process const& process)
+{
+  if (auto heap = process.GetTrampolineHeap())
+  {
+    return heap;
+  }
+
+  return process.SetTrampolineHeap(std::make_shared<TrampolineHeap>(process));
+}
+
+inline std::unique_ptr<TrampolineBlock> AllocateTrampolineNear(
+  Process const& process, void* address, std::size_t size)
+{
+  return GetTrampolineHeap(process)->Allocate(address, size);
+}
+}
+}
@@ -704,6 +704,29 @@ typedef struct _RTL_USER_PROCESS_PARAMETERS
 
 typedef RTL_USER_PROCESS_PARAMETERS* PRTL_USER_PROCESS_PARAMETERS;
 
+struct PEB_LDR_DATA
+{
+  ULONG Length;
+  BOOLEAN Initialized;
+  HANDLE SsHandle;
+  LIST_ENTRY InLoadOrderModuleList;
+  LIST_ENTRY InMemoryOrderModuleList;
+  LIST_ENTRY InInitializationOrderModuleList;
+};
+
+// Only the fields which have been stable since XP.
+struct LDR_DATA_TABLE_ENTRY
+{
+  LIST_ENTRY InLoadOrderLinks;
+  LIST_ENTRY InMemoryOrderLinks;
+  LIST_ENTRY InInitializationOrderLinks;
+  PVOID DllBase;
+  PVOID EntryPoint;
+  ULONG SizeOfImage;
+  UNICODE_STRING FullDllName;
+  UNICODE_STRING BaseDllName;
+};
+
 struct PEB
 {
   UCHAR InheritedAddressSpace;
@@ -19,10 +19,12 @@ namespace hadesmem
 {
 namespace detail
 {
-inline void WriteUnchecked(Process const& process,
-                           PVOID address,
-                           LPCVOID data,
-                           std::size_t len)
+// Returns the error code rather than throwing, so it's safe to call while
+// other threads are suspended (it doesn't allocate).
+inline DWORD WriteUncheckedNoThrow(Process const& process,
+                                   PVOID address,
+                                   LPCVOID data,
+                                   std::size_t len) noexcept
 {
   HADESMEM_DETAIL_ASSERT(address != nullptr);
   HADESMEM_DETAIL_ASSERT(data != nullptr);
@@ -30,10 +32,23 @@ inline void WriteUnchecked(Process const& process,
 
   SIZE_T bytes_written = 0;
   if (!::WriteProcessMemory(
-        process.GetHandle(), address, data, len, &bytes_written) ||
-      bytes_written != len)
+        process.GetHandle(), address, data, len, &bytes_written))
+  {
+    return ::GetLastError();
+  }
+
+  return bytes_written == len ? ERROR_SUCCESS : ERROR_PARTIAL_COPY;
+}
+
+inline void WriteUnchecked(Process const& process,
+                           PVOID address,
+                           LPCVOID data,
+                           std::size_t len)
+{
+  DWORD const last_error =
+    WriteUncheckedNoThrow(process, address, data, len);
+  if (last_error != ERROR_SUCCESS)
   {
-    DWORD const last_error = ::GetLastError();
     HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
                                     << ErrorString{"WriteProcessMemory failed."}
                                     << ErrorCodeWinLast{last_error});
@@ -49,6 +64,10 @@ inline void WriteImpl(Process const& process,
   HADESMEM_DETAIL_ASSERT(data != nullptr);
   HADESMEM_DETAIL_ASSERT(len != 0);
 
+  // Invalidate up front so a partial write (i.e. a failure part way through)
+  // can't leave stale data in the cache.
+  process.InvalidateReadCache(address, len);
+
   for (;;)
   {
     ProtectGuard protect_guard{process, address, ProtectGuardType::kWrite};
@@ -4,7 +4,10 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <exception>
 #include <iterator>
 #include <limits>
 #include <locale>
@@ -25,16 +28,25 @@
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/crypto.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/mapped_file.hpp>
+#if !defined(HADESMEM_NO_PUGIXML)
+#include <hadesmem/detail/pattern_cache.hpp>
+#endif
+#include <hadesmem/detail/pattern_matcher.hpp>
 #if !defined(HADESMEM_NO_PUGIXML)
 #include <hadesmem/detail/pugixml_helpers.hpp>
 #endif
 #include <hadesmem/detail/smart_handle.hpp>
 #include <hadesmem/detail/static_assert.hpp>
 #include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/detail/task_scheduler.hpp>
 #include <hadesmem/detail/to_upper_ordinal.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/find_procedure.hpp>
 #include <hadesmem/module.hpp>
+#include <hadesmem/module_index.hpp>
 #include <hadesmem/module_list.hpp>
 #include <hadesmem/pelib/dos_header.hpp>
 #include <hadesmem/pelib/nt_headers.hpp>
@@ -47,8 +59,6 @@
 // TODO: Standalone app/example for FindPattern. For dumping results,
 // experimenting with patterns, automatically generating new patterns, etc.
 
-// TODO: Support nibble wildcards. (e.g. FF D? EB)
-
 // TODO: Handle the case where after resolving a pattern, the result lives
 // outside the module (the heap, a different module, etc) and we want to use
 // that result as the starting address for a different pattern. Example: Using a
@@ -151,11 +161,35 @@ inline void* Rel(Process const& process,
   }
 }
 
-struct PatternDataByte
+inline bool ConvertNibble(wchar_t c, std::uint8_t* value, std::uint8_t* mask)
 {
-  std::uint8_t data;
-  bool wildcard;
-};
+  if (c == L'?')
+  {
+    *value = 0;
+    *mask = 0;
+    return true;
+  }
+
+  if (c >= L'0' && c <= L'9')
+  {
+    *value = static_cast<std::uint8_t>(c - L'0');
+  }
+  else if (c >= L'a' && c <= L'f')
+  {
+    *value = static_cast<std::uint8_t>(c - L'a' + 0xA);
+  }
+  else if (c >= L'A' && c <= L'F')
+  {
+    *value = static_cast<std::uint8_t>(c - L'A' + 0xA);
+  }
+  else
+  {
+    return false;
+  }
+
+  *mask = 0xF;
+  return true;
+}
 
 inline std::vector<PatternDataByte> ConvertData(std::wstring const& data)
 {
@@ -178,27 +212,44 @@ inline std::vector<PatternDataByte> ConvertData(std::wstring const& data)
                                       << ErrorString{"Data parsing failed."});
     }
 
-    bool const is_wildcard = (data_cur_str == L"??");
-    std::uint32_t current = 0U;
-    if (!is_wildcard)
+    // Full (??) or nibble (e.g. D? or ?D) wildcard.
+    if (data_cur_str.find(L'?') != std::wstring::npos)
     {
-      std::wistringstream conv{data_cur_str};
-      conv.imbue(std::locale::classic());
-      if (!(conv >> std::hex >> current))
-      {
-        HADESMEM_DETAIL_THROW_EXCEPTION(
-          Error{} << ErrorString{"Data conversion failed."});
-      }
-
-      if (current > static_cast<std::uint8_t>(-1))
+      std::uint8_t hi = 0;
+      std::uint8_t hi_mask = 0;
+      std::uint8_t lo = 0;
+      std::uint8_t lo_mask = 0;
+      if (data_cur_str.size() != 2 ||
+          !ConvertNibble(data_cur_str[0], &hi, &hi_mask) ||
+          !ConvertNibble(data_cur_str[1], &lo, &lo_mask))
       {
         HADESMEM_DETAIL_THROW_EXCEPTION(Error()
-                                        << ErrorString("Invalid data."));
+                                        << ErrorString("Invalid wildcard."));
       }
+
+      data_real.emplace_back(
+        PatternDataByte{static_cast<std::uint8_t>((hi << 4) | lo),
+                        static_cast<std::uint8_t>((hi_mask << 4) | lo_mask)});
+      continue;
+    }
+
+    std::uint32_t current = 0U;
+    std::wistringstream conv{data_cur_str};
+    conv.imbue(std::locale::classic());
+    if (!(conv >> std::hex >> current))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Data conversion failed."});
+    }
+
+    if (current > static_cast<std::uint8_t>(-1))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error()
+                                      << ErrorString("Invalid data."));
     }
 
     data_real.emplace_back(
-      PatternDataByte{static_cast<std::uint8_t>(current), is_wildcard});
+      PatternDataByte{static_cast<std::uint8_t>(current), 0xFF});
   } while (!data_str.eof());
 
   return data_real;
@@ -217,20 +268,11 @@ void* FindRaw(Process const& process,
   std::vector<std::uint8_t> const haystack{ReadVector<std::uint8_t>(
     process, s_beg, static_cast<std::size_t>(mem_size))};
 
-  auto const h_beg = std::begin(haystack);
-  auto const h_end = std::end(haystack);
-  auto const iter =
-    std::search(h_beg,
-                h_end,
-                n_beg,
-                n_end,
-                [](std::uint8_t h_cur, detail::PatternDataByte const& n_cur) {
-                  return n_cur.wildcard || h_cur == n_cur.data;
-                });
-
-  if (iter != h_end)
+  PatternMatcher const matcher{n_beg, n_end};
+  auto const h_beg = haystack.data();
+  if (auto const match = matcher.Search(h_beg, h_beg + haystack.size()))
   {
-    return s_beg + std::distance(h_beg, iter);
+    return s_beg + (match - h_beg);
   }
 
   return nullptr;
@@ -242,14 +284,33 @@ struct ModuleRegionInfo
   using ScanRegion = std::pair<std::uint8_t*, std::uint8_t*>;
   std::vector<ScanRegion> code_regions;
   std::vector<ScanRegion> data_regions;
+  // Index of the section each region came from.
+  std::vector<WORD> code_sections;
+  std::vector<WORD> data_sections;
 };
 
+// If an index is given the module is looked up in that rather than by taking
+// a new snapshot.
 inline ModuleRegionInfo GetModuleInfo(Process const& process,
-                                      std::wstring const& module)
+                                      std::wstring const& module,
+                                      ModuleIndex const* module_index = nullptr)
 {
   ModuleRegionInfo mod_info;
 
-  if (module.empty())
+  if (module_index)
+  {
+    Module const* const found = module.empty()
+                                  ? module_index->Find(HMODULE{})
+                                  : module_index->Find(module);
+    if (!found)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Could not find module."});
+    }
+
+    mod_info.module = std::make_shared<Module>(*found);
+  }
+  else if (module.empty())
   {
     // I'm sorry... /clr
     mod_info.module = std::make_shared<Module>(process, __nullptr);
@@ -261,12 +322,16 @@ inline ModuleRegionInfo GetModuleInfo(Process const& process,
 
   auto const base =
     reinterpret_cast<std::uint8_t*>(mod_info.module->GetHandle());
-  PeFile const pe_file{process, base, hadesmem::PeFileType::kImage, 0};
+  PeFile const pe_file{
+    process, base, hadesmem::PeFileType::kImage, mod_info.module->GetSize()};
   DosHeader const dos_header{process, pe_file};
   NtHeaders const nt_headers{process, pe_file};
   SectionList const sections{process, pe_file};
+  WORD section_index = 0;
   for (auto const& s : sections)
   {
+    WORD const cur_section_index = section_index++;
+
     bool const is_code_section =
       !!(s.GetCharacteristics() & IMAGE_SCN_CNT_CODE);
     bool const is_data_section =
@@ -295,6 +360,9 @@ inline ModuleRegionInfo GetModuleInfo(Process const& process,
     auto& regions =
       is_code_section ? mod_info.code_regions : mod_info.data_regions;
     regions.emplace_back(section_beg, section_end);
+    auto& region_sections =
+      is_code_section ? mod_info.code_sections : mod_info.data_sections;
+    region_sections.push_back(cur_section_index);
   }
 
   if (mod_info.code_regions.empty() && mod_info.data_regions.empty())
@@ -306,14 +374,67 @@ inline ModuleRegionInfo GetModuleInfo(Process const& process,
   return mod_info;
 }
 
-template <typename NeedleIterator>
-void* Find(Process const& process,
-           ModuleRegionInfo::ScanRegion const& region,
-           void* start,
-           NeedleIterator n_beg,
-           NeedleIterator n_end)
+// SHA-1 of the raw data of the section backing each region. The hashes are
+// taken from the module's file on disk rather than from memory, so they are
+// unaffected by relocations (and by anything which has patched the image since
+// it was loaded).
+inline void GetModuleRegionHashes(ModuleRegionInfo const& mod_info,
+                                  std::vector<std::wstring>* code_hashes,
+                                  std::vector<std::wstring>* data_hashes)
 {
-  std::uint8_t* s_beg = region.first;
+  HADESMEM_DETAIL_ASSERT(code_hashes != nullptr);
+  HADESMEM_DETAIL_ASSERT(data_hashes != nullptr);
+
+  auto buf = PeFileToBuffer(mod_info.module->GetPath());
+  if (buf.size() > (std::numeric_limits<DWORD>::max)())
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Module file too large."});
+  }
+
+  auto const buf_size = static_cast<DWORD>(buf.size());
+  Process const local_process{::GetCurrentProcessId()};
+  PeFile const pe_file{local_process,
+                       buf.data(),
+                       PeFileType::kData,
+                       buf_size,
+                       PeFileFlags::kLocalBuffer};
+  std::vector<std::wstring> section_hashes;
+  SectionList const sections{local_process, pe_file};
+  for (auto const& s : sections)
+  {
+    DWORD const raw_beg = (std::min)(s.GetPointerToRawData(), buf_size);
+    DWORD const raw_size =
+      (std::min)(s.GetSizeOfRawData(), buf_size - raw_beg);
+    section_hashes.emplace_back(
+      ByteArrayToString(GetSha1Hash(buf.data() + raw_beg, raw_size)));
+  }
+
+  auto const get_hashes = [&](std::vector<WORD> const& region_sections,
+                              std::vector<std::wstring>* hashes) {
+    hashes->clear();
+    for (auto const i : region_sections)
+    {
+      if (i >= section_hashes.size())
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Module and file sections do not match."});
+      }
+
+      hashes->push_back(section_hashes[i]);
+    }
+  };
+  get_hashes(mod_info.code_sections, code_hashes);
+  get_hashes(mod_info.data_sections, data_hashes);
+}
+
+// Applies the custom start address rules to a region. Returns false if the
+// region should be skipped.
+inline bool GetScanBegin(ModuleRegionInfo::ScanRegion const& region,
+                         void* start,
+                         std::uint8_t** s_beg)
+{
+  *s_beg = region.first;
   std::uint8_t* const s_end = region.second;
 
   // Support custom scan start address.
@@ -322,10 +443,10 @@ void* Find(Process const& process,
     // Use specified starting address (plus one, so we don't
     // just find the same thing again) if we're in the target
     // region.
-    if (start >= s_beg && start < s_end)
+    if (start >= *s_beg && start < s_end)
     {
-      s_beg = static_cast<std::uint8_t*>(start) + 1;
-      if (s_beg == s_end)
+      *s_beg = static_cast<std::uint8_t*>(start) + 1;
+      if (*s_beg == s_end)
       {
         HADESMEM_DETAIL_THROW_EXCEPTION(
           Error() << ErrorString("Invalid start address."));
@@ -334,11 +455,167 @@ void* Find(Process const& process,
     // Skip if we're not in the target region.
     else
     {
-      return nullptr;
+      return false;
     }
   }
 
-  return FindRaw(process, s_beg, s_end, n_beg, n_end);
+  return true;
+}
+
+template <typename NeedleIterator>
+void* Find(Process const& process,
+           ModuleRegionInfo::ScanRegion const& region,
+           void* start,
+           NeedleIterator n_beg,
+           NeedleIterator n_end)
+{
+  std::uint8_t* s_beg = nullptr;
+  if (!GetScanBegin(region, start, &s_beg))
+  {
+    return nullptr;
+  }
+
+  return FindRaw(process, s_beg, region.second, n_beg, n_end);
+}
+
+// Roughly the size of L2, so each chunk is read into a buffer which stays
+// in cache while it is scanned.
+std::size_t const kParallelScanChunkSize = 0x40000;
+
+// Parallel scans run on the shared scheduler, with the calling thread helping
+// out, so asking for more threads than that has no effect.
+inline std::size_t GetScanThreadCount(std::size_t num_threads) noexcept
+{
+  if (!num_threads)
+  {
+    return GetDefaultThreadCount();
+  }
+
+  return (std::min)(num_threads, GetDefaultThreadCount() + 1);
+}
+
+// Equivalent of calling Find on each region in turn and returning the first
+// match, except that the regions are split into chunks which are read and
+// scanned concurrently. Chunks overlap by the needle size minus one so
+// matches spanning a chunk boundary are found. Chunks are handed out in
+// address order and every chunk before the first match is always scanned, so
+// the result is the same as the serial scan no matter how the work is
+// scheduled.
+template <typename NeedleIterator>
+void* FindParallel(Process const& process,
+                   std::vector<ModuleRegionInfo::ScanRegion> const& regions,
+                   void* start,
+                   NeedleIterator n_beg,
+                   NeedleIterator n_end,
+                   std::size_t num_threads)
+{
+  PatternMatcher const matcher{n_beg, n_end};
+  std::size_t const overlap = matcher.GetSize() - 1;
+
+  struct Chunk
+  {
+    std::uint8_t* beg;
+    std::uint8_t* end;
+    std::uint8_t* region_end;
+  };
+
+  std::vector<Chunk> chunks;
+  for (auto const& region : regions)
+  {
+    std::uint8_t* s_beg = nullptr;
+    if (!GetScanBegin(region, start, &s_beg))
+    {
+      continue;
+    }
+
+    std::uint8_t* const s_end = region.second;
+    for (std::uint8_t* c = s_beg; c < s_end;)
+    {
+      std::size_t const remaining = static_cast<std::size_t>(s_end - c);
+      std::uint8_t* const c_end =
+        c + (std::min)(remaining, kParallelScanChunkSize);
+      chunks.emplace_back(Chunk{c, c_end, s_end});
+      c = c_end;
+    }
+  }
+
+  std::vector<void*> results(chunks.size());
+  std::vector<std::exception_ptr> errors(chunks.size());
+  std::atomic<std::size_t> next_chunk{0};
+  std::atomic<std::size_t> first_done{chunks.size()};
+
+  auto const set_first_done = [&](std::size_t i) {
+    std::size_t cur = first_done.load();
+    while (i < cur && !first_done.compare_exchange_weak(cur, i))
+    {
+    }
+  };
+
+  auto const worker = [&]() {
+    for (;;)
+    {
+      std::size_t const i = next_chunk++;
+      if (i >= chunks.size() || i > first_done.load())
+      {
+        return;
+      }
+
+      try
+      {
+        auto const& chunk = chunks[i];
+        std::size_t const tail = static_cast<std::size_t>(
+          (std::min)(static_cast<std::ptrdiff_t>(overlap),
+                     chunk.region_end - chunk.end));
+        std::size_t const read_size =
+          static_cast<std::size_t>(chunk.end - chunk.beg) + tail;
+        std::vector<std::uint8_t> const haystack{
+          ReadVector<std::uint8_t>(process, chunk.beg, read_size)};
+
+        auto const h_beg = haystack.data();
+        if (auto const match = matcher.Search(h_beg, h_beg + haystack.size()))
+        {
+          results[i] = chunk.beg + (match - h_beg);
+          set_first_done(i);
+        }
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+        set_first_done(i);
+      }
+    }
+  };
+
+  // Workers catch everything themselves, so the group never has an error to
+  // rethrow. It's waited on (even if queueing fails part way) before the state
+  // the workers reference goes out of scope.
+  std::size_t const num_workers = (std::min)(num_threads, chunks.size());
+  {
+    // Held until the group has been waited on. The workers are only reused
+    // across calls if the caller holds a reference as well.
+    auto const scheduler = GetSharedTaskScheduler();
+    TaskGroup group{*scheduler};
+    for (std::size_t i = 1; i < num_workers; ++i)
+    {
+      group.Run([&worker]() { worker(); });
+    }
+
+    worker();
+    group.Wait();
+  }
+
+  std::size_t const first = first_done.load();
+  if (first == chunks.size())
+  {
+    return nullptr;
+  }
+
+  if (errors[first])
+  {
+    std::rethrow_exception(errors[first]);
+  }
+
+  return results[first];
 }
 
 template <typename NeedleIterator>
@@ -348,25 +625,40 @@ void* Find(Process const& process,
            NeedleIterator n_end,
            std::uint32_t flags,
            void* start,
-           std::wstring const* name)
+           std::wstring const* name,
+           std::size_t num_threads = 1)
 {
   HADESMEM_DETAIL_ASSERT(n_beg != n_end);
 
   bool const scan_data_secs = !!(flags & PatternFlags::kScanData);
   auto const& scan_regions =
     scan_data_secs ? mod_info.data_regions : mod_info.code_regions;
-  for (auto const& region : scan_regions)
+  void* address = nullptr;
+  num_threads = GetScanThreadCount(num_threads);
+  if (num_threads > 1)
   {
-    if (void* const address = Find(process, region, start, n_beg, n_end))
+    address =
+      FindParallel(process, scan_regions, start, n_beg, n_end, num_threads);
+  }
+  else
+  {
+    for (auto const& region : scan_regions)
     {
-      return !!(flags & PatternFlags::kRelativeAddress)
-               ? static_cast<std::uint8_t*>(address) -
-                   reinterpret_cast<std::uintptr_t>(
-                     mod_info.module->GetHandle())
-               : address;
+      if ((address = Find(process, region, start, n_beg, n_end)) != nullptr)
+      {
+        break;
+      }
     }
   }
 
+  if (address)
+  {
+    return !!(flags & PatternFlags::kRelativeAddress)
+             ? static_cast<std::uint8_t*>(address) -
+                 reinterpret_cast<std::uintptr_t>(mod_info.module->GetHandle())
+             : address;
+  }
+
   if (!!(flags & PatternFlags::kThrowOnUnmatch))
   {
     auto const name_narrow = name ? WideCharToMultiByte(*name) : std::string();
@@ -385,11 +677,17 @@ void* Find(Process const& process,
            NeedleIterator n_end,
            std::uint32_t flags,
            void* start,
-           std::wstring const* name)
+           std::wstring const* name,
+           std::size_t num_threads = 1)
 {
   HADESMEM_DETAIL_ASSERT(n_beg != n_end);
 
-  if (void* const address = Find(process, region, start, n_beg, n_end))
+  num_threads = GetScanThreadCount(num_threads);
+  void* const address =
+    num_threads > 1
+      ? FindParallel(process, {region}, start, n_beg, n_end, num_threads)
+      : Find(process, region, start, n_beg, n_end);
+  if (address)
   {
     return !!(flags & PatternFlags::kRelativeAddress)
              ? static_cast<std::uint8_t*>(address) -
@@ -407,14 +705,222 @@ void* Find(Process const& process,
 
   return nullptr;
 }
+
+// Batched equivalent of calling Find on a module once per needle. The module
+// info is only looked up once, each region is read at most once (and only if
+// a needle needs it), and each region is scanned in a single pass for all the
+// needles which are still outstanding.
+class ModuleScanner
+{
+public:
+  struct Request
+  {
+    std::vector<PatternDataByte> const* needle;
+    std::uint32_t flags;
+    void* start;
+    std::wstring const* name;
+  };
+
+  explicit ModuleScanner(Process const& process,
+                         std::wstring const& module,
+                         ModuleIndex const* module_index = nullptr)
+    : process_{&process},
+      mod_info_(GetModuleInfo(process, module, module_index))
+  {
+    code_data_.resize(mod_info_.code_regions.size());
+    data_data_.resize(mod_info_.data_regions.size());
+  }
+
+  explicit ModuleScanner(Process const&& process,
+                         std::wstring const& module,
+                         ModuleIndex const* module_index = nullptr) = delete;
+
+  ModuleRegionInfo const& GetModuleRegionInfo() const noexcept
+  {
+    return mod_info_;
+  }
+
+  static std::size_t const kNoRegion = static_cast<std::size_t>(-1);
+
+  // Results are the same as those of Find for each request (including
+  // throwing for the first unmatched request with kThrowOnUnmatch). If
+  // result_regions is not null it receives the index of the region (code or
+  // data, depending on kScanData) each request was matched in, or kNoRegion.
+  std::vector<void*>
+    Find(std::vector<Request> const& requests,
+         std::vector<std::size_t>* result_regions = nullptr)
+  {
+    std::vector<void*> results(requests.size());
+    std::vector<std::size_t> regions(requests.size(), kNoRegion);
+
+    for (bool const scan_data_secs : {false, true})
+    {
+      std::vector<std::size_t> indexes;
+      std::vector<PatternMatcher> matchers;
+      for (std::size_t i = 0; i < requests.size(); ++i)
+      {
+        HADESMEM_DETAIL_ASSERT(!requests[i].needle->empty());
+        if (!!(requests[i].flags & PatternFlags::kScanData) == scan_data_secs)
+        {
+          indexes.push_back(i);
+          matchers.emplace_back(std::begin(*requests[i].needle),
+                                std::end(*requests[i].needle));
+        }
+      }
+
+      if (indexes.empty())
+      {
+        continue;
+      }
+
+      FindInRegions(requests,
+                    indexes,
+                    std::move(matchers),
+                    scan_data_secs,
+                    &results,
+                    &regions);
+    }
+
+    for (std::size_t i = 0; i < requests.size(); ++i)
+    {
+      results[i] = FinishResult(requests[i], results[i]);
+    }
+
+    if (result_regions)
+    {
+      *result_regions = std::move(regions);
+    }
+
+    return results;
+  }
+
+  // Applies the same post-processing as Find to a raw match which was found
+  // some other way (e.g. loaded from a cache).
+  void* FinishResult(Request const& request, void* address) const
+  {
+    auto const base =
+      reinterpret_cast<std::uintptr_t>(mod_info_.module->GetHandle());
+    if (address)
+    {
+      if (!!(request.flags & PatternFlags::kRelativeAddress))
+      {
+        address = static_cast<std::uint8_t*>(address) - base;
+      }
+    }
+    else if (!!(request.flags & PatternFlags::kThrowOnUnmatch))
+    {
+      auto const name_narrow =
+        request.name ? WideCharToMultiByte(*request.name) : std::string();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Could not match pattern."}
+                                      << ErrorStringOther{name_narrow});
+    }
+
+    return address;
+  }
+
+private:
+  void FindInRegions(std::vector<Request> const& requests,
+                     std::vector<std::size_t> const& indexes,
+                     std::vector<PatternMatcher>&& matchers,
+                     bool scan_data_secs,
+                     std::vector<void*>* results,
+                     std::vector<std::size_t>* result_regions)
+  {
+    auto const& regions =
+      scan_data_secs ? mod_info_.data_regions : mod_info_.code_regions;
+    auto& regions_data = scan_data_secs ? data_data_ : code_data_;
+
+    MultiPatternMatcher multi_matcher{std::move(matchers)};
+    std::vector<bool> found(indexes.size());
+    std::vector<std::size_t> begin_offsets(indexes.size());
+    std::vector<std::uint8_t const*> region_results(indexes.size());
+    for (std::size_t r = 0; r < regions.size(); ++r)
+    {
+      std::uint8_t* const s_beg = regions[r].first;
+      std::uint8_t* const s_end = regions[r].second;
+
+      bool any_active = false;
+      for (std::size_t j = 0; j < indexes.size(); ++j)
+      {
+        begin_offsets[j] = MultiPatternMatcher::kInactive;
+        void* const start = requests[indexes[j]].start;
+        if (found[j])
+        {
+          continue;
+        }
+
+        // Same rules as Find. If there's a start address then only the region
+        // containing it is scanned, starting from the byte after it.
+        if (start)
+        {
+          if (start < s_beg || start >= s_end)
+          {
+            continue;
+          }
+
+          if (static_cast<std::uint8_t*>(start) + 1 == s_end)
+          {
+            HADESMEM_DETAIL_THROW_EXCEPTION(
+              Error() << ErrorString("Invalid start address."));
+          }
+
+          begin_offsets[j] = static_cast<std::uint8_t*>(start) + 1 - s_beg;
+        }
+        else
+        {
+          begin_offsets[j] = 0;
+        }
+
+        any_active = true;
+      }
+
+      if (!any_active)
+      {
+        continue;
+      }
+
+      auto& haystack = regions_data[r];
+      if (haystack.empty())
+      {
+        haystack = ReadVector<std::uint8_t>(
+          *process_, s_beg, static_cast<std::size_t>(s_end - s_beg));
+      }
+
+      auto const h_beg = haystack.data();
+      multi_matcher.Search(
+        h_beg, h_beg + haystack.size(), begin_offsets, &region_results);
+
+      for (std::size_t j = 0; j < indexes.size(); ++j)
+      {
+        if (begin_offsets[j] != MultiPatternMatcher::kInactive &&
+            region_results[j])
+        {
+          found[j] = true;
+          (*results)[indexes[j]] = s_beg + (region_results[j] - h_beg);
+          (*result_regions)[indexes[j]] = r;
+        }
+      }
+    }
+  }
+
+  Process const* process_;
+  ModuleRegionInfo mod_info_;
+  std::vector<std::vector<std::uint8_t>> code_data_;
+  std::vector<std::vector<std::uint8_t>> data_data_;
+};
 }
 
+// Regions larger than a few hundred KB can be scanned in parallel by passing
+// a num_threads other than one (zero uses one thread per hardware thread).
+// The result is always the same as the serial scan.
 inline void* Find(Process const& process,
                   std::wstring const& module,
                   std::wstring const& data,
                   std::uint32_t flags,
                   std::uintptr_t start,
-                  std::wstring const* name = nullptr)
+                  std::wstring const* name = nullptr,
+                  std::size_t num_threads = 1)
 {
   HADESMEM_DETAIL_ASSERT(
     !(flags & ~(PatternFlags::kInvalidFlagMaxValue - 1UL)));
@@ -431,7 +937,8 @@ inline void* Find(Process const& process,
                       std::end(needle),
                       flags,
                       start_abs,
-                      name);
+                      name,
+                      num_threads);
 }
 
 inline void* Find(Process const& process,
@@ -440,7 +947,8 @@ inline void* Find(Process const& process,
                   std::wstring const& data,
                   std::uint32_t flags,
                   std::uintptr_t start,
-                  std::wstring const* name = nullptr)
+                  std::wstring const* name = nullptr,
+                  std::size_t num_threads = 1)
 {
   HADESMEM_DETAIL_ASSERT(
     !(flags & ~(PatternFlags::kInvalidFlagMaxValue - 1UL)));
@@ -455,7 +963,8 @@ inline void* Find(Process const& process,
                       std::end(needle),
                       flags,
                       start_abs,
-                      name);
+                      name,
+                      num_threads);
 }
 
 inline void* FindInFile(Process const& process,
@@ -463,49 +972,28 @@ inline void* FindInFile(Process const& process,
                         std::wstring const& data,
                         std::uint32_t flags,
                         std::uintptr_t start,
-                        std::wstring const* name = nullptr)
+                        std::wstring const* name = nullptr,
+                        std::size_t num_threads = 1)
 {
   HADESMEM_DETAIL_ASSERT(
     !(flags & ~(PatternFlags::kInvalidFlagMaxValue - 1UL)));
 
-  detail::SmartFileHandle const file{::CreateFileW(path.c_str(),
-                                                   GENERIC_READ,
-                                                   FILE_SHARE_READ,
-                                                   nullptr,
-                                                   OPEN_EXISTING,
-                                                   0,
-                                                   nullptr)};
-  if (!file.IsValid())
-  {
-    DWORD const last_error = ::GetLastError();
-    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                    << ErrorString{"CreateFileW failed."}
-                                    << ErrorCodeWinLast{last_error});
-  }
-
-  detail::SmartHandle const file_mapping{::CreateFileMappingW(
-    file.GetHandle(), nullptr, PAGE_READONLY, 0, 0, nullptr)};
-  if (!file_mapping.IsValid())
-  {
-    DWORD const last_error = ::GetLastError();
-    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                    << ErrorString{"CreateFileMappingW failed."}
-                                    << ErrorCodeWinLast{last_error});
-  }
-
-  detail::SmartMappedFileHandle const file_view{
-    ::MapViewOfFile(file_mapping.GetHandle(), FILE_MAP_READ, 0, 0, 0)};
-  if (!file_view.IsValid())
+  // Nothing is committed up front, so this is fine even for huge files as long
+  // as there's enough address space. Files which aren't on a local drive are
+  // read in instead, as touching a view of them faults if the share or device
+  // goes away.
+  detail::MappedFile const file{path};
+  if (!file.IsLocal())
   {
-    DWORD const last_error = ::GetLastError();
-    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                    << ErrorString{"MapViewOfFile failed."}
-                                    << ErrorCodeWinLast{last_error});
+    auto buf = file.Read(0, (std::numeric_limits<std::size_t>::max)());
+    return Find(
+      process, buf.data(), buf.size(), data, flags, start, name, num_threads);
   }
 
-  auto const base = file_view.GetHandle();
-  auto const size = detail::GetModuleRegionSize(process, base);
-  return Find(process, base, size, data, flags, start, name);
+  auto const view = file.MapView(0, (std::numeric_limits<std::size_t>::max)());
+  auto const base = view.GetBase();
+  auto const size = view.GetSize();
+  return Find(process, base, size, data, flags, start, name, num_threads);
 }
 
 #if !defined(HADESMEM_NO_PUGIXML)
@@ -717,24 +1205,57 @@ private:
 class FindPattern
 {
 public:
+  // If cache_path is not empty then results are loaded from (and saved back
+  // to) a persistent cache, and only patterns whose results may have changed
+  // since the cache was written (i.e. the pattern itself or a section of the
+  // module it could have matched in has changed) are rescanned.
   explicit FindPattern(Process const& process,
                        std::wstring const& pattern_file,
-                       bool in_memory_file)
+                       bool in_memory_file,
+                       std::wstring const& cache_path = std::wstring())
     : process_{&process}, find_pattern_datas_{}
   {
+    detail::PatternCache cache;
+    if (!cache_path.empty())
+    {
+      cache.Load(cache_path);
+    }
+
+    auto const cache_ptr = cache_path.empty() ? nullptr : &cache;
+    bool cache_dirty = false;
     if (in_memory_file)
     {
-      LoadPatternFileMemory(pattern_file);
+      LoadPatternFileMemory(pattern_file, cache_ptr, &cache_dirty);
     }
     else
     {
-      LoadPatternFile(pattern_file);
+      LoadPatternFile(pattern_file, cache_ptr, &cache_dirty);
+    }
+
+    if (cache_dirty)
+    {
+      // Same as loading, the cache is only an optimization, so failing to
+      // write it (e.g. a read-only directory) shouldn't throw away results.
+      try
+      {
+        cache.Save(cache_path);
+      }
+      catch (std::exception const& /*e*/)
+      {
+        HADESMEM_DETAIL_TRACE_FORMAT_W(
+          L"WARNING! Failed to save pattern cache. Path: [%s].",
+          cache_path.c_str());
+        HADESMEM_DETAIL_TRACE_A(
+          boost::current_exception_diagnostic_information().c_str());
+      }
     }
   }
 
   explicit FindPattern(Process const&& process,
                        std::wstring const& pattern,
-                       bool in_memory_file) = delete;
+                       bool in_memory_file,
+                       std::wstring const& cache_path = std::wstring()) =
+    delete;
 
   ModuleMap const& GetModuleMap() const noexcept
   {
@@ -771,7 +1292,9 @@ public:
   }
 
 private:
-  void LoadPatternFile(std::wstring const& path)
+  void LoadPatternFile(std::wstring const& path,
+                       detail::PatternCache* cache,
+                       bool* cache_dirty)
   {
     pugi::xml_document doc;
     auto const load_result = doc.load_file(path.c_str());
@@ -783,10 +1306,12 @@ private:
                 << ErrorStringOther{load_result.description()});
     }
 
-    LoadPatternFileImpl(doc);
+    LoadPatternFileImpl(doc, cache, cache_dirty);
   }
 
-  void LoadPatternFileMemory(std::wstring const& data)
+  void LoadPatternFileMemory(std::wstring const& data,
+                             detail::PatternCache* cache,
+                             bool* cache_dirty)
   {
     pugi::xml_document doc;
     auto const load_result = doc.load(data.c_str());
@@ -798,7 +1323,7 @@ private:
                 << ErrorStringOther{load_result.description()});
     }
 
-    LoadPatternFileImpl(doc);
+    LoadPatternFileImpl(doc, cache, cache_dirty);
   }
 
   Pattern LookupEx(std::wstring const& module, std::wstring const& name) const
@@ -1116,52 +1641,347 @@ private:
     return start_rva;
   }
 
-  void LoadPatternFileImpl(pugi::xml_document const& doc)
+  bool IsPatternResolved(std::wstring const& module,
+                         std::wstring const& name) const
+  {
+    auto const iter = find_pattern_datas_.find(module);
+    return iter != std::end(find_pattern_datas_) &&
+           iter->second.find(name) != std::end(iter->second);
+  }
+
+  // Builds the cache record for a module as it currently is (minus the
+  // patterns). Hashing the sections means reading the entire file, so it is
+  // skipped if the headers and the file's size and timestamp are the same as
+  // when the cached record was made.
+  detail::PatternCacheModule
+    GetPatternCacheModule(detail::ModuleRegionInfo const& mod_info,
+                          detail::PatternCacheModule const* cached) const
+  {
+    detail::PatternCacheModule cur{};
+
+    PeFile const pe_file{
+      *process_, mod_info.module->GetHandle(), PeFileType::kImage, 0};
+    NtHeaders const nt_headers{*process_, pe_file};
+    cur.time_date_stamp = nt_headers.GetTimeDateStamp();
+    cur.size_of_image = nt_headers.GetSizeOfImage();
+
+    auto const file = detail::OpenFileForMetadata(mod_info.module->GetPath());
+    auto const file_info = detail::GetFileInformationByHandle(file.GetHandle());
+    cur.file_size =
+      (static_cast<std::uint64_t>(file_info.nFileSizeHigh) << 32) |
+      file_info.nFileSizeLow;
+    cur.last_write_time =
+      (static_cast<std::uint64_t>(file_info.ftLastWriteTime.dwHighDateTime)
+       << 32) |
+      file_info.ftLastWriteTime.dwLowDateTime;
+
+    std::vector<std::wstring> code_hashes;
+    std::vector<std::wstring> data_hashes;
+    if (cached && cached->time_date_stamp == cur.time_date_stamp &&
+        cached->size_of_image == cur.size_of_image &&
+        cached->file_size == cur.file_size &&
+        cached->last_write_time == cur.last_write_time &&
+        cached->code_regions.size() == mod_info.code_regions.size() &&
+        cached->data_regions.size() == mod_info.data_regions.size())
+    {
+      for (auto const& region : cached->code_regions)
+      {
+        code_hashes.push_back(region.hash);
+      }
+
+      for (auto const& region : cached->data_regions)
+      {
+        data_hashes.push_back(region.hash);
+      }
+    }
+    else
+    {
+      detail::GetModuleRegionHashes(mod_info, &code_hashes, &data_hashes);
+    }
+
+    auto const make_regions = [](
+      std::vector<detail::ModuleRegionInfo::ScanRegion> const& regions,
+      std::vector<std::wstring> const& hashes,
+      std::vector<detail::PatternCacheRegion>* cache_regions) {
+      HADESMEM_DETAIL_ASSERT(regions.size() == hashes.size());
+      for (std::size_t i = 0; i < regions.size(); ++i)
+      {
+        cache_regions->push_back(detail::PatternCacheRegion{
+          hashes[i], static_cast<DWORD>(regions[i].second - regions[i].first)});
+      }
+    };
+    make_regions(mod_info.code_regions, code_hashes, &cur.code_regions);
+    make_regions(mod_info.data_regions, data_hashes, &cur.data_regions);
+
+    return cur;
+  }
+
+  // Number of leading regions which are the same in both records. A cached
+  // match is still valid if neither the region it was found in nor any region
+  // scanned before it has changed.
+  static std::size_t GetUnchangedRegionCount(
+    std::vector<detail::PatternCacheRegion> const& cached,
+    std::vector<detail::PatternCacheRegion> const& cur)
+  {
+    std::size_t i = 0;
+    for (; i < cached.size() && i < cur.size(); ++i)
+    {
+      if (cached[i].hash != cur[i].hash || cached[i].size != cur[i].size)
+      {
+        break;
+      }
+    }
+
+    return i;
+  }
+
+  static bool IsCacheEntryValid(detail::PatternCacheModule const& cached,
+                                detail::PatternCacheModule const& cur,
+                                detail::PatternCacheEntry const& entry,
+                                std::wstring const& data,
+                                std::uint32_t flags,
+                                std::uintptr_t start_rva)
+  {
+    if (entry.data != data || entry.flags != flags ||
+        entry.start_rva != start_rva)
+    {
+      return false;
+    }
+
+    bool const scan_data_secs = !!(flags & PatternFlags::kScanData);
+    auto const& cached_regions =
+      scan_data_secs ? cached.data_regions : cached.code_regions;
+    auto const& cur_regions =
+      scan_data_secs ? cur.data_regions : cur.code_regions;
+    std::size_t const unchanged =
+      GetUnchangedRegionCount(cached_regions, cur_regions);
+    if (entry.found)
+    {
+      return entry.region < unchanged;
+    }
+
+    return unchanged == cur_regions.size() &&
+           cached_regions.size() == cur_regions.size();
+  }
+
+  void LoadPatternFileImpl(pugi::xml_document const& doc,
+                           detail::PatternCache* cache,
+                           bool* cache_dirty)
   {
     auto const patterns_info_full_list = ReadPatternsFromXml(doc);
+    // One walk of the module list for the whole file, rather than one
+    // snapshot per module.
+    ModuleIndex const module_index{*process_};
     for (auto const& patterns_info_full_pair : patterns_info_full_list)
     {
       HADESMEM_DETAIL_ASSERT(
         find_pattern_datas_.find(patterns_info_full_pair.first) ==
         std::end(find_pattern_datas_));
 
-      auto const mod_info =
-        detail::GetModuleInfo(*process_, patterns_info_full_pair.first);
+      detail::ModuleScanner scanner{
+        *process_, patterns_info_full_pair.first, &module_index};
+      auto const& mod_info = scanner.GetModuleRegionInfo();
       auto const base =
         reinterpret_cast<std::uintptr_t>(mod_info.module->GetHandle());
       auto const& module = patterns_info_full_pair.first;
       auto const& patterns_info_full = patterns_info_full_pair.second;
       auto const& pattern_infos = patterns_info_full.patterns;
+
+      std::vector<std::vector<detail::PatternDataByte>> needles;
+      needles.reserve(pattern_infos.size());
       for (auto const& p : pattern_infos)
       {
-        std::uint32_t const flags = patterns_info_full.flags | p.pattern.flags;
-        void* address = nullptr;
-        std::uintptr_t const start_rva = [&]() -> std::uintptr_t {
-          if (!p.pattern.start_rva.empty())
+        needles.emplace_back(detail::ConvertData(p.pattern.data));
+      }
+
+      // The cache is only an optimization, so if we can't get the info needed
+      // to validate it (e.g. the module has no backing file) just scan.
+      detail::PatternCacheModule const* cached_module = nullptr;
+      detail::PatternCacheModule cur_module{};
+      bool use_cache = false;
+      if (cache)
+      {
+        cached_module = cache->GetModule(module);
+        try
+        {
+          cur_module = GetPatternCacheModule(mod_info, cached_module);
+          use_cache = true;
+        }
+        catch (std::exception const& /*e*/)
+        {
+        }
+      }
+
+      bool any_scanned = false;
+
+      // Patterns are resolved in waves, with each wave being a single pass
+      // over the module. The first wave is everything which doesn't use the
+      // result of another pattern as its start address, the second wave is
+      // everything which depends only on the first wave, etc.
+      std::vector<bool> resolved(pattern_infos.size());
+      std::size_t num_resolved = 0;
+      while (num_resolved != pattern_infos.size())
+      {
+        std::vector<std::size_t> wave;
+        std::vector<detail::ModuleScanner::Request> requests;
+        std::vector<std::uintptr_t> start_rvas;
+        for (std::size_t i = 0; i < pattern_infos.size(); ++i)
+        {
+          auto const& p = pattern_infos[i];
+          bool const depends_on_pattern = p.pattern.start_rva.empty() &&
+                                          p.pattern.start_export.empty() &&
+                                          !p.pattern.start.empty();
+          if (resolved[i] || (depends_on_pattern &&
+                              !IsPatternResolved(module, p.pattern.start)))
           {
-            return detail::HexStrToPtr(p.pattern.start_rva);
+            continue;
           }
-          else if (!p.pattern.start_export.empty())
+
+          std::uint32_t const flags =
+            patterns_info_full.flags | p.pattern.flags;
+          std::uintptr_t const start_rva = [&]() -> std::uintptr_t {
+            if (!p.pattern.start_rva.empty())
+            {
+              return detail::HexStrToPtr(p.pattern.start_rva);
+            }
+            else if (!p.pattern.start_export.empty())
+            {
+              return GetStartRvaFromExport(*mod_info.module,
+                                           p.pattern.start_export);
+            }
+            else
+            {
+              return GetStartRvaFromPattern(module, base, p.pattern.start);
+            }
+          }();
+          void* const start_abs =
+            start_rva ? reinterpret_cast<std::uint8_t*>(base) + start_rva
+                      : nullptr;
+
+          wave.push_back(i);
+          requests.push_back(detail::ModuleScanner::Request{
+            &needles[i], flags, start_abs, &p.pattern.name});
+          start_rvas.push_back(start_rva);
+        }
+
+        // Either a dependency which doesn't exist or a cycle. Let the lookup
+        // of the first one we're stuck on generate the error.
+        if (wave.empty())
+        {
+          for (std::size_t i = 0; i < pattern_infos.size(); ++i)
           {
-            return GetStartRvaFromExport(*mod_info.module,
-                                         p.pattern.start_export);
+            if (!resolved[i])
+            {
+              LookupEx(module, pattern_infos[i].pattern.start);
+            }
           }
-          else
+
+          HADESMEM_DETAIL_ASSERT(false);
+          HADESMEM_DETAIL_THROW_EXCEPTION(
+            Error{} << ErrorString{"Failed to resolve pattern dependencies."});
+        }
+
+        // Raw (i.e. absolute and unmanipulated) matches, either from the
+        // cache or from scanning whatever the cache couldn't give us.
+        std::vector<void*> raw_addresses(wave.size());
+        std::vector<std::size_t> regions(wave.size(),
+                                         detail::ModuleScanner::kNoRegion);
+        std::vector<std::size_t> scan_indexes;
+        std::vector<detail::ModuleScanner::Request> scan_requests;
+        for (std::size_t j = 0; j < wave.size(); ++j)
+        {
+          auto const& p = pattern_infos[wave[j]];
+          if (use_cache && cached_module)
+          {
+            auto const iter = cached_module->patterns.find(p.pattern.name);
+            if (iter != std::end(cached_module->patterns) &&
+                IsCacheEntryValid(*cached_module,
+                                  cur_module,
+                                  iter->second,
+                                  p.pattern.data,
+                                  requests[j].flags,
+                                  start_rvas[j]))
+            {
+              if (iter->second.found)
+              {
+                raw_addresses[j] =
+                  reinterpret_cast<std::uint8_t*>(base) + iter->second.rva;
+                regions[j] = iter->second.region;
+              }
+
+              continue;
+            }
+          }
+
+          scan_indexes.push_back(j);
+          scan_requests.push_back(requests[j]);
+        }
+
+        if (!scan_requests.empty())
+        {
+          std::vector<std::size_t> scan_regions;
+          auto const scan_addresses =
+            scanner.Find(scan_requests, &scan_regions);
+          for (std::size_t k = 0; k < scan_indexes.size(); ++k)
+          {
+            std::size_t const j = scan_indexes[k];
+            void* address = scan_addresses[k];
+            if (address &&
+                !!(requests[j].flags & PatternFlags::kRelativeAddress))
+            {
+              address = static_cast<std::uint8_t*>(address) + base;
+            }
+
+            raw_addresses[j] = address;
+            regions[j] = scan_regions[k];
+          }
+
+          any_scanned = true;
+        }
+
+        for (std::size_t j = 0; j < wave.size(); ++j)
+        {
+          auto const& p = pattern_infos[wave[j]];
+          std::uint32_t const flags = requests[j].flags;
+
+          if (use_cache)
+          {
+            bool const found = raw_addresses[j] != nullptr;
+            cur_module.patterns[p.pattern.name] = detail::PatternCacheEntry{
+              p.pattern.data,
+              flags,
+              start_rvas[j],
+              found,
+              regions[j],
+              found ? reinterpret_cast<std::uintptr_t>(raw_addresses[j]) - base
+                    : 0U};
+          }
+
+          void* address = scanner.FinishResult(requests[j], raw_addresses[j]);
+          if (address)
           {
-            return GetStartRvaFromPattern(module, base, p.pattern.start);
+            address = ApplyManipulators(address, flags, base, p.manipulators);
           }
-        }();
 
-        address = ::hadesmem::Find(
-          *process_, module, p.pattern.data, flags, start_rva, &p.pattern.name);
+          find_pattern_datas_[module][p.pattern.name] = Pattern{address, flags};
+          resolved[wave[j]] = true;
+          ++num_resolved;
+        }
+      }
 
-        if (address)
+      if (use_cache)
+      {
+        if (any_scanned || !cached_module ||
+            cached_module->time_date_stamp != cur_module.time_date_stamp ||
+            cached_module->size_of_image != cur_module.size_of_image ||
+            cached_module->file_size != cur_module.file_size ||
+            cached_module->last_write_time != cur_module.last_write_time ||
+            cached_module->patterns.size() != cur_module.patterns.size())
         {
-          address = ApplyManipulators(address, flags, base, p.manipulators);
+          *cache_dirty = true;
         }
 
-        find_pattern_datas_[patterns_info_full_pair.first][p.pattern.name] =
-          Pattern{address, flags};
+        cache->SetModule(module, std::move(cur_module));
       }
     }
   }
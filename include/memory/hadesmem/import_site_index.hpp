@@ -0,0 +1,327 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/detail/to_upper_ordinal.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_list.hpp>
+#include <hadesmem/pelib/import_dir.hpp>
+#include <hadesmem/pelib/import_dir_list.hpp>
+#include <hadesmem/pelib/import_thunk_span.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+
+// TODO: Index delay load imports.
+
+// TODO: Add API set schema support, so that imports from api-ms-win-* and
+// ext-ms-win-* are also found when looking up their host module.
+
+namespace hadesmem
+{
+// An IAT slot which the loader bound an import to.
+struct ImportSite
+{
+  HMODULE importer;
+  // Along with the base, identifies the importer across a refresh (see
+  // ImportSiteIndex::Refresh).
+  DWORD importer_size;
+  void* slot;
+};
+
+// Index of the imports of every module loaded in a process, from (imported
+// module, function name or ordinal) to the IAT slots the import is bound to.
+// Each module's import tables are parsed once, with bulk reads, so looking up
+// any number of functions is a hash lookup each rather than a walk of every
+// import table.
+// Refresh is incremental. Modules which are still loaded are not parsed again.
+// Only imports with an ILT (OriginalFirstThunk) are indexed, as once the IAT
+// is bound there's no other way to tell which function a slot is for.
+// References returned by the Find functions are invalidated by Refresh, Add
+// and Remove. Not thread-safe.
+class ImportSiteIndex
+{
+public:
+  explicit ImportSiteIndex(Process const& process) : process_{&process}
+  {
+    Refresh();
+  }
+
+  // Only indexes imports from module, for callers which only look up functions
+  // from that one module (e.g. a single PatchIat). Every module's import
+  // descriptors still have to be read to find the ones for module, but the
+  // thunks (and names) of all the others are skipped.
+  explicit ImportSiteIndex(Process const& process, std::wstring const& module)
+    : process_{&process}, filter_(detail::ToUpperOrdinal(module))
+  {
+    Refresh();
+  }
+
+  explicit ImportSiteIndex(Process const&& process) = delete;
+
+  explicit ImportSiteIndex(Process const&& process,
+                           std::wstring const& module) = delete;
+
+  void Refresh()
+  {
+    std::map<std::uintptr_t, DWORD> loaded;
+    ModuleList const modules{*process_};
+    for (auto const& module : modules)
+    {
+      loaded.emplace(reinterpret_cast<std::uintptr_t>(module.GetHandle()),
+                     module.GetSize());
+    }
+
+    // A different size at the same base is a different module, so it needs to
+    // be parsed again.
+    for (auto iter = std::begin(importers_); iter != std::end(importers_);)
+    {
+      auto const loaded_iter = loaded.find(iter->first);
+      if (loaded_iter == std::end(loaded) ||
+          loaded_iter->second != iter->second.size)
+      {
+        RemoveSites(iter->first, iter->second);
+        iter = importers_.erase(iter);
+      }
+      else
+      {
+        ++iter;
+      }
+    }
+
+    for (auto const& module : loaded)
+    {
+      if (importers_.find(module.first) == std::end(importers_))
+      {
+        AddImporter(module.first, module.second);
+      }
+    }
+  }
+
+  // For callers which are notified of loads and unloads (e.g. by hooking the
+  // loader), so the module doesn't have to wait for the next refresh.
+  void Add(HMODULE handle)
+  {
+    Remove(handle);
+
+    Module const module{*process_, handle};
+    AddImporter(reinterpret_cast<std::uintptr_t>(module.GetHandle()),
+                module.GetSize());
+  }
+
+  void Remove(HMODULE handle)
+  {
+    auto const iter =
+      importers_.find(reinterpret_cast<std::uintptr_t>(handle));
+    if (iter == std::end(importers_))
+    {
+      return;
+    }
+
+    RemoveSites(iter->first, iter->second);
+    importers_.erase(iter);
+  }
+
+  // Module is the name the importer uses (e.g. "kernel32.dll"), and is case
+  // insensitive.
+  std::vector<ImportSite> const& Find(std::wstring const& module,
+                                      std::string const& function) const
+  {
+    auto const imports = FindImports(module);
+    if (!imports)
+    {
+      return empty_;
+    }
+
+    auto const iter = imports->by_name.find(function);
+    return iter != std::end(imports->by_name) ? iter->second : empty_;
+  }
+
+  std::vector<ImportSite> const& Find(std::wstring const& module,
+                                      WORD ordinal) const
+  {
+    auto const imports = FindImports(module);
+    if (!imports)
+    {
+      return empty_;
+    }
+
+    auto const iter = imports->by_ordinal.find(ordinal);
+    return iter != std::end(imports->by_ordinal) ? iter->second : empty_;
+  }
+
+  std::size_t GetNumModules() const noexcept
+  {
+    return importers_.size();
+  }
+
+private:
+  struct Imports
+  {
+    std::unordered_map<std::string, std::vector<ImportSite>> by_name;
+    std::unordered_map<WORD, std::vector<ImportSite>> by_ordinal;
+  };
+
+  struct Importer
+  {
+    DWORD size;
+    // Keys into imports_, so the module's sites can be found again on removal
+    // without searching the whole index.
+    std::vector<std::wstring> modules;
+  };
+
+  Imports const* FindImports(std::wstring const& module) const
+  {
+    auto const iter = imports_.find(detail::ToUpperOrdinal(module));
+    return iter != std::end(imports_) ? &iter->second : nullptr;
+  }
+
+  void AddImporter(std::uintptr_t base, DWORD size)
+  {
+    Importer importer{size, {}};
+    auto const handle = reinterpret_cast<HMODULE>(base);
+    try
+    {
+      AddSites(handle, size, importer);
+    }
+    catch (std::exception const& /*e*/)
+    {
+      // Keep whatever was indexed before the error, so a single malformed
+      // import descriptor doesn't hide the rest of the module.
+      HADESMEM_DETAIL_TRACE_FORMAT_A(
+        "WARNING! Failed to index imports of module [%p].", handle);
+    }
+
+    importers_.emplace(base, std::move(importer));
+  }
+
+  void AddSites(HMODULE handle, DWORD size, Importer& importer)
+  {
+    PeFile const pe_file{*process_, handle, PeFileType::kImage, size};
+    ImportDirList const import_dirs{*process_, pe_file};
+    // Reused between names, to avoid allocating for every one we read.
+    std::string name_storage;
+    for (auto const& id : import_dirs)
+    {
+      if (!id.GetOriginalFirstThunk())
+      {
+        continue;
+      }
+
+      std::wstring module;
+      try
+      {
+        module = detail::ToUpperOrdinal(detail::MultiByteToWideChar(
+          id.GetNameView(name_storage).to_string()));
+      }
+      catch (std::exception const& /*e*/)
+      {
+        // Invalid name. Nothing we can look it up by, so skip it.
+        continue;
+      }
+
+      if (!filter_.empty() && module != filter_)
+      {
+        continue;
+      }
+
+      ImportThunkSpan const iat{*process_, pe_file, id.GetFirstThunk()};
+      ImportThunkSpan const ilt{
+        *process_, pe_file, id.GetOriginalFirstThunk(), iat.size()};
+      if (ilt.empty())
+      {
+        continue;
+      }
+
+      // Recorded before adding any sites, so that they're found on removal
+      // even if we fail part way through.
+      if (std::find(std::begin(importer.modules),
+                    std::end(importer.modules),
+                    module) == std::end(importer.modules))
+      {
+        importer.modules.push_back(module);
+      }
+
+      Imports& imports = imports_[module];
+      for (std::size_t i = 0; i < ilt.size(); ++i)
+      {
+        auto const& thunk = ilt[i];
+        ImportSite const site{handle, size, iat[i].GetBase()};
+        if (thunk.ByOrdinal())
+        {
+          imports.by_ordinal[thunk.GetOrdinal()].push_back(site);
+          continue;
+        }
+
+        try
+        {
+          imports.by_name[ilt.GetNameView(thunk, name_storage).to_string()]
+            .push_back(site);
+        }
+        catch (std::exception const& /*e*/)
+        {
+          // Invalid name. Nothing we can look it up by, so skip it.
+        }
+      }
+    }
+  }
+
+  void RemoveSites(std::uintptr_t base, Importer const& importer)
+  {
+    auto const handle = reinterpret_cast<HMODULE>(base);
+    auto const remove_sites = [&](auto& sites_map) {
+      for (auto iter = std::begin(sites_map); iter != std::end(sites_map);)
+      {
+        auto& sites = iter->second;
+        sites.erase(std::remove_if(std::begin(sites),
+                                   std::end(sites),
+                                   [&](ImportSite const& site) {
+                                     return site.importer == handle;
+                                   }),
+                    std::end(sites));
+        iter = sites.empty() ? sites_map.erase(iter) : std::next(iter);
+      }
+    };
+
+    for (auto const& module : importer.modules)
+    {
+      auto const iter = imports_.find(module);
+      if (iter == std::end(imports_))
+      {
+        continue;
+      }
+
+      remove_sites(iter->second.by_name);
+      remove_sites(iter->second.by_ordinal);
+      if (iter->second.by_name.empty() && iter->second.by_ordinal.empty())
+      {
+        imports_.erase(iter);
+      }
+    }
+  }
+
+  Process const* process_;
+  // Upper case. Empty to index every module.
+  std::wstring filter_;
+  std::map<std::uintptr_t, Importer> importers_;
+  std::unordered_map<std::wstring, Imports> imports_;
+  std::vector<ImportSite> empty_;
+};
+}
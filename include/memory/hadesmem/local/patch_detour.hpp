@@ -29,12 +29,15 @@
 #include <hadesmem/detail/scope_warden.hpp>
 #include <hadesmem/detail/srw_lock.hpp>
 #include <hadesmem/detail/thread_aux.hpp>
+#include <hadesmem/detail/trampoline_heap.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/type_traits.hpp>
 #include <hadesmem/detail/winternl.hpp>
+#include <hadesmem/detail/write_impl.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/flush.hpp>
 #include <hadesmem/local/patch_detour_base.hpp>
+#include <hadesmem/local/patch_transaction.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/read.hpp>
 #include <hadesmem/thread.hpp>
@@ -109,6 +112,10 @@ public:
       HADESMEM_DETAIL_THROW_EXCEPTION(
         Error{} << ErrorString{"PatchDetour only supported on local process."});
     }
+
+    // Share the caller's trampoline heap (creating it if need be), rather than
+    // giving our copy of the Process a heap of its own.
+    process_.SetTrampolineHeap(detail::GetTrampolineHeap(process));
   }
 
   explicit PatchDetour(Process const&& process,
@@ -128,6 +135,7 @@ public:
       trampoline_{std::move(other.trampoline_)},
       stub_gate_{std::move(other.stub_gate_)},
       orig_(std::move(other.orig_)),
+      patch_(std::move(other.patch_)),
       trampolines_(std::move(other.trampolines_)),
       ref_count_{other.ref_count_.load()},
       stub_{other.stub_},
@@ -159,6 +167,8 @@ public:
 
     orig_ = std::move(other.orig_);
 
+    patch_ = std::move(other.patch_);
+
     trampolines_ = std::move(other.trampolines_);
 
     ref_count_ = other.ref_count_.load();
@@ -189,6 +199,23 @@ public:
       return;
     }
 
+    // TODO: Make suspension optional, as in some cases we know that all the
+    // threads are suspended already (e.g. creation-time injection).
+    PatchTransaction transaction{process_};
+    transaction.Add(*this);
+    transaction.Apply();
+  }
+
+  virtual void PrepareApply() override
+  {
+    HADESMEM_DETAIL_ASSERT(!applied_);
+
+    if (detached_)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Patch is detached."});
+    }
+
     // Reset the trampolines here because we don't do it in remove, otherwise
     // there's a potential race condition where we want to unhook and unload
     // safely, so we unhook the function, then try waiting on our ref count to
@@ -198,20 +225,36 @@ public:
     trampolines_.clear();
     stub_gate_ = nullptr;
 
-    // TODO: Narrow the scope of the suspension to only the point where we
-    // actually do the hook, because a thread might hold a lock we need (e.g.
-    // heap lock).
-    // TODO: Make suspension optional, as in some cases we know that all the
-    // threads are suspended already (e.g. creation-time injection).
-    // Need to fix the potential deadlock problem, as well as the perf
-    // problem, before re-enabling this.
-    // SuspendedProcess const suspended_process{process_.GetId()};
-
     std::uint32_t const kMaxInstructionLen = 15;
     std::uint32_t const kTrampSize = kMaxInstructionLen * 3;
 
-    trampoline_ = std::make_unique<Allocator>(process_, kTrampSize);
+    // Room for the worst case of every relocated instruction being rewritten
+    // as a push/ret, plus the jump back. Allocated near the target so that
+    // usually doesn't happen.
+    std::uint32_t const kTrampBlockSize = 0x80;
+    trampoline_ =
+      detail::AllocateTrampolineNear(process_, target_, kTrampBlockSize);
     auto tramp_cur = static_cast<std::uint8_t*>(trampoline_->GetBase());
+    auto const tramp_end = tramp_cur + kTrampBlockSize;
+
+    // Fail rather than write past the end of the block if the relocated code
+    // ever grows by more than it allows for.
+    auto const check_tramp_space = [&](std::size_t len) {
+      if (static_cast<std::size_t>(tramp_end - tramp_cur) < len)
+      {
+        HADESMEM_DETAIL_ASSERT(false);
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Trampoline block too small."});
+      }
+    };
+
+    auto const write_tramp_jump = [&](void* jump_target) {
+      auto const jump_buf = detail::GenJump(
+        process_, tramp_cur, jump_target, true, &trampolines_);
+      check_tramp_space(jump_buf.size());
+      WriteVector(process_, tramp_cur, jump_buf);
+      tramp_cur += jump_buf.size();
+    };
 
     auto const detour_raw = detour_.target<DetourFuncRawT>();
     (void)detour_raw;
@@ -242,7 +285,8 @@ public:
 #error "[HadesMem] Unsupported architecture."
 #endif
 
-    stub_gate_ = detail::AllocatePageNear(process_, target_);
+    stub_gate_ = detail::AllocateTrampolineNear(
+      process_, target_, detail::PatchConstants::kStubGateSize);
 
     std::size_t const patch_size = GetPatchSize();
 
@@ -314,13 +358,13 @@ public:
         if (ud_obj.mnemonic == UD_Ijmp)
         {
           HADESMEM_DETAIL_TRACE_A("Writing resolved jump.");
-          tramp_cur += detail::WriteJump(
-            process_, tramp_cur, jump_target, true, &trampolines_);
+          write_tramp_jump(jump_target);
         }
         else
         {
           HADESMEM_DETAIL_ASSERT(ud_obj.mnemonic == UD_Icall);
           HADESMEM_DETAIL_TRACE_A("Writing resolved call.");
+          check_tramp_space(detail::PatchConstants::kCallSize64);
           tramp_cur +=
             detail::WriteCall(process_, tramp_cur, jump_target, trampolines_);
         }
@@ -328,6 +372,7 @@ public:
       else
       {
         std::uint8_t const* const raw = ud_insn_ptr(&ud_obj);
+        check_tramp_space(len);
         Write(process_, tramp_cur, raw, raw + len);
         tramp_cur += len;
       }
@@ -337,12 +382,7 @@ public:
 
     HADESMEM_DETAIL_TRACE_A("Writing jump back to original code.");
 
-    tramp_cur +=
-      detail::WriteJump(process_,
-                        tramp_cur,
-                        reinterpret_cast<std::uint8_t*>(target_) + instr_size,
-                        true,
-                        &trampolines_);
+    write_tramp_jump(reinterpret_cast<std::uint8_t*>(target_) + instr_size);
 
     FlushInstructionCache(
       process_, trampoline_->GetBase(), trampoline_->GetSize());
@@ -355,13 +395,43 @@ public:
 
     orig_ = ReadVector<std::uint8_t>(process_, target_, patch_size);
 
-    detail::VerifyPatchThreads(process_.GetId(), target_, orig_.size());
+    PreparePatch();
+  }
+
+  virtual DWORD CommitApply() noexcept override
+  {
+    HADESMEM_DETAIL_ASSERT(!applied_ && !orig_.empty());
+
+    DWORD const last_error = WritePatch();
+    if (last_error == ERROR_SUCCESS)
+    {
+      applied_ = true;
+    }
+
+    return last_error;
+  }
 
-    WritePatch();
+  virtual DWORD RevertApply() noexcept override
+  {
+    HADESMEM_DETAIL_ASSERT(applied_);
 
-    FlushInstructionCache(process_, target_, instr_size);
+    DWORD const last_error = RemovePatch();
+    if (last_error == ERROR_SUCCESS)
+    {
+      applied_ = false;
+    }
 
-    applied_ = true;
+    return last_error;
+  }
+
+  virtual void* GetPatchAddress() const noexcept override
+  {
+    return target_;
+  }
+
+  virtual std::size_t GetPatchLength() const noexcept override
+  {
+    return orig_.size();
   }
 
   virtual void Remove() override
@@ -371,18 +441,49 @@ public:
       return;
     }
 
-    SuspendedProcess const suspended_process{process_.GetId()};
+    // Nothing may be allocated (or thrown) while other threads are suspended,
+    // so the same as PatchTransaction::Apply, the target is made writable up
+    // front, the threads are checked against the snapshot SuspendedProcess
+    // already took, and anything which went wrong is only reported once
+    // they're resumed.
+    std::vector<std::pair<void*, std::size_t>> const patch_ranges = {
+      {target_, orig_.size()}};
+    std::vector<std::pair<void*, std::size_t>> const ranges = {
+      patch_ranges.front(), {trampoline_->GetBase(), trampoline_->GetSize()}};
+    DWORD blocking_thread_id = 0;
+    DWORD last_error = ERROR_SUCCESS;
+    DWORD write_error = ERROR_SUCCESS;
+    {
+      auto const guards = detail::ProtectPatchRanges(process_, patch_ranges);
+
+      SuspendedProcess const suspended_process{process_.GetId()};
+
+      blocking_thread_id =
+        detail::FindThreadInPatchRanges(suspended_process, ranges, last_error);
+      if (!blocking_thread_id)
+      {
+        write_error = RemovePatch();
+      }
+    }
+
+    detail::InvalidatePatchRanges(process_, patch_ranges);
 
-    detail::VerifyPatchThreads(process_.GetId(), target_, orig_.size());
-    detail::VerifyPatchThreads(
-      process_.GetId(), trampoline_->GetBase(), trampoline_->GetSize());
+    if (blocking_thread_id)
+    {
+      detail::ThrowThreadInPatchRanges(last_error);
+    }
 
-    RemovePatch();
+    if (write_error != ERROR_SUCCESS)
+    {
+      detail::ThrowPatchWriteFailed(write_error);
+    }
 
     // Don't free trampolines here. Do it in Apply/destructor. See comments in
     // Apply for the rationale.
 
     applied_ = false;
+
+    CancelApply();
   }
 
   virtual void RemoveUnchecked() noexcept override
@@ -470,19 +571,30 @@ protected:
                      : detail::PatchConstants::kJmpSize64;
   }
 
-  virtual void WritePatch()
+  // Called at the end of PrepareApply, to do anything WritePatch would
+  // otherwise need to (such as allocating), as it may be called while other
+  // threads are suspended.
+  virtual void PreparePatch()
   {
-    HADESMEM_DETAIL_TRACE_A("Writing jump to stub.");
+    HADESMEM_DETAIL_TRACE_A("Generating jump to stub.");
 
-    detail::WriteJump(
+    patch_ = detail::GenJump(
       process_, target_, stub_gate_->GetBase(), false, &trampolines_);
   }
 
-  virtual void RemovePatch()
+  // WritePatch and RemovePatch are called while other threads are suspended,
+  // with the target already writable, so they must not allocate, throw or
+  // trace. They return the error code instead (ERROR_SUCCESS on success).
+  virtual DWORD WritePatch() noexcept
   {
-    HADESMEM_DETAIL_TRACE_A("Restoring original bytes.");
+    return detail::WriteUncheckedNoThrow(
+      process_, target_, patch_.data(), patch_.size());
+  }
 
-    WriteVector(process_, target_, orig_);
+  virtual DWORD RemovePatch() noexcept
+  {
+    return detail::WriteUncheckedNoThrow(
+      process_, target_, orig_.data(), orig_.size());
   }
 
   virtual bool CanHookChainImpl() const noexcept
@@ -495,10 +607,11 @@ protected:
   bool detached_{false};
   void* target_{};
   DetourFuncT detour_{};
-  std::unique_ptr<Allocator> trampoline_{};
-  std::unique_ptr<Allocator> stub_gate_{};
+  std::unique_ptr<detail::TrampolineBlock> trampoline_{};
+  std::unique_ptr<detail::TrampolineBlock> stub_gate_{};
   std::vector<BYTE> orig_{};
-  std::vector<std::unique_ptr<Allocator>> trampolines_{};
+  std::vector<BYTE> patch_{};
+  std::vector<std::unique_ptr<detail::TrampolineBlock>> trampolines_{};
   std::atomic<std::uint32_t> ref_count_{};
   std::unique_ptr<StubT> stub_{};
   ContextT context_;
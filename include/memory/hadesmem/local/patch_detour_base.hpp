@@ -4,9 +4,12 @@
 #pragma once
 
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <type_traits>
 
+#include <windows.h>
+
 #include <hadesmem/alloc.hpp>
 #include <hadesmem/detail/alias_cast.hpp>
 #include <hadesmem/detail/assert.hpp>
@@ -24,6 +27,39 @@ class PatchDetourBase
 public:
   virtual void Apply() = 0;
 
+  // Apply split in two for PatchTransaction, so that everything which doesn't
+  // touch the target (allocating and generating trampolines, disassembly,
+  // reading the original bytes, etc.) can be done up front, and other threads
+  // only need to be suspended while the patch itself is written.
+  // CommitApply must be preceded by a successful PrepareApply. It doesn't
+  // suspend threads, verify thread IPs against the patch range, make the
+  // target writable, or flush the instruction cache, all of which are the
+  // caller's responsibility. As other threads are suspended while it runs, it
+  // must not allocate or throw, so it returns the error code instead
+  // (ERROR_SUCCESS if the patch was written).
+  virtual void PrepareApply() = 0;
+
+  virtual DWORD CommitApply() noexcept = 0;
+
+  // Undoes a CommitApply, under the same conditions. Trampolines are kept
+  // (same as Remove), so threads which are part way through the detour are
+  // unaffected.
+  virtual DWORD RevertApply() noexcept = 0;
+
+  // Releases anything PrepareApply registered outside of the patch itself
+  // (e.g. PatchVeh's exception handler entry), once the patch has been
+  // reverted or removed, or if it was never committed. Unlike CommitApply and
+  // RevertApply this may take locks and wait on other threads, so it must not
+  // be called while they are suspended. Safe to call more than once.
+  virtual void CancelApply()
+  {
+  }
+
+  // The range written by CommitApply. Only valid after PrepareApply.
+  virtual void* GetPatchAddress() const noexcept = 0;
+
+  virtual std::size_t GetPatchLength() const noexcept = 0;
+
   virtual void Remove() = 0;
 
   virtual void RemoveUnchecked() noexcept = 0;
@@ -26,7 +26,6 @@
 #include <hadesmem/detail/patch_detour_stub.hpp>
 #include <hadesmem/detail/patcher_aux.hpp>
 #include <hadesmem/detail/scope_warden.hpp>
-#include <hadesmem/detail/srw_lock.hpp>
 #include <hadesmem/detail/thread_aux.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/type_traits.hpp>
@@ -88,6 +87,11 @@ public:
   {
   }
 
+  virtual ~PatchDr()
+  {
+    RemoveUnchecked();
+  }
+
   PatchDr& operator=(PatchDr&& other)
   {
     PatchVeh::operator=(std::move(other));
@@ -102,65 +106,41 @@ protected:
     return 1;
   }
 
-  virtual void WritePatch() override
+  // The debug registers are checked here as well as in WritePatch, so that
+  // running out of them is reported as an exception rather than only as an
+  // error code from a write made while other threads are suspended.
+  virtual void PreparePatch() override
   {
-    hadesmem::detail::AcquireSRWLock const lock(
-      &GetSrwLock(), hadesmem::detail::SRWLockType::Exclusive);
-
-    auto& veh_hooks = GetVehHooks();
-
-    HADESMEM_DETAIL_ASSERT(veh_hooks.find(target_) == std::end(veh_hooks));
-    veh_hooks[target_] = this;
-
-    auto const veh_cleanup_hook = [&]() {
-      auto const veh_hooks_removed = veh_hooks.erase(target_);
-      (void)veh_hooks_removed;
-      HADESMEM_DETAIL_ASSERT(veh_hooks_removed);
-    };
-    auto scope_veh_cleanup_hook =
-      hadesmem::detail::MakeScopeWarden(veh_cleanup_hook);
-
-    HADESMEM_DETAIL_TRACE_A("Setting DR hook.");
+    PatchVeh::PreparePatch();
 
-    auto& dr_hooks = GetDrHooks();
-    auto const thread_id = ::GetCurrentThreadId();
-    HADESMEM_DETAIL_ASSERT(dr_hooks.find(thread_id) == std::end(dr_hooks));
+    Thread const thread(::GetCurrentThreadId());
+    auto const context = GetThreadContext(thread, CONTEXT_DEBUG_REGISTERS);
+    if (FindFreeDr(context) == kInvalidDrIndex)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"No free debug registers."});
+    }
+  }
 
-    Thread const thread(thread_id);
-    auto context = GetThreadContext(thread, CONTEXT_DEBUG_REGISTERS);
+  virtual DWORD WritePatch() noexcept override
+  {
+    auto& thread_dr_index = GetDrIndex();
+    HADESMEM_DETAIL_ASSERT(thread_dr_index == kInvalidDrIndex);
 
-    std::uint32_t dr_index = static_cast<std::uint32_t>(-1);
-    for (std::uint32_t i = 0; i < 4; ++i)
+    CONTEXT context{};
+    context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+    if (!::GetThreadContext(::GetCurrentThread(), &context))
     {
-      // Check whether the DR is available according to the control register
-      bool const control_available = !(context.Dr7 & (1ULL << (i * 2)));
-      // Check whether the DR is zero. Pobably not actually necessary, but
-      // it's a nice additional sanity check. This may require a
-      // user-controlable flag in future though if the code being hooked is
-      // 'hostile'.
-      bool const dr_available = !(&context.Dr0)[i];
-      if (control_available && dr_available)
-      {
-        dr_index = i;
-        break;
-      }
+      return ::GetLastError();
     }
 
-    if (dr_index == static_cast<std::uint32_t>(-1))
+    auto const dr_index = FindFreeDr(context);
+    if (dr_index == kInvalidDrIndex)
     {
-      HADESMEM_DETAIL_THROW_EXCEPTION(
-        Error{} << ErrorString{"No free debug registers."});
+      return ERROR_NO_MORE_ITEMS;
     }
 
-    dr_hooks[::GetCurrentThreadId()] = dr_index;
-
-    auto const dr_cleanup_hook = [&]() {
-      auto const dr_hooks_removed = dr_hooks.erase(::GetCurrentThreadId());
-      (void)dr_hooks_removed;
-      HADESMEM_DETAIL_ASSERT(dr_hooks_removed);
-    };
-    auto scope_dr_cleanup_hook =
-      hadesmem::detail::MakeScopeWarden(dr_cleanup_hook);
+    thread_dr_index = dr_index;
 
     (&context.Dr0)[dr_index] = reinterpret_cast<std::uintptr_t>(target_);
     // Set appropriate L0-L3 flag
@@ -175,48 +155,70 @@ protected:
     std::uintptr_t local_enable = 1 << 8;
     context.Dr7 |= local_enable;
 
-    SetThreadContext(thread, context);
+    if (!::SetThreadContext(::GetCurrentThread(), &context))
+    {
+      DWORD const last_error = ::GetLastError();
+      thread_dr_index = kInvalidDrIndex;
+      return last_error;
+    }
 
-    scope_veh_cleanup_hook.Dismiss();
-    scope_dr_cleanup_hook.Dismiss();
+    return ERROR_SUCCESS;
   }
 
-  virtual void RemovePatch() override
+  virtual DWORD RemovePatch() noexcept override
   {
-    hadesmem::detail::AcquireSRWLock const lock(
-      &GetSrwLock(), hadesmem::detail::SRWLockType::Exclusive);
-
-    HADESMEM_DETAIL_TRACE_A("Unsetting DR hook.");
+    auto& thread_dr_index = GetDrIndex();
+    HADESMEM_DETAIL_ASSERT(thread_dr_index != kInvalidDrIndex);
+    auto const dr_index = thread_dr_index;
 
-    auto& dr_hooks = GetDrHooks();
-    auto const thread_id = ::GetCurrentThreadId();
-    auto const iter = dr_hooks.find(thread_id);
-    HADESMEM_DETAIL_ASSERT(iter != std::end(dr_hooks));
-    auto const dr_index = iter->second;
-
-    Thread const thread(thread_id);
-    auto context = GetThreadContext(thread, CONTEXT_DEBUG_REGISTERS);
+    CONTEXT context{};
+    context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+    if (!::GetThreadContext(::GetCurrentThread(), &context))
+    {
+      return ::GetLastError();
+    }
 
     // Clear the appropriate DR
     *(&context.Dr0 + dr_index) = 0;
     // Clear appropriate L0-L3 flag
     context.Dr7 &= ~static_cast<std::uintptr_t>(1ULL << (dr_index * 2));
 
-    SetThreadContext(thread, context);
+    if (!::SetThreadContext(::GetCurrentThread(), &context))
+    {
+      return ::GetLastError();
+    }
 
-    auto const dr_hooks_removed = dr_hooks.erase(thread_id);
-    (void)dr_hooks_removed;
-    HADESMEM_DETAIL_ASSERT(dr_hooks_removed);
+    thread_dr_index = kInvalidDrIndex;
 
-    auto& veh_hooks = GetVehHooks();
-    auto const veh_hooks_removed = veh_hooks.erase(target_);
-    (void)veh_hooks_removed;
-    HADESMEM_DETAIL_ASSERT(veh_hooks_removed);
+    return ERROR_SUCCESS;
   }
 
   virtual bool CanHookChainImpl() const noexcept override
   {
     return false;
   }
+
+private:
+  // Index of the first debug register which is free according to the context,
+  // or kInvalidDrIndex if there isn't one.
+  static std::uintptr_t FindFreeDr(CONTEXT const& context) noexcept
+  {
+    for (std::uint32_t i = 0; i < 4; ++i)
+    {
+      // Check whether the DR is available according to the control register
+      bool const control_available = !(context.Dr7 & (1ULL << (i * 2)));
+      // Check whether the DR is zero. Pobably not actually necessary, but
+      // it's a nice additional sanity check. This may require a
+      // user-controlable flag in future though if the code being hooked is
+      // 'hostile'.
+      bool const dr_available = !(&context.Dr0)[i];
+      if (control_available && dr_available)
+      {
+        return i;
+      }
+    }
+
+    return kInvalidDrIndex;
+  }
 };
 }
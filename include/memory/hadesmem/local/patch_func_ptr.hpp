@@ -3,7 +3,9 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 #include <windows.h>
@@ -12,10 +14,14 @@
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/patch_code_gen.hpp>
 #include <hadesmem/detail/patch_detour_stub.hpp>
+#include <hadesmem/detail/patcher_aux.hpp>
 #include <hadesmem/detail/trace.hpp>
+#include <hadesmem/detail/trampoline_heap.hpp>
+#include <hadesmem/detail/write_impl.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/flush.hpp>
 #include <hadesmem/local/patch_detour_base.hpp>
+#include <hadesmem/local/patch_transaction.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/read.hpp>
 #include <hadesmem/write.hpp>
@@ -134,6 +140,21 @@ public:
       return;
     }
 
+    PatchTransaction transaction{*process_};
+    transaction.Add(*this);
+    transaction.Apply();
+  }
+
+  virtual void PrepareApply() override
+  {
+    HADESMEM_DETAIL_ASSERT(!applied_);
+
+    if (detached_)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Patch is detached."});
+    }
+
     stub_gate_ = nullptr;
 
     auto const detour_raw = detour_.target<DetourFuncRawT>();
@@ -147,7 +168,8 @@ public:
       HADESMEM_DETAIL_TRACE_FORMAT_A("Target = %p, Detour = INVALID.", target_);
     }
 
-    stub_gate_ = std::make_unique<Allocator>(*process_, sizeof(void*));
+    stub_gate_ = detail::AllocateTrampolineNear(
+      *process_, target_, detail::PatchConstants::kStubGateSize);
 
     detail::WriteStubGate<TargetFuncT>(*process_,
                                        stub_gate_->GetBase(),
@@ -156,10 +178,42 @@ public:
                                        &GetReturnAddressPtrPtr);
 
     orig_ = Read<void*>(*process_, target_);
+  }
 
-    WritePatch();
+  virtual DWORD CommitApply() noexcept override
+  {
+    HADESMEM_DETAIL_ASSERT(!applied_ && stub_gate_);
 
-    applied_ = true;
+    DWORD const last_error = WritePatch();
+    if (last_error == ERROR_SUCCESS)
+    {
+      applied_ = true;
+    }
+
+    return last_error;
+  }
+
+  virtual DWORD RevertApply() noexcept override
+  {
+    HADESMEM_DETAIL_ASSERT(applied_);
+
+    DWORD const last_error = RemovePatch();
+    if (last_error == ERROR_SUCCESS)
+    {
+      applied_ = false;
+    }
+
+    return last_error;
+  }
+
+  virtual void* GetPatchAddress() const noexcept override
+  {
+    return target_;
+  }
+
+  virtual std::size_t GetPatchLength() const noexcept override
+  {
+    return sizeof(*target_);
   }
 
   virtual void Remove() override
@@ -169,7 +223,21 @@ public:
       return;
     }
 
-    RemovePatch();
+    std::vector<std::pair<void*, std::size_t>> const ranges = {
+      {target_, sizeof(*target_)}};
+    DWORD last_error = ERROR_SUCCESS;
+    {
+      auto const guards = detail::ProtectPatchRanges(*process_, ranges);
+
+      last_error = RemovePatch();
+    }
+
+    detail::InvalidatePatchRanges(*process_, ranges);
+
+    if (last_error != ERROR_SUCCESS)
+    {
+      detail::ThrowPatchWriteFailed(last_error);
+    }
 
     // Don't free trampolines here. Do it in Apply/destructor. See comments in
     // Apply for the rationale.
@@ -257,18 +325,20 @@ protected:
     return sizeof(void*);
   }
 
-  virtual void WritePatch()
+  // WritePatch and RemovePatch are called while other threads are suspended
+  // (see PatchDetourBase::CommitApply), so they must not allocate, throw or
+  // trace.
+  virtual DWORD WritePatch() noexcept
   {
-    HADESMEM_DETAIL_TRACE_A("Writing pointer to stub.");
-
-    Write(*process_, target_, stub_gate_->GetBase());
+    void* const stub_gate = stub_gate_->GetBase();
+    return detail::WriteUncheckedNoThrow(
+      *process_, target_, &stub_gate, sizeof(stub_gate));
   }
 
-  virtual void RemovePatch()
+  virtual DWORD RemovePatch() noexcept
   {
-    HADESMEM_DETAIL_TRACE_A("Restoring original pointer.");
-
-    Write(*process_, target_, orig_);
+    return detail::WriteUncheckedNoThrow(
+      *process_, target_, &orig_, sizeof(orig_));
   }
 
   virtual bool CanHookChainImpl() const noexcept
@@ -282,7 +352,7 @@ private:
   bool detached_{false};
   TargetFuncRawT* target_{};
   DetourFuncT detour_{};
-  std::unique_ptr<Allocator> stub_gate_{};
+  std::unique_ptr<detail::TrampolineBlock> stub_gate_{};
   void* orig_{};
   std::atomic<std::uint32_t> ref_count_{};
   std::unique_ptr<StubT> stub_{};
@@ -3,7 +3,15 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #include <windows.h>
@@ -15,25 +23,19 @@
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/flush.hpp>
+#include <hadesmem/import_site_index.hpp>
 #include <hadesmem/local/patch_detour_base.hpp>
 #include <hadesmem/local/patch_func_ptr.hpp>
 #include <hadesmem/local/patch_func_rva.hpp>
+#include <hadesmem/local/patch_transaction.hpp>
 #include <hadesmem/module.hpp>
-#include <hadesmem/module_list.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
-#include <hadesmem/pelib/import_dir.hpp>
-#include <hadesmem/pelib/import_dir_list.hpp>
-#include <hadesmem/pelib/import_thunk.hpp>
-#include <hadesmem/pelib/import_thunk_list.hpp>
 #include <hadesmem/pelib/export.hpp>
 #include <hadesmem/pelib/export_list.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/read.hpp>
 #include <hadesmem/write.hpp>
 
-// TODO: Add some sort of 'Update' or 'Rehook' function for use on module
-// load/unload.
-
 // TODO: Support 'stealth' IAT hooking where we redirect to code inside the
 // module which will raise an exception.
 
@@ -62,11 +64,32 @@ public:
   HADESMEM_DETAIL_STATIC_ASSERT(detail::IsFunction<TargetFuncRawT>::value);
   HADESMEM_DETAIL_STATIC_ASSERT(detail::IsFunction<DetourFuncRawT>::value);
 
+  // Only indexes the imports from module, but that still means reading the
+  // import descriptors of every loaded module. Hooks created this way can be
+  // updated with a full index, or one built for the same module.
   PatchIat(Process const& process,
            std::wstring const& module,
            std::string const& function,
            DetourFuncT const& detour,
            ContextT context = ContextT())
+    : PatchIat{process,
+               ImportSiteIndex{process, module},
+               module,
+               function,
+               detour,
+               std::move(context)}
+  {
+  }
+
+  // When hooking more than one function, build the index once and share it
+  // between the patches, rather than having every patch parse the import
+  // tables of every module.
+  PatchIat(Process const& process,
+           ImportSiteIndex const& index,
+           std::wstring const& module,
+           std::string const& function,
+           DetourFuncT const& detour,
+           ContextT context = ContextT())
     : process_{process},
       module_(detail::ToUpperOrdinal(module)),
       function_(function),
@@ -79,11 +102,7 @@ public:
         Error{} << ErrorString{"PatchIat only supported on local process."});
     }
 
-    hadesmem::ModuleList const modules{process};
-    for (auto const& m : modules)
-    {
-      HookModule(m);
-    }
+    Update(index);
   }
 
   explicit PatchIat(Process const&& process,
@@ -92,6 +111,13 @@ public:
                     DetourFuncT const& detour,
                     ContextT context = ContextT()) = delete;
 
+  explicit PatchIat(Process const&& process,
+                    ImportSiteIndex const& index,
+                    std::wstring const& module,
+                    std::string const& function,
+                    DetourFuncT const& detour,
+                    ContextT context = ContextT()) = delete;
+
   PatchIat(PatchIat const& other) = delete;
 
   PatchIat& operator=(PatchIat const& other) = delete;
@@ -103,7 +129,7 @@ public:
       detour_{std::move(other.detour_)},
       context_(std::move(other.context_)),
       eat_hook_{std::move(other.eat_hook_)},
-      iat_hooks_{std::move(other.iat_hooks_)},
+      iat_hooks_{std::move(other.iat_hooks_)}
   {
   }
 
@@ -127,19 +153,28 @@ public:
     RemoveUnchecked();
   }
 
+  // All of the IAT slots (and the EAT entry) are written in a single pass.
   void Apply()
+  {
+    PatchTransaction transaction{process_};
+    Apply(transaction);
+    transaction.Apply();
+  }
+
+  // Adds the patch to a transaction rather than applying it immediately, so
+  // that any number of patches can be written in a single pass (i.e. with
+  // other threads suspended once, and each region's protection changed once).
+  // The patch must outlive the transaction.
+  void Apply(PatchTransaction& transaction)
   {
     if (eat_hook_)
     {
-      eat_hook_->Apply();
+      transaction.Add(*eat_hook_);
     }
 
     for (auto& iat_hook : iat_hooks_)
     {
-      if (iat_hook.second)
-      {
-        iat_hook.second->Apply();
-      }
+      transaction.Add(*iat_hook.second);
     }
   }
 
@@ -161,7 +196,10 @@ public:
 
   void RemoveUnchecked() noexcept
   {
-    eat_hook_->RemoveUnchecked();
+    if (eat_hook_)
+    {
+      eat_hook_->RemoveUnchecked();
+    }
 
     for (auto& iat_hook : iat_hooks_)
     {
@@ -172,96 +210,145 @@ public:
     }
   }
 
-private:
-  void HookModule(Module const& m)
+  bool IsApplied() const noexcept
   {
-    hadesmem::PeFile const pe_file{
-      process_, m.GetHandle(), hadesmem::PeFileType::kImage, 0};
+    if (eat_hook_ && eat_hook_->IsApplied())
+    {
+      return true;
+    }
 
-    auto const cur_mod_name = detail::ToUpperOrdinal(m.GetName());
-    if (cur_mod_name == module_)
+    for (auto const& iat_hook : iat_hooks_)
     {
-      HookModuleExports(pe_file);
+      if (iat_hook.second->IsApplied())
+      {
+        return true;
+      }
     }
 
-    HookModuleImports(pe_file);
+    return false;
   }
 
-  void HookModuleExports(PeFile const& pe_file)
+  // For use on module load/unload, after the index has been updated. Hooks
+  // the IAT slots of modules loaded since the patch was created (and the
+  // target's exports, if it wasn't loaded then), and forgets the slots of
+  // modules which have since been unloaded. If the patch is applied, the new
+  // hooks are applied too.
+  // TODO: Detect the target being unloaded and handle the EAT hook too.
+  void Update(ImportSiteIndex const& index)
   {
-    hadesmem::ExportList exports{process_, pe_file};
-    for (auto& e : exports)
+    bool const applied = IsApplied();
+    PatchTransaction transaction{process_};
+
+    if (!eat_hook_)
     {
-      if (function_ != e.GetName())
+      HookExports();
+      if (eat_hook_ && applied)
       {
-        continue;
+        transaction.Add(*eat_hook_);
       }
+    }
 
-      if (e.IsForwarded())
+    auto const& sites = index.Find(module_, function_);
+    std::set<IatHookKey> keys;
+    for (auto const& site : sites)
+    {
+      keys.insert(GetIatHookKey(site));
+    }
+
+    for (auto iter = std::begin(iat_hooks_); iter != std::end(iat_hooks_);)
+    {
+      if (keys.find(iter->first) == std::end(keys))
       {
-        // TODO: Handle forwarded exports correctly.
-        HADESMEM_DETAIL_TRACE_FORMAT_A(
-          "WARNING! Unhandled forwarded export with forwarder [%s].",
-          e.GetForwarder());
-        HADESMEM_DETAIL_ASSERT(false);
+        // The module is gone (possibly replaced by a different one at the same
+        // base), so there's nothing left to restore.
+        iter->second->Detach();
+        iter = iat_hooks_.erase(iter);
+      }
+      else
+      {
+        ++iter;
       }
+    }
 
-      HADESMEM_DETAIL_ASSERT(!eat_hook_);
+    for (auto const& site : sites)
+    {
+      auto& iat_hook = iat_hooks_[GetIatHookKey(site)];
+      if (iat_hook)
+      {
+        continue;
+      }
 
       HADESMEM_DETAIL_TRACE_FORMAT_A(
-        "Got export at [%p] with value [%p].", e.GetRvaPtr(), e.GetVa());
+        "Got import thunk at [%p] in module [%p].", site.slot, site.importer);
 
-      eat_hook_ = std::make_unique<PatchFuncRva<TargetFuncT, ContextT>>(
-        process_, pe_file.GetBase(), e.GetRvaPtr(), detour_, context_);
+      auto const func_ptr = static_cast<TargetFuncRawT*>(site.slot);
+      iat_hook = std::make_unique<PatchFuncPtr<TargetFuncT, ContextT>>(
+        process_, func_ptr, detour_, context_);
+      if (applied)
+      {
+        transaction.Add(*iat_hook);
+      }
     }
+
+    transaction.Apply();
   }
 
-  void HookModuleImports(PeFile const& pe_file)
-  {
-    hadesmem::ImportDirList const import_dirs{process_, pe_file};
-    for (auto const& id : import_dirs)
-    {
-      // TODO: Handle forwarded exports here also? i.e. Hook both things that
-      // import via the forwarder and also hook the real implementation.
+private:
+  // Importer base and size, and IAT slot. The importer is identified the same
+  // way ImportSiteIndex::Refresh does, so if a module is unloaded and a
+  // different one is loaded at the same base, its slots get new hooks rather
+  // than being mistaken for the old module's.
+  using IatHookKey = std::tuple<HMODULE, DWORD, void*>;
 
-      auto const imp_mod_name =
-        detail::ToUpperOrdinal(detail::MultiByteToWideChar(id.GetName()));
-      if (imp_mod_name != module_)
-      {
-        continue;
-      }
+  static IatHookKey GetIatHookKey(ImportSite const& site)
+  {
+    return IatHookKey{site.importer, site.importer_size, site.slot};
+  }
 
-      HookModuleImportDir(pe_file, id);
+  void HookExports()
+  {
+    HMODULE handle = nullptr;
+    try
+    {
+      handle = Module{process_, module_}.GetHandle();
     }
+    catch (std::exception const& /*e*/)
+    {
+      // Not loaded (yet).
+      return;
+    }
+
+    hadesmem::PeFile const pe_file{
+      process_, handle, hadesmem::PeFileType::kImage, 0};
+    HookModuleExports(pe_file);
   }
 
-  void HookModuleImportDir(PeFile const& pe_file, hadesmem::ImportDir const& id)
+  void HookModuleExports(PeFile const& pe_file)
   {
-    hadesmem::ImportThunkList import_thunks{
-      process_, pe_file, id.GetFirstThunk()};
-    hadesmem::ImportThunkList orig_import_thunks{
-      process_, pe_file, id.GetOriginalFirstThunk()};
-    for (auto it = std::begin(import_thunks),
-              oit = std::begin(orig_import_thunks);
-         it != std::end(import_thunks) && oit != std::end(orig_import_thunks);
-         ++it, ++oit)
+    hadesmem::ExportList exports{process_, pe_file};
+    for (auto& e : exports)
     {
-      if (function_ != oit->GetName())
+      if (function_ != e.GetNameView())
       {
         continue;
       }
 
+      if (e.IsForwarded())
+      {
+        // TODO: Handle forwarded exports correctly.
+        HADESMEM_DETAIL_TRACE_FORMAT_A(
+          "WARNING! Unhandled forwarded export with forwarder [%s].",
+          e.GetForwarder());
+        HADESMEM_DETAIL_ASSERT(false);
+      }
+
+      HADESMEM_DETAIL_ASSERT(!eat_hook_);
+
       HADESMEM_DETAIL_TRACE_FORMAT_A(
-        "Got import thunk at [%p] with value [%p].",
-        it->GetFunctionPtr(),
-        reinterpret_cast<void const*>(it->GetFunction()));
-
-      auto& iat_hook = iat_hooks_[pe_file.GetBase()];
-      HADESMEM_DETAIL_ASSERT(!iat_hook);
-      auto const func_ptr =
-        reinterpret_cast<TargetFuncRawT*>(it->GetFunctionPtr());
-      iat_hook = std::make_unique<PatchFuncPtr<TargetFuncT, ContextT>>(
-        process_, func_ptr, detour_, context_);
+        "Got export at [%p] with value [%p].", e.GetRvaPtr(), e.GetVa());
+
+      eat_hook_ = std::make_unique<PatchFuncRva<TargetFuncT, ContextT>>(
+        process_, pe_file.GetBase(), e.GetRvaPtr(), detour_, context_);
     }
   }
 
@@ -271,6 +358,6 @@ private:
   DetourFuncT detour_{};
   ContextT context_;
   std::unique_ptr<PatchDetourBase> eat_hook_;
-  std::map<void*, std::unique_ptr<PatchDetourBase>> iat_hooks_{};
+  std::map<IatHookKey, std::unique_ptr<PatchDetourBase>> iat_hooks_{};
 };
 }
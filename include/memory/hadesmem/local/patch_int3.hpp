@@ -26,11 +26,11 @@
 #include <hadesmem/detail/patch_detour_stub.hpp>
 #include <hadesmem/detail/patcher_aux.hpp>
 #include <hadesmem/detail/scope_warden.hpp>
-#include <hadesmem/detail/srw_lock.hpp>
 #include <hadesmem/detail/thread_aux.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/type_traits.hpp>
 #include <hadesmem/detail/winternl.hpp>
+#include <hadesmem/detail/write_impl.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/flush.hpp>
 #include <hadesmem/local/patch_veh.hpp>
@@ -71,6 +71,11 @@ public:
   {
   }
 
+  virtual ~PatchInt3()
+  {
+    RemoveUnchecked();
+  }
+
   PatchInt3& operator=(PatchInt3&& other)
   {
     PatchVeh::operator=(std::move(other));
@@ -84,42 +89,17 @@ protected:
     return 1;
   }
 
-  virtual void WritePatch() override
+  virtual DWORD WritePatch() noexcept override
   {
-    auto& veh_hooks = GetVehHooks();
-
-    {
-      hadesmem::detail::AcquireSRWLock const lock(
-        &GetSrwLock(), hadesmem::detail::SRWLockType::Exclusive);
-
-      HADESMEM_DETAIL_ASSERT(veh_hooks.find(target_) == std::end(veh_hooks));
-      veh_hooks[target_] = this;
-    }
-
-    auto const cleanup_hook = [&]() { veh_hooks.erase(target_); };
-    auto scope_cleanup_hook = hadesmem::detail::MakeScopeWarden(cleanup_hook);
-
-    HADESMEM_DETAIL_TRACE_A("Writing breakpoint.");
-
-    std::vector<std::uint8_t> const buf = {0xCC};
-    WriteVector(process_, target_, buf);
-
-    scope_cleanup_hook.Dismiss();
+    static std::uint8_t const kBreakpoint = 0xCC;
+    return detail::WriteUncheckedNoThrow(
+      process_, target_, &kBreakpoint, sizeof(kBreakpoint));
   }
 
-  virtual void RemovePatch() override
+  virtual DWORD RemovePatch() noexcept override
   {
-    HADESMEM_DETAIL_TRACE_A("Restoring original bytes.");
-
-    WriteVector(process_, target_, orig_);
-
-    {
-      hadesmem::detail::AcquireSRWLock const lock(
-        &GetSrwLock(), hadesmem::detail::SRWLockType::Exclusive);
-
-      auto& veh_hooks = GetVehHooks();
-      veh_hooks.erase(target_);
-    }
+    return detail::WriteUncheckedNoThrow(
+      process_, target_, orig_.data(), orig_.size());
   }
 
   virtual bool CanHookChainImpl() const noexcept override
@@ -0,0 +1,191 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/patcher_aux.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/flush.hpp>
+#include <hadesmem/local/patch_detour_base.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/thread_helpers.hpp>
+
+// TODO: Support removal as a transaction too.
+
+// TODO: Support PatchVmt once it's ported to PatchDetourBase.
+
+namespace hadesmem
+{
+// Applies a batch of patches as a unit. All the expensive work (allocating and
+// generating trampolines, disassembly, etc.) is done for every patch up front,
+// then other threads are suspended once while all of the patches are written.
+// Either every patch is applied, or (if anything fails) none of them are.
+class PatchTransaction
+{
+public:
+  explicit PatchTransaction(Process const& process) : process_{&process}
+  {
+    if (process.GetId() != ::GetCurrentProcessId())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{}
+        << ErrorString{"PatchTransaction only supported on local process."});
+    }
+  }
+
+  explicit PatchTransaction(Process const&& process) = delete;
+
+  PatchTransaction(PatchTransaction const& other) = delete;
+
+  PatchTransaction& operator=(PatchTransaction const& other) = delete;
+
+  // The patch must outlive the transaction. Patches which are already applied
+  // are skipped.
+  void Add(PatchDetourBase& patch)
+  {
+    patches_.push_back(&patch);
+  }
+
+  void Apply()
+  {
+    std::vector<PatchDetourBase*> pending;
+    for (auto const patch : patches_)
+    {
+      if (!patch->IsApplied())
+      {
+        pending.push_back(patch);
+      }
+    }
+
+    if (pending.empty())
+    {
+      return;
+    }
+
+    try
+    {
+      for (auto const patch : pending)
+      {
+        patch->PrepareApply();
+      }
+    }
+    catch (...)
+    {
+      Cancel(pending);
+      throw;
+    }
+
+    std::vector<std::pair<void*, std::size_t>> ranges;
+    ranges.reserve(pending.size());
+    for (auto const patch : pending)
+    {
+      ranges.emplace_back(patch->GetPatchAddress(), patch->GetPatchLength());
+    }
+
+    // Nothing may be allocated (or thrown) while other threads are suspended,
+    // as one of them may hold the heap lock. So the regions are made writable
+    // up front, the threads are checked against the snapshot SuspendedProcess
+    // already took, the patches are written without allocating, and anything
+    // which went wrong is only reported once the threads are resumed.
+    // Anything the patches need has been allocated by PrepareApply.
+    DWORD blocking_thread_id = 0;
+    DWORD last_error = ERROR_SUCCESS;
+    DWORD write_error = ERROR_SUCCESS;
+    try
+    {
+      // Restored after the threads are resumed, success or not.
+      auto const guards = detail::ProtectPatchRanges(*process_, ranges);
+
+      SuspendedProcess const suspended_process{process_->GetId()};
+
+      blocking_thread_id =
+        detail::FindThreadInPatchRanges(suspended_process, ranges, last_error);
+      if (!blocking_thread_id)
+      {
+        write_error = Commit(pending);
+      }
+    }
+    catch (...)
+    {
+      Cancel(pending);
+      throw;
+    }
+
+    detail::InvalidatePatchRanges(*process_, ranges);
+
+    if (blocking_thread_id)
+    {
+      Cancel(pending);
+      detail::ThrowThreadInPatchRanges(last_error);
+    }
+
+    if (write_error != ERROR_SUCCESS)
+    {
+      Cancel(pending);
+      detail::ThrowPatchWriteFailed(write_error);
+    }
+
+    // One flush for the whole batch rather than one per patch.
+    FlushInstructionCache(*process_, nullptr, 0);
+  }
+
+private:
+  // Writes every patch, or (if one fails) none of them. Called while other
+  // threads are suspended.
+  static DWORD Commit(std::vector<PatchDetourBase*> const& pending) noexcept
+  {
+    for (std::size_t committed = 0; committed < pending.size(); ++committed)
+    {
+      DWORD const last_error = pending[committed]->CommitApply();
+      if (last_error != ERROR_SUCCESS)
+      {
+        Rollback(pending, committed);
+        return last_error;
+      }
+    }
+
+    return ERROR_SUCCESS;
+  }
+
+  static void Cancel(std::vector<PatchDetourBase*> const& pending) noexcept
+  {
+    for (auto const patch : pending)
+    {
+      try
+      {
+        patch->CancelApply();
+      }
+      catch (...)
+      {
+        HADESMEM_DETAIL_TRACE_A(
+          boost::current_exception_diagnostic_information().c_str());
+        HADESMEM_DETAIL_ASSERT(false);
+      }
+    }
+  }
+
+  static void Rollback(std::vector<PatchDetourBase*> const& pending,
+                       std::size_t committed) noexcept
+  {
+    while (committed)
+    {
+      // WARNING: Patch is left applied if RevertApply fails.
+      DWORD const last_error = pending[--committed]->RevertApply();
+      (void)last_error;
+      HADESMEM_DETAIL_ASSERT(last_error == ERROR_SUCCESS);
+    }
+  }
+
+  Process const* process_;
+  std::vector<PatchDetourBase*> patches_;
+};
+}
@@ -7,7 +7,6 @@
 #include <climits>
 #include <cstdint>
 #include <functional>
-#include <map>
 #include <memory>
 #include <sstream>
 #include <type_traits>
@@ -21,12 +20,13 @@
 #include <windows.h>
 
 #include <hadesmem/alloc.hpp>
+#include <hadesmem/detail/address_table.hpp>
 #include <hadesmem/detail/alias_cast.hpp>
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/patch_detour_stub.hpp>
 #include <hadesmem/detail/patcher_aux.hpp>
+#include <hadesmem/detail/reader_epoch.hpp>
 #include <hadesmem/detail/scope_warden.hpp>
-#include <hadesmem/detail/srw_lock.hpp>
 #include <hadesmem/detail/thread_aux.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/type_traits.hpp>
@@ -66,22 +66,53 @@ public:
 
   PatchVeh& operator=(PatchVeh const& other) = delete;
 
-  PatchVeh(PatchVeh&& other) : PatchDetour{std::move(other)}
+  PatchVeh(PatchVeh&& other)
+    : PatchDetour{std::move(other)}, hit_count_{other.hit_count_.load()}
   {
   }
 
   PatchVeh& operator=(PatchVeh&& other)
   {
     PatchDetour::operator=(std::move(other));
+    hit_count_ = other.hit_count_.load();
     return *this;
   }
 
+  virtual ~PatchVeh()
+  {
+    try
+    {
+      CancelApply();
+    }
+    catch (...)
+    {
+      // WARNING: Handlers may use the patch after it's freed if this fails.
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+    }
+  }
+
+  virtual void CancelApply() override
+  {
+    if (target_ && GetVehHooks().Find(target_) == this)
+    {
+      EraseVehHook(target_);
+    }
+  }
+
+  // Number of times the exception handler has dispatched to this hook.
+  std::uint64_t GetHitCount() const noexcept
+  {
+    return hit_count_.load(std::memory_order_relaxed);
+  }
+
   static void InitializeStatics()
   {
     GetInitialized();
-    GetSrwLock();
     GetVehHooks();
-    GetDrHooks();
+    GetVehEpoch();
+    GetDrIndex();
   }
 
 protected:
@@ -90,14 +121,31 @@ protected:
     HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{"Unimplemented."});
   }
 
-  virtual void WritePatch() override
+  // The hook is registered here rather than in WritePatch, as the table may
+  // need to allocate (and takes a lock), and WritePatch may be called while
+  // other threads are suspended. Until the patch is written the handlers only
+  // see the hook if something else raises an exception at the target.
+  // Unregistered by CancelApply.
+  virtual void PreparePatch() override
   {
-    HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{"Unimplemented."});
+    auto& veh_hooks = GetVehHooks();
+    if (veh_hooks.Find(target_) != this && !veh_hooks.Insert(target_, this))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Target is already hooked."});
+    }
   }
 
-  virtual void RemovePatch() override
+  virtual DWORD WritePatch() noexcept override
   {
-    HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{"Unimplemented."});
+    HADESMEM_DETAIL_ASSERT(false);
+    return ERROR_CALL_NOT_IMPLEMENTED;
+  }
+
+  virtual DWORD RemovePatch() noexcept override
+  {
+    HADESMEM_DETAIL_ASSERT(false);
+    return ERROR_CALL_NOT_IMPLEMENTED;
   }
 
   virtual bool CanHookChainImpl() const noexcept override
@@ -142,20 +190,22 @@ protected:
     }
   }
 
+  // NOTE: The handlers take no locks. This is on the path of every call to a
+  // hooked function, and every unrelated breakpoint/single step exception
+  // in the process. Instead they stay in the VEH epoch for as long as they
+  // use the patch, which EraseVehHook waits on before the patch can be freed.
   static LONG CALLBACK HandleBreakpoint(PEXCEPTION_POINTERS exception_pointers)
   {
-    hadesmem::detail::AcquireSRWLock const lock(
-      &GetSrwLock(), hadesmem::detail::SRWLockType::Shared);
+    detail::ReaderEpochGuard const epoch_guard{GetVehEpoch()};
 
-    auto& veh_hooks = GetVehHooks();
-    auto const iter =
-      veh_hooks.find(exception_pointers->ExceptionRecord->ExceptionAddress);
-    if (iter == std::end(veh_hooks))
+    PatchVeh* const patch = GetVehHooks().Find(
+      exception_pointers->ExceptionRecord->ExceptionAddress);
+    if (!patch)
     {
       return EXCEPTION_CONTINUE_SEARCH;
     }
 
-    PatchVeh* patch = iter->second;
+    patch->hit_count_.fetch_add(1, std::memory_order_relaxed);
 #if defined(HADESMEM_DETAIL_ARCH_X64)
     exception_pointers->ContextRecord->Rip =
       reinterpret_cast<std::uintptr_t>(patch->stub_gate_->GetBase());
@@ -171,25 +221,21 @@ protected:
 
   static LONG CALLBACK HandleSingleStep(PEXCEPTION_POINTERS exception_pointers)
   {
-    hadesmem::detail::AcquireSRWLock const lock(
-      &GetSrwLock(), hadesmem::detail::SRWLockType::Shared);
+    detail::ReaderEpochGuard const epoch_guard{GetVehEpoch()};
 
-    auto& veh_hooks = GetVehHooks();
-    auto const iter =
-      veh_hooks.find(exception_pointers->ExceptionRecord->ExceptionAddress);
-    if (iter == std::end(veh_hooks))
+    PatchVeh* const patch = GetVehHooks().Find(
+      exception_pointers->ExceptionRecord->ExceptionAddress);
+    if (!patch)
     {
       return EXCEPTION_CONTINUE_SEARCH;
     }
 
-    auto& dr_hooks = GetDrHooks();
-    auto const dr_hook_iter = dr_hooks.find(::GetCurrentThreadId());
-    if (dr_hook_iter == std::end(dr_hooks))
+    std::uintptr_t const dr_index = GetDrIndex();
+    if (dr_index == kInvalidDrIndex)
     {
       return EXCEPTION_CONTINUE_SEARCH;
     }
 
-    std::uintptr_t const dr_index = dr_hook_iter->second;
     if (!(exception_pointers->ContextRecord->Dr6 & (1ULL << dr_index)))
     {
       return EXCEPTION_CONTINUE_SEARCH;
@@ -200,7 +246,7 @@ protected:
     // Set resume flag
     exception_pointers->ContextRecord->EFlags |= (1ULL << 16);
 
-    PatchVeh* patch = iter->second;
+    patch->hit_count_.fetch_add(1, std::memory_order_relaxed);
 #if defined(HADESMEM_DETAIL_ARCH_X64)
     exception_pointers->ContextRecord->Rip =
       reinterpret_cast<std::uintptr_t>(patch->stub_gate_->GetBase());
@@ -220,22 +266,40 @@ protected:
     return initialized;
   }
 
-  static std::map<void*, PatchVeh*>& GetVehHooks()
+  static detail::AddressTable<PatchVeh>& GetVehHooks()
   {
-    static std::map<void*, PatchVeh*> veh_hooks;
+    static detail::AddressTable<PatchVeh> veh_hooks;
     return veh_hooks;
   }
 
-  static std::map<DWORD, std::uintptr_t>& GetDrHooks()
+  static detail::ReaderEpoch& GetVehEpoch()
   {
-    static std::map<DWORD, std::uintptr_t> dr_hooks;
-    return dr_hooks;
+    static detail::ReaderEpoch veh_epoch;
+    return veh_epoch;
   }
 
-  static SRWLOCK& GetSrwLock()
+  // Once this returns no handler can still be using the hook, so it's safe
+  // to free. Must not be called while other threads are suspended, as one of
+  // them may be inside a handler, which is why it's done by CancelApply
+  // rather than RemovePatch.
+  static bool EraseVehHook(void const* target)
   {
-    static SRWLOCK srw_lock = SRWLOCK_INIT;
-    return srw_lock;
+    bool const erased = GetVehHooks().Erase(target);
+    GetVehEpoch().Synchronize();
+    return erased;
   }
+
+  static std::uintptr_t const kInvalidDrIndex =
+    static_cast<std::uintptr_t>(-1);
+
+  // DR hooks are per-thread (the debug registers are part of the thread's
+  // context), and only one is supported per thread.
+  static std::uintptr_t& GetDrIndex() noexcept
+  {
+    thread_local static std::uintptr_t dr_index = kInvalidDrIndex;
+    return dr_index;
+  }
+
+  std::atomic<std::uint64_t> hit_count_{};
 };
 }
@@ -59,6 +59,7 @@ public:
 
 private:
   template <typename ModuleT> friend class ModuleIterator;
+  friend class ModuleIndex;
 
   using EntryCallback = std::function<bool(MODULEENTRY32W const&)>;
 
@@ -68,6 +69,19 @@ private:
     Initialize(entry);
   }
 
+  explicit Module(Process const& process,
+                  HMODULE handle,
+                  DWORD size,
+                  std::wstring name,
+                  std::wstring path)
+    : process_(&process),
+      handle_(handle),
+      size_(size),
+      name_(std::move(name)),
+      path_(std::move(path))
+  {
+  }
+
   void Initialize(HMODULE handle)
   {
     auto const handle_check = [&](MODULEENTRY32W const& entry) -> bool {
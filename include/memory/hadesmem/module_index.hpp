@@ -0,0 +1,364 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/peb.hpp>
+#include <hadesmem/detail/to_upper_ordinal.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/detail/winapi.hpp>
+#include <hadesmem/detail/winternl.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_list.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+// TODO: Walk the 32-bit loader list (PEB32) of a WoW64 process from a native
+// process instead of falling back to Toolhelp.
+
+namespace hadesmem
+{
+namespace detail
+{
+// The loader structures are pointer sized, so they can only be read as-is from
+// a process of the same bitness. (From a native process, a WoW64 process's
+// 32-bit modules aren't in the native list at all.)
+inline bool CanWalkLoaderList(Process const& process)
+{
+  return IsWoW64Process(::GetCurrentProcess()) ==
+         IsWoW64Process(process.GetHandle());
+}
+
+// Walks the loader's in load order module list, calling f(entry_address,
+// entry) for each entry until it returns true. We don't hold the loader lock,
+// so the list may change under us. Returns false if the walk was cut short by
+// that (in which case f may already have been called for some entries), and
+// true otherwise. Throws if the list can't be read at all.
+template <typename F> bool WalkLoaderList(Process const& process, F f)
+{
+  HADESMEM_DETAIL_ASSERT(CanWalkLoaderList(process));
+
+  auto const peb = GetPeb(process);
+  if (!peb.Ldr)
+  {
+    // Loader isn't initialized yet (e.g. process was created suspended).
+    return true;
+  }
+
+  auto const ldr_data_address = reinterpret_cast<std::uint8_t*>(peb.Ldr);
+  auto const ldr_data =
+    Read<winternl::PEB_LDR_DATA>(process, ldr_data_address);
+  auto const head = reinterpret_cast<LIST_ENTRY*>(
+    ldr_data_address +
+    offsetof(winternl::PEB_LDR_DATA, InLoadOrderModuleList));
+
+  // Guard against looping forever on a list which is being modified.
+  std::size_t const kMaxEntries = 0x10000;
+  std::size_t num_entries = 0;
+  for (LIST_ENTRY* link = ldr_data.InLoadOrderModuleList.Flink; link != head;)
+  {
+    if (!link || ++num_entries > kMaxEntries)
+    {
+      return false;
+    }
+
+    // InLoadOrderLinks is the first member, so the link is the entry.
+    winternl::LDR_DATA_TABLE_ENTRY ldr_entry;
+    try
+    {
+      ldr_entry = Read<winternl::LDR_DATA_TABLE_ENTRY>(process, link);
+    }
+    catch (std::exception const&)
+    {
+      // Entry was freed under us.
+      return false;
+    }
+
+    if (f(static_cast<void*>(link), ldr_entry))
+    {
+      return true;
+    }
+
+    link = ldr_entry.InLoadOrderLinks.Flink;
+  }
+
+  return true;
+}
+}
+
+// Index of the modules loaded in a process, built from the loader's module
+// list in the PEB rather than from a Toolhelp snapshot. Lookups by name are a
+// hash lookup, and lookups by address are a binary search.
+// Refresh is incremental. Entries which are still in the list are kept as-is,
+// so only modules loaded since the last refresh have their names read.
+// Falls back to Toolhelp when the process's bitness differs from ours, or when
+// the list keeps changing while we walk it.
+// Pointers returned by the Find functions are invalidated by Refresh and
+// Remove. Not thread-safe.
+class ModuleIndex
+{
+public:
+  explicit ModuleIndex(Process const& process)
+    : process_{&process}, walk_loader_list_{detail::CanWalkLoaderList(process)}
+  {
+    Refresh();
+  }
+
+  explicit ModuleIndex(Process const&& process) = delete;
+
+  void Refresh()
+  {
+    if (walk_loader_list_)
+    {
+      std::size_t const kMaxAttempts = 5;
+      for (std::size_t i = 0; i < kMaxAttempts; ++i)
+      {
+        if (RefreshFromLoaderList())
+        {
+          return;
+        }
+      }
+
+      HADESMEM_DETAIL_TRACE_A(
+        "Loader list kept changing. Falling back to Toolhelp.");
+    }
+
+    RefreshFromToolhelp();
+  }
+
+  // For callers which are notified of unloads (e.g. by hooking the loader),
+  // so the module doesn't have to wait for the next refresh to go away.
+  void Remove(HMODULE handle)
+  {
+    auto const iter = modules_.find(reinterpret_cast<std::uintptr_t>(handle));
+    if (iter == std::end(modules_))
+    {
+      return;
+    }
+
+    modules_.erase(iter);
+    load_order_.erase(
+      std::remove(std::begin(load_order_), std::end(load_order_), handle),
+      std::end(load_order_));
+    RebuildNameIndex();
+  }
+
+  // Same semantics as the Module constructor. A null handle is the main
+  // module.
+  Module const* Find(HMODULE handle) const
+  {
+    if (!handle)
+    {
+      return load_order_.empty() ? nullptr : Find(load_order_.front());
+    }
+
+    auto const iter = modules_.find(reinterpret_cast<std::uintptr_t>(handle));
+    return iter != std::end(modules_) ? &iter->second.module : nullptr;
+  }
+
+  // Same semantics as the Module constructor. Anything containing a path
+  // separator is a path, otherwise it's a name. Both are case insensitive.
+  Module const* Find(std::wstring const& path) const
+  {
+    bool const is_path = (path.find_first_of(L"\\/") != std::wstring::npos);
+    auto const& index = is_path ? paths_ : names_;
+    auto const iter = index.find(detail::ToUpperOrdinal(path));
+    if (iter != std::end(index))
+    {
+      return Find(iter->second);
+    }
+
+    if (is_path)
+    {
+      // Slow path for other spellings of the same file (short names, links,
+      // etc.).
+      for (auto const handle : load_order_)
+      {
+        Module const* const module = Find(handle);
+        if (detail::ArePathsEquivalent(path, module->GetPath()))
+        {
+          return module;
+        }
+      }
+    }
+
+    return nullptr;
+  }
+
+  Module const* FindByAddress(void const* address) const
+  {
+    auto const address_num = reinterpret_cast<std::uintptr_t>(address);
+    auto iter = modules_.upper_bound(address_num);
+    if (iter == std::begin(modules_))
+    {
+      return nullptr;
+    }
+
+    --iter;
+    Module const& module = iter->second.module;
+    return address_num - iter->first < module.GetSize() ? &module : nullptr;
+  }
+
+  std::size_t GetSize() const noexcept
+  {
+    return modules_.size();
+  }
+
+private:
+  struct Entry
+  {
+    // Address of the loader's entry, or null if from Toolhelp.
+    void* ldr_entry;
+    Module module;
+  };
+
+  bool RefreshFromLoaderList()
+  {
+    std::map<std::uintptr_t, Entry> modules;
+    std::vector<HMODULE> load_order;
+    auto const add_module =
+      [&](void* ldr_entry_address,
+          detail::winternl::LDR_DATA_TABLE_ENTRY const& ldr_entry) {
+        if (!ldr_entry.DllBase)
+        {
+          return false;
+        }
+
+        auto const base = reinterpret_cast<std::uintptr_t>(ldr_entry.DllBase);
+        auto const iter = modules_.find(base);
+        bool const unchanged = iter != std::end(modules_) &&
+                               iter->second.ldr_entry == ldr_entry_address &&
+                               iter->second.module.GetSize() ==
+                                 ldr_entry.SizeOfImage;
+        if (modules.emplace(base,
+                            unchanged ? iter->second
+                                      : Entry{ldr_entry_address,
+                                              ReadModule(ldr_entry)})
+              .second)
+        {
+          load_order.push_back(reinterpret_cast<HMODULE>(base));
+        }
+
+        return false;
+      };
+
+    try
+    {
+      if (!detail::WalkLoaderList(*process_, add_module))
+      {
+        return false;
+      }
+    }
+    catch (std::exception const&)
+    {
+      // Names are read separately from the entries, so an entry can still be
+      // freed under us after it has been read.
+      return false;
+    }
+
+    modules_ = std::move(modules);
+    load_order_ = std::move(load_order);
+    RebuildNameIndex();
+    return true;
+  }
+
+  void RefreshFromToolhelp()
+  {
+    std::map<std::uintptr_t, Entry> modules;
+    std::vector<HMODULE> load_order;
+    ModuleList const module_list{*process_};
+    for (auto const& module : module_list)
+    {
+      auto const base = reinterpret_cast<std::uintptr_t>(module.GetHandle());
+      if (modules.emplace(base, Entry{nullptr, module}).second)
+      {
+        load_order.push_back(module.GetHandle());
+      }
+    }
+
+    modules_ = std::move(modules);
+    load_order_ = std::move(load_order);
+    RebuildNameIndex();
+  }
+
+  Module ReadModule(detail::winternl::LDR_DATA_TABLE_ENTRY const& ldr_entry)
+  {
+    std::wstring path = ReadUnicodeString(ldr_entry.FullDllName);
+
+    // BaseDllName normally points into the FullDllName buffer, in which case
+    // there's no need to read it again.
+    std::wstring name;
+    auto const path_beg =
+      reinterpret_cast<std::uintptr_t>(ldr_entry.FullDllName.Buffer);
+    auto const name_beg =
+      reinterpret_cast<std::uintptr_t>(ldr_entry.BaseDllName.Buffer);
+    auto const path_len = path.size() * sizeof(wchar_t);
+    if (name_beg >= path_beg && !((name_beg - path_beg) % sizeof(wchar_t)) &&
+        name_beg - path_beg + ldr_entry.BaseDllName.Length <= path_len)
+    {
+      name = path.substr((name_beg - path_beg) / sizeof(wchar_t),
+                         ldr_entry.BaseDllName.Length / sizeof(wchar_t));
+    }
+    else
+    {
+      name = ReadUnicodeString(ldr_entry.BaseDllName);
+    }
+
+    return Module{*process_,
+                  static_cast<HMODULE>(ldr_entry.DllBase),
+                  ldr_entry.SizeOfImage,
+                  std::move(name),
+                  std::move(path)};
+  }
+
+  std::wstring ReadUnicodeString(UNICODE_STRING const& str)
+  {
+    if (!str.Length || !str.Buffer)
+    {
+      return {};
+    }
+
+    auto const buf =
+      ReadVector<wchar_t>(*process_, str.Buffer, str.Length / sizeof(wchar_t));
+    return std::wstring(std::begin(buf), std::end(buf));
+  }
+
+  void RebuildNameIndex()
+  {
+    names_.clear();
+    paths_.clear();
+    // Earlier modules win if there are duplicates, to match the Module
+    // constructor.
+    for (auto const handle : load_order_)
+    {
+      Module const& module = *Find(handle);
+      names_.emplace(detail::ToUpperOrdinal(module.GetName()), handle);
+      paths_.emplace(detail::ToUpperOrdinal(module.GetPath()), handle);
+    }
+  }
+
+  Process const* process_;
+  bool walk_loader_list_;
+  std::map<std::uintptr_t, Entry> modules_;
+  std::vector<HMODULE> load_order_;
+  std::unordered_map<std::wstring, HMODULE> names_;
+  std::unordered_map<std::wstring, HMODULE> paths_;
+};
+}
@@ -9,6 +9,7 @@
 #include <hadesmem/local/patch_func_ptr.hpp>
 #include <hadesmem/local/patch_iat.hpp>
 #include <hadesmem/local/patch_int3.hpp>
+#include <hadesmem/local/patch_transaction.hpp>
 #include <hadesmem/local/patch_veh.hpp>
 #include <hadesmem/local/patch_vmt.hpp>
 #include <hadesmem/patch_raw.hpp>
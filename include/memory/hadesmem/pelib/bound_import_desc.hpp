@@ -103,7 +103,8 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_BOUND_IMPORT_DESCRIPTOR>(*process_, base_);
+    data_ = detail::PeRead<IMAGE_BOUND_IMPORT_DESCRIPTOR>(
+      *process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
@@ -17,6 +17,7 @@
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/detail/string_view.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/pelib/export_dir.hpp>
 #include <hadesmem/pelib/nt_headers.hpp>
@@ -43,7 +44,8 @@ public:
                   WORD procedure_number)
     : process_{&process},
       pe_file_{&pe_file},
-      procedure_number_{procedure_number}
+      procedure_number_{procedure_number},
+      local_{pe_file.IsLocal()}
   {
     ExportDir const export_dir{process, pe_file};
 
@@ -66,18 +68,19 @@ public:
       if (ptr_ordinals && ptr_names)
       {
         std::vector<WORD> const name_ordinals =
-          ReadVector<WORD>(process, ptr_ordinals, num_names);
+          detail::PeReadVector<WORD>(process, pe_file, ptr_ordinals, num_names);
         auto const name_ord_iter = std::find(
           std::begin(name_ordinals), std::end(name_ordinals), ordinal_number_);
         if (name_ord_iter != std::end(name_ordinals))
         {
           by_name_ = true;
-          DWORD const name_rva =
-            Read<DWORD>(process,
-                        ptr_names + std::distance(std::begin(name_ordinals),
-                                                  name_ord_iter));
-          name_ = detail::CheckedReadString<char>(
-            process, pe_file, RvaToVa(process, pe_file, name_rva));
+          DWORD const name_rva = detail::PeRead<DWORD>(
+            process,
+            pe_file,
+            ptr_names +
+              std::distance(std::begin(name_ordinals), name_ord_iter));
+          name_view_ = detail::CheckedReadStringView<char>(
+            process, pe_file, RvaToVa(process, pe_file, name_rva), name_);
         }
       }
     }
@@ -90,7 +93,7 @@ public:
         Error{} << ErrorString{"AddressOfFunctions invalid."});
     }
     rva_ptr_ = reinterpret_cast<DWORD*>(ptr_functions + ordinal_number_);
-    DWORD const func_rva = Read<DWORD>(process, rva_ptr_);
+    DWORD const func_rva = detail::PeRead<DWORD>(process, pe_file, rva_ptr_);
 
     NtHeaders const nt_headers{process, pe_file};
 
@@ -104,16 +107,11 @@ public:
     if (func_rva >= export_dir_start && func_rva + 4 < export_dir_end)
     {
       forwarded_ = true;
-      forwarder_ = detail::CheckedReadString<char>(
-        process, pe_file, RvaToVa(process, pe_file, func_rva));
+      forwarder_view_ = detail::CheckedReadStringView<char>(
+        process, pe_file, RvaToVa(process, pe_file, func_rva), forwarder_);
 
-      std::string::size_type const split_pos = forwarder_.rfind('.');
-      if (split_pos != std::string::npos)
-      {
-        forwarder_split_ = std::make_pair(forwarder_.substr(0, split_pos),
-                                          forwarder_.substr(split_pos + 1));
-      }
-      else
+      forwarder_split_ = forwarder_view_.rfind('.');
+      if (forwarder_split_ == detail::StringView::npos)
       {
         HADESMEM_DETAIL_THROW_EXCEPTION(
           Error{} << ErrorString{"Invalid forwarder string format."});
@@ -155,7 +153,14 @@ public:
 
   std::string GetName() const
   {
-    return name_;
+    return GetNameView().to_string();
+  }
+
+  // Refers directly to the name in the file when it's a local buffer, so the
+  // result is only valid for as long as both the PeFile and the Export are.
+  detail::StringView GetNameView() const noexcept
+  {
+    return local_ ? name_view_ : detail::StringView{name_};
   }
 
   WORD GetProcedureNumber() const noexcept
@@ -185,22 +190,39 @@ public:
 
   std::string GetForwarder() const
   {
-    return forwarder_;
+    return GetForwarderView().to_string();
   }
 
   std::string GetForwarderModule() const
   {
-    return forwarder_split_.first;
+    return GetForwarderModuleView().to_string();
   }
 
   std::string GetForwarderFunction() const
   {
-    return forwarder_split_.second;
+    return GetForwarderFunctionView().to_string();
+  }
+
+  // Same lifetime rules as GetNameView.
+  detail::StringView GetForwarderView() const noexcept
+  {
+    return local_ ? forwarder_view_ : detail::StringView{forwarder_};
+  }
+
+  detail::StringView GetForwarderModuleView() const noexcept
+  {
+    return GetForwarderView().substr(0, forwarder_split_);
+  }
+
+  detail::StringView GetForwarderFunctionView() const noexcept
+  {
+    return GetForwarderView().substr(forwarder_split_ + 1);
   }
 
-  bool IsForwardedByOrdinal() const
+  bool IsForwardedByOrdinal() const noexcept
   {
-    return (GetForwarderFunction()[0] == '#');
+    detail::StringView const forwarder_function{GetForwarderFunctionView()};
+    return !forwarder_function.empty() && forwarder_function[0] == '#';
   }
 
   WORD GetForwarderOrdinal() const
@@ -213,8 +235,8 @@ public:
 
     try
     {
-      std::string const forwarder_function{GetForwarderFunction()};
-      return detail::StrToNum<WORD>(forwarder_function.substr(1));
+      return detail::StrToNum<WORD>(
+        GetForwarderFunctionView().substr(1).to_string());
     }
     catch (std::exception const& /*e*/)
     {
@@ -236,14 +258,20 @@ private:
   DWORD rva_{};
   DWORD* rva_ptr_{};
   void* va_{};
+  // Strings in local buffers are referred to rather than copied. Otherwise
+  // they're stored here, and views of them are created on demand so that
+  // copies of the Export don't refer to the original's storage.
   std::string name_;
   std::string forwarder_;
-  std::pair<std::string, std::string> forwarder_split_;
+  detail::StringView name_view_;
+  detail::StringView forwarder_view_;
+  std::size_t forwarder_split_{};
   WORD procedure_number_{};
   WORD ordinal_number_{};
   bool by_name_{};
   bool forwarded_{};
   bool virtual_va_{};
+  bool local_{};
 };
 
 inline bool operator==(Export const& lhs, Export const& rhs) noexcept
@@ -67,7 +67,8 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_EXPORT_DIRECTORY>(*process_, base_);
+    data_ =
+      detail::PeRead<IMAGE_EXPORT_DIRECTORY>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
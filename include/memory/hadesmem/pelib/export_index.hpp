@@ -0,0 +1,318 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+#include <winnt.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/export_dir.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+
+// TODO: Support data exports (see export.hpp).
+
+// TODO: Expose a way to get an Export directly from the index, so ExportList
+// can be built on top of it rather than re-reading the tables per export.
+
+namespace hadesmem
+{
+// Read-only snapshot of a module's export tables, built with a single read of
+// each of AddressOfFunctions/AddressOfNames/AddressOfNameOrdinals (or a single
+// read of the entire export directory when the tables and names live inside
+// it, which is the normal case). Lookup by name is a binary search of the name
+// table, which is how the loader does it. The index holds no reference to the
+// Process or PeFile it was built from, so it may outlive both.
+class ExportIndex
+{
+public:
+  explicit ExportIndex(Process const& process, PeFile const& pe_file)
+    : base_{pe_file.GetBase()}
+  {
+    NtHeaders const nt_headers{process, pe_file};
+    time_date_stamp_ = nt_headers.GetTimeDateStamp();
+
+    ExportDir const export_dir{process, pe_file};
+    ordinal_base_ = export_dir.GetOrdinalBase();
+
+    export_dir_start_ =
+      nt_headers.GetDataDirectoryVirtualAddress(PeDataDir::Export);
+    export_dir_end_ =
+      export_dir_start_ + nt_headers.GetDataDirectorySize(PeDataDir::Export);
+
+    ReadExportDirData(process, pe_file);
+
+    // Ordinals are WORDs, so anything beyond this is unreachable (and most
+    // likely a malformed file trying to make us allocate huge amounts of
+    // memory).
+    DWORD const kMaxEntries = 0x10000;
+    DWORD const num_funcs =
+      (std::min)(export_dir.GetNumberOfFunctions(), kMaxEntries);
+    DWORD const num_names =
+      (std::min)(export_dir.GetNumberOfNames(), kMaxEntries);
+
+    functions_ = ReadTable<DWORD>(
+      process, pe_file, export_dir.GetAddressOfFunctions(), num_funcs);
+
+    if (num_names)
+    {
+      auto const name_rvas = ReadTable<DWORD>(
+        process, pe_file, export_dir.GetAddressOfNames(), num_names);
+      auto const name_ordinals = ReadTable<WORD>(
+        process, pe_file, export_dir.GetAddressOfNameOrdinals(), num_names);
+      names_.reserve(num_names);
+      for (DWORD i = 0; i < num_names; ++i)
+      {
+        names_.emplace_back(ReadName(process, pe_file, name_rvas[i]),
+                            name_ordinals[i]);
+      }
+
+      // The loader assumes the table is sorted, but we don't want to silently
+      // fail to find names in a file which isn't.
+      auto const name_less = [](NameEntry const& lhs, NameEntry const& rhs) {
+        return lhs.first < rhs.first;
+      };
+      if (!std::is_sorted(std::begin(names_), std::end(names_), name_less))
+      {
+        std::stable_sort(std::begin(names_), std::end(names_), name_less);
+      }
+    }
+
+    for (DWORD i = 0; i < num_funcs; ++i)
+    {
+      // Same check as Export. If the RVA lies inside the export dir region
+      // then it's a forwarded export.
+      DWORD const func_rva = functions_[i];
+      if (func_rva >= export_dir_start_ && func_rva + 4 < export_dir_end_)
+      {
+        forwarders_[static_cast<WORD>(i)] =
+          ReadName(process, pe_file, func_rva);
+      }
+    }
+
+    // Only needed during construction.
+    export_dir_data_.clear();
+    export_dir_data_.shrink_to_fit();
+  }
+
+  explicit ExportIndex(Process const&& process, PeFile const& pe_file) = delete;
+
+  explicit ExportIndex(Process const& process, PeFile&& pe_file) = delete;
+
+  explicit ExportIndex(Process const&& process, PeFile&& pe_file) = delete;
+
+  PVOID GetBase() const noexcept
+  {
+    return base_;
+  }
+
+  DWORD GetTimeDateStamp() const noexcept
+  {
+    return time_date_stamp_;
+  }
+
+  DWORD GetOrdinalBase() const noexcept
+  {
+    return ordinal_base_;
+  }
+
+  DWORD GetNumberOfFunctions() const noexcept
+  {
+    return static_cast<DWORD>(functions_.size());
+  }
+
+  DWORD GetNumberOfNames() const noexcept
+  {
+    return static_cast<DWORD>(names_.size());
+  }
+
+  // Converts a name to an (unbiased) ordinal number, i.e. an index into
+  // AddressOfFunctions.
+  bool FindOrdinalNumber(std::string const& name, WORD* ordinal_number) const
+  {
+    HADESMEM_DETAIL_ASSERT(ordinal_number != nullptr);
+
+    auto const iter =
+      std::lower_bound(std::begin(names_),
+                       std::end(names_),
+                       name,
+                       [](NameEntry const& lhs, std::string const& rhs) {
+                         return lhs.first < rhs;
+                       });
+    if (iter == std::end(names_) || iter->first != name)
+    {
+      return false;
+    }
+
+    *ordinal_number = iter->second;
+    return IsOrdinalNumberValid(*ordinal_number);
+  }
+
+  // Converts a (biased) procedure number to an ordinal number.
+  bool FindOrdinalNumber(WORD procedure_number, WORD* ordinal_number) const
+  {
+    HADESMEM_DETAIL_ASSERT(ordinal_number != nullptr);
+
+    if (procedure_number < ordinal_base_)
+    {
+      return false;
+    }
+
+    *ordinal_number = static_cast<WORD>(procedure_number - ordinal_base_);
+    return IsOrdinalNumberValid(*ordinal_number);
+  }
+
+  DWORD GetFunctionRva(WORD ordinal_number) const
+  {
+    if (!IsOrdinalNumberValid(ordinal_number))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Ordinal out of range."});
+    }
+
+    return functions_[ordinal_number];
+  }
+
+  bool IsForwarded(WORD ordinal_number) const
+  {
+    return forwarders_.find(ordinal_number) != std::end(forwarders_);
+  }
+
+  std::string GetForwarder(WORD ordinal_number) const
+  {
+    auto const iter = forwarders_.find(ordinal_number);
+    if (iter == std::end(forwarders_))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Function is not forwarded."});
+    }
+
+    return iter->second;
+  }
+
+private:
+  using NameEntry = std::pair<std::string, WORD>;
+
+  bool IsOrdinalNumberValid(WORD ordinal_number) const noexcept
+  {
+    return ordinal_number < functions_.size();
+  }
+
+  void ReadExportDirData(Process const& process, PeFile const& pe_file)
+  {
+    // The size is not validated by the loader, so treat anything odd as a
+    // reason to fall back to reading each table separately.
+    DWORD const kMaxExportDirSize = 0x1000000;
+    DWORD const size = export_dir_end_ - export_dir_start_;
+    if (export_dir_end_ <= export_dir_start_ || size > kMaxExportDirSize)
+    {
+      return;
+    }
+
+    auto const beg =
+      static_cast<std::uint8_t*>(RvaToVa(process, pe_file, export_dir_start_));
+    auto const last = static_cast<std::uint8_t*>(
+      RvaToVa(process, pe_file, export_dir_end_ - 1));
+    // Must be contiguous (i.e. not split across sections in a data file).
+    if (!beg || last != beg + size - 1)
+    {
+      return;
+    }
+
+    try
+    {
+      export_dir_data_ =
+        detail::PeReadVector<std::uint8_t>(process, pe_file, beg, size);
+    }
+    catch (std::exception const& /*e*/)
+    {
+      export_dir_data_.clear();
+    }
+  }
+
+  bool InExportDirData(DWORD rva, DWORD len) const noexcept
+  {
+    return !export_dir_data_.empty() && rva >= export_dir_start_ &&
+           rva - export_dir_start_ <= export_dir_data_.size() &&
+           len <= export_dir_data_.size() - (rva - export_dir_start_);
+  }
+
+  template <typename T>
+  std::vector<T> ReadTable(Process const& process,
+                           PeFile const& pe_file,
+                           DWORD rva,
+                           DWORD count) const
+  {
+    if (!count)
+    {
+      return {};
+    }
+
+    if (InExportDirData(rva, count * static_cast<DWORD>(sizeof(T))))
+    {
+      std::vector<T> table(count);
+      std::memcpy(table.data(),
+                  export_dir_data_.data() + (rva - export_dir_start_),
+                  count * sizeof(T));
+      return table;
+    }
+
+    void* const va = RvaToVa(process, pe_file, rva);
+    if (!va)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Export table RVA invalid."});
+    }
+
+    return detail::PeReadVector<T>(process, pe_file, va, count);
+  }
+
+  std::string
+    ReadName(Process const& process, PeFile const& pe_file, DWORD rva) const
+  {
+    if (InExportDirData(rva, 1))
+    {
+      auto const beg = export_dir_data_.data() + (rva - export_dir_start_);
+      auto const end = export_dir_data_.data() + export_dir_data_.size();
+      auto const term = std::find(beg, end, std::uint8_t{});
+      if (term != end)
+      {
+        return std::string(beg, term);
+      }
+    }
+
+    void* const va = RvaToVa(process, pe_file, rva);
+    if (!va)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Export name invalid."});
+    }
+
+    return detail::CheckedReadString<char>(process, pe_file, va);
+  }
+
+  PVOID base_{};
+  DWORD time_date_stamp_{};
+  DWORD ordinal_base_{};
+  DWORD export_dir_start_{};
+  DWORD export_dir_end_{};
+  std::vector<std::uint8_t> export_dir_data_;
+  std::vector<DWORD> functions_;
+  std::vector<NameEntry> names_;
+  std::map<WORD, std::string> forwarders_;
+};
+}
@@ -15,6 +15,7 @@
 #include <winnt.h>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/string_view.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/pelib/nt_headers.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
@@ -83,7 +84,8 @@ public:
           auto const offset = sizeof(DWORD) * (i + 1);
           auto const len = sizeof(IMAGE_IMPORT_DESCRIPTOR) - offset;
           auto const buf =
-            ReadVector<std::uint8_t>(*process_, desc_raw_beg, len);
+            detail::PeReadVector<std::uint8_t>(
+              *process_, *pe_file_, desc_raw_beg, len);
           auto const data_beg =
             reinterpret_cast<std::uint8_t*>(&data_) + offset;
           ::ZeroMemory(&data_, sizeof(data_));
@@ -123,7 +125,8 @@ public:
   // we're reading garbage.
   void UpdateRead()
   {
-    data_ = Read<IMAGE_IMPORT_DESCRIPTOR>(*process_, base_);
+    data_ =
+      detail::PeRead<IMAGE_IMPORT_DESCRIPTOR>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
@@ -199,26 +202,16 @@ public:
 
   std::string GetName() const
   {
-    DWORD const name_rva = GetNameRaw();
-    if (!name_rva)
-    {
-      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                      << ErrorString{"Name RVA is invalid."});
-    }
-
-    auto name_va =
-      static_cast<std::uint8_t*>(RvaToVa(*process_, *pe_file_, name_rva));
-    // It's possible for the RVA to be invalid on disk because it's fixed by
-    // relocations.
-    // Sample: imports_relocW7.exe
-    // TODO: Handle this.
-    if (!name_va)
-    {
-      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                      << ErrorString{"Name VA is invalid."});
-    }
+    return detail::CheckedReadString<char>(*process_, *pe_file_, GetNameVa());
+  }
 
-    return detail::CheckedReadString<char>(*process_, *pe_file_, name_va);
+  // Refers directly to the name in the file when it's a local buffer, and
+  // otherwise reads it into storage (which can be reused between calls). See
+  // detail::CheckedReadStringView.
+  detail::StringView GetNameView(std::string& storage) const
+  {
+    return detail::CheckedReadStringView<char>(
+      *process_, *pe_file_, GetNameVa(), storage);
   }
 
   DWORD GetFirstThunk() const
@@ -250,8 +243,8 @@ public:
   // the existing one.
   void SetName(std::string const& name)
   {
-    DWORD name_rva =
-      Read<DWORD>(*process_, base_ + offsetof(IMAGE_IMPORT_DESCRIPTOR, Name));
+    DWORD name_rva = detail::PeRead<DWORD>(
+      *process_, *pe_file_, base_ + offsetof(IMAGE_IMPORT_DESCRIPTOR, Name));
     if (!name_rva)
     {
       HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
@@ -282,6 +275,30 @@ public:
   }
 
 private:
+  std::uint8_t* GetNameVa() const
+  {
+    DWORD const name_rva = GetNameRaw();
+    if (!name_rva)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Name RVA is invalid."});
+    }
+
+    auto name_va =
+      static_cast<std::uint8_t*>(RvaToVa(*process_, *pe_file_, name_rva));
+    // It's possible for the RVA to be invalid on disk because it's fixed by
+    // relocations.
+    // Sample: imports_relocW7.exe
+    // TODO: Handle this.
+    if (!name_va)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Name VA is invalid."});
+    }
+
+    return name_va;
+  }
+
   Process const* process_;
   PeFile const* pe_file_;
   PBYTE base_;
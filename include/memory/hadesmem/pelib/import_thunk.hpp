@@ -14,6 +14,7 @@
 #include <winnt.h>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/string_view.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/pelib/import_dir.hpp>
 #include <hadesmem/pelib/nt_headers.hpp>
@@ -58,11 +59,13 @@ public:
   {
     if (pe_file_->Is64())
     {
-      data_64_ = Read<IMAGE_THUNK_DATA64>(*process_, base_);
+      data_64_ =
+        detail::PeRead<IMAGE_THUNK_DATA64>(*process_, *pe_file_, base_);
     }
     else
     {
-      data_32_ = Read<IMAGE_THUNK_DATA32>(*process_, base_);
+      data_32_ =
+        detail::PeRead<IMAGE_THUNK_DATA32>(*process_, *pe_file_, base_);
     }
   }
 
@@ -154,28 +157,30 @@ public:
 
   WORD GetHint() const
   {
-    auto const name_import = static_cast<std::uint8_t*>(
-      RvaToVa(*process_, *pe_file_, static_cast<DWORD>(GetAddressOfData())));
-    if (!name_import)
-    {
-      HADESMEM_DETAIL_THROW_EXCEPTION(
-        Error{} << ErrorString{"Invalid import name and hint."});
-    }
-    return Read<WORD>(*process_,
-                      name_import + offsetof(IMAGE_IMPORT_BY_NAME, Hint));
+    return detail::PeRead<WORD>(*process_,
+                                *pe_file_,
+                                GetNameImport() +
+                                  offsetof(IMAGE_IMPORT_BY_NAME, Hint));
   }
 
   std::string GetName() const
   {
-    auto const name_import = static_cast<std::uint8_t*>(
-      RvaToVa(*process_, *pe_file_, static_cast<DWORD>(GetAddressOfData())));
-    if (!name_import)
-    {
-      HADESMEM_DETAIL_THROW_EXCEPTION(
-        Error{} << ErrorString{"Invalid import name and hint."});
-    }
     return detail::CheckedReadString<char>(
-      *process_, *pe_file_, name_import + offsetof(IMAGE_IMPORT_BY_NAME, Name));
+      *process_,
+      *pe_file_,
+      GetNameImport() + offsetof(IMAGE_IMPORT_BY_NAME, Name));
+  }
+
+  // Refers directly to the name in the file when it's a local buffer, and
+  // otherwise reads it into storage (which can be reused between calls). See
+  // detail::CheckedReadStringView.
+  detail::StringView GetNameView(std::string& storage) const
+  {
+    return detail::CheckedReadStringView<char>(
+      *process_,
+      *pe_file_,
+      GetNameImport() + offsetof(IMAGE_IMPORT_BY_NAME, Name),
+      storage);
   }
 
   void SetAddressOfData(ULONGLONG address_of_data)
@@ -227,6 +232,19 @@ public:
   }
 
 private:
+  std::uint8_t* GetNameImport() const
+  {
+    auto const name_import = static_cast<std::uint8_t*>(
+      RvaToVa(*process_, *pe_file_, static_cast<DWORD>(GetAddressOfData())));
+    if (!name_import)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid import name and hint."});
+    }
+
+    return name_import;
+  }
+
   Process const* process_;
   PeFile const* pe_file_;
   PBYTE base_;
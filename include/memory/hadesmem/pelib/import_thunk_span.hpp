@@ -0,0 +1,289 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+#include <winnt.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/string_view.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+namespace hadesmem
+{
+// Snapshot of a single thunk. Same accessors as ImportThunk, minus the ones
+// which need to read more data (see ImportThunkSpan).
+class ImportThunkEntry
+{
+public:
+  explicit ImportThunkEntry(void* base, ULONGLONG data, bool is_64) noexcept
+    : base_{static_cast<std::uint8_t*>(base)}, data_{data}, is_64_{is_64}
+  {
+  }
+
+  void* GetBase() const noexcept
+  {
+    return base_;
+  }
+
+  ULONGLONG GetAddressOfData() const noexcept
+  {
+    return data_;
+  }
+
+  ULONGLONG GetOrdinalRaw() const noexcept
+  {
+    return data_;
+  }
+
+  bool ByOrdinal() const noexcept
+  {
+    return is_64_ ? IMAGE_SNAP_BY_ORDINAL64(data_)
+                  : IMAGE_SNAP_BY_ORDINAL32(static_cast<DWORD>(data_));
+  }
+
+  WORD GetOrdinal() const noexcept
+  {
+    return static_cast<WORD>(is_64_
+                               ? IMAGE_ORDINAL64(data_)
+                               : IMAGE_ORDINAL32(static_cast<DWORD>(data_)));
+  }
+
+  ULONGLONG GetFunction() const noexcept
+  {
+    return data_;
+  }
+
+  ULONGLONG* GetFunctionPtr() const noexcept
+  {
+    // Function is at the start of the thunk for both 32-bit and 64-bit.
+    return reinterpret_cast<ULONGLONG*>(base_);
+  }
+
+private:
+  std::uint8_t* base_;
+  ULONGLONG data_;
+  bool is_64_;
+};
+
+// Alternative to ImportThunkList for hot paths. The whole thunk table is read
+// up front in a handful of bulk reads rather than one read per thunk, and
+// iteration is over a plain vector (so random access, and no allocations per
+// element). Termination is the same as ImportThunkList, i.e. the first null
+// thunk or the first thunk which can't be read.
+// Entries are a snapshot, so writes through ImportThunk (or by the loader)
+// aren't reflected.
+class ImportThunkSpan
+{
+public:
+  using value_type = ImportThunkEntry;
+  using iterator = std::vector<ImportThunkEntry>::const_iterator;
+  using const_iterator = std::vector<ImportThunkEntry>::const_iterator;
+  using size_type = std::vector<ImportThunkEntry>::size_type;
+
+  // Enumeration stops after max_count thunks, for callers which are going to
+  // stop early anyway (e.g. on malformed files with no terminator).
+  explicit ImportThunkSpan(
+    Process const& process,
+    PeFile const& pe_file,
+    DWORD first_thunk,
+    std::size_t max_count = (std::numeric_limits<std::size_t>::max)())
+    : process_{&process}, pe_file_{&pe_file}
+  {
+    try
+    {
+      auto const thunk_ptr =
+        static_cast<std::uint8_t*>(RvaToVa(process, pe_file, first_thunk));
+      if (!thunk_ptr)
+      {
+        return;
+      }
+
+      if (pe_file.Is64())
+      {
+        ReadThunks<IMAGE_THUNK_DATA64>(thunk_ptr, max_count);
+      }
+      else
+      {
+        ReadThunks<IMAGE_THUNK_DATA32>(thunk_ptr, max_count);
+      }
+    }
+    catch (std::exception const& /*e*/)
+    {
+      // Nothing to do here.
+    }
+  }
+
+  explicit ImportThunkSpan(Process const&& process,
+                           PeFile const& pe_file,
+                           DWORD first_thunk,
+                           std::size_t max_count = 0) = delete;
+
+  explicit ImportThunkSpan(Process const& process,
+                           PeFile&& pe_file,
+                           DWORD first_thunk,
+                           std::size_t max_count = 0) = delete;
+
+  explicit ImportThunkSpan(Process const&& process,
+                           PeFile&& pe_file,
+                           DWORD first_thunk,
+                           std::size_t max_count = 0) = delete;
+
+  const_iterator begin() const noexcept
+  {
+    return thunks_.cbegin();
+  }
+
+  const_iterator cbegin() const noexcept
+  {
+    return thunks_.cbegin();
+  }
+
+  const_iterator end() const noexcept
+  {
+    return thunks_.cend();
+  }
+
+  const_iterator cend() const noexcept
+  {
+    return thunks_.cend();
+  }
+
+  size_type size() const noexcept
+  {
+    return thunks_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return thunks_.empty();
+  }
+
+  ImportThunkEntry const& operator[](size_type n) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(n < thunks_.size());
+    return thunks_[n];
+  }
+
+  // Same as ImportThunk::GetHint.
+  WORD GetHint(ImportThunkEntry const& thunk) const
+  {
+    return detail::PeRead<WORD>(*process_,
+                                *pe_file_,
+                                GetNameImport(thunk) +
+                                  offsetof(IMAGE_IMPORT_BY_NAME, Hint));
+  }
+
+  // Same as ImportThunk::GetName.
+  std::string GetName(ImportThunkEntry const& thunk) const
+  {
+    return detail::CheckedReadString<char>(
+      *process_,
+      *pe_file_,
+      GetNameImport(thunk) + offsetof(IMAGE_IMPORT_BY_NAME, Name));
+  }
+
+  // Same as ImportThunk::GetNameView.
+  detail::StringView GetNameView(ImportThunkEntry const& thunk,
+                                 std::string& storage) const
+  {
+    return detail::CheckedReadStringView<char>(
+      *process_,
+      *pe_file_,
+      GetNameImport(thunk) + offsetof(IMAGE_IMPORT_BY_NAME, Name),
+      storage);
+  }
+
+private:
+  template <typename ThunkT>
+  void ReadThunks(std::uint8_t* thunk_ptr, std::size_t max_count)
+  {
+    // Start small, as most tables are short, and grow from there.
+    std::size_t const kMinBatch = 16;
+    std::size_t const kMaxBatch = 0x1000;
+    std::size_t batch = kMinBatch;
+
+    auto const file_end = reinterpret_cast<std::uintptr_t>(
+      static_cast<std::uint8_t*>(pe_file_->GetBase()) + pe_file_->GetSize());
+    for (auto cur = reinterpret_cast<std::uintptr_t>(thunk_ptr);
+         thunks_.size() < max_count;)
+    {
+      // No point reading past the end of the file (or image) when we know the
+      // table must end before it.
+      std::size_t count = (std::min)(batch, max_count - thunks_.size());
+      if (cur < file_end && (file_end - cur) / sizeof(ThunkT))
+      {
+        count = (std::min)(count, (file_end - cur) / sizeof(ThunkT));
+      }
+
+      std::vector<ThunkT> thunks;
+      try
+      {
+        thunks = detail::PeReadVector<ThunkT>(
+          *process_, *pe_file_, reinterpret_cast<void*>(cur), count);
+      }
+      catch (std::exception const& /*e*/)
+      {
+        // Part of the batch can't be read, but that may well be past the end
+        // of the table. Go one at a time until we find out.
+        if (count == 1)
+        {
+          return;
+        }
+
+        batch = 1;
+        continue;
+      }
+
+      for (auto const& thunk : thunks)
+      {
+        if (!thunk.u1.AddressOfData)
+        {
+          return;
+        }
+
+        thunks_.emplace_back(
+          reinterpret_cast<void*>(cur), thunk.u1.AddressOfData, Is64<ThunkT>());
+        cur += sizeof(ThunkT);
+      }
+
+      batch = (std::min)(batch * 2, kMaxBatch);
+    }
+  }
+
+  template <typename ThunkT> static constexpr bool Is64() noexcept
+  {
+    return sizeof(ThunkT) == sizeof(IMAGE_THUNK_DATA64);
+  }
+
+  std::uint8_t* GetNameImport(ImportThunkEntry const& thunk) const
+  {
+    auto const name_import = static_cast<std::uint8_t*>(RvaToVa(
+      *process_, *pe_file_, static_cast<DWORD>(thunk.GetAddressOfData())));
+    if (!name_import)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid import name and hint."});
+    }
+
+    return name_import;
+  }
+
+  Process const* process_;
+  PeFile const* pe_file_;
+  std::vector<ImportThunkEntry> thunks_;
+};
+}
@@ -74,11 +74,13 @@ public:
   {
     if (pe_file_->Is64())
     {
-      data_64_ = Read<IMAGE_NT_HEADERS64>(*process_, base_);
+      data_64_ =
+        detail::PeRead<IMAGE_NT_HEADERS64>(*process_, *pe_file_, base_);
     }
     else
     {
-      data_32_ = Read<IMAGE_NT_HEADERS32>(*process_, base_);
+      data_32_ =
+        detail::PeRead<IMAGE_NT_HEADERS32>(*process_, *pe_file_, base_);
     }
   }
 
@@ -92,6 +94,8 @@ public:
     {
       Write(*process_, base_, data_32_);
     }
+
+    pe_file_->RefreshLayout();
   }
 
   bool IsValid() const
@@ -111,7 +111,8 @@ public:
 
   void UpdateRead()
   {
-    data_ = ReadVector<std::uint8_t>(*process_, base_, size_);
+    data_ = detail::PeReadVector<std::uint8_t>(
+      *process_, *pe_file_, base_, size_);
   }
 
   void UpdateWrite()
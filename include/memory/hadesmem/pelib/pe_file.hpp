@@ -3,21 +3,28 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <iosfwd>
+#include <limits>
 #include <memory>
 #include <ostream>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <windows.h>
 #include <winnt.h>
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/memory_span.hpp>
 #include <hadesmem/detail/region_alloc_size.hpp>
+#include <hadesmem/detail/string_view.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/module.hpp>
+#include <hadesmem/module_index.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/region.hpp>
 #include <hadesmem/region_list.hpp>
@@ -40,11 +47,12 @@
 // pretty sure it's different in some cases... Add warning in Dump for this and
 // run a full scan.
 
-// TODO: Decouple PeLib from Process so we can operate directly on
-// files/memory/etc. Need some sort of abstraction to replace Process (and the
-// accompanying calls to Read/Write/etc.). Dependency on hadesmem APIs in
-// general should be removed, as ideally we could make the PeFile code
-// OS-independent as all we're doing is parsing files.
+// TODO: Finish decoupling PeLib from Process so we can operate directly on
+// files/memory/etc. Reads now go through detail::PeRead/PeReadVector (which
+// use a plain bounds-checked MemorySpan for local buffers), but writes still
+// go through Process, and dependency on hadesmem APIs in general should be
+// removed, as ideally we could make the PeFile code OS-independent as all
+// we're doing is parsing files.
 
 // TODO: Move to an attribute based system for warning on malformed or
 // suspicious files. Also important for testing, so we can ensure certain
@@ -109,13 +117,182 @@ enum class PeFileType
   kData
 };
 
+struct PeFileFlags
+{
+  enum : std::uint32_t
+  {
+    kNone,
+    // The file lives in a buffer in our own address space which is readable
+    // in its entirety (e.g. a file read into a std::vector). All reads are
+    // then done as bounds-checked loads rather than going through
+    // VirtualQueryEx/ReadProcessMemory/etc.
+    kLocalBuffer
+  };
+};
+
+namespace detail
+{
+// Extents of a section header, as used by RvaToVa and FileOffsetToRva. Ends
+// are computed with the same (wrapping) DWORD arithmetic the loader uses, so
+// an extent which wraps is empty.
+struct PeSectionExtent
+{
+  DWORD virtual_beg;
+  DWORD virtual_end;
+  DWORD virtual_size;
+  DWORD raw_beg;
+  DWORD raw_end;
+  DWORD raw_size;
+};
+
+// Everything RvaToVa and FileOffsetToRva need from the headers of a data file,
+// parsed once when the PeFile is created rather than on every call.
+struct PeLayout
+{
+  // Returns the first section (in section table order) whose virtual extent
+  // contains the RVA.
+  PeSectionExtent const* FindByRva(DWORD rva) const noexcept
+  {
+    return Find(rva,
+                by_virtual,
+                virtual_overlap,
+                &PeSectionExtent::virtual_beg,
+                &PeSectionExtent::virtual_end);
+  }
+
+  // Returns the first section (in section table order) whose raw extent
+  // contains the file offset.
+  PeSectionExtent const* FindByFileOffset(DWORD file_offset) const noexcept
+  {
+    return Find(file_offset,
+                by_raw,
+                raw_overlap,
+                &PeSectionExtent::raw_beg,
+                &PeSectionExtent::raw_end);
+  }
+
+  // Sorts the non-empty extents for binary search, and checks whether they
+  // overlap (in which case 'first in table order' can't be found by a binary
+  // search, so we fall back to a linear one).
+  void Index()
+  {
+    BuildIndex(&PeSectionExtent::virtual_beg,
+               &PeSectionExtent::virtual_end,
+               &by_virtual,
+               &virtual_overlap);
+    BuildIndex(&PeSectionExtent::raw_beg,
+               &PeSectionExtent::raw_end,
+               &by_raw,
+               &raw_overlap);
+
+    min_virtual_beg = (std::numeric_limits<DWORD>::max)();
+    for (auto const& section : sections)
+    {
+      min_virtual_beg = (std::min)(min_virtual_beg, section.virtual_beg);
+    }
+  }
+
+  DWORD size_of_headers;
+  DWORD file_alignment;
+  DWORD size_of_image;
+  WORD num_sections;
+  // The entire section table is outside the file.
+  bool virtual_section_table;
+  // The sections which could be read, in table order. If there are fewer than
+  // num_sections then either the next header is outside the file
+  // (virtual_section_cut), or it couldn't be read.
+  std::vector<PeSectionExtent> sections;
+  bool virtual_section_cut;
+  DWORD min_virtual_beg;
+  std::vector<std::size_t> by_virtual;
+  bool virtual_overlap;
+  std::vector<std::size_t> by_raw;
+  bool raw_overlap;
+
+private:
+  using ExtentMember = DWORD PeSectionExtent::*;
+
+  static bool IsEmpty(PeSectionExtent const& section,
+                      ExtentMember beg,
+                      ExtentMember end) noexcept
+  {
+    return section.*end <= section.*beg;
+  }
+
+  void BuildIndex(ExtentMember beg,
+                  ExtentMember end,
+                  std::vector<std::size_t>* index,
+                  bool* overlap)
+  {
+    index->clear();
+    for (std::size_t i = 0; i < sections.size(); ++i)
+    {
+      if (!IsEmpty(sections[i], beg, end))
+      {
+        index->push_back(i);
+      }
+    }
+
+    std::stable_sort(std::begin(*index),
+                     std::end(*index),
+                     [&](std::size_t lhs, std::size_t rhs) {
+                       return sections[lhs].*beg < sections[rhs].*beg;
+                     });
+
+    *overlap = false;
+    for (std::size_t i = 1; i < index->size(); ++i)
+    {
+      if (sections[(*index)[i]].*beg < sections[(*index)[i - 1]].*end)
+      {
+        *overlap = true;
+        break;
+      }
+    }
+  }
+
+  PeSectionExtent const* Find(DWORD value,
+                              std::vector<std::size_t> const& index,
+                              bool overlap,
+                              ExtentMember beg,
+                              ExtentMember end) const noexcept
+  {
+    if (overlap)
+    {
+      for (auto const& section : sections)
+      {
+        if (section.*beg <= value && value < section.*end)
+        {
+          return &section;
+        }
+      }
+
+      return nullptr;
+    }
+
+    auto const iter = std::upper_bound(
+      std::begin(index),
+      std::end(index),
+      value,
+      [&](DWORD lhs, std::size_t rhs) { return lhs < sections[rhs].*beg; });
+    if (iter == std::begin(index))
+    {
+      return nullptr;
+    }
+
+    PeSectionExtent const& section = sections[*std::prev(iter)];
+    return value < section.*end ? &section : nullptr;
+  }
+};
+}
+
 class PeFile
 {
 public:
   explicit PeFile(Process const& process,
                   void* address,
                   PeFileType type,
-                  DWORD size)
+                  DWORD size,
+                  std::uint32_t flags = PeFileFlags::kNone)
     : process_{&process},
       base_{static_cast<std::uint8_t*>(address)},
       type_{type},
@@ -132,8 +309,7 @@ public:
     {
       try
       {
-        Module const module{process, reinterpret_cast<HMODULE>(address)};
-        size_ = module.GetSize();
+        size_ = GetLoadedModuleSize(process, address);
       }
       catch (...)
       {
@@ -145,6 +321,17 @@ public:
       }
     }
 
+    if (!!(flags & PeFileFlags::kLocalBuffer))
+    {
+      if (process.GetId() != ::GetCurrentProcessId() || !size_)
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Invalid local buffer."});
+      }
+
+      local_span_ = detail::MemorySpan{base_, size_};
+    }
+
     // Not erroring out anywhere here in order to retain back-compat.
     // TODO: Do this properly as part of the rewrite.
     try
@@ -152,13 +339,18 @@ public:
       if (size_ > sizeof(IMAGE_DOS_HEADER))
       {
         auto const nt_hdrs_ofs =
-          Read<IMAGE_DOS_HEADER>(process, address).e_lfanew;
+          ReadHeader<IMAGE_DOS_HEADER>(address).e_lfanew;
         if (size_ >= nt_hdrs_ofs + sizeof(DWORD) + sizeof(IMAGE_FILE_HEADER))
         {
-          auto const nt_hdrs = Read<IMAGE_NT_HEADERS>(
-            process, static_cast<std::uint8_t*>(address) + nt_hdrs_ofs);
-          if (nt_hdrs.Signature == IMAGE_NT_SIGNATURE &&
-              nt_hdrs.FileHeader.Machine == IMAGE_FILE_MACHINE_AMD64)
+          // Only read as much as we've checked is inside the file, so the
+          // local buffer case doesn't trip the bounds check.
+          auto const ptr_nt_hdrs =
+            static_cast<std::uint8_t*>(address) + nt_hdrs_ofs;
+          auto const signature = ReadHeader<DWORD>(ptr_nt_hdrs);
+          auto const file_hdr =
+            ReadHeader<IMAGE_FILE_HEADER>(ptr_nt_hdrs + sizeof(DWORD));
+          if (signature == IMAGE_NT_SIGNATURE &&
+              file_hdr.Machine == IMAGE_FILE_MACHINE_AMD64)
           {
             is_64_ = true;
           }
@@ -168,12 +360,18 @@ public:
     catch (...)
     {
     }
+
+    if (type_ == PeFileType::kData)
+    {
+      layout_ = ParseLayout();
+    }
   }
 
   explicit PeFile(Process const&& process,
                   void* address,
                   PeFileType type,
-                  DWORD size) = delete;
+                  DWORD size,
+                  std::uint32_t flags = PeFileFlags::kNone) = delete;
 
   PVOID GetBase() const noexcept
   {
@@ -195,14 +393,203 @@ public:
     return is_64_;
   }
 
+  bool IsLocal() const noexcept
+  {
+    return local_span_.IsValid();
+  }
+
+  detail::MemorySpan const& GetLocalSpan() const noexcept
+  {
+    return local_span_;
+  }
+
+  // Null for images, and for data files whose headers couldn't be parsed
+  // (in which case RvaToVa etc. do it the slow way, so they fail in the same
+  // way they always have).
+  detail::PeLayout const* GetLayout() const noexcept
+  {
+    return layout_.get();
+  }
+
+  // The layout is a snapshot of the headers, so it has to be rebuilt whenever
+  // they change. NtHeaders, Section and DosHeader do this in UpdateWrite, but
+  // anything writing to the headers directly has to call it itself.
+  void RefreshLayout() const
+  {
+    if (type_ == PeFileType::kData)
+    {
+      layout_ = ParseLayout();
+    }
+  }
+
 private:
+  std::shared_ptr<detail::PeLayout const> ParseLayout() const
+  {
+    try
+    {
+      auto const dos_header = ReadHeader<IMAGE_DOS_HEADER>(base_);
+      if (dos_header.e_magic != IMAGE_DOS_SIGNATURE)
+      {
+        return {};
+      }
+
+      PBYTE const ptr_nt_headers = base_ + dos_header.e_lfanew;
+      if (ReadHeader<DWORD>(ptr_nt_headers) != IMAGE_NT_SIGNATURE)
+      {
+        return {};
+      }
+
+      auto const file_header =
+        ReadHeader<IMAGE_FILE_HEADER>(ptr_nt_headers + sizeof(DWORD));
+
+      auto layout = std::make_shared<detail::PeLayout>();
+      PBYTE const ptr_optional_header =
+        ptr_nt_headers + sizeof(DWORD) + sizeof(IMAGE_FILE_HEADER);
+      if (is_64_)
+      {
+        auto const optional_header =
+          ReadHeader<IMAGE_OPTIONAL_HEADER64>(ptr_optional_header);
+        layout->size_of_headers = optional_header.SizeOfHeaders;
+        layout->file_alignment = optional_header.FileAlignment;
+        layout->size_of_image = optional_header.SizeOfImage;
+      }
+      else
+      {
+        auto const optional_header =
+          ReadHeader<IMAGE_OPTIONAL_HEADER32>(ptr_optional_header);
+        layout->size_of_headers = optional_header.SizeOfHeaders;
+        layout->file_alignment = optional_header.FileAlignment;
+        layout->size_of_image = optional_header.SizeOfImage;
+      }
+
+      layout->num_sections = file_header.NumberOfSections;
+      layout->virtual_section_cut = false;
+
+      auto ptr_section_header = reinterpret_cast<PIMAGE_SECTION_HEADER>(
+        ptr_nt_headers + offsetof(IMAGE_NT_HEADERS, OptionalHeader) +
+        file_header.SizeOfOptionalHeader);
+      void const* const file_end = base_ + size_;
+      layout->virtual_section_table = (ptr_section_header >= file_end);
+      for (WORD i = 0;
+           !layout->virtual_section_table && i < layout->num_sections;
+           ++i, ++ptr_section_header)
+      {
+        if (ptr_section_header + 1 > file_end)
+        {
+          layout->virtual_section_cut = true;
+          break;
+        }
+
+        IMAGE_SECTION_HEADER section_header;
+        try
+        {
+          section_header = ReadHeader<IMAGE_SECTION_HEADER>(ptr_section_header);
+        }
+        catch (...)
+        {
+          break;
+        }
+
+        detail::PeSectionExtent section;
+        section.virtual_beg = section_header.VirtualAddress;
+        section.virtual_size = section_header.Misc.VirtualSize;
+        section.raw_size = section_header.SizeOfRawData;
+        // If VirtualSize is zero then SizeOfRawData is used.
+        section.virtual_end =
+          section.virtual_beg +
+          (section.virtual_size ? section.virtual_size : section.raw_size);
+        section.raw_beg = section_header.PointerToRawData;
+        section.raw_end = section.raw_beg + section.raw_size;
+        layout->sections.push_back(section);
+      }
+
+      layout->Index();
+      return layout;
+    }
+    catch (...)
+    {
+      return {};
+    }
+  }
+
+  template <typename T> T ReadHeader(void* address) const
+  {
+    return IsLocal() ? local_span_.Read<T>(address)
+                     : Read<T>(*process_, address);
+  }
+
+  // Walks the loader's module list (stopping at the module) rather than
+  // taking a Toolhelp snapshot where possible.
+  static DWORD GetLoadedModuleSize(Process const& process, void* address)
+  {
+    if (detail::CanWalkLoaderList(process))
+    {
+      DWORD size = 0;
+      auto const find_module =
+        [&](void* /*ldr_entry_address*/,
+            detail::winternl::LDR_DATA_TABLE_ENTRY const& ldr_entry) {
+          if (ldr_entry.DllBase == address)
+          {
+            size = ldr_entry.SizeOfImage;
+            return true;
+          }
+
+          return false;
+        };
+      if (detail::WalkLoaderList(process, find_module))
+      {
+        // Toolhelp gets its list from the same place, so there's no point
+        // trying that too.
+        if (!size)
+        {
+          HADESMEM_DETAIL_THROW_EXCEPTION(
+            Error{} << ErrorString{"Could not find module."});
+        }
+
+        return size;
+      }
+    }
+
+    Module const module{process, reinterpret_cast<HMODULE>(address)};
+    return module.GetSize();
+  }
+
   Process const* process_;
   PBYTE base_;
   PeFileType type_;
   DWORD size_;
   bool is_64_{false};
+  detail::MemorySpan local_span_;
+  mutable std::shared_ptr<detail::PeLayout const> layout_;
 };
 
+namespace detail
+{
+template <typename T>
+T PeRead(Process const& process, PeFile const& pe_file, void* address)
+{
+  HADESMEM_DETAIL_ASSERT(address != nullptr);
+
+  auto const& local_span = pe_file.GetLocalSpan();
+  return local_span.IsValid() ? local_span.Read<T>(address)
+                              : Read<T>(process, address);
+}
+
+template <typename T, typename Alloc = std::allocator<T>>
+std::vector<T, Alloc> PeReadVector(Process const& process,
+                                   PeFile const& pe_file,
+                                   void* address,
+                                   std::size_t count)
+{
+  HADESMEM_DETAIL_ASSERT(count ? address != nullptr : true);
+
+  auto const& local_span = pe_file.GetLocalSpan();
+  return local_span.IsValid()
+           ? local_span.ReadVector<T, Alloc>(address, count)
+           : ReadVector<T, Alloc>(process, address, count);
+}
+}
+
 inline bool operator==(PeFile const& lhs, PeFile const& rhs) noexcept
 {
   return lhs.GetBase() == rhs.GetBase();
@@ -249,17 +636,15 @@ inline std::wostream& operator<<(std::wostream& lhs, PeFile const& rhs)
   return lhs;
 }
 
-// TODO: Add sample files for all the corner cases we're handling, and ensure it
-// is correct, so we can add regression tests.
-// TODO: Find a better name for this functions? It's slightly confusing...
-// TODO: Measure code coverage of this and other critical functions when writing
-// tests to ensure full coverage. Then add attributes and regression tests.
-// TODO: Consider if there is a better way to handle virtual VAs other than an
-// out param. Attributes?
-inline PVOID RvaToVa(Process const& process,
-                     PeFile const& pe_file,
-                     DWORD rva,
-                     bool* virtual_va = nullptr)
+namespace detail
+{
+// Parses the headers on every call. Used for images and for data files whose
+// headers couldn't be parsed up front. Also the reference implementation the
+// cached layout is tested against.
+inline PVOID RvaToVaUncached(Process const& process,
+                             PeFile const& pe_file,
+                             DWORD rva,
+                             bool* virtual_va = nullptr)
 {
   if (virtual_va)
   {
@@ -276,7 +661,8 @@ inline PVOID RvaToVa(Process const& process,
       return nullptr;
     }
 
-    IMAGE_DOS_HEADER dos_header = Read<IMAGE_DOS_HEADER>(process, base);
+    IMAGE_DOS_HEADER dos_header =
+      detail::PeRead<IMAGE_DOS_HEADER>(process, pe_file, base);
     if (dos_header.e_magic != IMAGE_DOS_SIGNATURE)
     {
       HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
@@ -284,26 +670,30 @@ inline PVOID RvaToVa(Process const& process,
     }
 
     BYTE* ptr_nt_headers = base + dos_header.e_lfanew;
-    if (Read<DWORD>(process, ptr_nt_headers) != IMAGE_NT_SIGNATURE)
+    if (detail::PeRead<DWORD>(process, pe_file, ptr_nt_headers) !=
+        IMAGE_NT_SIGNATURE)
     {
       HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
                                       << ErrorString{"Invalid NT headers."});
     }
 
-    auto const file_header =
-      Read<IMAGE_FILE_HEADER>(process, ptr_nt_headers + sizeof(DWORD));
+    auto const file_header = detail::PeRead<IMAGE_FILE_HEADER>(
+      process, pe_file, ptr_nt_headers + sizeof(DWORD));
 
     auto const optional_header_32 =
-      pe_file.Is64()
-        ? IMAGE_OPTIONAL_HEADER32{}
-        : Read<IMAGE_OPTIONAL_HEADER32>(process,
-                                        ptr_nt_headers + sizeof(DWORD) +
-                                          sizeof(IMAGE_FILE_HEADER));
+      pe_file.Is64() ? IMAGE_OPTIONAL_HEADER32{}
+                     : detail::PeRead<IMAGE_OPTIONAL_HEADER32>(
+                         process,
+                         pe_file,
+                         ptr_nt_headers + sizeof(DWORD) +
+                           sizeof(IMAGE_FILE_HEADER));
     auto const optional_header_64 =
-      pe_file.Is64()
-        ? Read<IMAGE_OPTIONAL_HEADER64>(
-            process, ptr_nt_headers + sizeof(DWORD) + sizeof(IMAGE_FILE_HEADER))
-        : IMAGE_OPTIONAL_HEADER64{};
+      pe_file.Is64() ? detail::PeRead<IMAGE_OPTIONAL_HEADER64>(
+                         process,
+                         pe_file,
+                         ptr_nt_headers + sizeof(DWORD) +
+                           sizeof(IMAGE_FILE_HEADER))
+                     : IMAGE_OPTIONAL_HEADER64{};
 
     DWORD const size_of_headers = pe_file.Is64()
                                     ? optional_header_64.SizeOfHeaders
@@ -387,8 +777,8 @@ inline PVOID RvaToVa(Process const& process,
         return nullptr;
       }
 
-      auto const section_header =
-        Read<IMAGE_SECTION_HEADER>(process, ptr_section_header);
+      auto const section_header = detail::PeRead<IMAGE_SECTION_HEADER>(
+        process, pe_file, ptr_section_header);
 
       DWORD const virtual_beg = section_header.VirtualAddress;
       DWORD const virtual_size = section_header.Misc.VirtualSize;
@@ -493,18 +883,17 @@ inline PVOID RvaToVa(Process const& process,
   }
 }
 
-// TODO: 'Harden' this function against malicious/malformed PE files like is
-// done for RvaToVa.
-inline DWORD FileOffsetToRva(Process const& process,
-                             PeFile const& pe_file,
-                             DWORD file_offset)
+inline DWORD FileOffsetToRvaUncached(Process const& process,
+                                     PeFile const& pe_file,
+                                     DWORD file_offset)
 {
   PeFileType const type = pe_file.GetType();
   PBYTE base = static_cast<PBYTE>(pe_file.GetBase());
 
   if (type == PeFileType::kData)
   {
-    IMAGE_DOS_HEADER dos_header = Read<IMAGE_DOS_HEADER>(process, base);
+    IMAGE_DOS_HEADER dos_header =
+      detail::PeRead<IMAGE_DOS_HEADER>(process, pe_file, base);
     if (dos_header.e_magic != IMAGE_DOS_SIGNATURE)
     {
       HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
@@ -512,14 +901,15 @@ inline DWORD FileOffsetToRva(Process const& process,
     }
 
     BYTE* ptr_nt_headers = base + dos_header.e_lfanew;
-    if (Read<DWORD>(process, ptr_nt_headers) != IMAGE_NT_SIGNATURE)
+    if (detail::PeRead<DWORD>(process, pe_file, ptr_nt_headers) !=
+        IMAGE_NT_SIGNATURE)
     {
       HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
                                       << ErrorString{"Invalid NT headers."});
     }
 
-    auto const file_header =
-      Read<IMAGE_FILE_HEADER>(process, ptr_nt_headers + sizeof(DWORD));
+    auto const file_header = detail::PeRead<IMAGE_FILE_HEADER>(
+      process, pe_file, ptr_nt_headers + sizeof(DWORD));
 
     auto ptr_section_header = reinterpret_cast<PIMAGE_SECTION_HEADER>(
       ptr_nt_headers + offsetof(IMAGE_NT_HEADERS, OptionalHeader) +
@@ -528,8 +918,8 @@ inline DWORD FileOffsetToRva(Process const& process,
     WORD num_sections = file_header.NumberOfSections;
     for (WORD i = 0; i < num_sections; ++i)
     {
-      auto const section_header =
-        Read<IMAGE_SECTION_HEADER>(process, ptr_section_header);
+      auto const section_header = detail::PeRead<IMAGE_SECTION_HEADER>(
+        process, pe_file, ptr_section_header);
 
       DWORD const raw_beg = section_header.PointerToRawData;
       DWORD const raw_size = section_header.SizeOfRawData;
@@ -556,6 +946,136 @@ inline DWORD FileOffsetToRva(Process const& process,
                                     << ErrorString{"Unhandled file type."});
   }
 }
+}
+
+// TODO: Add sample files for all the corner cases we're handling, and ensure it
+// is correct, so we can add regression tests.
+// TODO: Find a better name for this functions? It's slightly confusing...
+// TODO: Measure code coverage of this and other critical functions when writing
+// tests to ensure full coverage. Then add attributes and regression tests.
+// TODO: Consider if there is a better way to handle virtual VAs other than an
+// out param. Attributes?
+inline PVOID RvaToVa(Process const& process,
+                     PeFile const& pe_file,
+                     DWORD rva,
+                     bool* virtual_va = nullptr)
+{
+  detail::PeLayout const* const layout = pe_file.GetLayout();
+  if (pe_file.GetType() != PeFileType::kData || !layout)
+  {
+    return detail::RvaToVaUncached(process, pe_file, rva, virtual_va);
+  }
+
+  if (virtual_va)
+  {
+    *virtual_va = false;
+  }
+
+  if (!rva)
+  {
+    return nullptr;
+  }
+
+  PBYTE const base = static_cast<PBYTE>(pe_file.GetBase());
+  DWORD const file_size = pe_file.GetSize();
+
+  if (!layout->num_sections)
+  {
+    return rva > file_size ? nullptr : base + rva;
+  }
+
+  if (rva < layout->size_of_headers)
+  {
+    return (rva > file_size || rva > layout->size_of_image) ? nullptr
+                                                            : base + rva;
+  }
+
+  if (rva > layout->size_of_image)
+  {
+    return nullptr;
+  }
+
+  if (layout->virtual_section_table)
+  {
+    return rva > file_size ? nullptr : base + rva;
+  }
+
+  if (detail::PeSectionExtent const* const section = layout->FindByRva(rva))
+  {
+    rva -= section->virtual_beg;
+
+    if (rva > section->raw_size)
+    {
+      if (rva < section->virtual_size && virtual_va)
+      {
+        *virtual_va = true;
+      }
+
+      return nullptr;
+    }
+
+    if (section->raw_beg >= 0x200)
+    {
+      rva += section->raw_beg & ~(layout->file_alignment - 1);
+    }
+
+    return rva >= file_size ? nullptr : base + rva;
+  }
+
+  if (layout->sections.size() < layout->num_sections)
+  {
+    // Past the readable part of the section table, which is nullptr for a
+    // virtual section header, or whatever the slow path does (i.e. most
+    // likely throw) for one which we failed to read.
+    return layout->virtual_section_cut
+             ? nullptr
+             : detail::RvaToVaUncached(process, pe_file, rva, virtual_va);
+  }
+
+  bool const in_header = rva < layout->min_virtual_beg;
+  if (in_header && rva < file_size)
+  {
+    DWORD const file_alignment = layout->file_alignment;
+    if (file_alignment < 200)
+    {
+      return base + rva;
+    }
+    else if (rva < file_alignment)
+    {
+      return base + rva;
+    }
+    else
+    {
+      return nullptr;
+    }
+  }
+
+  // Sample: nullSOH-XP (Corkami PE Corpus)
+  if (rva < layout->size_of_image && rva < file_size)
+  {
+    return base + rva;
+  }
+
+  return nullptr;
+}
+
+// TODO: 'Harden' this function against malicious/malformed PE files like is
+// done for RvaToVa.
+inline DWORD FileOffsetToRva(Process const& process,
+                             PeFile const& pe_file,
+                             DWORD file_offset)
+{
+  detail::PeLayout const* const layout = pe_file.GetLayout();
+  if (pe_file.GetType() != PeFileType::kData || !layout ||
+      layout->sections.size() < layout->num_sections)
+  {
+    return detail::FileOffsetToRvaUncached(process, pe_file, file_offset);
+  }
+
+  detail::PeSectionExtent const* const section =
+    layout->FindByFileOffset(file_offset);
+  return section ? file_offset - section->raw_beg + section->virtual_beg : 0;
+}
 
 namespace detail
 {
@@ -572,7 +1092,9 @@ std::basic_string<CharT> CheckedReadString(Process const& process,
     // TODO: Extra bounds checking to ensure we don't read outside the image in
     // the case that we're reading a string at the end of the file which is not
     // null terminated, and we're on a region boundary.
-    return ReadString<CharT>(process, address);
+    auto const& local_span = pe_file.GetLocalSpan();
+    return local_span.IsValid() ? local_span.ReadString<CharT>(address)
+                                : ReadString<CharT>(process, address);
   }
   else if (pe_file.GetType() == PeFileType::kData)
   {
@@ -584,7 +1106,10 @@ std::basic_string<CharT> CheckedReadString(Process const& process,
     }
     // Handle EOF termination.
     // Sample: maxsecXP.exe (Corkami PE Corpus)
-    return ReadStringBounded<CharT>(process, address, file_end);
+    auto const& local_span = pe_file.GetLocalSpan();
+    return local_span.IsValid()
+             ? local_span.ReadString<CharT>(address, file_end)
+             : ReadStringBounded<CharT>(process, address, file_end);
   }
   else
   {
@@ -593,5 +1118,44 @@ std::basic_string<CharT> CheckedReadString(Process const& process,
                                     << ErrorString{"Unknown PE file type."});
   }
 }
+
+// Same as CheckedReadString, but for local buffers the result refers directly
+// to the string in the buffer rather than to a copy of it. Otherwise the string
+// is read into storage and the result refers to that, so the result is only
+// valid for as long as both the PeFile and storage are.
+template <typename CharT>
+BasicStringView<CharT>
+  CheckedReadStringView(Process const& process,
+                        PeFile const& pe_file,
+                        void* address,
+                        std::basic_string<CharT>& storage)
+{
+  if (!pe_file.IsLocal())
+  {
+    storage = CheckedReadString<CharT>(process, pe_file, address);
+    return storage;
+  }
+
+  void* upper_bound = nullptr;
+  if (pe_file.GetType() == PeFileType::kData)
+  {
+    upper_bound =
+      static_cast<std::uint8_t*>(pe_file.GetBase()) + pe_file.GetSize();
+    if (address >= upper_bound)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{"Invalid VA."});
+    }
+  }
+  else if (pe_file.GetType() != PeFileType::kImage)
+  {
+    HADESMEM_DETAIL_ASSERT(false);
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Unknown PE file type."});
+  }
+
+  std::size_t const len =
+    pe_file.GetLocalSpan().GetStringLength<CharT>(address, upper_bound);
+  return {static_cast<CharT const*>(address), len};
+}
 }
 }
@@ -59,7 +59,8 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_BASE_RELOCATION>(*process_, base_);
+    data_ =
+      detail::PeRead<IMAGE_BASE_RELOCATION>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
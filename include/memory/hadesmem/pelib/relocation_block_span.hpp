@@ -0,0 +1,360 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <vector>
+
+#include <windows.h>
+#include <winnt.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+namespace hadesmem
+{
+// Snapshot of a single relocation. Same accessors as Relocation.
+class RelocationEntry
+{
+public:
+  explicit RelocationEntry(std::uint16_t data) noexcept : data_{data}
+  {
+  }
+
+  std::uint8_t GetType() const noexcept
+  {
+    return static_cast<std::uint8_t>(data_ >> 12);
+  }
+
+  WORD GetOffset() const noexcept
+  {
+    return static_cast<WORD>(data_ & 0x0FFF);
+  }
+
+private:
+  std::uint16_t data_;
+};
+
+// Snapshot of a single relocation block. Same accessors as RelocationBlock,
+// plus the block's relocations as a contiguous range (which may be shorter
+// than GetNumberOfRelocations if the data couldn't all be read, as with
+// RelocationList).
+class RelocationBlockEntry
+{
+public:
+  using const_iterator = RelocationEntry const*;
+
+  explicit RelocationBlockEntry(void* base,
+                                IMAGE_BASE_RELOCATION const& data) noexcept
+    : base_{static_cast<std::uint8_t*>(base)}, data_(data)
+  {
+  }
+
+  void* GetBase() const noexcept
+  {
+    return base_;
+  }
+
+  DWORD GetVirtualAddress() const noexcept
+  {
+    return data_.VirtualAddress;
+  }
+
+  DWORD GetSizeOfBlock() const noexcept
+  {
+    return data_.SizeOfBlock;
+  }
+
+  DWORD GetNumberOfRelocations() const noexcept
+  {
+    DWORD const size_of_block = GetSizeOfBlock();
+    return size_of_block ? (static_cast<DWORD>(
+                             (size_of_block - sizeof(IMAGE_BASE_RELOCATION)) /
+                             sizeof(WORD)))
+                         : 0;
+  }
+
+  PWORD GetRelocationDataStart() const noexcept
+  {
+    return reinterpret_cast<PWORD>(reinterpret_cast<std::uintptr_t>(base_) +
+                                   sizeof(IMAGE_BASE_RELOCATION));
+  }
+
+  const_iterator begin() const noexcept
+  {
+    return relocs_beg_;
+  }
+
+  const_iterator end() const noexcept
+  {
+    return relocs_end_;
+  }
+
+  std::size_t size() const noexcept
+  {
+    return static_cast<std::size_t>(relocs_end_ - relocs_beg_);
+  }
+
+private:
+  friend class RelocationBlockSpan;
+
+  std::uint8_t* base_;
+  IMAGE_BASE_RELOCATION data_;
+  RelocationEntry const* relocs_beg_{};
+  RelocationEntry const* relocs_end_{};
+};
+
+// Alternative to RelocationBlockList/RelocationList for hot paths. The
+// relocation directory is read in a single read (where it lies within the
+// file or image) rather than one read per block and one per relocation, and
+// iteration is over plain vectors. Termination is the same as
+// RelocationBlockList.
+// Blocks point into storage owned by the span, so it's move-only.
+class RelocationBlockSpan
+{
+public:
+  using value_type = RelocationBlockEntry;
+  using iterator = std::vector<RelocationBlockEntry>::const_iterator;
+  using const_iterator = std::vector<RelocationBlockEntry>::const_iterator;
+  using size_type = std::vector<RelocationBlockEntry>::size_type;
+
+  explicit RelocationBlockSpan(Process const& process, PeFile const& pe_file)
+    : process_{&process}, pe_file_{&pe_file}
+  {
+    std::vector<std::size_t> relocs_ends;
+    try
+    {
+      ReadBlocks(relocs_ends);
+    }
+    catch (std::exception const& /*e*/)
+    {
+      // Nothing to do here.
+    }
+
+    // Only safe to take pointers into the relocations once they're all read.
+    std::size_t relocs_beg = 0;
+    for (std::size_t i = 0; i < blocks_.size(); ++i)
+    {
+      blocks_[i].relocs_beg_ = relocs_.data() + relocs_beg;
+      blocks_[i].relocs_end_ = relocs_.data() + relocs_ends[i];
+      relocs_beg = relocs_ends[i];
+    }
+  }
+
+  explicit RelocationBlockSpan(Process const&& process,
+                               PeFile const& pe_file) = delete;
+
+  explicit RelocationBlockSpan(Process const& process,
+                               PeFile&& pe_file) = delete;
+
+  explicit RelocationBlockSpan(Process const&& process,
+                               PeFile&& pe_file) = delete;
+
+  RelocationBlockSpan(RelocationBlockSpan const& other) = delete;
+
+  RelocationBlockSpan& operator=(RelocationBlockSpan const& other) = delete;
+
+  RelocationBlockSpan(RelocationBlockSpan&& other) = default;
+
+  RelocationBlockSpan& operator=(RelocationBlockSpan&& other) = default;
+
+  const_iterator begin() const noexcept
+  {
+    return blocks_.cbegin();
+  }
+
+  const_iterator cbegin() const noexcept
+  {
+    return blocks_.cbegin();
+  }
+
+  const_iterator end() const noexcept
+  {
+    return blocks_.cend();
+  }
+
+  const_iterator cend() const noexcept
+  {
+    return blocks_.cend();
+  }
+
+  size_type size() const noexcept
+  {
+    return blocks_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return blocks_.empty();
+  }
+
+  RelocationBlockEntry const& operator[](size_type n) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(n < blocks_.size());
+    return blocks_[n];
+  }
+
+private:
+  // Mirrors RelocationBlockIterator, including its validation.
+  void ReadBlocks(std::vector<std::size_t>& relocs_ends)
+  {
+    NtHeaders const nt_headers{*process_, *pe_file_};
+
+    DWORD const data_dir_va =
+      nt_headers.GetDataDirectoryVirtualAddress(PeDataDir::BaseReloc);
+    DWORD const size = nt_headers.GetDataDirectorySize(PeDataDir::BaseReloc);
+    if (!data_dir_va || !size)
+    {
+      return;
+    }
+
+    auto const base =
+      static_cast<std::uint8_t*>(RvaToVa(*process_, *pe_file_, data_dir_va));
+    if (!base)
+    {
+      return;
+    }
+
+    // Cast to integer and back to avoid pointer overflow UB.
+    auto const dir_beg = reinterpret_cast<std::uintptr_t>(base);
+    auto const dir_end = dir_beg + size;
+    auto const file_end = reinterpret_cast<std::uintptr_t>(
+      static_cast<std::uint8_t*>(pe_file_->GetBase()) + pe_file_->GetSize());
+    // Sample: virtrelocXP.exe
+    if (pe_file_->GetType() == PeFileType::kData &&
+        (dir_end < dir_beg || dir_end > file_end))
+    {
+      return;
+    }
+
+    // Read the whole directory up front if it's all inside the file or
+    // image. Anything else (including if this read fails) is read on demand,
+    // which is what RelocationBlockList does for everything.
+    if (dir_end >= dir_beg && dir_end <= file_end)
+    {
+      try
+      {
+        dir_buf_ = detail::PeReadVector<std::uint8_t>(
+          *process_, *pe_file_, base, size);
+        dir_beg_ = dir_beg;
+      }
+      catch (std::exception const& /*e*/)
+      {
+        dir_buf_.clear();
+      }
+    }
+
+    for (std::uintptr_t cur = dir_beg;;)
+    {
+      RelocationBlockEntry const block{reinterpret_cast<void*>(cur),
+                                       ReadHeader(cur)};
+
+      // TODO: Dump should warn for this.
+      auto const relocs_beg =
+        reinterpret_cast<std::uintptr_t>(block.GetRelocationDataStart());
+      auto const relocs_end =
+        relocs_beg + block.GetNumberOfRelocations() * sizeof(WORD);
+      if (relocs_end < relocs_beg || relocs_end > dir_end)
+      {
+        return;
+      }
+
+      ReadRelocations(relocs_beg, block.GetNumberOfRelocations());
+      relocs_ends.push_back(relocs_.size());
+      blocks_.push_back(block);
+
+      // TODO: Dump should warn for integer overflow or mis-aligned off-the-end
+      // data.
+      if (relocs_end < cur || relocs_end >= dir_end)
+      {
+        return;
+      }
+
+      cur = relocs_end;
+    }
+  }
+
+  bool IsBuffered(std::uintptr_t address, std::size_t len) const noexcept
+  {
+    return !dir_buf_.empty() && address >= dir_beg_ &&
+           address - dir_beg_ <= dir_buf_.size() &&
+           len <= dir_buf_.size() - (address - dir_beg_);
+  }
+
+  IMAGE_BASE_RELOCATION ReadHeader(std::uintptr_t address) const
+  {
+    if (IsBuffered(address, sizeof(IMAGE_BASE_RELOCATION)))
+    {
+      IMAGE_BASE_RELOCATION header;
+      std::memcpy(
+        &header, &dir_buf_[address - dir_beg_], sizeof(IMAGE_BASE_RELOCATION));
+      return header;
+    }
+
+    // The last header can hang off the end of the directory.
+    return detail::PeRead<IMAGE_BASE_RELOCATION>(
+      *process_, *pe_file_, reinterpret_cast<void*>(address));
+  }
+
+  void ReadRelocations(std::uintptr_t address, DWORD count)
+  {
+    if (IsBuffered(address, count * sizeof(WORD)))
+    {
+      for (DWORD i = 0; i < count; ++i)
+      {
+        std::uint16_t data;
+        std::size_t const offset = address - dir_beg_ + i * sizeof(WORD);
+        std::memcpy(&data, &dir_buf_[offset], sizeof(WORD));
+        relocs_.emplace_back(data);
+      }
+
+      return;
+    }
+
+    // RelocationList stops at the first relocation it can't read, so only
+    // fall back to doing the same if the bulk read fails.
+    try
+    {
+      auto const data = detail::PeReadVector<std::uint16_t>(
+        *process_, *pe_file_, reinterpret_cast<void*>(address), count);
+      for (auto const reloc : data)
+      {
+        relocs_.emplace_back(reloc);
+      }
+    }
+    catch (std::exception const& /*e*/)
+    {
+      try
+      {
+        for (DWORD i = 0; i < count; ++i)
+        {
+          relocs_.emplace_back(detail::PeRead<std::uint16_t>(
+            *process_,
+            *pe_file_,
+            reinterpret_cast<void*>(address + i * sizeof(WORD))));
+        }
+      }
+      catch (std::exception const& /*e*/)
+      {
+        // Nothing to do here.
+      }
+    }
+  }
+
+  Process const* process_;
+  PeFile const* pe_file_;
+  std::vector<std::uint8_t> dir_buf_;
+  std::uintptr_t dir_beg_{};
+  std::vector<RelocationBlockEntry> blocks_;
+  std::vector<RelocationEntry> relocs_;
+};
+}
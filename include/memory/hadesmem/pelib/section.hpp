@@ -16,6 +16,7 @@
 #include <winnt.h>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/string_view.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
 #include <hadesmem/pelib/nt_headers.hpp>
@@ -94,25 +95,35 @@ public:
     }
     else
     {
-      data_ = Read<IMAGE_SECTION_HEADER>(*process_, base_);
+      data_ =
+        detail::PeRead<IMAGE_SECTION_HEADER>(*process_, *pe_file_, base_);
     }
   }
 
   void UpdateWrite()
   {
     Write(*process_, base_, data_);
+
+    pe_file_->RefreshLayout();
   }
 
   // TODO: Don't truncate.
   std::string GetName() const
   {
-    std::string name;
-    for (std::size_t i = 0; i < 8 && data_.Name[i]; ++i)
+    return GetNameView().to_string();
+  }
+
+  // Refers to the copy of the header held by this object, so the result is
+  // only valid for as long as the object is (and isn't modified).
+  detail::StringView GetNameView() const noexcept
+  {
+    std::size_t len = 0;
+    while (len < sizeof(data_.Name) && data_.Name[len])
     {
-      name += data_.Name[i];
+      ++len;
     }
 
-    return name;
+    return {reinterpret_cast<char const*>(data_.Name), len};
   }
 
   DWORD GetVirtualAddress() const
@@ -0,0 +1,218 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+#include <winnt.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/string_view.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+namespace hadesmem
+{
+// Snapshot of a single section header. Same accessors as Section.
+class SectionEntry
+{
+public:
+  explicit SectionEntry(void* base,
+                        IMAGE_SECTION_HEADER const& data,
+                        bool is_virtual) noexcept
+    : base_{static_cast<std::uint8_t*>(base)},
+      data_(data),
+      is_virtual_{is_virtual}
+  {
+  }
+
+  void* GetBase() const noexcept
+  {
+    return base_;
+  }
+
+  bool IsVirtual() const noexcept
+  {
+    return is_virtual_;
+  }
+
+  // TODO: Don't truncate.
+  std::string GetName() const
+  {
+    return GetNameView().to_string();
+  }
+
+  // Refers to the copy of the header held by this object, so the result is
+  // only valid for as long as the object is (and isn't modified).
+  detail::StringView GetNameView() const noexcept
+  {
+    std::size_t len = 0;
+    while (len < sizeof(data_.Name) && data_.Name[len])
+    {
+      ++len;
+    }
+
+    return {reinterpret_cast<char const*>(data_.Name), len};
+  }
+
+  DWORD GetVirtualAddress() const noexcept
+  {
+    return data_.VirtualAddress;
+  }
+
+  DWORD GetVirtualSize() const noexcept
+  {
+    return data_.Misc.VirtualSize;
+  }
+
+  DWORD GetSizeOfRawData() const noexcept
+  {
+    return data_.SizeOfRawData;
+  }
+
+  DWORD GetPointerToRawData() const noexcept
+  {
+    return data_.PointerToRawData;
+  }
+
+  DWORD GetPointerToRelocations() const noexcept
+  {
+    return data_.PointerToRelocations;
+  }
+
+  DWORD GetPointerToLinenumbers() const noexcept
+  {
+    return data_.PointerToLinenumbers;
+  }
+
+  WORD GetNumberOfRelocations() const noexcept
+  {
+    return data_.NumberOfRelocations;
+  }
+
+  WORD GetNumberOfLinenumbers() const noexcept
+  {
+    return data_.NumberOfLinenumbers;
+  }
+
+  DWORD GetCharacteristics() const noexcept
+  {
+    return data_.Characteristics;
+  }
+
+private:
+  std::uint8_t* base_;
+  IMAGE_SECTION_HEADER data_;
+  bool is_virtual_;
+};
+
+// Alternative to SectionList for hot paths. The section table is read in a
+// single read rather than one per section, and iteration is over a plain
+// vector. Headers which lie (even partially) past the end of a data file are
+// zeroed and marked virtual, as they are by Section.
+// Throws if the NT headers are invalid or the table can't be read.
+class SectionSpan
+{
+public:
+  using value_type = SectionEntry;
+  using iterator = std::vector<SectionEntry>::const_iterator;
+  using const_iterator = std::vector<SectionEntry>::const_iterator;
+  using size_type = std::vector<SectionEntry>::size_type;
+
+  explicit SectionSpan(Process const& process, PeFile const& pe_file)
+  {
+    NtHeaders const nt_headers(process, pe_file);
+    WORD const num_sections = nt_headers.GetNumberOfSections();
+    if (!num_sections)
+    {
+      return;
+    }
+
+    auto const table = reinterpret_cast<PIMAGE_SECTION_HEADER>(
+      static_cast<std::uint8_t*>(nt_headers.GetBase()) +
+      (pe_file.Is64() ? offsetof(IMAGE_NT_HEADERS64, OptionalHeader)
+                      : offsetof(IMAGE_NT_HEADERS32, OptionalHeader)) +
+      nt_headers.GetSizeOfOptionalHeader());
+
+    std::size_t num_readable = num_sections;
+    if (pe_file.GetType() == PeFileType::kData)
+    {
+      auto const table_beg = reinterpret_cast<std::uintptr_t>(table);
+      auto const file_end = reinterpret_cast<std::uintptr_t>(
+        static_cast<std::uint8_t*>(pe_file.GetBase()) + pe_file.GetSize());
+      num_readable = table_beg < file_end
+                       ? (std::min)(static_cast<std::size_t>(
+                                      (file_end - table_beg) /
+                                      sizeof(IMAGE_SECTION_HEADER)),
+                                    num_readable)
+                       : 0;
+    }
+
+    auto const headers = detail::PeReadVector<IMAGE_SECTION_HEADER>(
+      process, pe_file, table, num_readable);
+    sections_.reserve(num_sections);
+    for (std::size_t i = 0; i < num_sections; ++i)
+    {
+      bool const is_virtual = i >= num_readable;
+      sections_.emplace_back(table + i,
+                             is_virtual ? IMAGE_SECTION_HEADER{} : headers[i],
+                             is_virtual);
+    }
+  }
+
+  explicit SectionSpan(Process const&& process, PeFile const& pe_file) = delete;
+
+  explicit SectionSpan(Process const& process, PeFile&& pe_file) = delete;
+
+  explicit SectionSpan(Process const&& process, PeFile&& pe_file) = delete;
+
+  const_iterator begin() const noexcept
+  {
+    return sections_.cbegin();
+  }
+
+  const_iterator cbegin() const noexcept
+  {
+    return sections_.cbegin();
+  }
+
+  const_iterator end() const noexcept
+  {
+    return sections_.cend();
+  }
+
+  const_iterator cend() const noexcept
+  {
+    return sections_.cend();
+  }
+
+  size_type size() const noexcept
+  {
+    return sections_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return sections_.empty();
+  }
+
+  SectionEntry const& operator[](size_type n) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(n < sections_.size());
+    return sections_[n];
+  }
+
+private:
+  std::vector<SectionEntry> sections_;
+};
+}
@@ -62,11 +62,13 @@ public:
   {
     if (pe_file_->Is64())
     {
-      data_64_ = Read<IMAGE_TLS_DIRECTORY64>(*process_, base_);
+      data_64_ =
+        detail::PeRead<IMAGE_TLS_DIRECTORY64>(*process_, *pe_file_, base_);
     }
     else
     {
-      data_32_ = Read<IMAGE_TLS_DIRECTORY32>(*process_, base_);
+      data_32_ =
+        detail::PeRead<IMAGE_TLS_DIRECTORY32>(*process_, *pe_file_, base_);
     }
   }
 
@@ -257,8 +259,10 @@ private:
         Error{} << ErrorString{"TLS callbacks are invalid."});
     }
 
-    for (auto callback = Read<T>(*process_, callbacks_raw); callback;
-         callback = Read<T>(*process_, ++callbacks_raw))
+    for (auto callback =
+           detail::PeRead<T>(*process_, *pe_file_, callbacks_raw);
+         callback;
+         callback = detail::PeRead<T>(*process_, *pe_file_, ++callbacks_raw))
     {
       *callbacks++ = static_cast<ULONGLONG>(callback) - image_base;
     }
@@ -0,0 +1,701 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/detail/read_impl.hpp>
+#include <hadesmem/detail/task_scheduler.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_index.hpp>
+#include <hadesmem/module_list.hpp>
+#include <hadesmem/process.hpp>
+
+// TODO: Support scanning a WoW64 process from a native process (i.e. 32-bit
+// pointers).
+
+// TODO: Parallelize the search itself (e.g. split on the first level). It's
+// rarely the bottleneck compared to building the map, but deep searches with a
+// large offset bound can take a while.
+
+// TODO: Allow paths to continue through static addresses, for when the
+// 'static' pointer is itself reached through another module (e.g. a global
+// in a DLL pointing into the main module's data).
+
+namespace hadesmem
+{
+struct PointerScanOptions
+{
+  // Maximum number of dereferences in a path.
+  std::size_t max_depth = 4;
+  // Maximum offset added after each dereference.
+  std::size_t max_offset = 0x800;
+  // Alignment of the pointers themselves.
+  std::size_t alignment = sizeof(void*);
+  // The search stops once this many paths have been found.
+  std::size_t max_results = 0x100000;
+  std::size_t chunk_size = 0x100000;
+  // Zero is one thread per core. One builds the map on the calling thread.
+  std::size_t num_threads = 0;
+};
+
+struct PointerScanRegion
+{
+  std::uintptr_t base;
+  std::size_t size;
+};
+
+struct PointerScanModule
+{
+  std::wstring name;
+  std::uintptr_t base;
+  std::size_t size;
+};
+
+// Resolved as follows, where the result should be the target:
+//   address = base of modules[module] + base_offset
+//   for each offset: address = *address + offset
+struct PointerPath
+{
+  std::uint32_t module;
+  std::uintptr_t base_offset;
+  std::vector<std::uintptr_t> offsets;
+};
+
+struct PointerScanResults
+{
+  std::vector<std::wstring> modules;
+  std::vector<PointerPath> paths;
+};
+
+namespace detail
+{
+// Reverse pointer map. Every pointer-sized value in memory which points into a
+// readable region, sorted by the value it points to (then by where it is).
+class PointerMap
+{
+public:
+  struct Entry
+  {
+    std::uintptr_t value;
+    std::uintptr_t source;
+  };
+
+  PointerMap() = default;
+
+  // read(address, buffer, len) should return false if the memory can't be
+  // read. Regions must be sorted and must not overlap.
+  template <typename ReadFn>
+  PointerMap(std::vector<PointerScanRegion> const& regions,
+             ReadFn const& read,
+             PointerScanOptions const& options)
+    : regions_(regions)
+  {
+    HADESMEM_DETAIL_ASSERT(options.alignment != 0);
+
+    struct Chunk
+    {
+      std::uintptr_t beg;
+      std::size_t len;
+    };
+
+    std::size_t const alignment = options.alignment;
+    std::size_t const chunk_size =
+      (std::max)(options.chunk_size / alignment, std::size_t{1}) * alignment;
+    std::vector<Chunk> chunks;
+    for (auto const& region : regions_)
+    {
+      std::uintptr_t const end = region.base + region.size;
+      for (std::uintptr_t c =
+             (region.base + alignment - 1) / alignment * alignment;
+           c < end && end - c >= sizeof(std::uintptr_t);
+           c += chunk_size)
+      {
+        std::size_t const len = static_cast<std::size_t>(
+          (std::min)(end - c, chunk_size + sizeof(std::uintptr_t) - 1));
+        chunks.emplace_back(Chunk{c, len});
+        if (end - c <= chunk_size)
+        {
+          break;
+        }
+      }
+    }
+
+    std::vector<std::vector<Entry>> chunk_entries(chunks.size());
+    auto const scan_chunk = [&](std::size_t i) {
+      Chunk const& chunk = chunks[i];
+      std::vector<std::uint8_t> buf(chunk.len);
+      if (!read(chunk.beg, buf.data(), buf.size()))
+      {
+        return;
+      }
+
+      std::vector<Entry>& entries = chunk_entries[i];
+      for (std::size_t offset = 0; offset + sizeof(std::uintptr_t) <= chunk.len;
+           offset += alignment)
+      {
+        std::uintptr_t value;
+        std::memcpy(&value, buf.data() + offset, sizeof(value));
+        if (IsValidPointer(value))
+        {
+          entries.emplace_back(Entry{value, chunk.beg + offset});
+        }
+      }
+
+      entries.shrink_to_fit();
+    };
+
+    std::size_t num_threads = options.num_threads;
+    if (!num_threads)
+    {
+      num_threads = std::thread::hardware_concurrency();
+    }
+
+    if (num_threads > 1 && chunks.size() > 1)
+    {
+      TaskScheduler scheduler{num_threads, num_threads * 4};
+      TaskGroup group{scheduler};
+      for (std::size_t i = 0; i < chunks.size(); ++i)
+      {
+        group.Run([&scan_chunk, i]() { scan_chunk(i); });
+      }
+
+      group.Wait();
+    }
+    else
+    {
+      for (std::size_t i = 0; i < chunks.size(); ++i)
+      {
+        scan_chunk(i);
+      }
+    }
+
+    std::size_t num_entries = 0;
+    for (auto const& entries : chunk_entries)
+    {
+      num_entries += entries.size();
+    }
+
+    // Chunks are in address order, and the sort is stable, so entries with
+    // the same value end up sorted by source.
+    entries_.reserve(num_entries);
+    for (auto& entries : chunk_entries)
+    {
+      entries_.insert(
+        std::end(entries_), std::begin(entries), std::end(entries));
+      std::vector<Entry>().swap(entries);
+    }
+
+    RadixSort();
+  }
+
+  bool IsValidPointer(std::uintptr_t value) const noexcept
+  {
+    auto const iter = std::upper_bound(
+      std::begin(regions_),
+      std::end(regions_),
+      value,
+      [](std::uintptr_t lhs, PointerScanRegion const& rhs) {
+        return lhs < rhs.base;
+      });
+    return iter != std::begin(regions_) &&
+           value - std::prev(iter)->base < std::prev(iter)->size;
+  }
+
+  // Returns the entries with a value in [lo, hi].
+  std::pair<Entry const*, Entry const*> FindRange(std::uintptr_t lo,
+                                                  std::uintptr_t hi) const
+  {
+    auto const by_value = [](Entry const& lhs, std::uintptr_t rhs) {
+      return lhs.value < rhs;
+    };
+    auto const first =
+      std::lower_bound(std::begin(entries_), std::end(entries_), lo, by_value);
+    auto last = first;
+    while (last != std::end(entries_) && last->value <= hi)
+    {
+      ++last;
+    }
+
+    Entry const* const data = entries_.data();
+    return {data + (first - std::begin(entries_)),
+            data + (last - std::begin(entries_))};
+  }
+
+  std::size_t GetSize() const noexcept
+  {
+    return entries_.size();
+  }
+
+private:
+  // LSD radix sort on the value, a byte at a time. Bytes which are the same
+  // in every value (e.g. the top bytes of user mode addresses) are skipped.
+  void RadixSort()
+  {
+    std::size_t const kDigits = sizeof(std::uintptr_t);
+    std::vector<std::array<std::size_t, 256>> counts(kDigits);
+    for (auto& count : counts)
+    {
+      count.fill(0);
+    }
+
+    for (auto const& entry : entries_)
+    {
+      for (std::size_t d = 0; d < kDigits; ++d)
+      {
+        ++counts[d][(entry.value >> (d * 8)) & 0xFF];
+      }
+    }
+
+    std::vector<Entry> tmp(entries_.size());
+    for (std::size_t d = 0; d < kDigits; ++d)
+    {
+      auto& count = counts[d];
+      if (std::find(std::begin(count), std::end(count), entries_.size()) !=
+          std::end(count))
+      {
+        continue;
+      }
+
+      std::size_t offset = 0;
+      for (auto& c : count)
+      {
+        std::size_t const cur = c;
+        c = offset;
+        offset += cur;
+      }
+
+      for (auto const& entry : entries_)
+      {
+        tmp[count[(entry.value >> (d * 8)) & 0xFF]++] = entry;
+      }
+
+      entries_.swap(tmp);
+    }
+  }
+
+  std::vector<PointerScanRegion> regions_;
+  std::vector<Entry> entries_;
+};
+
+inline void AppendVarint(std::uint64_t value, std::vector<char>* out)
+{
+  for (; value >= 0x80; value >>= 7)
+  {
+    out->push_back(static_cast<char>((value & 0x7F) | 0x80));
+  }
+
+  out->push_back(static_cast<char>(value));
+}
+
+inline std::uint64_t ReadVarint(std::vector<char> const& in, std::size_t* pos)
+{
+  std::uint64_t value = 0;
+  for (unsigned int shift = 0; shift < 64; shift += 7)
+  {
+    if (*pos >= in.size())
+    {
+      break;
+    }
+
+    auto const b = static_cast<std::uint8_t>(in[(*pos)++]);
+    value |= static_cast<std::uint64_t>(b & 0x7F) << shift;
+    if (!(b & 0x80))
+    {
+      return value;
+    }
+  }
+
+  HADESMEM_DETAIL_THROW_EXCEPTION(
+    Error{} << ErrorString{"Invalid or truncated pointer scan file."});
+}
+
+std::uint32_t const kPointerScanFileMagic = 0x53504D48; // 'HMPS'
+std::uint32_t const kPointerScanFileVersion = 1;
+}
+
+// Finds chains of pointers from static addresses (i.e. in a module) to a
+// target address, which can then be used to find the target again in a later
+// instance of the process. Building the reverse pointer map reads all of the
+// process's readable memory, so the scanner should be kept around for multiple
+// targets. The map is a snapshot, so it doesn't see changes made afterwards.
+class PointerScanner
+{
+public:
+  explicit PointerScanner(Process const& process,
+                          PointerScanOptions const& options =
+                            PointerScanOptions{})
+    : options_(options)
+  {
+    std::vector<PointerScanRegion> regions;
+    MEMORY_BASIC_INFORMATION mbi{};
+    for (std::uintptr_t address = 0;
+         detail::TryQuery(process, reinterpret_cast<void*>(address), &mbi);)
+    {
+      auto const base = reinterpret_cast<std::uintptr_t>(mbi.BaseAddress);
+      if (base + mbi.RegionSize <= address)
+      {
+        break;
+      }
+
+      if (detail::CanRead(mbi) && !detail::IsBadProtect(mbi))
+      {
+        // Merge adjacent regions so pointers straddling the boundary are
+        // still found.
+        if (!regions.empty() &&
+            regions.back().base + regions.back().size == base)
+        {
+          regions.back().size += mbi.RegionSize;
+        }
+        else
+        {
+          regions.push_back(PointerScanRegion{base, mbi.RegionSize});
+        }
+      }
+
+      address = base + mbi.RegionSize;
+    }
+
+    ModuleList const module_list{process};
+    for (auto const& module : module_list)
+    {
+      modules_.push_back(
+        PointerScanModule{module.GetName(),
+                          reinterpret_cast<std::uintptr_t>(module.GetHandle()),
+                          module.GetSize()});
+    }
+
+    auto const read = [&](std::uintptr_t address, void* buf, std::size_t len) {
+      try
+      {
+        detail::ReadUnchecked(
+          process, reinterpret_cast<void*>(address), buf, len);
+        return true;
+      }
+      catch (std::exception const& /*e*/)
+      {
+        return false;
+      }
+    };
+    Init(regions, read);
+  }
+
+  explicit PointerScanner(Process const&& process,
+                          PointerScanOptions const& options =
+                            PointerScanOptions{}) = delete;
+
+  // For scanning a memory image other than a live process (e.g. a dump, or a
+  // synthetic image in tests). read(address, buffer, len) should return false
+  // if the memory can't be read.
+  template <typename ReadFn>
+  PointerScanner(std::vector<PointerScanRegion> regions,
+                 std::vector<PointerScanModule> modules,
+                 ReadFn const& read,
+                 PointerScanOptions const& options = PointerScanOptions{})
+    : options_(options), modules_(std::move(modules))
+  {
+    std::sort(std::begin(regions),
+              std::end(regions),
+              [](PointerScanRegion const& lhs, PointerScanRegion const& rhs) {
+                return lhs.base < rhs.base;
+              });
+    Init(regions, read);
+  }
+
+  PointerScanResults Scan(void const* target) const
+  {
+    PointerScanResults results;
+    for (auto const& module : modules_)
+    {
+      results.modules.push_back(module.name);
+    }
+
+    std::vector<std::uintptr_t> offsets;
+    std::unordered_map<std::uintptr_t, std::size_t> dead;
+    Search(reinterpret_cast<std::uintptr_t>(target), &offsets, &dead, &results);
+    return results;
+  }
+
+  std::size_t GetNumPointers() const noexcept
+  {
+    return map_.GetSize();
+  }
+
+private:
+  template <typename ReadFn>
+  void Init(std::vector<PointerScanRegion> const& regions, ReadFn const& read)
+  {
+    map_ = detail::PointerMap{regions, read, options_};
+
+    for (std::size_t i = 0; i < modules_.size(); ++i)
+    {
+      module_order_.push_back(static_cast<std::uint32_t>(i));
+    }
+
+    std::sort(std::begin(module_order_),
+              std::end(module_order_),
+              [&](std::uint32_t lhs, std::uint32_t rhs) {
+                return modules_[lhs].base < modules_[rhs].base;
+              });
+  }
+
+  // Returns the index of the module containing the address, or -1.
+  std::uint32_t FindModule(std::uintptr_t address) const noexcept
+  {
+    auto const iter = std::upper_bound(
+      std::begin(module_order_),
+      std::end(module_order_),
+      address,
+      [&](std::uintptr_t lhs, std::uint32_t rhs) {
+        return lhs < modules_[rhs].base;
+      });
+    if (iter == std::begin(module_order_))
+    {
+      return static_cast<std::uint32_t>(-1);
+    }
+
+    PointerScanModule const& module = modules_[*std::prev(iter)];
+    return address - module.base < module.size
+             ? *std::prev(iter)
+             : static_cast<std::uint32_t>(-1);
+  }
+
+  // Depth first search backwards from the target. offsets holds the path so
+  // far, innermost first. Addresses which have already been searched to at
+  // least the remaining depth without finding anything are remembered in
+  // dead, which is what keeps the search from exploding on densely linked
+  // memory (e.g. heap free lists). Returns whether any paths were found.
+  bool Search(std::uintptr_t address,
+              std::vector<std::uintptr_t>* offsets,
+              std::unordered_map<std::uintptr_t, std::size_t>* dead,
+              PointerScanResults* results) const
+  {
+    std::size_t const remaining = options_.max_depth - offsets->size();
+    auto const dead_iter = dead->find(address);
+    if (dead_iter != std::end(*dead) && dead_iter->second >= remaining)
+    {
+      return false;
+    }
+
+    std::uintptr_t const lo =
+      address > options_.max_offset ? address - options_.max_offset : 0;
+    auto const range = map_.FindRange(lo, address);
+    bool found = false;
+    for (auto entry = range.first; entry != range.second; ++entry)
+    {
+      if (results->paths.size() >= options_.max_results)
+      {
+        // Truncated, so we can't say anything about what's dead.
+        return true;
+      }
+
+      offsets->push_back(address - entry->value);
+
+      std::uint32_t const module = FindModule(entry->source);
+      if (module != static_cast<std::uint32_t>(-1))
+      {
+        results->paths.push_back(PointerPath{
+          module,
+          entry->source - modules_[module].base,
+          std::vector<std::uintptr_t>(offsets->rbegin(), offsets->rend())});
+        found = true;
+      }
+      else if (offsets->size() < options_.max_depth)
+      {
+        found = Search(entry->source, offsets, dead, results) || found;
+      }
+
+      offsets->pop_back();
+    }
+
+    if (!found)
+    {
+      (*dead)[address] = remaining;
+    }
+
+    return found;
+  }
+
+  PointerScanOptions options_;
+  std::vector<PointerScanModule> modules_;
+  std::vector<std::uint32_t> module_order_;
+  detail::PointerMap map_;
+};
+
+// Follows a path in a (possibly different instance of the) process. Returns
+// null if the module isn't loaded or any of the pointers can't be read.
+inline void* ResolvePointerPath(Process const& process,
+                                ModuleIndex const& modules,
+                                PointerScanResults const& results,
+                                PointerPath const& path)
+{
+  if (path.module >= results.modules.size())
+  {
+    return nullptr;
+  }
+
+  Module const* const module = modules.Find(results.modules[path.module]);
+  if (!module)
+  {
+    return nullptr;
+  }
+
+  auto address =
+    reinterpret_cast<std::uintptr_t>(module->GetHandle()) + path.base_offset;
+  for (auto const offset : path.offsets)
+  {
+    std::uintptr_t value = 0;
+    try
+    {
+      detail::ReadUnchecked(
+        process, reinterpret_cast<void*>(address), &value, sizeof(value));
+    }
+    catch (std::exception const& /*e*/)
+    {
+      return nullptr;
+    }
+
+    address = value + offset;
+  }
+
+  return reinterpret_cast<void*>(address);
+}
+
+// Re-validates results (e.g. loaded from a file saved by a previous instance
+// of the process), keeping only the paths which still lead to the target.
+inline PointerScanResults FilterPointerPaths(Process const& process,
+                                             PointerScanResults const& results,
+                                             void const* target)
+{
+  ModuleIndex const modules{process};
+  PointerScanResults filtered;
+  filtered.modules = results.modules;
+  for (auto const& path : results.paths)
+  {
+    if (ResolvePointerPath(process, modules, results, path) == target)
+    {
+      filtered.paths.push_back(path);
+    }
+  }
+
+  return filtered;
+}
+
+inline void SavePointerScanResults(std::wstring const& path,
+                                   PointerScanResults const& results)
+{
+  std::vector<char> buf;
+  detail::AppendVarint(detail::kPointerScanFileMagic, &buf);
+  detail::AppendVarint(detail::kPointerScanFileVersion, &buf);
+  detail::AppendVarint(sizeof(std::uintptr_t), &buf);
+
+  detail::AppendVarint(results.modules.size(), &buf);
+  for (auto const& name : results.modules)
+  {
+    detail::AppendVarint(name.size(), &buf);
+    for (auto const c : name)
+    {
+      detail::AppendVarint(static_cast<std::uint16_t>(c), &buf);
+    }
+  }
+
+  detail::AppendVarint(results.paths.size(), &buf);
+  for (auto const& p : results.paths)
+  {
+    detail::AppendVarint(p.module, &buf);
+    detail::AppendVarint(p.base_offset, &buf);
+    detail::AppendVarint(p.offsets.size(), &buf);
+    for (auto const offset : p.offsets)
+    {
+      detail::AppendVarint(offset, &buf);
+    }
+  }
+
+  detail::BufferToFile(
+    path, buf.data(), static_cast<std::streamsize>(buf.size()));
+}
+
+inline PointerScanResults LoadPointerScanResults(std::wstring const& path)
+{
+  std::vector<char> const buf = detail::FileToBuffer(path);
+  std::size_t pos = 0;
+  auto const read = [&]() { return detail::ReadVarint(buf, &pos); };
+  auto const read_size = [&]() {
+    std::uint64_t const size = read();
+    // Every element takes at least a byte, which stops a corrupt size from
+    // turning into a huge allocation.
+    if (size > buf.size() - pos)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid or truncated pointer scan file."});
+    }
+
+    return static_cast<std::size_t>(size);
+  };
+
+  if (read() != detail::kPointerScanFileMagic ||
+      read() != detail::kPointerScanFileVersion)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"Unknown pointer scan file format or version."});
+  }
+
+  if (read() != sizeof(std::uintptr_t))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"Pointer scan file is for a different "
+                             "architecture."});
+  }
+
+  PointerScanResults results;
+  results.modules.resize(read_size());
+  for (auto& name : results.modules)
+  {
+    name.resize(read_size());
+    for (auto& c : name)
+    {
+      c = static_cast<wchar_t>(read());
+    }
+  }
+
+  results.paths.resize(read_size());
+  for (auto& p : results.paths)
+  {
+    p.module = static_cast<std::uint32_t>(read());
+    p.base_offset = static_cast<std::uintptr_t>(read());
+    p.offsets.resize(read_size());
+    for (auto& offset : p.offsets)
+    {
+      offset = static_cast<std::uintptr_t>(read());
+    }
+
+    if (p.module >= results.modules.size())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid or truncated pointer scan file."});
+    }
+  }
+
+  return results;
+}
+}
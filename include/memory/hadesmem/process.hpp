@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <ostream>
 #include <string>
@@ -13,6 +14,8 @@
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/read_cache.hpp>
+#include <hadesmem/detail/region_map.hpp>
 #include <hadesmem/detail/smart_handle.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/winapi.hpp>
@@ -37,6 +40,12 @@
 
 namespace hadesmem
 {
+namespace detail
+{
+class CallStubCache;
+class TrampolineHeap;
+}
+
 class Process
 {
 public:
@@ -47,7 +56,11 @@ public:
 
   Process(Process const& other)
     : handle_{DuplicateHandle(other.id_, other.handle_.GetHandle())},
-      id_{other.id_}
+      id_{other.id_},
+      read_cache_{other.read_cache_},
+      region_map_{other.region_map_},
+      call_stub_cache_{std::atomic_load(&other.call_stub_cache_)},
+      trampoline_heap_{std::atomic_load(&other.trampoline_heap_)}
   {
   }
 
@@ -60,7 +73,13 @@ public:
   }
 
   Process(Process&& other) noexcept : handle_{std::move(other.handle_)},
-                                      id_{other.id_}
+                                      id_{other.id_},
+                                      read_cache_{std::move(other.read_cache_)},
+                                      region_map_{std::move(other.region_map_)},
+                                      call_stub_cache_{
+                                        std::move(other.call_stub_cache_)},
+                                      trampoline_heap_{
+                                        std::move(other.trampoline_heap_)}
   {
     other.id_ = 0;
   }
@@ -71,6 +90,10 @@ public:
 
     handle_ = std::move(other.handle_);
     id_ = other.id_;
+    read_cache_ = std::move(other.read_cache_);
+    region_map_ = std::move(other.region_map_);
+    call_stub_cache_ = std::move(other.call_stub_cache_);
+    trampoline_heap_ = std::move(other.trampoline_heap_);
 
     other.id_ = 0;
 
@@ -92,6 +115,175 @@ public:
     return handle_.GetHandle();
   }
 
+  // Opt-in page cache for Read/ReadVector/etc. Cached pages are only
+  // invalidated by our own Write/Protect/Free, so this should only be enabled
+  // when the memory being read is known not to change underneath us (e.g.
+  // parsing the headers of a loaded module), or when the caller invalidates
+  // it explicitly. Copies of a Process share the same cache.
+  void EnableReadCache(
+    std::size_t max_pages = detail::ReadCache::kDefaultMaxPages)
+  {
+    read_cache_ = std::make_shared<detail::ReadCache>(
+      max_pages, detail::GetSystemInfo().dwPageSize);
+  }
+
+  void DisableReadCache() noexcept
+  {
+    read_cache_.reset();
+  }
+
+  bool IsReadCacheEnabled() const noexcept
+  {
+    return !!read_cache_;
+  }
+
+  void InvalidateReadCache() const
+  {
+    if (read_cache_)
+    {
+      read_cache_->Invalidate();
+    }
+  }
+
+  void InvalidateReadCache(void const* address, std::size_t len) const
+  {
+    if (read_cache_)
+    {
+      read_cache_->Invalidate(address, len);
+    }
+  }
+
+  ReadCacheStats GetReadCacheStats() const
+  {
+    return read_cache_ ? read_cache_->GetStats() : ReadCacheStats{};
+  }
+
+  detail::ReadCache* GetReadCache() const noexcept
+  {
+    return read_cache_.get();
+  }
+
+  // Opt-in snapshot of the address space, used instead of VirtualQueryEx by
+  // Read/Write/Protect/RegionList/etc. The whole address space is captured up
+  // front. Like the read cache it is only invalidated by our own
+  // Alloc/Free/Protect, so anything else which changes the address space
+  // (e.g. the target loading a module) needs a refresh. Invalidated parts are
+  // queried again as they're needed. Copies of a Process share the same map.
+  void EnableRegionMap()
+  {
+    auto region_map =
+      std::make_shared<detail::RegionMap>(detail::GetSystemInfo().dwPageSize);
+    region_map->Capture(detail::VirtualQueryFn{GetHandle()});
+    region_map_ = std::move(region_map);
+  }
+
+  void DisableRegionMap() noexcept
+  {
+    region_map_.reset();
+  }
+
+  bool IsRegionMapEnabled() const noexcept
+  {
+    return !!region_map_;
+  }
+
+  void RefreshRegionMap() const
+  {
+    if (region_map_)
+    {
+      region_map_->Capture(detail::VirtualQueryFn{GetHandle()});
+    }
+  }
+
+  void RefreshRegionMap(void const* address, std::size_t len) const
+  {
+    if (region_map_)
+    {
+      region_map_->Refresh(address, len, detail::VirtualQueryFn{GetHandle()});
+    }
+  }
+
+  void InvalidateRegionMap(void const* address, std::size_t len) const
+  {
+    if (region_map_)
+    {
+      region_map_->Invalidate(address, len);
+    }
+  }
+
+  void InvalidateRegionMapAllocation(void const* allocation_base) const
+  {
+    if (region_map_)
+    {
+      region_map_->InvalidateAllocation(allocation_base);
+    }
+  }
+
+  detail::RegionMap* GetRegionMap() const noexcept
+  {
+    return region_map_.get();
+  }
+
+  // Stubs generated by Call/CallMulti, which are reused for calls with the
+  // same signature. Created on first use (see detail::GetCallStubCache).
+  // Copies of a Process share the same cache, and the stubs are freed along
+  // with the last of them.
+  std::shared_ptr<detail::CallStubCache> GetCallStubCache() const noexcept
+  {
+    return std::atomic_load(&call_stub_cache_);
+  }
+
+  // Only sets the cache if there isn't one yet. Returns whichever is in use.
+  std::shared_ptr<detail::CallStubCache>
+    SetCallStubCache(std::shared_ptr<detail::CallStubCache> const& cache) const
+    noexcept
+  {
+    std::shared_ptr<detail::CallStubCache> expected;
+    return std::atomic_compare_exchange_strong(
+             &call_stub_cache_, &expected, cache)
+             ? cache
+             : expected;
+  }
+
+  // Drops this Process's reference to the cache, so later calls through it
+  // generate new stubs. The old ones are freed once no copy (or call in
+  // progress) still uses them.
+  void FlushCallStubCache() const noexcept
+  {
+    std::atomic_store(&call_stub_cache_,
+                      std::shared_ptr<detail::CallStubCache>{});
+  }
+
+  // Heap which trampolines (and other small blocks of code used by the
+  // patchers) are allocated from. Created on first use (see
+  // detail::GetTrampolineHeap). Copies of a Process share the same heap, and
+  // it's freed once the last of them (and the last block allocated from it)
+  // goes away.
+  std::shared_ptr<detail::TrampolineHeap> GetTrampolineHeap() const noexcept
+  {
+    return std::atomic_load(&trampoline_heap_);
+  }
+
+  // Only sets the heap if there isn't one yet. Returns whichever is in use.
+  std::shared_ptr<detail::TrampolineHeap>
+    SetTrampolineHeap(std::shared_ptr<detail::TrampolineHeap> const& heap) const
+    noexcept
+  {
+    std::shared_ptr<detail::TrampolineHeap> expected;
+    return std::atomic_compare_exchange_strong(
+             &trampoline_heap_, &expected, heap)
+             ? heap
+             : expected;
+  }
+
+  // Drops this Process's reference to the heap, so later allocations through
+  // it come from a new one. Blocks already allocated keep the old heap alive.
+  void FlushTrampolineHeap() const noexcept
+  {
+    std::atomic_store(&trampoline_heap_,
+                      std::shared_ptr<detail::TrampolineHeap>{});
+  }
+
   void Cleanup()
   {
     if (id_ != ::GetCurrentProcessId())
@@ -104,6 +296,10 @@ public:
     }
 
     id_ = 0;
+    read_cache_.reset();
+    region_map_.reset();
+    FlushCallStubCache();
+    FlushTrampolineHeap();
   }
 
 private:
@@ -155,6 +351,10 @@ private:
 
   detail::SmartHandle handle_;
   DWORD id_;
+  std::shared_ptr<detail::ReadCache> read_cache_;
+  std::shared_ptr<detail::RegionMap> region_map_;
+  mutable std::shared_ptr<detail::CallStubCache> call_stub_cache_;
+  mutable std::shared_ptr<detail::TrampolineHeap> trampoline_heap_;
 };
 
 inline bool operator==(Process const& lhs, Process const& rhs) noexcept
@@ -57,6 +57,9 @@ inline bool IsBadProtect(Process const& process, LPCVOID address)
 inline DWORD Protect(Process const& process, LPVOID address, DWORD protect)
 {
   MEMORY_BASIC_INFORMATION const mbi = detail::Query(process, address);
-  return detail::Protect(process, mbi, protect);
+  process.InvalidateReadCache(mbi.BaseAddress, mbi.RegionSize);
+  DWORD const old_protect = detail::Protect(process, mbi, protect);
+  process.InvalidateRegionMap(mbi.BaseAddress, mbi.RegionSize);
+  return old_protect;
 }
 }
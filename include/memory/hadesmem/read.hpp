@@ -3,8 +3,10 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <iterator>
 #include <memory>
@@ -97,6 +99,51 @@ void ReadStringEx(Process const& process,
 
   HADESMEM_DETAIL_ASSERT(chunk_len != 0);
 
+  // When the page cache is enabled read a page at a time through it instead,
+  // so repeated string reads (e.g. import/export names) hit the cache rather
+  // than querying and reading the remote process every time.
+  if (detail::ReadCache* const cache = process.GetReadCache())
+  {
+    std::size_t const page_size = cache->GetPageSize();
+    std::vector<T> buf;
+    for (;;)
+    {
+      auto const cur = static_cast<std::uint8_t*>(address);
+      auto end = reinterpret_cast<std::uint8_t*>(cache->GetPageBase(address) +
+                                                 page_size);
+      // Always read at least one character so a misaligned string which
+      // straddles a page boundary still makes progress.
+      if (static_cast<std::size_t>(end - cur) < sizeof(T))
+      {
+        end = cur + sizeof(T);
+      }
+
+      if (upper_bound)
+      {
+        end = (std::min)(end, static_cast<std::uint8_t*>(upper_bound));
+      }
+
+      std::size_t const buf_len =
+        end > cur ? static_cast<std::size_t>(end - cur) / sizeof(T) : 0;
+      if (!buf_len)
+      {
+        return;
+      }
+
+      buf.resize(buf_len);
+      detail::ReadImpl(process, address, buf.data(), buf_len * sizeof(T));
+
+      auto const iter = std::find(std::begin(buf), std::end(buf), T());
+      std::copy(std::begin(buf), iter, data);
+
+      address = cur + buf_len * sizeof(T);
+      if (iter != std::end(buf) || address == upper_bound)
+      {
+        return;
+      }
+    }
+  }
+
   for (;;)
   {
     detail::ProtectGuard protect_guard{
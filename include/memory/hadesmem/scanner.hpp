@@ -3,26 +3,754 @@
 
 #pragma once
 
-// TODO: Implement this.
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+#include <intrin.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/optional.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/detail/read_impl.hpp>
+#include <hadesmem/detail/scan_kernel.hpp>
+#include <hadesmem/detail/task_scheduler.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+
 // TODO: Use process reflection on Windows 7 + for scanning while process is suspended. (RtlCreateProcessReflection)
 //  Requires extra privileges though Make it optional?
 //  There's newer and better APIs available on W8+. PSS? ProcDump supports them all I think...
 //  PSS doesn't support large pages, so can't be used against e.g.SQL.
 // TODO: Use a file view with a small memory cache rather than consuming large amounts of RAM.
-// TODO: Multi-threaded scanning options.
+//  Mainly a problem for unknown value scans, which keep a copy of everything scanned.
 // TODO: Wildcard support for vector/string scanning.
 // TODO: Regex support for string scanning.
-// TODO: Memory protection filters(read, write, exec).
-// TODO: Memory type filters(private, mapped, image).
 // TODO: Support pausing target while scanning.
 // TODO: Support injected scanning.
-// TODO: Configurable scan buffer size.
-// TODO: Pointer scanner.
-// TODO: Unknown value scan.
-// TODO: Progressive scan filtering based on either value or criteria.
 // TODO: Scan history and undo.
 // TODO: Support case insensitive string scanning.
 // TODO: Binary scanning.
 // TODO: Custom scanning via user supplied predicate.
-// TODO: Improved floating point support (configurable or 'smart' epsilon).
+// TODO: 'Smart' floating point epsilon (e.g. based on the magnitude of the value).
 // TODO: Group search support.
+
+namespace hadesmem
+{
+struct ScannerOptions
+{
+  // Maximum number of bytes read by each ReadProcessMemory call. Results are
+  // also stored in blocks of this size.
+  std::size_t chunk_size = 0x100000;
+  // Distance between candidate addresses. Zero is sizeof(T). Can be less than
+  // sizeof(T) to find unaligned (and overlapping) values.
+  std::size_t alignment = 0;
+  bool writable_only = true;
+  bool skip_executable = false;
+  // Any combination of MEM_PRIVATE, MEM_MAPPED and MEM_IMAGE.
+  DWORD mem_types = MEM_PRIVATE | MEM_MAPPED | MEM_IMAGE;
+  // Range to scan. A null end is the end of the address space.
+  void const* start = nullptr;
+  void const* end = nullptr;
+  // Zero is one thread per core. One scans on the calling thread.
+  std::size_t num_threads = 0;
+  // Tolerance for floating point equality. Ignored for integers.
+  double epsilon = 0.0;
+  // Maximum number of bytes an unknown value scan may keep a copy of. The
+  // scan fails up front if the memory to be scanned is larger. Zero is no
+  // limit.
+  std::size_t max_snapshot_size = sizeof(void*) == 8 ? 0x40000000 : 0x10000000;
+};
+
+namespace detail
+{
+// Compact set of candidate addresses within one chunk of memory, along with
+// their values as of the last scan. Candidates are 'slots' stride bytes apart
+// starting at base. Depending on how dense the set is the slots are stored as
+// a bitmap, as an array of deltas between consecutive slots (LEB128 encoded),
+// or not at all when every slot is a candidate (in which case the values are
+// the raw bytes of the whole chunk, as after an unknown value scan).
+class ScanResultBlock
+{
+public:
+  enum class Encoding
+  {
+    kAll,
+    kBitmap,
+    kDelta
+  };
+
+  static ScanResultBlock MakeAll(std::uintptr_t base,
+                                 std::size_t num_slots,
+                                 std::size_t stride,
+                                 std::vector<std::uint8_t>&& data)
+  {
+    ScanResultBlock block{base, num_slots, stride, 0};
+    block.encoding_ = Encoding::kAll;
+    block.count_ = num_slots;
+    block.values_ = std::move(data);
+    return block;
+  }
+
+  // values holds the value (value_size bytes) of each set bit, in order.
+  static ScanResultBlock MakeSparse(std::uintptr_t base,
+                                    std::size_t num_slots,
+                                    std::size_t stride,
+                                    std::size_t value_size,
+                                    std::uint64_t const* bits,
+                                    std::size_t count,
+                                    std::vector<std::uint8_t>&& values)
+  {
+    HADESMEM_DETAIL_ASSERT(values.size() == count * value_size);
+
+    ScanResultBlock block{base, num_slots, stride, value_size};
+    block.count_ = count;
+    block.values_ = std::move(values);
+    block.values_.shrink_to_fit();
+
+    std::size_t const bitmap_size = (num_slots + 31) / 32 * 4;
+    std::vector<std::uint8_t> deltas;
+    std::size_t prev = 0;
+    for (std::size_t i = 0; i < num_slots && deltas.size() < bitmap_size;)
+    {
+      std::uint64_t const word = bits[i / 64];
+      if (!word)
+      {
+        i += 64;
+        continue;
+      }
+
+      if (word & (std::uint64_t{1} << (i % 64)))
+      {
+        AppendDelta(i - prev, &deltas);
+        prev = i;
+      }
+
+      ++i;
+    }
+
+    if (deltas.size() < bitmap_size)
+    {
+      block.encoding_ = Encoding::kDelta;
+      block.index_ = std::move(deltas);
+      block.index_.shrink_to_fit();
+    }
+    else
+    {
+      block.encoding_ = Encoding::kBitmap;
+      block.index_.resize(bitmap_size);
+      std::memcpy(block.index_.data(), bits, bitmap_size);
+    }
+
+    return block;
+  }
+
+  std::uintptr_t GetBase() const noexcept
+  {
+    return base_;
+  }
+
+  std::uintptr_t GetAddress(std::size_t slot) const noexcept
+  {
+    return base_ + slot * stride_;
+  }
+
+  std::size_t GetNumSlots() const noexcept
+  {
+    return num_slots_;
+  }
+
+  std::size_t GetStride() const noexcept
+  {
+    return stride_;
+  }
+
+  std::size_t GetCount() const noexcept
+  {
+    return count_;
+  }
+
+  Encoding GetEncoding() const noexcept
+  {
+    return encoding_;
+  }
+
+  // Only valid for Encoding::kAll.
+  std::vector<std::uint8_t> const& GetData() const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(encoding_ == Encoding::kAll);
+    return values_;
+  }
+
+  std::size_t GetMemoryUsage() const noexcept
+  {
+    return sizeof(*this) + index_.capacity() + values_.capacity();
+  }
+
+  // Calls f(slot, value) for each candidate in slot order, where value points
+  // to the bytes of the value from the last scan.
+  template <typename F> void ForEach(F f) const
+  {
+    switch (encoding_)
+    {
+    case Encoding::kAll:
+      for (std::size_t i = 0; i < num_slots_; ++i)
+      {
+        f(i, values_.data() + i * stride_);
+      }
+      break;
+
+    case Encoding::kBitmap:
+    {
+      std::size_t n = 0;
+      for (std::size_t i = 0; i < index_.size(); i += 4)
+      {
+        std::uint32_t word;
+        std::memcpy(&word, index_.data() + i, sizeof(word));
+        for (unsigned long bit = 0; ::_BitScanForward(&bit, word);
+             word &= word - 1)
+        {
+          f(i * 8 + bit, values_.data() + n++ * value_size_);
+        }
+      }
+      break;
+    }
+
+    case Encoding::kDelta:
+    {
+      std::size_t slot = 0;
+      std::size_t n = 0;
+      for (std::size_t i = 0; i < index_.size();)
+      {
+        slot += ReadDelta(index_, &i);
+        f(slot, values_.data() + n++ * value_size_);
+      }
+      break;
+    }
+    }
+  }
+
+private:
+  ScanResultBlock(std::uintptr_t base,
+                  std::size_t num_slots,
+                  std::size_t stride,
+                  std::size_t value_size) noexcept
+    : base_{base},
+      num_slots_{num_slots},
+      stride_{stride},
+      value_size_{value_size}
+  {
+  }
+
+  static void AppendDelta(std::size_t delta, std::vector<std::uint8_t>* out)
+  {
+    for (; delta >= 0x80; delta >>= 7)
+    {
+      out->push_back(static_cast<std::uint8_t>(delta | 0x80));
+    }
+
+    out->push_back(static_cast<std::uint8_t>(delta));
+  }
+
+  static std::size_t ReadDelta(std::vector<std::uint8_t> const& in,
+                               std::size_t* pos) noexcept
+  {
+    std::size_t delta = 0;
+    for (unsigned int shift = 0;; shift += 7)
+    {
+      std::uint8_t const b = in[(*pos)++];
+      delta |= static_cast<std::size_t>(b & 0x7F) << shift;
+      if (!(b & 0x80))
+      {
+        return delta;
+      }
+    }
+  }
+
+  std::uintptr_t base_;
+  std::size_t num_slots_;
+  std::size_t stride_;
+  std::size_t value_size_;
+  std::size_t count_{};
+  Encoding encoding_{Encoding::kAll};
+  std::vector<std::uint8_t> index_;
+  std::vector<std::uint8_t> values_;
+};
+
+inline bool IsScannable(MEMORY_BASIC_INFORMATION const& mbi,
+                        ScannerOptions const& options) noexcept
+{
+  return CanRead(mbi) && !IsBadProtect(mbi) &&
+         !!(mbi.Type & options.mem_types) &&
+         (!options.writable_only || CanWrite(mbi)) &&
+         (!options.skip_executable || !CanExecute(mbi));
+}
+}
+
+// Scans memory for values of type T (any integer or floating point type),
+// then narrows the results down with further scans. Each scan after the first
+// only reads the memory around the remaining candidates, and can compare
+// against the values seen by the previous scan (e.g. ScanCompare::kChanged).
+// Results are stored compactly (see detail::ScanResultBlock), though note an
+// unknown value scan has to keep a copy of all the memory it scanned (up to
+// ScannerOptions::max_snapshot_size).
+// Memory which can't be read any more (e.g. it was freed) is dropped from the
+// results rather than failing the scan.
+template <typename T> class Scanner
+{
+public:
+  static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                "Scanner only supports integer and floating point types.");
+
+  explicit Scanner(Process const& process,
+                   ScannerOptions const& options = ScannerOptions{})
+    : process_{&process},
+      options_(options),
+      stride_{options.alignment ? options.alignment : sizeof(T)}
+  {
+    // Chunks start on a stride boundary so slots line up across chunks.
+    chunk_size_ = (std::max)(options.chunk_size / stride_, std::size_t{1}) *
+                  stride_;
+
+    std::size_t num_threads = options.num_threads;
+    if (!num_threads)
+    {
+      num_threads = std::thread::hardware_concurrency();
+    }
+
+    if (num_threads > 1)
+    {
+      // Bound the number of queued chunks, as each holds a read buffer while
+      // it runs and a result block after.
+      scheduler_ = std::make_unique<detail::TaskScheduler>(num_threads,
+                                                           num_threads * 4);
+    }
+  }
+
+  explicit Scanner(Process const&& process,
+                   ScannerOptions const& options = ScannerOptions{}) = delete;
+
+  // Starts a new scan, discarding any previous results. Relative compares
+  // aren't allowed, as there is nothing to compare against yet.
+  void FirstScan(ScanCompare compare, T value = T(), T value2 = T())
+  {
+    if (detail::IsRelativeScanCompare(compare))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Relative compare requires a previous scan."});
+    }
+
+    Reset();
+
+    struct Chunk
+    {
+      std::uintptr_t beg;
+      std::size_t len;
+    };
+
+    std::vector<Chunk> chunks;
+    auto const start = reinterpret_cast<std::uintptr_t>(options_.start);
+    auto const end = options_.end
+                       ? reinterpret_cast<std::uintptr_t>(options_.end)
+                       : (std::numeric_limits<std::uintptr_t>::max)();
+    MEMORY_BASIC_INFORMATION mbi{};
+    for (std::uintptr_t address = start;
+         address < end &&
+         detail::TryQuery(*process_, reinterpret_cast<void*>(address), &mbi);)
+    {
+      auto const region_beg = reinterpret_cast<std::uintptr_t>(mbi.BaseAddress);
+      auto const region_end = region_beg + mbi.RegionSize;
+      if (region_end <= address)
+      {
+        break;
+      }
+
+      if (detail::IsScannable(mbi, options_))
+      {
+        std::uintptr_t const beg =
+          ((std::max)(region_beg, start) + stride_ - 1) / stride_ * stride_;
+        std::uintptr_t const scan_end = (std::min)(region_end, end);
+        for (std::uintptr_t c = beg; c < scan_end && scan_end - c >= sizeof(T);
+             c += chunk_size_)
+        {
+          // Read past the end of the chunk (but not the region) so values
+          // starting near the end of the chunk are complete.
+          std::size_t const len = static_cast<std::size_t>(
+            (std::min)(scan_end - c, chunk_size_ + sizeof(T) - 1));
+          chunks.emplace_back(Chunk{c, len});
+          if (scan_end - c <= chunk_size_)
+          {
+            break;
+          }
+        }
+      }
+
+      address = region_end;
+    }
+
+    if (compare == ScanCompare::kUnknown && options_.max_snapshot_size)
+    {
+      std::size_t snapshot_size = 0;
+      for (auto const& chunk : chunks)
+      {
+        snapshot_size += chunk.len;
+      }
+
+      if (snapshot_size > options_.max_snapshot_size)
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Unknown value scan exceeds the snapshot "
+                                 "size limit. Narrow the range to scan, or "
+                                 "raise ScannerOptions::max_snapshot_size."});
+      }
+    }
+
+    detail::ScanPredicate<T> const pred = MakePredicate(compare, value, value2);
+    std::vector<detail::Optional<detail::ScanResultBlock>> blocks(
+      chunks.size());
+    RunParallel(chunks.size(), [&](std::size_t i) {
+      blocks[i] = FirstScanChunk(chunks[i].beg, chunks[i].len, pred);
+    });
+
+    StoreBlocks(std::move(blocks));
+    has_scan_ = true;
+  }
+
+  // Filters the results of the previous scan.
+  void NextScan(ScanCompare compare, T value = T(), T value2 = T())
+  {
+    if (!has_scan_)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"NextScan requires a previous scan."});
+    }
+
+    detail::ScanPredicate<T> const pred = MakePredicate(compare, value, value2);
+    std::vector<detail::Optional<detail::ScanResultBlock>> blocks(
+      blocks_.size());
+    RunParallel(blocks_.size(), [&](std::size_t i) {
+      blocks[i] = NextScanBlock(blocks_[i], pred);
+    });
+
+    StoreBlocks(std::move(blocks));
+  }
+
+  void Reset()
+  {
+    blocks_.clear();
+    blocks_.shrink_to_fit();
+    count_ = 0;
+    has_scan_ = false;
+  }
+
+  std::size_t GetCount() const noexcept
+  {
+    return count_;
+  }
+
+  // Calls f(address, value) for each result in address order, where value is
+  // as of the last scan.
+  template <typename F> void ForEach(F f) const
+  {
+    for (auto const& block : blocks_)
+    {
+      block.ForEach([&](std::size_t slot, std::uint8_t const* data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        f(reinterpret_cast<void*>(block.GetAddress(slot)), value);
+      });
+    }
+  }
+
+  std::vector<void*> GetAddresses(
+    std::size_t max_count = (std::numeric_limits<std::size_t>::max)()) const
+  {
+    std::vector<void*> addresses;
+    addresses.reserve((std::min)(count_, max_count));
+    for (auto const& block : blocks_)
+    {
+      if (addresses.size() >= max_count)
+      {
+        break;
+      }
+
+      block.ForEach([&](std::size_t slot, std::uint8_t const* /*data*/) {
+        if (addresses.size() < max_count)
+        {
+          addresses.push_back(reinterpret_cast<void*>(block.GetAddress(slot)));
+        }
+      });
+    }
+
+    return addresses;
+  }
+
+  // Approximate number of bytes used to store the results.
+  std::size_t GetMemoryUsage() const noexcept
+  {
+    std::size_t usage = 0;
+    for (auto const& block : blocks_)
+    {
+      usage += block.GetMemoryUsage();
+    }
+
+    return usage;
+  }
+
+private:
+  // Candidates closer together than this are read with a single call.
+  static std::size_t const kMaxRescanGap = 0x1000;
+
+  detail::ScanPredicate<T> MakePredicate(ScanCompare compare,
+                                         T value,
+                                         T value2) const noexcept
+  {
+    return detail::ScanPredicate<T>{
+      compare, value, value2, static_cast<T>(options_.epsilon)};
+  }
+
+  template <typename F> void RunParallel(std::size_t count, F f)
+  {
+    if (!scheduler_ || count < 2)
+    {
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        f(i);
+      }
+
+      return;
+    }
+
+    detail::TaskGroup group{*scheduler_};
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      group.Run([&f, i]() { f(i); });
+    }
+
+    group.Wait();
+  }
+
+  bool TryRead(std::uintptr_t address, std::uint8_t* buf, std::size_t len) const
+  {
+    try
+    {
+      detail::ReadUnchecked(
+        *process_, reinterpret_cast<void*>(address), buf, len);
+      return true;
+    }
+    catch (std::exception const& /*e*/)
+    {
+      return false;
+    }
+  }
+
+  detail::Optional<detail::ScanResultBlock> FirstScanChunk(
+    std::uintptr_t beg,
+    std::size_t len,
+    detail::ScanPredicate<T> const& pred) const
+  {
+    std::vector<std::uint8_t> buf(len);
+    if (!TryRead(beg, buf.data(), len))
+    {
+      return {};
+    }
+
+    std::size_t const num_slots = (len - sizeof(T)) / stride_ + 1;
+    if (pred.compare == ScanCompare::kUnknown)
+    {
+      return detail::Optional<detail::ScanResultBlock>{
+        detail::ScanResultBlock::MakeAll(
+          beg, num_slots, stride_, std::move(buf))};
+    }
+
+    std::vector<std::uint64_t> bits((num_slots + 63) / 64);
+    std::size_t const count =
+      detail::ScanValues(buf.data(), num_slots, stride_, pred, bits.data());
+    if (!count)
+    {
+      return {};
+    }
+
+    std::vector<std::uint8_t> values;
+    values.reserve(count * sizeof(T));
+    for (std::size_t i = 0; i < num_slots; ++i)
+    {
+      if (bits[i / 64] & (std::uint64_t{1} << (i % 64)))
+      {
+        std::uint8_t const* const value = buf.data() + i * stride_;
+        values.insert(std::end(values), value, value + sizeof(T));
+      }
+    }
+
+    return detail::Optional<detail::ScanResultBlock>{
+      detail::ScanResultBlock::MakeSparse(beg,
+                                          num_slots,
+                                          stride_,
+                                          sizeof(T),
+                                          bits.data(),
+                                          count,
+                                          std::move(values))};
+  }
+
+  detail::Optional<detail::ScanResultBlock>
+    NextScanBlock(detail::ScanResultBlock const& block,
+                  detail::ScanPredicate<T> const& pred) const
+  {
+    std::size_t const num_slots = block.GetNumSlots();
+    std::vector<std::uint64_t> bits((num_slots + 63) / 64);
+    std::vector<std::uint8_t> values;
+    std::size_t count = 0;
+
+    auto const add_match = [&](std::size_t slot, std::uint8_t const* value) {
+      bits[slot / 64] |= std::uint64_t{1} << (slot % 64);
+      values.insert(std::end(values), value, value + sizeof(T));
+      ++count;
+    };
+
+    if (block.GetEncoding() == detail::ScanResultBlock::Encoding::kAll)
+    {
+      // Every slot is a candidate, so just re-read the whole chunk.
+      std::vector<std::uint8_t> const& prev_data = block.GetData();
+      std::vector<std::uint8_t> buf(prev_data.size());
+      if (!TryRead(block.GetBase(), buf.data(), buf.size()))
+      {
+        return {};
+      }
+
+      if (!detail::IsRelativeScanCompare(pred.compare))
+      {
+        count = detail::ScanValues(
+          buf.data(), num_slots, stride_, pred, bits.data());
+        if (pred.compare == ScanCompare::kUnknown)
+        {
+          return detail::Optional<detail::ScanResultBlock>{
+            detail::ScanResultBlock::MakeAll(
+              block.GetBase(), num_slots, stride_, std::move(buf))};
+        }
+
+        values.reserve(count * sizeof(T));
+        for (std::size_t i = 0; i < num_slots; ++i)
+        {
+          if (bits[i / 64] & (std::uint64_t{1} << (i % 64)))
+          {
+            std::uint8_t const* const value = buf.data() + i * stride_;
+            values.insert(std::end(values), value, value + sizeof(T));
+          }
+        }
+      }
+      else
+      {
+        for (std::size_t i = 0; i < num_slots; ++i)
+        {
+          T cur;
+          T prev;
+          std::memcpy(&cur, buf.data() + i * stride_, sizeof(T));
+          std::memcpy(&prev, prev_data.data() + i * stride_, sizeof(T));
+          if (detail::ScanMatch(pred, cur, prev))
+          {
+            add_match(i, buf.data() + i * stride_);
+          }
+        }
+      }
+    }
+    else
+    {
+      // Group nearby candidates into runs which are each read with a single
+      // call, so sparse results don't pay for reading the whole chunk and
+      // dense results don't pay for a call per candidate.
+      std::vector<std::pair<std::size_t, T>> run;
+      std::vector<std::uint8_t> buf;
+      auto const flush_run = [&]() {
+        std::size_t const first = run.front().first;
+        std::size_t const len =
+          (run.back().first - first) * stride_ + sizeof(T);
+        buf.resize(len);
+        if (TryRead(block.GetAddress(first), buf.data(), len))
+        {
+          for (auto const& candidate : run)
+          {
+            std::uint8_t const* const data =
+              buf.data() + (candidate.first - first) * stride_;
+            T cur;
+            std::memcpy(&cur, data, sizeof(T));
+            if (detail::ScanMatch(pred, cur, candidate.second))
+            {
+              add_match(candidate.first, data);
+            }
+          }
+        }
+
+        run.clear();
+      };
+
+      block.ForEach([&](std::size_t slot, std::uint8_t const* data) {
+        if (!run.empty() &&
+            ((slot - run.front().first) * stride_ + sizeof(T) > chunk_size_ ||
+             (slot - run.back().first) * stride_ > kMaxRescanGap))
+        {
+          flush_run();
+        }
+
+        T prev;
+        std::memcpy(&prev, data, sizeof(T));
+        run.emplace_back(slot, prev);
+      });
+
+      if (!run.empty())
+      {
+        flush_run();
+      }
+    }
+
+    if (!count)
+    {
+      return {};
+    }
+
+    return detail::Optional<detail::ScanResultBlock>{
+      detail::ScanResultBlock::MakeSparse(block.GetBase(),
+                                          num_slots,
+                                          stride_,
+                                          sizeof(T),
+                                          bits.data(),
+                                          count,
+                                          std::move(values))};
+  }
+
+  void StoreBlocks(
+    std::vector<detail::Optional<detail::ScanResultBlock>>&& blocks)
+  {
+    blocks_.clear();
+    count_ = 0;
+    for (auto& block : blocks)
+    {
+      if (block)
+      {
+        count_ += block->GetCount();
+        blocks_.emplace_back(std::move(*block));
+      }
+    }
+
+    blocks_.shrink_to_fit();
+  }
+
+  Process const* process_;
+  ScannerOptions options_;
+  std::size_t stride_;
+  std::size_t chunk_size_;
+  std::unique_ptr<detail::TaskScheduler> scheduler_;
+  std::vector<detail::ScanResultBlock> blocks_;
+  std::size_t count_{};
+  bool has_scan_{};
+};
+}
@@ -4,12 +4,14 @@
 #pragma once
 
 #include <algorithm>
-#include <set>
+#include <cstddef>
+#include <iterator>
 #include <sstream>
 #include <vector>
 
 #include <windows.h>
 #include <winnt.h>
+#include <tlhelp32.h>
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/assert.hpp>
@@ -234,52 +236,71 @@ class SuspendedProcess
 public:
   explicit SuspendedProcess(DWORD pid, DWORD retries = 5)
   {
+    // Once the first thread is suspended nothing can be allocated until we're
+    // done, as that thread may be holding the heap lock. So the snapshots are
+    // walked with the raw Toolhelp API (ThreadList and the wrappers in
+    // detail/toolhelp.hpp allocate), and room for every thread is reserved
+    // up front, with plenty of slack for threads created in the meantime.
+    // TODO: Failing to suspend a thread (e.g. because it has just exited)
+    // still allocates, as it's reported with an exception.
+    threads_.reserve(CountThreads(pid) * 2 + 16);
+
     // Multiple retries may be needed to plug a race condition
     // whereby after a thread snapshot is taken but before suspension
     // takes place, an existing thread launches a new thread which
     // would then be missed.
-    std::set<DWORD> tids;
+    DWORD const current_thread_id = ::GetCurrentThreadId();
     bool need_retry = false;
     do
     {
       need_retry = false;
 
-      ThreadList const threads(pid);
-      for (auto const& thread_entry : threads)
+      detail::SmartSnapHandle const snap{
+        ::CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0)};
+      if (!snap.IsValid())
       {
-        DWORD const current_thread_id = ::GetCurrentThreadId();
-        if (thread_entry.GetId() != current_thread_id)
+        DWORD const last_error = ::GetLastError();
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error() << ErrorString("CreateToolhelp32Snapshot failed.")
+                  << ErrorCodeWinLast(last_error));
+      }
+
+      THREADENTRY32 entry{};
+      entry.dwSize = static_cast<DWORD>(sizeof(entry));
+      for (BOOL more = ::Thread32First(snap.GetHandle(), &entry); more;
+           more = ::Thread32Next(snap.GetHandle(), &entry))
+      {
+        DWORD const thread_id = entry.th32ThreadID;
+        if (entry.th32OwnerProcessID != pid ||
+            thread_id == current_thread_id || IsSuspended(thread_id))
+        {
+          continue;
+        }
+
+        need_retry = true;
+
+        try
+        {
+          // Close potential race condition whereby after the snapshot is
+          // taken the thread could terminate and have its TID reused in
+          // a different process.
+          Thread const thread(thread_id);
+          VerifyPid(thread, pid);
+
+          // Should be safe (with the exception outlined above) to suspend
+          // the thread now, because we have a handle to the thread open,
+          // and we've verified it exists in the correct process.
+          threads_.emplace_back(thread_id);
+        }
+        catch (std::exception const& e)
         {
-          auto const inserted = tids.insert(thread_entry.GetId());
-          if (inserted.second)
-          {
-            need_retry = true;
-
-            try
-            {
-              // Close potential race condition whereby after the snapshot is
-              // taken the thread could terminate and have its TID reused in
-              // a different process.
-              Thread const thread(thread_entry.GetId());
-              VerifyPid(thread, pid);
-
-              // Should be safe (with the exception outlined above) to suspend
-              // the thread now, because we have a handle to the thread open,
-              // and we've verified it exists in the correct process.
-              threads_.emplace_back(thread_entry.GetId());
-            }
-            catch (std::exception const& e)
-            {
-              (void)e;
-              HADESMEM_DETAIL_TRACE_FORMAT_A(
-                "WARNING! Error while suspending thread. TID: [%lu]. Error: "
-                "[%s].",
-                thread_entry.GetId(),
-                boost::current_exception_diagnostic_information().c_str());
-              tids.erase(inserted.first);
-              continue;
-            }
-          }
+          (void)e;
+          HADESMEM_DETAIL_TRACE_FORMAT_A(
+            "WARNING! Error while suspending thread. TID: [%lu]. Error: "
+            "[%s].",
+            thread_id,
+            boost::current_exception_diagnostic_information().c_str());
+          continue;
         }
       }
     } while (need_retry && retries--);
@@ -308,7 +329,30 @@ public:
     return *this;
   }
 
+  // Every thread in the process other than the calling one, as of when the
+  // process was suspended.
+  std::vector<SuspendedThread> const& GetThreads() const noexcept
+  {
+    return threads_;
+  }
+
 private:
+  static std::size_t CountThreads(DWORD pid)
+  {
+    ThreadList const threads(pid);
+    return static_cast<std::size_t>(
+      std::distance(std::begin(threads), std::end(threads)));
+  }
+
+  bool IsSuspended(DWORD thread_id) const noexcept
+  {
+    return std::any_of(std::begin(threads_),
+                       std::end(threads_),
+                       [&](SuspendedThread const& thread) {
+                         return thread.GetId() == thread_id;
+                       });
+  }
+
   void VerifyPid(Thread const& thread, DWORD pid) const
   {
     DWORD const tid_pid = ::GetProcessIdOfThread(thread.GetHandle());
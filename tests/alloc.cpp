@@ -5,14 +5,18 @@
 #include <hadesmem/alloc.hpp>
 
 #include <cstdint>
+#include <memory>
+#include <set>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/trampoline_heap.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
 
@@ -86,9 +90,60 @@ void TestAllocator()
   BOOST_TEST_NE(test_str_1.str(), test_str_3.str());
 }
 
+void TestTrampolineHeap()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  auto const heap = hadesmem::detail::GetTrampolineHeap(process);
+  BOOST_TEST_EQ(heap, hadesmem::detail::GetTrampolineHeap(process));
+
+  // Copies share the heap, and flushing only drops the reference.
+  {
+    hadesmem::Process const process_copy{process};
+    BOOST_TEST_EQ(heap, hadesmem::detail::GetTrampolineHeap(process_copy));
+    process_copy.FlushTrampolineHeap();
+    auto const heap_new = hadesmem::detail::GetTrampolineHeap(process_copy);
+    BOOST_TEST_NE(heap, heap_new);
+    BOOST_TEST_EQ(heap, hadesmem::detail::GetTrampolineHeap(process));
+  }
+
+  void* const target = reinterpret_cast<void*>(&TestTrampolineHeap);
+  auto const num_granules = heap->GetNumGranules();
+
+  std::vector<std::unique_ptr<hadesmem::detail::TrampolineBlock>> blocks;
+  std::set<void*> bases;
+  for (std::size_t i = 0; i < 0x100; ++i)
+  {
+    blocks.emplace_back(
+      hadesmem::detail::AllocateTrampolineNear(process, target, 0x30));
+    BOOST_TEST_EQ(blocks.back()->GetSize(), 0x40UL);
+    BOOST_TEST(bases.insert(blocks.back()->GetBase()).second);
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+    auto const distance =
+      reinterpret_cast<std::intptr_t>(blocks.back()->GetBase()) -
+      reinterpret_cast<std::intptr_t>(target);
+    BOOST_TEST(distance < 0x7FFFFF00LL && distance > -0x7FFFFF00LL);
+#endif
+  }
+
+  // Everything should have come out of a single granule.
+  BOOST_TEST(heap->GetNumGranules() <= num_granules + 1);
+
+  void* const freed = blocks.front()->GetBase();
+  blocks.front().reset();
+  blocks.front() =
+    hadesmem::detail::AllocateTrampolineNear(process, target, 0x40);
+  BOOST_TEST_EQ(blocks.front()->GetBase(), freed);
+
+  BOOST_TEST_THROWS(
+    hadesmem::detail::AllocateTrampolineNear(process, target, 0),
+    hadesmem::Error);
+}
+
 int main()
 {
   TestAlloc();
   TestAllocator();
+  TestTrampolineHeap();
   return boost::report_errors();
 }
@@ -0,0 +1,247 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+// Benchmarks for the hot paths. These live in their own project rather than
+// in the tests, as they take a while to run and their output is only useful
+// when compared by hand between builds. Results are still checked, so a
+// broken fast path fails here too.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/call.hpp>
+#include <hadesmem/call_server.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/pattern_matcher.hpp>
+#include <hadesmem/find_pattern.hpp>
+#include <hadesmem/patcher.hpp>
+#include <hadesmem/process.hpp>
+
+namespace
+{
+std::uint8_t const* FindNaive(
+  std::vector<hadesmem::detail::PatternDataByte> const& needle,
+  std::uint8_t const* beg,
+  std::uint8_t const* end)
+{
+  auto const iter = std::search(
+    beg,
+    end,
+    std::begin(needle),
+    std::end(needle),
+    [](std::uint8_t h, hadesmem::detail::PatternDataByte const& n) {
+      return (h & n.mask) == n.data;
+    });
+  return iter == end ? nullptr : iter;
+}
+
+template <typename Func>
+void BenchmarkSearch(char const* name,
+                     std::uint8_t const* beg,
+                     std::uint8_t const* end,
+                     std::uint8_t const* expected,
+                     Func search)
+{
+  auto const start = std::chrono::high_resolution_clock::now();
+  std::uint8_t const* const result = search();
+  std::chrono::duration<double> const elapsed =
+    std::chrono::high_resolution_clock::now() - start;
+  BOOST_TEST_EQ(result, expected);
+  double const size_mb = static_cast<double>(end - beg) / (1024 * 1024);
+  std::cout << name << ": " << size_mb / elapsed.count() << " MB/s\n";
+}
+}
+
+// Scans a synthetic buffer which looks vaguely like x64 code.
+void BenchmarkPatternMatcher()
+{
+  std::size_t const kBufferSize = 100 * 1024 * 1024;
+  std::mt19937 rng{0x1337};
+  std::uint8_t const common[] = {
+    0x48, 0x8B, 0x89, 0x24, 0x4C, 0x44, 0x0F, 0x83, 0x00, 0xFF, 0xE8, 0xCC};
+  std::vector<std::uint8_t> haystack(kBufferSize);
+  for (auto& b : haystack)
+  {
+    b = rng() % 2 ? common[rng() % sizeof(common)]
+                  : static_cast<std::uint8_t>(rng());
+  }
+
+  auto const needle =
+    hadesmem::detail::ConvertData(L"48 8B ?? 24 ?? E8 ?? ?? ?? ?? 4C 8B 5?");
+  auto const plant = haystack.size() - 0x1000;
+  std::uint8_t const planted[] = {
+    0x48, 0x8B, 0x7C, 0x24, 0x30, 0xE8, 1, 2, 3, 4, 0x4C, 0x8B, 0x5C};
+  std::copy(std::begin(planted), std::end(planted), &haystack[plant]);
+
+  auto const beg = haystack.data();
+  auto const end = haystack.data() + haystack.size();
+  BenchmarkSearch("std::search", beg, end, beg + plant, [&]() {
+    return FindNaive(needle, beg, end);
+  });
+
+  struct Matcher
+  {
+    char const* name;
+    std::uint32_t flags;
+  };
+  Matcher const matchers[] = {
+    {"PatternMatcher (auto)", hadesmem::detail::PatternMatcherFlags::kNone},
+    {"PatternMatcher (no AVX2)",
+     hadesmem::detail::PatternMatcherFlags::kNoAvx2},
+    {"PatternMatcher (no SIMD)",
+     hadesmem::detail::PatternMatcherFlags::kNoSimd}};
+  for (auto const& m : matchers)
+  {
+    hadesmem::detail::PatternMatcher const matcher{
+      std::begin(needle), std::end(needle), m.flags};
+    BenchmarkSearch(m.name, beg, end, beg + plant, [&]() {
+      return matcher.Search(beg, end);
+    });
+  }
+}
+
+// Shows how the parallel scan scales with thread count.
+void BenchmarkFindPatternParallel()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  std::size_t const kBufferSize = 256 * 1024 * 1024;
+  std::mt19937 rng{0x1337};
+  std::vector<std::uint8_t> haystack(kBufferSize);
+  for (auto& b : haystack)
+  {
+    b = static_cast<std::uint8_t>(rng());
+  }
+
+  std::uint8_t const planted[] = {
+    0x48, 0x8B, 0x7C, 0x24, 0x30, 0xE8, 1, 2, 3, 4, 0x4C, 0x8B, 0x5C};
+  std::size_t const plant = haystack.size() - 0x1000;
+  std::copy(std::begin(planted), std::end(planted), &haystack[plant]);
+
+  for (std::size_t const num_threads : {1U, 2U, 4U, 8U, 16U, 0U})
+  {
+    auto const start = std::chrono::high_resolution_clock::now();
+    void* const result =
+      hadesmem::Find(process,
+                     haystack.data(),
+                     haystack.size(),
+                     L"48 8B ?? 24 ?? E8 ?? ?? ?? ?? 4C 8B 5?",
+                     hadesmem::PatternFlags::kRelativeAddress,
+                     0U,
+                     nullptr,
+                     num_threads);
+    std::chrono::duration<double> const elapsed =
+      std::chrono::high_resolution_clock::now() - start;
+    BOOST_TEST_EQ(reinterpret_cast<std::uintptr_t>(result), plant);
+    std::cout << "Find (" << hadesmem::detail::GetScanThreadCount(num_threads)
+              << " threads): "
+              << (kBufferSize / (1024.0 * 1024.0)) / elapsed.count()
+              << " MB/s\n";
+  }
+}
+
+extern "C" __declspec(noinline) int __stdcall BenchmarkScratch(int a)
+{
+  BOOST_TEST_EQ(a, 42);
+  return 0x1234;
+}
+
+void BenchmarkPatchInt3()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  auto volatile const scratch_fn = &BenchmarkScratch;
+
+  auto const scratch_detour = [](hadesmem::PatchDetourBase* patch, int a) {
+    auto const orig = patch->GetTrampolineT<decltype(&BenchmarkScratch)>();
+    return orig(a);
+  };
+
+  hadesmem::PatchInt3<decltype(BenchmarkScratch)> patch{
+    process, scratch_fn, scratch_detour};
+  patch.Apply();
+
+  // Every call is a full exception round trip (breakpoint, handler lookup,
+  // detour, trampoline), so this is mostly a measure of the handler overhead.
+  std::uint64_t const kNumCalls = 100000;
+  auto const start = std::chrono::high_resolution_clock::now();
+  for (std::uint64_t i = 0; i < kNumCalls; ++i)
+  {
+    BOOST_TEST_EQ(scratch_fn(42), 0x1234);
+  }
+  auto const elapsed = std::chrono::high_resolution_clock::now() - start;
+
+  BOOST_TEST_EQ(patch.GetHitCount(), kNumCalls);
+
+  std::cout
+    << "PatchInt3: "
+    << std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() /
+         kNumCalls
+    << "ns per call.\n";
+
+  patch.Remove();
+  BOOST_TEST_EQ(scratch_fn(42), 0x1234);
+  BOOST_TEST_EQ(patch.GetHitCount(), kNumCalls);
+}
+
+std::uint64_t BenchmarkCallRet()
+{
+  return 0x123456787654321LL;
+}
+
+void BenchmarkCallServer()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  std::size_t const kNumCalls = 100;
+
+  auto const call_start = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < kNumCalls; ++i)
+  {
+    auto const call_ret =
+      hadesmem::Call(process, &BenchmarkCallRet, hadesmem::CallConv::kDefault);
+    BOOST_TEST_EQ(call_ret.GetReturnValue(), 0x123456787654321ULL);
+  }
+  auto const call_elapsed =
+    std::chrono::high_resolution_clock::now() - call_start;
+
+  hadesmem::CallServer server{process};
+  auto const server_start = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < kNumCalls; ++i)
+  {
+    auto const call_ret =
+      server.Call(&BenchmarkCallRet, hadesmem::CallConv::kDefault);
+    BOOST_TEST_EQ(call_ret.GetReturnValue(), 0x123456787654321ULL);
+  }
+  auto const server_elapsed =
+    std::chrono::high_resolution_clock::now() - server_start;
+
+  std::cout << "Call: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                 call_elapsed).count() /
+                 kNumCalls
+            << "us per call.\n";
+  std::cout << "CallServer: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                 server_elapsed).count() /
+                 kNumCalls
+            << "us per call.\n";
+}
+
+int main()
+{
+  BenchmarkPatternMatcher();
+  BenchmarkFindPatternParallel();
+  BenchmarkPatchInt3();
+  BenchmarkCallServer();
+  return boost::report_errors();
+}
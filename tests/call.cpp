@@ -3,8 +3,15 @@
 
 #include <hadesmem/call.hpp>
 #include <hadesmem/call.hpp>
+#include <hadesmem/call_server.hpp>
+#include <hadesmem/call_server.hpp>
 
+#include <algorithm>
 #include <cstdint>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
@@ -446,8 +453,232 @@ void TestCall()
   BOOST_TEST_EQ(multi_call_ret[3].GetReturnValue<DWORD_PTR>(), 0x1234U);
 }
 
+void TestCallStubCache()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+  BOOST_TEST(!process.GetCallStubCache());
+
+  // Repeated calls with the same signature share a stub.
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    auto const call_int_ret = hadesmem::Call(process,
+                                             &TestInteger,
+                                             hadesmem::CallConv::kDefault,
+                                             0xAAAAAAAAU,
+                                             0xBBBBBBBBU,
+                                             0xCCCCCCCCU,
+                                             0xDDDDDDDDU,
+                                             0xEEEEEEEEU,
+                                             0xFFFFFFFFU);
+    BOOST_TEST_EQ(call_int_ret.GetReturnValue(), 0x12345678UL);
+  }
+
+  std::weak_ptr<hadesmem::detail::CallStubCache> weak_cache;
+  {
+    auto const cache = process.GetCallStubCache();
+    BOOST_TEST(!!cache);
+    if (!cache)
+    {
+      return;
+    }
+    weak_cache = cache;
+    BOOST_TEST_EQ(cache->GetNumStubs(), 1U);
+
+    auto const get_stub = [&](std::vector<hadesmem::CallArg> const& args,
+                              hadesmem::CallConv call_conv) {
+      std::vector<hadesmem::CallConv> const call_convs{call_conv};
+      std::vector<std::vector<hadesmem::CallArg>> const args_full{args};
+      return cache->GetStub(std::begin(call_convs), std::begin(args_full), 1);
+    };
+
+    // Argument values don't matter, only their kinds.
+    void* const int32_stub =
+      get_stub({hadesmem::CallArg{1U}, hadesmem::CallArg{2U}},
+               hadesmem::CallConv::kDefault);
+    BOOST_TEST_EQ(get_stub({hadesmem::CallArg{3U}, hadesmem::CallArg{4U}},
+                           hadesmem::CallConv::kDefault),
+                  int32_stub);
+    BOOST_TEST_EQ(cache->GetNumStubs(), 2U);
+
+    // Anything else which changes the code gets its own stub.
+    std::vector<void*> stubs{
+      int32_stub,
+      get_stub({hadesmem::CallArg{1U}, hadesmem::CallArg{2ULL}},
+               hadesmem::CallConv::kDefault),
+      get_stub({hadesmem::CallArg{1U}, hadesmem::CallArg{2.0f}},
+               hadesmem::CallConv::kDefault),
+      get_stub({hadesmem::CallArg{1U}, hadesmem::CallArg{2.0}},
+               hadesmem::CallConv::kDefault),
+      get_stub({hadesmem::CallArg{2.0}, hadesmem::CallArg{1U}},
+               hadesmem::CallConv::kDefault),
+      get_stub({hadesmem::CallArg{1U}}, hadesmem::CallConv::kDefault),
+      get_stub({}, hadesmem::CallConv::kDefault),
+      get_stub({hadesmem::CallArg{1U}, hadesmem::CallArg{2U}},
+               hadesmem::CallConv::kStdCall)};
+    std::size_t const num_stubs = stubs.size();
+    std::sort(std::begin(stubs), std::end(stubs));
+    BOOST_TEST(std::unique(std::begin(stubs), std::end(stubs)) ==
+               std::end(stubs));
+    BOOST_TEST_EQ(cache->GetNumStubs(), 1 + num_stubs);
+
+    // Copies share the cache.
+    hadesmem::Process const process_copy{process};
+    BOOST_TEST(process_copy.GetCallStubCache() == cache);
+  }
+
+  // Flushing frees the stubs once nothing else uses them, and the next call
+  // starts a new cache.
+  BOOST_TEST(!weak_cache.expired());
+  process.FlushCallStubCache();
+  BOOST_TEST(!process.GetCallStubCache());
+  BOOST_TEST(weak_cache.expired());
+  auto const call_64_ret =
+    hadesmem::Call(process, &TestCall64Ret, hadesmem::CallConv::kDefault);
+  BOOST_TEST_EQ(call_64_ret.GetReturnValue(), 0x123456787654321ULL);
+  BOOST_TEST(!!process.GetCallStubCache());
+
+  // As does the last copy of the Process going away.
+  weak_cache = process.GetCallStubCache();
+  {
+    hadesmem::Process moved{process};
+    hadesmem::Process const moved_to{std::move(moved)};
+    process.FlushCallStubCache();
+    BOOST_TEST(!weak_cache.expired());
+  }
+  BOOST_TEST(weak_cache.expired());
+}
+
+void TestCallServer()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  // Small ring so the tests below wrap around it.
+  hadesmem::CallServer server{process, 4};
+
+  auto const call_int_ret = server.Call(&TestInteger,
+                                        hadesmem::CallConv::kDefault,
+                                        0xAAAAAAAAU,
+                                        0xBBBBBBBBU,
+                                        0xCCCCCCCCU,
+                                        0xDDDDDDDDU,
+                                        0xEEEEEEEEU,
+                                        0xFFFFFFFFU);
+  BOOST_TEST_EQ(call_int_ret.GetReturnValue(), 0x12345678UL);
+  BOOST_TEST_EQ(call_int_ret.GetLastError(), 0x87654321UL);
+
+  auto const call_float_ret = server.Call(&TestFloat,
+                                          hadesmem::CallConv::kDefault,
+                                          1.11111f,
+                                          2.22222f,
+                                          3.33333f,
+                                          4.44444f,
+                                          5.55555f,
+                                          6.66666f);
+  BOOST_TEST_EQ(call_float_ret.GetReturnValue(), 1.23456f);
+
+  auto const call_double_ret = server.Call(&TestDouble,
+                                           hadesmem::CallConv::kDefault,
+                                           1.11111,
+                                           2.22222,
+                                           3.33333,
+                                           4.44444,
+                                           5.55555,
+                                           6.66666);
+  BOOST_TEST_EQ(call_double_ret.GetReturnValue(), 1.23456);
+
+  auto const call_ret = server.Call(&TestMixed,
+                                    hadesmem::CallConv::kDefault,
+                                    1337.6666,
+                                    nullptr,
+                                    'c',
+                                    9081.736455f,
+                                    -1234,
+                                    0xDEAFBEEFU,
+                                    1234.56f,
+                                    9876.54,
+                                    &dummy_glob,
+                                    0xAAAAAAAABBBBBBBBULL);
+  BOOST_TEST_EQ(call_ret.GetReturnValue(), 1234UL);
+  BOOST_TEST_EQ(call_ret.GetLastError(), 5678UL);
+
+#if defined(HADESMEM_DETAIL_ARCH_X86)
+  auto const call_int_fast_ret = server.Call(&TestIntegerFast,
+                                             hadesmem::CallConv::kFastCall,
+                                             0xAAAAAAAA,
+                                             0xBBBBBBBB,
+                                             0xCCCCCCCC,
+                                             0xDDDDDDDD,
+                                             0xEEEEEEEE,
+                                             0xFFFFFFFF);
+  BOOST_TEST_EQ(call_int_fast_ret.GetReturnValue(), 0x12345678UL);
+
+  auto const call_int_std_ret = server.Call(&TestIntegerStd,
+                                            hadesmem::CallConv::kStdCall,
+                                            0xAAAAAAAA,
+                                            0xBBBBBBBB,
+                                            0xCCCCCCCC,
+                                            0xDDDDDDDD,
+                                            0xEEEEEEEE,
+                                            0xFFFFFFFF);
+  BOOST_TEST_EQ(call_int_std_ret.GetReturnValue(), 0x12345678UL);
+#endif
+
+  // Float and integer returns interleaved, to check the server doesn't leave
+  // anything behind on the FPU stack.
+  for (int i = 0; i < 16; ++i)
+  {
+    auto const call_ret_double =
+      server.Call(&TestCallDoubleRet, hadesmem::CallConv::kDefault);
+    BOOST_TEST_EQ(call_ret_double.GetReturnValue(), 9.876);
+
+    auto const call_ret_64 =
+      server.Call(&TestCall64Ret, hadesmem::CallConv::kDefault);
+    BOOST_TEST_EQ(call_ret_64.GetReturnValue(), 0x123456787654321ULL);
+  }
+
+  // Last error is reset before each call, unlike within a MultiCall.
+  std::vector<void*> addresses;
+  std::vector<hadesmem::CallConv> call_convs;
+  std::vector<std::vector<hadesmem::CallArg>> args_full;
+  for (DWORD i = 0; i < 10; ++i)
+  {
+    addresses.push_back(reinterpret_cast<void*>(&MultiThreadSet));
+    call_convs.push_back(hadesmem::CallConv::kDefault);
+    args_full.push_back({hadesmem::CallArg{i}});
+  }
+  std::vector<hadesmem::CallResultRaw> multi_call_ret;
+  server.CallMulti(std::begin(addresses),
+                   std::end(addresses),
+                   std::begin(call_convs),
+                   std::begin(args_full),
+                   std::back_inserter(multi_call_ret));
+  BOOST_TEST_EQ(multi_call_ret.size(), 10UL);
+  for (DWORD i = 0; i < 10; ++i)
+  {
+    BOOST_TEST_EQ(multi_call_ret[i].GetLastError(), i);
+  }
+
+  std::vector<hadesmem::CallArg> const no_args;
+  auto future_1 = server.CallRawAsync(reinterpret_cast<void*>(&TestCall64Ret),
+                                      hadesmem::CallConv::kDefault,
+                                      std::begin(no_args),
+                                      std::end(no_args));
+  {
+    // Abandoned without being waited on.
+    auto future_2 =
+      server.CallRawAsync(reinterpret_cast<void*>(&TestCallDoubleRet),
+                          hadesmem::CallConv::kDefault,
+                          std::begin(no_args),
+                          std::end(no_args));
+  }
+  BOOST_TEST_EQ(future_1.Get().GetReturnValue<std::uint64_t>(),
+                0x123456787654321ULL);
+}
+
 int main()
 {
   TestCall();
+  TestCallStubCache();
+  TestCallServer();
   return boost::report_errors();
 }
@@ -0,0 +1,241 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include "../examples/dump/filesystem.hpp"
+#include "../examples/dump/filesystem.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/self_path.hpp>
+#include <hadesmem/detail/task_scheduler.hpp>
+#include <hadesmem/error.hpp>
+
+#include "../examples/dump/main.hpp"
+#include "../examples/dump/warning.hpp"
+
+// Stand-ins for the parts of the dump example which filesystem.cpp calls out
+// to. Rather than dumping anything, DumpPeFile records which files it was
+// given and how many of them were being dumped at once.
+
+namespace
+{
+std::mutex g_dumped_mutex;
+std::map<std::wstring, std::size_t> g_dumped;
+std::size_t g_num_dumping;
+std::size_t g_max_dumping;
+
+thread_local std::wstring g_current_file_path;
+}
+
+std::wstring GetCurrentFilePath()
+{
+  return g_current_file_path;
+}
+
+void SetCurrentFilePath(std::wstring const& path)
+{
+  g_current_file_path = path;
+}
+
+std::wostream& GetOutputStreamW()
+{
+  // No buffer, so everything written to it is discarded.
+  thread_local static std::wostream str{nullptr};
+  return str;
+}
+
+void WarnForCurrentFile(WarningType /*warned_type*/)
+{
+}
+
+void DumpPeFile(hadesmem::Process const& /*process*/,
+                hadesmem::PeFile const& /*pe_file*/,
+                std::wstring const& path)
+{
+  {
+    std::lock_guard<std::mutex> lock{g_dumped_mutex};
+    ++g_dumped[hadesmem::detail::PathFindFileNameWrapper(path)];
+    g_max_dumping = (std::max)(g_max_dumping, ++g_num_dumping);
+  }
+
+  // Give the other workers a chance to overlap with this one.
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  std::lock_guard<std::mutex> lock{g_dumped_mutex};
+  --g_num_dumping;
+}
+
+namespace
+{
+struct TempTree
+{
+  std::wstring root;
+  std::vector<std::wstring> dirs;
+  std::vector<std::wstring> files;
+  std::vector<std::wstring> pe_names;
+  std::vector<std::wstring> other_names;
+};
+
+void CreateTempDir(TempTree& tree, std::wstring const& path)
+{
+  hadesmem::detail::CreateDirectoryWrapper(path);
+  tree.dirs.emplace_back(path);
+}
+
+void CreateTempFile(TempTree& tree,
+                    std::wstring const& dir,
+                    std::wstring const& name,
+                    std::vector<char> const& data,
+                    bool is_pe)
+{
+  std::wstring const path = hadesmem::detail::CombinePath(dir, name);
+  hadesmem::detail::BufferToFile(
+    path, data.data(), static_cast<std::streamsize>(data.size()));
+  tree.files.emplace_back(path);
+  (is_pe ? tree.pe_names : tree.other_names).emplace_back(name);
+}
+
+// Files are named uniquely across the whole tree, so they can be told apart
+// by name alone. The first directory has more PE files than fit in a single
+// batch.
+TempTree CreateTempTree()
+{
+  wchar_t temp_path[MAX_PATH + 1] = {};
+  if (!::GetTempPathW(MAX_PATH + 1, temp_path))
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(hadesmem::Error{}
+                                    << hadesmem::ErrorString{
+                                         "GetTempPathW failed."}
+                                    << hadesmem::ErrorCodeWinLast{last_error});
+  }
+
+  TempTree tree;
+  tree.root = hadesmem::detail::CombinePath(
+    temp_path,
+    L"hadesmem_dump_dir_" + std::to_wstring(::GetCurrentProcessId()) + L"_" +
+      std::to_wstring(::GetTickCount64()));
+  CreateTempDir(tree, tree.root);
+
+  std::vector<char> const pe =
+    hadesmem::detail::FileToBuffer(hadesmem::detail::GetSelfPath());
+  std::vector<char> const text{'M', 'Z', 'n', 'o', 't', ' ', 'a', ' ', 'P',
+                               'E'};
+
+  std::wstring const many = hadesmem::detail::CombinePath(tree.root, L"many");
+  CreateTempDir(tree, many);
+  for (std::size_t i = 0; i < 100; ++i)
+  {
+    CreateTempFile(
+      tree, many, L"many_" + std::to_wstring(i) + L".exe", pe, true);
+  }
+  CreateTempFile(tree, many, L"many_text.txt", text, false);
+
+  CreateTempDir(tree, hadesmem::detail::CombinePath(tree.root, L"empty"));
+
+  std::wstring nested = tree.root;
+  for (std::size_t i = 0; i < 5; ++i)
+  {
+    nested = hadesmem::detail::CombinePath(
+      nested, L"nested_" + std::to_wstring(i));
+    CreateTempDir(tree, nested);
+    CreateTempFile(
+      tree, nested, L"nested_" + std::to_wstring(i) + L".dll", pe, true);
+    CreateTempFile(
+      tree, nested, L"nested_" + std::to_wstring(i) + L".txt", text, false);
+  }
+
+  CreateTempFile(tree, tree.root, L"root.exe", pe, true);
+  CreateTempFile(tree, tree.root, L"root_empty.bin", {}, false);
+
+  return tree;
+}
+
+void DeleteTempTree(TempTree const& tree)
+{
+  for (auto const& file : tree.files)
+  {
+    ::DeleteFileW(file.c_str());
+  }
+
+  // Deepest first.
+  for (auto dir = tree.dirs.rbegin(); dir != tree.dirs.rend(); ++dir)
+  {
+    ::RemoveDirectoryW(dir->c_str());
+  }
+}
+}
+
+void TestDumpDir()
+{
+  TempTree const tree = CreateTempTree();
+
+  std::uint64_t const pe_size = static_cast<std::uint64_t>(
+    hadesmem::detail::FileToBuffer(hadesmem::detail::GetSelfPath()).size());
+
+  struct Config
+  {
+    std::size_t num_threads;
+    std::uint64_t max_inflight_bytes;
+  };
+  // No budget, a budget smaller than any file (so only one file can be in
+  // flight at once, and everything else has to wait its turn without blocking
+  // the workers), and a budget which fits a couple of files.
+  Config const configs[] = {
+    {1, 0}, {4, 0}, {4, 1}, {4, pe_size * 5 / 2}};
+  for (auto const& config : configs)
+  {
+    {
+      std::lock_guard<std::mutex> lock{g_dumped_mutex};
+      g_dumped.clear();
+      g_num_dumping = 0;
+      g_max_dumping = 0;
+    }
+
+    SetMaxInflightBytes(config.max_inflight_bytes);
+    hadesmem::detail::TaskScheduler scheduler{config.num_threads};
+    DumpDir(tree.root, scheduler);
+
+    std::lock_guard<std::mutex> lock{g_dumped_mutex};
+    BOOST_TEST_EQ(g_dumped.size(), tree.pe_names.size());
+    for (auto const& name : tree.pe_names)
+    {
+      auto const iter = g_dumped.find(name);
+      BOOST_TEST(iter != g_dumped.end() && iter->second == 1);
+    }
+    for (auto const& name : tree.other_names)
+    {
+      BOOST_TEST(g_dumped.find(name) == g_dumped.end());
+    }
+    BOOST_TEST_EQ(g_num_dumping, 0U);
+    if (config.max_inflight_bytes == 1)
+    {
+      BOOST_TEST_EQ(g_max_dumping, 1U);
+    }
+  }
+
+  SetMaxInflightBytes(0);
+  DeleteTempTree(tree);
+}
+
+int main()
+{
+  TestDumpDir();
+  return boost::report_errors();
+}
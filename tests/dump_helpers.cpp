@@ -0,0 +1,393 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/dump.hpp>
+#include <hadesmem/detail/dump.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/address_range_filter.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/process.hpp>
+
+namespace
+{
+std::uintptr_t RandomAddress(std::mt19937_64& rng)
+{
+  // Shift by a random amount so that small addresses (and therefore small
+  // keys on x64) are common too.
+  return static_cast<std::uintptr_t>(rng() >> (rng() % 64));
+}
+
+bool InRanges(
+  std::vector<std::pair<std::uintptr_t, std::uintptr_t>> const& ranges,
+  std::uintptr_t value)
+{
+  return std::any_of(std::begin(ranges),
+                     std::end(ranges),
+                     [&](std::pair<std::uintptr_t, std::uintptr_t> const& r) {
+                       return value >= r.first && value < r.second;
+                     });
+}
+
+// SIMD and scalar results agree at every offset of buf, and neither ever
+// rejects a value which really is in one of the ranges.
+void CheckAddressRangeFilter(
+  std::vector<std::pair<std::uintptr_t, std::uintptr_t>> const& ranges,
+  std::vector<std::uint8_t> const& buf)
+{
+  hadesmem::detail::AddressRangeFilter const filter{ranges};
+  for (std::size_t i = 0;
+       i + hadesmem::detail::AddressRangeFilter::kMatchSize <= buf.size();
+       ++i)
+  {
+    std::uint32_t const mask = filter.Match(buf.data() + i);
+    BOOST_TEST_EQ(mask & ~0xFU, 0U);
+    for (std::size_t j = 0; j < 4; ++j)
+    {
+      std::uintptr_t value;
+      std::memcpy(&value, buf.data() + i + j * 4, sizeof(value));
+      bool const scalar = filter.Match(value);
+      BOOST_TEST_EQ(((mask >> j) & 1) != 0, scalar);
+      if (InRanges(ranges, value))
+      {
+        BOOST_TEST(scalar);
+      }
+    }
+  }
+}
+}
+
+void TestAddressRangeFilter()
+{
+  std::mt19937_64 rng{7};
+
+  // Fewer ranges than the filter holds, exactly as many, and (many) more, so
+  // that the merging path is covered.
+  for (std::size_t const num_ranges : {0U, 1U, 3U, 8U, 9U, 17U, 40U, 200U})
+  {
+    for (std::size_t iter = 0; iter < 16; ++iter)
+    {
+      std::vector<std::pair<std::uintptr_t, std::uintptr_t>> ranges;
+      for (std::size_t i = 0; i < num_ranges; ++i)
+      {
+        std::uintptr_t const beg = RandomAddress(rng);
+        std::uintptr_t const size = RandomAddress(rng) >> (rng() % 16);
+        // Empty and wrapping ranges are ignored by the filter, and by us.
+        ranges.emplace_back(beg, beg + size);
+      }
+
+      // Mostly values from the ranges (and their edges), so there is
+      // something to find, plus random ones to reject.
+      std::vector<std::uint8_t> buf(512);
+      for (auto& b : buf)
+      {
+        b = static_cast<std::uint8_t>(rng());
+      }
+      for (std::size_t i = 0; i < 64 && !ranges.empty(); ++i)
+      {
+        auto const& range =
+          ranges[static_cast<std::size_t>(rng() % ranges.size())];
+        if (range.second <= range.first)
+        {
+          continue;
+        }
+
+        std::uintptr_t value;
+        switch (rng() % 3)
+        {
+        case 0:
+          value = range.first;
+          break;
+        case 1:
+          value = range.second - 1;
+          break;
+        default:
+          value = range.first + static_cast<std::uintptr_t>(
+                                  rng() % (range.second - range.first));
+          break;
+        }
+        std::memcpy(buf.data() + static_cast<std::size_t>(
+                                   rng() % (buf.size() - sizeof(value) + 1)),
+                    &value,
+                    sizeof(value));
+      }
+
+      CheckAddressRangeFilter(ranges, buf);
+    }
+  }
+
+  // Widely spaced ranges, so that merging them really does let through
+  // values which aren't in any range, and so only exact lookups can tell.
+  std::vector<std::pair<std::uintptr_t, std::uintptr_t>> spaced;
+  std::uintptr_t const stride =
+    static_cast<std::uintptr_t>(1) << (sizeof(void*) * 8 - 6);
+  for (std::uintptr_t i = 0; i < 32; ++i)
+  {
+    spaced.emplace_back(i * stride + stride / 4, i * stride + stride / 2);
+  }
+  hadesmem::detail::AddressRangeFilter const spaced_filter{spaced};
+  for (auto const& range : spaced)
+  {
+    BOOST_TEST(spaced_filter.Match(range.first));
+    BOOST_TEST(spaced_filter.Match(range.second - 1));
+  }
+  std::vector<std::uint8_t> spaced_buf(256);
+  for (std::size_t i = 0; i + sizeof(std::uintptr_t) <= spaced_buf.size();
+       i += sizeof(std::uintptr_t))
+  {
+    std::uintptr_t const value = spaced[i % spaced.size()].first +
+                                 static_cast<std::uintptr_t>(i);
+    std::memcpy(spaced_buf.data() + i, &value, sizeof(value));
+  }
+  CheckAddressRangeFilter(spaced, spaced_buf);
+
+  // Nothing passes an empty filter.
+  std::vector<std::pair<std::uintptr_t, std::uintptr_t>> const no_ranges;
+  hadesmem::detail::AddressRangeFilter const empty_filter{no_ranges};
+  BOOST_TEST(!empty_filter.Match(static_cast<std::uintptr_t>(0)));
+  BOOST_TEST(!empty_filter.Match(~static_cast<std::uintptr_t>(0)));
+  std::vector<std::uint8_t> const zeros(
+    hadesmem::detail::AddressRangeFilter::kMatchSize);
+  BOOST_TEST_EQ(empty_filter.Match(zeros.data()), 0U);
+}
+
+void TestExportMap()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  // Real modules, for their priorities. Two copies of this one, so there
+  // are ties for the sort to keep in order.
+  std::vector<hadesmem::detail::ModuleLight> modules;
+  modules.reserve(4);
+  for (auto const name : {L"kernel32.dll", L"ntdll.dll", L"", L""})
+  {
+    hadesmem::Module const module{process,
+                                  ::GetModuleHandleW(*name ? name : nullptr)};
+    modules.emplace_back(process,
+                         module.GetHandle(),
+                         module.GetSize(),
+                         false,
+                         module.GetHandle(),
+                         false);
+  }
+  BOOST_TEST_EQ(modules[0].priority_, 3);
+  BOOST_TEST_EQ(modules[1].priority_, 0);
+  BOOST_TEST_EQ(modules[2].priority_, 1);
+
+  // Nothing has been added, so nothing is found.
+  hadesmem::detail::ExportMap empty_map;
+  BOOST_TEST(empty_map.Find(modules[0].pe_file_.GetBase()).empty());
+  empty_map.Build();
+  BOOST_TEST_EQ(empty_map.size(), 0U);
+  BOOST_TEST(empty_map.Find(nullptr).empty());
+
+  std::mt19937_64 rng{11};
+  for (std::size_t const num_exports : {1U, 15U, 16U, 100U, 5000U})
+  {
+    hadesmem::detail::ExportMap export_map;
+    std::map<std::uintptr_t, std::vector<hadesmem::detail::ExportLight>>
+      expected;
+    std::vector<std::uintptr_t> vas;
+    std::uintptr_t const cluster = RandomAddress(rng);
+    for (std::size_t i = 0; i < num_exports; ++i)
+    {
+      // Forwarded and aliased exports share a VA. Real ones are also packed
+      // together and aligned, which is the worst case for the hash.
+      std::uintptr_t va;
+      switch (rng() % 4)
+      {
+      case 0:
+        va = vas.empty()
+               ? cluster
+               : vas[static_cast<std::size_t>(rng() % vas.size())];
+        break;
+      case 1:
+        va = RandomAddress(rng);
+        break;
+      default:
+        va = cluster + static_cast<std::uintptr_t>((rng() % 0x10000) * 0x10);
+        break;
+      }
+      vas.push_back(va);
+
+      hadesmem::detail::ExportLight const e{&modules[static_cast<std::size_t>(
+                                              rng() % modules.size())],
+                                            (rng() % 2) != 0,
+                                            std::to_string(i),
+                                            static_cast<DWORD>(i)};
+      export_map.Add(reinterpret_cast<void*>(va), e);
+      expected[va].push_back(e);
+    }
+    export_map.Build();
+
+    // Highest priority last, ties in the order they were added.
+    for (auto& kv : expected)
+    {
+      std::stable_sort(std::begin(kv.second),
+                       std::end(kv.second),
+                       [](hadesmem::detail::ExportLight const& lhs,
+                          hadesmem::detail::ExportLight const& rhs) {
+                         return lhs.module_->priority_ <
+                                rhs.module_->priority_;
+                       });
+    }
+
+    BOOST_TEST_EQ(export_map.size(), expected.size());
+    auto const& map_vas = export_map.GetVas();
+    BOOST_TEST_EQ(map_vas.size(), expected.size());
+    BOOST_TEST(std::equal(std::begin(map_vas),
+                          std::end(map_vas),
+                          std::begin(expected),
+                          std::end(expected),
+                          [](std::uintptr_t lhs,
+                             std::pair<std::uintptr_t const,
+                                       std::vector<
+                                         hadesmem::detail::ExportLight>> const&
+                               rhs) { return lhs == rhs.first; }));
+
+    for (auto const& kv : expected)
+    {
+      auto const range = export_map.Find(reinterpret_cast<void*>(kv.first));
+      BOOST_TEST_EQ(static_cast<std::size_t>(range.end() - range.begin()),
+                    kv.second.size());
+      if (static_cast<std::size_t>(range.end() - range.begin()) !=
+          kv.second.size())
+      {
+        continue;
+      }
+
+      auto e = kv.second.begin();
+      for (auto const& found : range)
+      {
+        BOOST_TEST_EQ(found.module_, e->module_);
+        BOOST_TEST_EQ(found.by_name_, e->by_name_);
+        BOOST_TEST_EQ(found.name_, e->name_);
+        BOOST_TEST_EQ(found.ordinal_, e->ordinal_);
+        ++e;
+      }
+      BOOST_TEST_EQ(range.back().name_, kv.second.back().name_);
+    }
+
+    // Neighbours of real VAs and random ones are (almost always) absent,
+    // and must not be found.
+    for (std::size_t i = 0; i < num_exports * 4; ++i)
+    {
+      std::uintptr_t const va =
+        i % 2 ? RandomAddress(rng)
+              : vas[static_cast<std::size_t>(rng() % vas.size())] + 1 +
+                  static_cast<std::uintptr_t>(rng() % 0x20);
+      bool const present = expected.find(va) != std::end(expected);
+      BOOST_TEST_EQ(!export_map.Find(reinterpret_cast<void*>(va)).empty(),
+                    present);
+    }
+  }
+}
+
+void TestCodePageCache()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  SYSTEM_INFO sys_info{};
+  ::GetSystemInfo(&sys_info);
+  std::size_t const page_size = sys_info.dwPageSize;
+
+  // Three executable pages followed by a non-executable one. The regions
+  // are captured when the cache is created, so this has to come first.
+  auto const mem = static_cast<std::uint8_t*>(::VirtualAlloc(
+    nullptr, page_size * 4, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE));
+  BOOST_TEST(mem != nullptr);
+  if (!mem)
+  {
+    return;
+  }
+  for (std::size_t i = 0; i < page_size * 4; ++i)
+  {
+    mem[i] = static_cast<std::uint8_t>(i * 7 + i / page_size);
+  }
+  DWORD old_protect = 0;
+  BOOST_TEST(::VirtualProtect(
+    mem + page_size * 3, page_size, PAGE_READWRITE, &old_protect));
+
+  // Pretend the first page belongs to the image being dumped, and that our
+  // copy of it differs from what's in memory, so we can tell which was read.
+  // The copy is a little longer than one page, but not by a whole page, so
+  // the second page still has to be read from memory.
+  std::vector<std::uint8_t> image(mem, mem + page_size + page_size / 2);
+  for (auto& b : image)
+  {
+    b = static_cast<std::uint8_t>(~b);
+  }
+
+  hadesmem::detail::CodePageCache cache{process, mem, image};
+  auto const& regions = cache.GetRegions();
+  BOOST_TEST(std::is_sorted(std::begin(regions), std::end(regions)));
+  for (std::size_t i = 0; i < 4; ++i)
+  {
+    auto const page = reinterpret_cast<std::uintptr_t>(mem + page_size * i);
+    BOOST_TEST_EQ(
+      std::any_of(std::begin(regions),
+                  std::end(regions),
+                  [&](std::pair<std::uintptr_t, std::uintptr_t> const& r) {
+                    return page >= r.first && page < r.second;
+                  }),
+      i < 3);
+  }
+
+  std::vector<std::uint8_t> out(page_size * 2);
+
+  // Within the image, from our copy.
+  BOOST_TEST(cache.Read(mem + 16, out.data(), 32));
+  BOOST_TEST(std::equal(out.data(), out.data() + 32, image.data() + 16));
+
+  // Across the end of the image, so from our copy then from memory.
+  BOOST_TEST(cache.Read(mem + page_size - 8, out.data(), 16));
+  BOOST_TEST(
+    std::equal(out.data(), out.data() + 8, image.data() + page_size - 8));
+  BOOST_TEST(std::equal(out.data() + 8, out.data() + 16, mem + page_size));
+
+  // Across a boundary outside the image, and across two of them.
+  BOOST_TEST(cache.Read(mem + page_size * 2 - 5, out.data(), 10));
+  BOOST_TEST(std::equal(out.data(), out.data() + 10, mem + page_size * 2 - 5));
+  BOOST_TEST(cache.Read(mem + page_size - 3, out.data(), page_size + 6));
+  BOOST_TEST(
+    std::equal(out.data(), out.data() + 3, image.data() + page_size - 3));
+  BOOST_TEST(std::equal(
+    out.data() + 3, out.data() + page_size + 6, mem + page_size));
+
+  // Pages are read once and kept, so later changes aren't seen.
+  mem[page_size * 2] = static_cast<std::uint8_t>(~mem[page_size * 2]);
+  BOOST_TEST(cache.Read(mem + page_size * 2, out.data(), 1));
+  BOOST_TEST_EQ(out[0], static_cast<std::uint8_t>(~mem[page_size * 2]));
+
+  // Running off the end of executable memory fails, even if part of the
+  // read was fine.
+  BOOST_TEST(cache.Read(mem + page_size * 3 - 4, out.data(), 4));
+  BOOST_TEST(!cache.Read(mem + page_size * 3 - 4, out.data(), 8));
+  BOOST_TEST(!cache.Read(mem + page_size * 3, out.data(), 1));
+  BOOST_TEST(!cache.Read(nullptr, out.data(), 1));
+
+  BOOST_TEST(::VirtualFree(mem, 0, MEM_RELEASE));
+}
+
+int main()
+{
+  TestAddressRangeFilter();
+  TestExportMap();
+  TestCodePageCache();
+  return boost::report_errors();
+}
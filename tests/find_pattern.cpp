@@ -4,13 +4,23 @@
 #include <hadesmem/find_pattern.hpp>
 #include <hadesmem/find_pattern.hpp>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/pattern_matcher.hpp>
 #include <hadesmem/detail/self_path.hpp>
 #include <hadesmem/error.hpp>
+#include <hadesmem/module.hpp>
 #include <hadesmem/process.hpp>
 
 // TODO: Clean up, expand, fix, etc these tests.
@@ -272,8 +282,260 @@ void TestFindPattern()
     hadesmem::Error);
 }
 
+namespace
+{
+std::uint8_t const* FindNaive(
+  std::vector<hadesmem::detail::PatternDataByte> const& needle,
+  std::uint8_t const* beg,
+  std::uint8_t const* end)
+{
+  auto const iter = std::search(
+    beg,
+    end,
+    std::begin(needle),
+    std::end(needle),
+    [](std::uint8_t h, hadesmem::detail::PatternDataByte const& n) {
+      return (h & n.mask) == n.data;
+    });
+  return iter == end ? nullptr : iter;
+}
+
+std::uint32_t const kMatcherFlags[] = {
+  hadesmem::detail::PatternMatcherFlags::kNone,
+  hadesmem::detail::PatternMatcherFlags::kNoAvx2,
+  hadesmem::detail::PatternMatcherFlags::kNoSimd};
+}
+
+void TestPatternMatcher()
+{
+  auto const nibble = hadesmem::detail::ConvertData(L"FF D? ?B ??");
+  BOOST_TEST_EQ(nibble.size(), 4UL);
+  BOOST_TEST_EQ(nibble[0].data, 0xFF);
+  BOOST_TEST_EQ(nibble[0].mask, 0xFF);
+  BOOST_TEST_EQ(nibble[1].data, 0xD0);
+  BOOST_TEST_EQ(nibble[1].mask, 0xF0);
+  BOOST_TEST_EQ(nibble[2].data, 0x0B);
+  BOOST_TEST_EQ(nibble[2].mask, 0x0F);
+  BOOST_TEST_EQ(nibble[3].mask, 0x00);
+  BOOST_TEST_THROWS(hadesmem::detail::ConvertData(L"F?F"), hadesmem::Error);
+  BOOST_TEST_THROWS(hadesmem::detail::ConvertData(L"G?"), hadesmem::Error);
+
+  hadesmem::Process const process{::GetCurrentProcessId()};
+  std::uint8_t buf[] = {0x00, 0xFF, 0xD7, 0x1B, 0x42, 0xFF, 0xD7, 0x2B, 0x42};
+  BOOST_TEST_EQ(hadesmem::Find(process,
+                               buf,
+                               sizeof(buf),
+                               L"FF D? ?B 42",
+                               hadesmem::PatternFlags::kRelativeAddress,
+                               0U),
+                reinterpret_cast<void*>(1));
+  BOOST_TEST_EQ(hadesmem::Find(process,
+                               buf,
+                               sizeof(buf),
+                               L"FF ?7 2? 42",
+                               hadesmem::PatternFlags::kRelativeAddress,
+                               0U),
+                reinterpret_cast<void*>(5));
+
+  // Compare against a naive search using small alphabets so there are plenty
+  // of partial matches, covering both the vector loops and the scalar tails.
+  std::mt19937 rng{0x1337};
+  for (int i = 0; i < 5000; ++i)
+  {
+    std::vector<std::uint8_t> haystack(rng() % 300);
+    for (auto& b : haystack)
+    {
+      b = static_cast<std::uint8_t>(rng() % 4 ? rng() % 6 : rng());
+    }
+
+    std::vector<hadesmem::detail::PatternDataByte> needle(1 + rng() % 40);
+    std::size_t const plant =
+      haystack.size() > needle.size()
+        ? rng() % (haystack.size() - needle.size() + 1)
+        : haystack.size();
+    for (std::size_t j = 0; j < needle.size(); ++j)
+    {
+      std::uint8_t const masks[] = {0x00, 0x0F, 0xF0, 0xFF, 0xFF, 0xFF};
+      std::uint8_t const mask = masks[rng() % 6];
+      std::uint8_t const data =
+        plant < haystack.size() && rng() % 2
+          ? haystack[plant + j]
+          : static_cast<std::uint8_t>(rng() % 6);
+      needle[j] = hadesmem::detail::PatternDataByte{
+        static_cast<std::uint8_t>(data & mask), mask};
+    }
+
+    auto const beg = haystack.data();
+    auto const end = haystack.data() + haystack.size();
+    auto const expected = FindNaive(needle, beg, end);
+    for (auto const flags : kMatcherFlags)
+    {
+      hadesmem::detail::PatternMatcher const matcher{
+        std::begin(needle), std::end(needle), flags};
+      BOOST_TEST_EQ(matcher.Search(beg, end), expected);
+    }
+  }
+}
+
+void TestMultiPatternMatcher()
+{
+  std::mt19937 rng{0x1337};
+  for (int i = 0; i < 500; ++i)
+  {
+    std::vector<std::uint8_t> haystack(rng() % 2000);
+    for (auto& b : haystack)
+    {
+      b = static_cast<std::uint8_t>(rng() % 8);
+    }
+
+    std::size_t const num_needles = 1 + rng() % 50;
+    std::vector<std::vector<hadesmem::detail::PatternDataByte>> needles;
+    std::vector<hadesmem::detail::PatternMatcher> matchers;
+    std::vector<std::size_t> begin_offsets;
+    for (std::size_t j = 0; j < num_needles; ++j)
+    {
+      std::vector<hadesmem::detail::PatternDataByte> needle(1 + rng() % 6);
+      for (auto& n : needle)
+      {
+        n.mask = rng() % 8 ? 0xFF : 0x00;
+        n.data = static_cast<std::uint8_t>((rng() % 8) & n.mask);
+      }
+      needles.push_back(needle);
+      matchers.emplace_back(std::begin(needle), std::end(needle));
+      begin_offsets.push_back(
+        rng() % 4 ? rng() % (haystack.size() + 1)
+                  : hadesmem::detail::MultiPatternMatcher::kInactive);
+    }
+
+    hadesmem::detail::MultiPatternMatcher multi_matcher{matchers};
+    std::vector<std::uint8_t const*> results(num_needles);
+    auto const beg = haystack.data();
+    auto const end = haystack.data() + haystack.size();
+    multi_matcher.Search(beg, end, begin_offsets, &results);
+    for (std::size_t j = 0; j < num_needles; ++j)
+    {
+      if (begin_offsets[j] != hadesmem::detail::MultiPatternMatcher::kInactive)
+      {
+        BOOST_TEST_EQ(results[j],
+                      FindNaive(needles[j], beg + begin_offsets[j], end));
+      }
+    }
+  }
+}
+
+void TestFindPatternParallel()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  std::size_t const chunk_size = hadesmem::detail::kParallelScanChunkSize;
+  std::vector<std::uint8_t> buf(chunk_size * 8);
+  std::uint8_t const needle[] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+  auto const plant = [&](std::size_t offset) {
+    std::copy(std::begin(needle), std::end(needle), &buf[offset]);
+  };
+
+  // Spanning a chunk boundary, with a later match in a chunk which is likely
+  // to finish first.
+  std::size_t const first = chunk_size * 3 - 2;
+  plant(first);
+  plant(chunk_size * 6);
+  plant(chunk_size * 7 + 1);
+
+  for (std::size_t const num_threads : {1U, 2U, 4U, 8U, 0U})
+  {
+    auto const find = [&](std::uintptr_t start) {
+      return reinterpret_cast<std::uintptr_t>(
+        hadesmem::Find(process,
+                       buf.data(),
+                       buf.size(),
+                       L"11 22 33 ?? 55 6?",
+                       hadesmem::PatternFlags::kRelativeAddress,
+                       start,
+                       nullptr,
+                       num_threads));
+    };
+    BOOST_TEST_EQ(find(0), first);
+    BOOST_TEST_EQ(find(first), chunk_size * 6);
+    BOOST_TEST_EQ(find(chunk_size * 6), chunk_size * 7 + 1);
+    BOOST_TEST_EQ(find(chunk_size * 7 + 1), 0U);
+    BOOST_TEST_THROWS(find(buf.size() - 1), hadesmem::Error);
+  }
+}
+
+void TestFindPatternCache()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  std::vector<wchar_t> temp_path(MAX_PATH + 1);
+  BOOST_TEST(::GetTempPathW(static_cast<DWORD>(temp_path.size()),
+                            temp_path.data()) != 0);
+  std::wstring const cache_path = hadesmem::detail::CombinePath(
+    temp_path.data(), L"hadesmem_find_pattern_cache.xml");
+  ::DeleteFileW(cache_path.c_str());
+
+  auto const make_pattern_file = [](std::wstring const& two_nop_data) {
+    return LR"(
+<?xml version="1.0" encoding="utf-8"?>
+<HadesMem>
+  <FindPattern>
+    <Flag Name="RelativeAddress"/>
+    <Pattern Name="First Call" Data="E8">
+      <Manipulator Name="Add" Operand1="1"/>
+      <Manipulator Name="Rel" Operand1="5" Operand2="1"/>
+    </Pattern>
+    <Pattern Name="Does Not Exist" Data="DE AD BE EF 13 37 DE AD BE EF 13 37"/>
+  </FindPattern>
+  <FindPattern Module="ntdll.dll">
+    <Pattern Name="Two Nop" Data=")" +
+           two_nop_data + LR"("/>
+    <Pattern Name="Two Nop Next" Data="??" Start="Two Nop"/>
+    <Pattern Name="Nop NtClose" Data="90" StartExport="NtClose"/>
+  </FindPattern>
+</HadesMem>
+)";
+  };
+
+  auto const check = [&](std::wstring const& pattern_file_data) {
+    hadesmem::FindPattern const uncached{process, pattern_file_data, true};
+    hadesmem::FindPattern const cached{
+      process, pattern_file_data, true, cache_path};
+    BOOST_TEST(hadesmem::detail::DoesFileExist(cache_path));
+    BOOST_TEST(cached == uncached);
+    BOOST_TEST_EQ(cached.Lookup(L"", L"Does Not Exist"),
+                  static_cast<void*>(nullptr));
+  };
+
+  // Empty cache, then a fully populated one, then a changed pattern.
+  auto const pattern_file_data = make_pattern_file(L"90 90");
+  check(pattern_file_data);
+  check(pattern_file_data);
+  check(make_pattern_file(L"90 90 ??"));
+
+  // Corrupt cache files are ignored (and replaced).
+  char const garbage[] = "<HadesMemPatternCache Version=";
+  hadesmem::detail::BufferToFile(cache_path, garbage, sizeof(garbage) - 1);
+  check(pattern_file_data);
+  check(pattern_file_data);
+
+  ::DeleteFileW(cache_path.c_str());
+
+  // Nor is failing to save it an error.
+  std::wstring const bad_cache_path = hadesmem::detail::CombinePath(
+    temp_path.data(),
+    L"hadesmem_does_not_exist\\hadesmem_find_pattern_cache.xml");
+  hadesmem::FindPattern const uncached{process, pattern_file_data, true};
+  hadesmem::FindPattern const unsaved{
+    process, pattern_file_data, true, bad_cache_path};
+  BOOST_TEST(!hadesmem::detail::DoesFileExist(bad_cache_path));
+  BOOST_TEST(unsaved == uncached);
+}
+
 int main()
 {
   TestFindPattern();
+  TestPatternMatcher();
+  TestMultiPatternMatcher();
+  TestFindPatternParallel();
+  TestFindPatternCache();
   return boost::report_errors();
 }
@@ -4,6 +4,7 @@
 #include <hadesmem/module.hpp>
 #include <hadesmem/module.hpp>
 
+#include <cstdint>
 #include <utility>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
@@ -14,6 +15,8 @@
 #include <hadesmem/detail/to_upper_ordinal.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/find_procedure.hpp>
+#include <hadesmem/module_index.hpp>
+#include <hadesmem/module_list.hpp>
 #include <hadesmem/process.hpp>
 
 void TestModule()
@@ -91,8 +94,59 @@ void TestModule()
   BOOST_TEST_NE(test_str_1.str(), test_str_3.str());
 }
 
+void TestModuleIndex()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  hadesmem::ModuleIndex index{process};
+  BOOST_TEST_NE(index.GetSize(), 0U);
+
+  // Must agree with the Toolhelp based lookups.
+  hadesmem::ModuleList const module_list{process};
+  for (auto const& module : module_list)
+  {
+    auto const found = index.Find(module.GetHandle());
+    BOOST_TEST(found != nullptr);
+    BOOST_TEST_EQ(*found, module);
+    BOOST_TEST_EQ(found->GetSize(), module.GetSize());
+    BOOST_TEST(hadesmem::detail::ToUpperOrdinal(found->GetName()) ==
+               hadesmem::detail::ToUpperOrdinal(module.GetName()));
+    auto const last = reinterpret_cast<std::uint8_t*>(module.GetHandle()) +
+                      module.GetSize() - 1;
+    BOOST_TEST(index.FindByAddress(last) == found);
+  }
+
+  hadesmem::Module const this_mod{process, nullptr};
+  BOOST_TEST(index.Find(nullptr) != nullptr);
+  BOOST_TEST_EQ(*index.Find(nullptr), this_mod);
+  hadesmem::Module const ntdll_mod{process, L"NtDll.DlL"};
+  BOOST_TEST(index.Find(L"NtDll.DlL") != nullptr);
+  BOOST_TEST_EQ(*index.Find(L"NtDll.DlL"), ntdll_mod);
+  BOOST_TEST(index.Find(ntdll_mod.GetPath()) != nullptr);
+  BOOST_TEST_EQ(*index.Find(ntdll_mod.GetPath()), ntdll_mod);
+  BOOST_TEST(index.Find(L"") == nullptr);
+  BOOST_TEST(index.Find(L"non_existant_module.dll") == nullptr);
+  BOOST_TEST(index.FindByAddress(nullptr) == nullptr);
+  BOOST_TEST(
+    index.FindByAddress(reinterpret_cast<std::uint8_t*>(&TestModuleIndex)) ==
+    index.Find(nullptr));
+
+  HMODULE const loaded = ::LoadLibraryW(L"winmm.dll");
+  BOOST_TEST(loaded != nullptr);
+  index.Refresh();
+  BOOST_TEST(index.Find(L"winmm.dll") != nullptr);
+  BOOST_TEST_EQ(index.Find(L"winmm.dll")->GetHandle(), loaded);
+  index.Remove(loaded);
+  BOOST_TEST(index.Find(L"winmm.dll") == nullptr);
+  BOOST_TEST(index.Find(loaded) == nullptr);
+  index.Refresh();
+  BOOST_TEST(index.Find(loaded) != nullptr);
+  ::FreeLibrary(loaded);
+}
+
 int main()
 {
   TestModule();
+  TestModuleIndex();
   return boost::report_errors();
 }
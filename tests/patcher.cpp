@@ -4,11 +4,15 @@
 #include <hadesmem/patcher.hpp>
 #include <hadesmem/patcher.hpp>
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
@@ -20,6 +24,7 @@
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/alias_cast.hpp>
+#include <hadesmem/detail/reader_epoch.hpp>
 #include <hadesmem/detail/self_path.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
@@ -198,6 +203,90 @@ void TestPatchDetour2()
   BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337);
 }
 
+extern "C" __declspec(noinline) int __stdcall Scratch2(int a)
+{
+  BOOST_TEST_EQ(a, 42);
+  return 0x1234;
+}
+
+void TestPatchTransaction()
+{
+  hadesmem::Process const& process = GetThisProcess();
+
+  auto volatile const scratch_fn = &Scratch;
+  auto volatile const scratch_2_fn = &Scratch2;
+
+  auto const scratch_detour =
+    [](hadesmem::PatchDetourBase* patch, int a, float b, void* c) {
+      auto const orig = patch->GetTrampolineT<decltype(&Scratch)>();
+      BOOST_TEST_EQ(orig(a, b, c), 0x1337);
+      return 0x42424242;
+    };
+  auto const scratch_2_detour = [](hadesmem::PatchDetourBase* patch, int a) {
+    auto const orig = patch->GetTrampolineT<decltype(&Scratch2)>();
+    BOOST_TEST_EQ(orig(a), 0x1234);
+    return 0x5678;
+  };
+
+  hadesmem::PatchDetour<decltype(Scratch)> detour_1{
+    process, scratch_fn, scratch_detour};
+  hadesmem::PatchDetour<decltype(Scratch2)> detour_2{
+    process, scratch_2_fn, scratch_2_detour};
+
+  hadesmem::PatchTransaction transaction{process};
+  transaction.Add(detour_1);
+  transaction.Add(detour_2);
+  transaction.Apply();
+  BOOST_TEST(detour_1.IsApplied());
+  BOOST_TEST(detour_2.IsApplied());
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x42424242);
+  BOOST_TEST_EQ(scratch_2_fn(42), 0x5678);
+
+  // Already applied patches are skipped.
+  transaction.Apply();
+  BOOST_TEST_EQ(scratch_2_fn(42), 0x5678);
+
+  detour_1.Remove();
+  detour_2.Remove();
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337);
+  BOOST_TEST_EQ(scratch_2_fn(42), 0x1234);
+
+  // A transaction which fails part way through leaves nothing behind,
+  // including the exception handler entries VEH patches register in
+  // PrepareApply. Here the second patch can't be prepared because the first
+  // has already claimed the target, and a new patch for the same target can
+  // only be applied afterwards if the first let go of it.
+  {
+    hadesmem::PatchInt3<decltype(&Scratch2)> int3_1{
+      process, scratch_2_fn, scratch_2_detour};
+    hadesmem::PatchInt3<decltype(&Scratch2)> int3_2{
+      process, scratch_2_fn, scratch_2_detour};
+    hadesmem::PatchTransaction failing{process};
+    failing.Add(int3_1);
+    failing.Add(int3_2);
+    BOOST_TEST_THROWS(failing.Apply(), hadesmem::Error);
+    BOOST_TEST(!int3_1.IsApplied());
+    BOOST_TEST(!int3_2.IsApplied());
+    BOOST_TEST_EQ(scratch_2_fn(42), 0x1234);
+
+    hadesmem::PatchInt3<decltype(&Scratch2)> int3_3{
+      process, scratch_2_fn, scratch_2_detour};
+    hadesmem::PatchTransaction transaction_int3{process};
+    transaction_int3.Add(int3_3);
+    transaction_int3.Apply();
+    BOOST_TEST_EQ(scratch_2_fn(42), 0x5678);
+    BOOST_TEST_EQ(int3_3.GetHitCount(), 1U);
+    int3_3.Remove();
+    BOOST_TEST_EQ(scratch_2_fn(42), 0x1234);
+  }
+
+  // The same patches can be applied again, either way.
+  detour_1.Apply();
+  transaction.Apply();
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x42424242);
+  BOOST_TEST_EQ(scratch_2_fn(42), 0x5678);
+}
+
 void TestPatchRaw()
 {
   hadesmem::Process const& process = GetThisProcess();
@@ -484,6 +573,63 @@ void TestPatchDr()
   TestPatchDetourJmp<hadesmem::PatchDr<decltype(&HookMe)>>();
 }
 
+// Readers use whatever object is published for a while, as the VEH handlers
+// do with hooks, whilst the writer keeps replacing and freeing it. The old
+// object is poisoned before being freed, so a reader which wasn't waited for
+// will see it.
+void TestReaderEpoch()
+{
+  struct Object
+  {
+    std::atomic<std::uint32_t> magic;
+  };
+
+  std::uint32_t const kMagic = 0x12345678;
+  hadesmem::detail::ReaderEpoch reader_epoch;
+  std::atomic<Object*> published{new Object{{kMagic}}};
+  std::atomic<bool> done{false};
+  std::atomic<std::uint32_t> num_bad{0};
+
+  auto const reader = [&]() {
+    while (!done)
+    {
+      hadesmem::detail::ReaderEpochGuard const epoch_guard{reader_epoch};
+      Object* const object = published.load();
+      for (int i = 0; i < 100; ++i)
+      {
+        if (object->magic.load() != kMagic)
+        {
+          ++num_bad;
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i)
+  {
+    readers.emplace_back(reader);
+  }
+
+  for (int i = 0; i < 1000; ++i)
+  {
+    Object* const old_object = published.exchange(new Object{{kMagic}});
+    reader_epoch.Synchronize();
+    old_object->magic = 0;
+    delete old_object;
+  }
+
+  done = true;
+  for (auto& t : readers)
+  {
+    t.join();
+  }
+
+  delete published.load();
+
+  BOOST_TEST_EQ(num_bad.load(), 0U);
+}
+
 __declspec(noinline) void TestGetLastErrorOrig()
 {
   ::SetLastError(0x1234);
@@ -524,13 +670,170 @@ void TestPatchIat()
   TestGetLastErrorOrig();
 }
 
+void TestPatchIatIndex()
+{
+  hadesmem::Process const& process = GetThisProcess();
+  auto const kernel32_mod = GetModuleHandleW(L"kernel32.dll");
+  BOOST_TEST_NE(kernel32_mod, static_cast<HMODULE>(nullptr));
+  __analysis_assume(kernel32_mod != nullptr);
+  auto const get_last_error_orig =
+    reinterpret_cast<void*>(GetProcAddress(kernel32_mod, "GetLastError"));
+
+  hadesmem::ImportSiteIndex index{process};
+  BOOST_TEST(index.GetNumModules() != 0);
+
+  auto const self = GetModuleHandleW(nullptr);
+  auto const has_self_site = [&]() {
+    bool found = false;
+    for (auto const& site : index.Find(L"kernel32.dll", "GetLastError"))
+    {
+      found = found || site.importer == self;
+    }
+    return found;
+  };
+  BOOST_TEST(has_self_site());
+  for (auto const& site : index.Find(L"kernel32.dll", "GetLastError"))
+  {
+    BOOST_TEST_EQ(*static_cast<void**>(site.slot), get_last_error_orig);
+  }
+  index.Remove(self);
+  BOOST_TEST(!has_self_site());
+  index.Add(self);
+  BOOST_TEST(has_self_site());
+  BOOST_TEST(index.Find(L"kernel32.dll", "non_existant_import").empty());
+  BOOST_TEST(index.Find(L"non_existant_module.dll", "GetLastError").empty());
+
+  // An index of a single module's imports finds the same sites.
+  hadesmem::ImportSiteIndex const kernel32_index{process, L"KERNEL32.DLL"};
+  BOOST_TEST_EQ(kernel32_index.Find(L"kernel32.dll", "GetLastError").size(),
+                index.Find(L"kernel32.dll", "GetLastError").size());
+  BOOST_TEST(kernel32_index.Find(L"ntdll.dll", "RtlGetLastWin32Error").empty());
+
+  TestGetLastErrorOrig();
+  auto const get_last_error_detour =
+    [](hadesmem::PatchDetourBase* patch) -> DWORD {
+    (void)patch;
+    return 0x1337UL;
+  };
+  hadesmem::PatchIat<decltype(&::GetLastError)> get_last_error_patch{
+    process, index, L"kernel32.dll", "GetLastError", get_last_error_detour};
+  hadesmem::PatchTransaction transaction{process};
+  get_last_error_patch.Apply(transaction);
+  BOOST_TEST(!get_last_error_patch.IsApplied());
+  TestGetLastErrorOrig();
+  transaction.Apply();
+  BOOST_TEST(get_last_error_patch.IsApplied());
+  TestGetLastErrorHooked();
+
+  // Nothing has been loaded or unloaded, so this shouldn't change anything.
+  index.Refresh();
+  BOOST_TEST(has_self_site());
+  get_last_error_patch.Update(index);
+  TestGetLastErrorHooked();
+
+  get_last_error_patch.Remove();
+  BOOST_TEST(!get_last_error_patch.IsApplied());
+  TestGetLastErrorOrig();
+}
+
+using InjectTestDepFooFn = DWORD_PTR();
+
+// Loads a DLL which imports the hooked function after the patch has been
+// applied, and then unloads it again. injecttest.dll imports
+// InjectTestDep_Foo from injecttestdep.dll, and both are built alongside the
+// tests.
+void TestPatchIatLoad()
+{
+  hadesmem::Process const& process = GetThisProcess();
+  std::wstring const dir_path = hadesmem::detail::GetSelfDirPath();
+  HMODULE const dep_mod =
+    ::LoadLibraryW((dir_path + L"\\injecttestdep.dll").c_str());
+  BOOST_TEST_NE(dep_mod, static_cast<HMODULE>(nullptr));
+  if (!dep_mod)
+  {
+    return;
+  }
+
+  auto const foo_orig = reinterpret_cast<InjectTestDepFooFn*>(
+    ::GetProcAddress(dep_mod, "InjectTestDep_Foo"));
+  BOOST_TEST(foo_orig != nullptr);
+  BOOST_TEST_EQ(foo_orig(), 0U);
+
+  {
+    hadesmem::ImportSiteIndex index{process};
+    auto const foo_detour =
+      [](hadesmem::PatchDetourBase* patch) -> DWORD_PTR {
+      (void)patch;
+      return 0x1337;
+    };
+    hadesmem::PatchIat<InjectTestDepFooFn*> foo_patch{
+      process, index, L"injecttestdep.dll", "InjectTestDep_Foo", foo_detour};
+    foo_patch.Apply();
+
+    HMODULE const test_mod =
+      ::LoadLibraryW((dir_path + L"\\injecttest.dll").c_str());
+    BOOST_TEST_NE(test_mod, static_cast<HMODULE>(nullptr));
+    if (!test_mod)
+    {
+      return;
+    }
+
+    auto const find_test_slot = [&]() -> void* {
+      for (auto const& site :
+           index.Find(L"injecttestdep.dll", "InjectTestDep_Foo"))
+      {
+        if (site.importer == test_mod)
+        {
+          return site.slot;
+        }
+      }
+      return nullptr;
+    };
+    BOOST_TEST(find_test_slot() == nullptr);
+    index.Refresh();
+    auto const slot = static_cast<InjectTestDepFooFn**>(find_test_slot());
+    BOOST_TEST(slot != nullptr);
+    if (slot)
+    {
+      // The loader bound the slot through the (hooked) EAT, so it already
+      // calls the detour. After the update the slot is hooked directly, so
+      // it's restored along with everything else on removal.
+      InjectTestDepFooFn* const bound = *slot;
+      foo_patch.Update(index);
+      BOOST_TEST(*slot != bound);
+      BOOST_TEST_EQ((*slot)(), 0x1337U);
+      foo_patch.Remove();
+      BOOST_TEST(*slot == bound);
+      foo_patch.Apply();
+      BOOST_TEST(*slot != bound);
+    }
+
+    // Once the DLL is gone the hook on its slot has to be forgotten, rather
+    // than being written back to on removal.
+    BOOST_TEST(::FreeLibrary(test_mod));
+    index.Refresh();
+    BOOST_TEST(find_test_slot() == nullptr);
+    foo_patch.Update(index);
+    BOOST_TEST(foo_patch.IsApplied());
+    foo_patch.Remove();
+    BOOST_TEST(!foo_patch.IsApplied());
+    BOOST_TEST_EQ(foo_orig(), 0U);
+  }
+
+  BOOST_TEST(::FreeLibrary(dep_mod));
+}
+
 int main()
 {
   TestPatchRaw();
   TestPatchDetour();
   TestPatchInt3();
   TestPatchDr();
+  TestReaderEpoch();
   TestPatchDetour2();
+  TestPatchTransaction();
   TestPatchIat();
+  TestPatchIatIndex();
+  TestPatchIatLoad();
   return boost::report_errors();
 }
@@ -12,11 +12,13 @@
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/find_procedure.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/module.hpp>
 #include <hadesmem/module_list.hpp>
 #include <hadesmem/pelib/export.hpp>
 #include <hadesmem/pelib/export_dir.hpp>
+#include <hadesmem/pelib/export_index.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/read.hpp>
@@ -93,8 +95,125 @@ void TestExportList()
   BOOST_TEST(processed_one_export_list);
 }
 
+void TestExportIndex()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  for (auto const& name : {L"ntdll.dll", L"kernel32.dll"})
+  {
+    HMODULE const mod = ::GetModuleHandleW(name);
+    BOOST_TEST(mod != nullptr);
+
+    hadesmem::PeFile const pe_file(
+      process, mod, hadesmem::PeFileType::kImage, 0);
+    hadesmem::ExportIndex const index(process, pe_file);
+    hadesmem::ExportDir const export_dir(process, pe_file);
+    BOOST_TEST_EQ(index.GetOrdinalBase(), export_dir.GetOrdinalBase());
+    BOOST_TEST_EQ(index.GetNumberOfFunctions(),
+                  export_dir.GetNumberOfFunctions());
+    BOOST_TEST_EQ(index.GetNumberOfNames(), export_dir.GetNumberOfNames());
+
+    hadesmem::ExportList const export_list(process, pe_file);
+    for (auto const& e : export_list)
+    {
+      WORD ordinal_number = 0;
+      BOOST_TEST(
+        index.FindOrdinalNumber(e.GetProcedureNumber(), &ordinal_number));
+      BOOST_TEST_EQ(ordinal_number, e.GetOrdinalNumber());
+
+      if (e.ByName())
+      {
+        BOOST_TEST(index.FindOrdinalNumber(e.GetName(), &ordinal_number));
+        BOOST_TEST_EQ(ordinal_number, e.GetOrdinalNumber());
+      }
+
+      BOOST_TEST_EQ(index.IsForwarded(ordinal_number), e.IsForwarded());
+      if (e.IsForwarded())
+      {
+        BOOST_TEST_EQ(index.GetForwarder(ordinal_number), e.GetForwarder());
+      }
+      else
+      {
+        BOOST_TEST_EQ(index.GetFunctionRva(ordinal_number), e.GetRva());
+      }
+    }
+
+    WORD ordinal_number = 0;
+    BOOST_TEST(
+      !index.FindOrdinalNumber("non_existant_export", &ordinal_number));
+  }
+
+  HMODULE const kernel32 = ::GetModuleHandleW(L"kernel32.dll");
+  // HeapAlloc and AcquireSRWLockShared are forwarded to ntdll.
+  for (auto const& name :
+       {"GetProcAddress", "HeapAlloc", "AcquireSRWLockShared"})
+  {
+    BOOST_TEST_EQ(
+      hadesmem::detail::GetProcAddressInternal(process, kernel32, name),
+      ::GetProcAddress(kernel32, name));
+  }
+  BOOST_TEST_EQ(hadesmem::detail::GetProcAddressInternal(
+                  process, kernel32, "non_existant_export"),
+                static_cast<FARPROC>(nullptr));
+}
+
+void TestExportNameViews()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  HMODULE const kernel32 = ::GetModuleHandleW(L"kernel32.dll");
+  BOOST_TEST(kernel32 != nullptr);
+
+  hadesmem::PeFile const pe_file_remote(
+    process, kernel32, hadesmem::PeFileType::kImage, 0);
+  hadesmem::PeFile const pe_file_local(process,
+                                       kernel32,
+                                       hadesmem::PeFileType::kImage,
+                                       0,
+                                       hadesmem::PeFileFlags::kLocalBuffer);
+  auto const local_beg = static_cast<char const*>(pe_file_local.GetBase());
+  auto const local_end = local_beg + pe_file_local.GetSize();
+
+  bool found_forwarded = false;
+  hadesmem::ExportList const export_list(process, pe_file_local);
+  for (auto const& e : export_list)
+  {
+    hadesmem::Export const e_remote(
+      process, pe_file_remote, e.GetProcedureNumber());
+    BOOST_TEST(e.GetNameView() == e_remote.GetName());
+    BOOST_TEST(e_remote.GetNameView() == e.GetName());
+    BOOST_TEST(e.GetForwarderView() == e_remote.GetForwarder());
+    BOOST_TEST(e.GetForwarderModuleView() == e_remote.GetForwarderModule());
+    BOOST_TEST(e.GetForwarderFunctionView() ==
+               e_remote.GetForwarderFunction());
+    BOOST_TEST_EQ(e.IsForwardedByOrdinal(), e_remote.IsForwardedByOrdinal());
+
+    // Names in local buffers should be referenced rather than copied.
+    if (e.ByName())
+    {
+      auto const name = e.GetNameView();
+      BOOST_TEST(name.data() >= local_beg && name.data() < local_end);
+    }
+
+    if (e.IsForwarded())
+    {
+      found_forwarded = true;
+      auto const forwarder = e.GetForwarderView();
+      BOOST_TEST(forwarder.data() >= local_beg && forwarder.data() < local_end);
+      BOOST_TEST(e.GetForwarderModuleView().to_string() + "." +
+                   e.GetForwarderFunctionView().to_string() ==
+                 e.GetForwarder());
+    }
+  }
+
+  // HeapAlloc is forwarded to ntdll.
+  BOOST_TEST(found_forwarded);
+}
+
 int main()
 {
   TestExportList();
+  TestExportIndex();
+  TestExportNameViews();
   return boost::report_errors();
 }
@@ -4,20 +4,28 @@
 #include <hadesmem/pelib/import_dir_list.hpp>
 #include <hadesmem/pelib/import_dir_list.hpp>
 
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <sstream>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/self_path.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/module.hpp>
 #include <hadesmem/module_list.hpp>
 #include <hadesmem/pelib/import_dir.hpp>
 #include <hadesmem/pelib/import_thunk.hpp>
 #include <hadesmem/pelib/import_thunk_list.hpp>
+#include <hadesmem/pelib/import_thunk_span.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/read.hpp>
@@ -110,6 +118,34 @@ void TestImportDirList()
       hadesmem::ImportThunkList import_thunks(
         process, cur_pe_file, d.GetOriginalFirstThunk());
       BOOST_TEST(std::begin(import_thunks) != std::end(import_thunks));
+
+      hadesmem::ImportThunkSpan const import_thunk_span(
+        process, cur_pe_file, d.GetOriginalFirstThunk());
+      BOOST_TEST_EQ(static_cast<std::size_t>(std::distance(
+                      std::begin(import_thunks), std::end(import_thunks))),
+                    import_thunk_span.size());
+      std::size_t thunk_index = 0;
+      for (auto const& t : import_thunks)
+      {
+        if (thunk_index >= import_thunk_span.size())
+        {
+          break;
+        }
+
+        auto const& entry = import_thunk_span[thunk_index++];
+        BOOST_TEST_EQ(entry.GetBase(), t.GetBase());
+        BOOST_TEST_EQ(entry.GetAddressOfData(), t.GetAddressOfData());
+        BOOST_TEST_EQ(entry.ByOrdinal(), t.ByOrdinal());
+        if (entry.ByOrdinal())
+        {
+          BOOST_TEST_EQ(entry.GetOrdinal(), t.GetOrdinal());
+        }
+        else
+        {
+          BOOST_TEST_EQ(import_thunk_span.GetHint(entry), t.GetHint());
+          BOOST_TEST_EQ(import_thunk_span.GetName(entry), t.GetName());
+        }
+      }
       for (auto const& t : import_thunks)
       {
         hadesmem::ImportThunk test_thunk(
@@ -158,8 +194,114 @@ void TestImportDirList()
   BOOST_TEST(processed_one_import_dir);
 }
 
+namespace
+{
+// Views of local buffers have to point into the file, and everything else
+// into the storage, with the same contents as GetName either way.
+void CheckNameView(hadesmem::PeFile const& pe_file,
+                   hadesmem::detail::StringView view,
+                   std::string const& storage,
+                   std::string const& name)
+{
+  BOOST_TEST_EQ(view.to_string(), name);
+  if (pe_file.IsLocal())
+  {
+    auto const beg = static_cast<char const*>(pe_file.GetBase());
+    BOOST_TEST(view.data() >= beg &&
+               view.data() + view.size() <= beg + pe_file.GetSize());
+  }
+  else
+  {
+    BOOST_TEST(view.data() == storage.data());
+  }
+}
+
+std::size_t CheckImportNameViews(hadesmem::Process const& process,
+                                 hadesmem::PeFile const& pe_file)
+{
+  std::size_t num_names = 0;
+  // Shared between every call, as callers are expected to do.
+  std::string storage;
+  hadesmem::ImportDirList const import_dirs(process, pe_file);
+  for (auto const& d : import_dirs)
+  {
+    auto const dir_view = d.GetNameView(storage);
+    CheckNameView(pe_file, dir_view, storage, d.GetName());
+    ++num_names;
+
+    if (!d.GetOriginalFirstThunk())
+    {
+      continue;
+    }
+
+    hadesmem::ImportThunkList const import_thunks(
+      process, pe_file, d.GetOriginalFirstThunk());
+    hadesmem::ImportThunkSpan const import_thunk_span(
+      process, pe_file, d.GetOriginalFirstThunk());
+    std::size_t thunk_index = 0;
+    for (auto const& t : import_thunks)
+    {
+      if (thunk_index >= import_thunk_span.size())
+      {
+        break;
+      }
+
+      auto const& entry = import_thunk_span[thunk_index++];
+      if (t.ByOrdinal())
+      {
+        continue;
+      }
+
+      std::string const name = t.GetName();
+      CheckNameView(pe_file, t.GetNameView(storage), storage, name);
+      CheckNameView(pe_file,
+                    import_thunk_span.GetNameView(entry, storage),
+                    storage,
+                    name);
+      ++num_names;
+    }
+  }
+
+  return num_names;
+}
+}
+
+void TestImportNameViews()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  // Our own image is readable in its entirety, so it can be used as a local
+  // buffer too.
+  for (auto const flags :
+       {hadesmem::PeFileFlags::kNone, hadesmem::PeFileFlags::kLocalBuffer})
+  {
+    hadesmem::PeFile const pe_file(process,
+                                   ::GetModuleHandleW(nullptr),
+                                   hadesmem::PeFileType::kImage,
+                                   0,
+                                   flags);
+    BOOST_TEST_EQ(pe_file.IsLocal(),
+                  flags == hadesmem::PeFileFlags::kLocalBuffer);
+    BOOST_TEST(CheckImportNameViews(process, pe_file) != 0);
+  }
+
+  std::vector<char> buf =
+    hadesmem::detail::PeFileToBuffer(hadesmem::detail::GetSelfPath());
+  for (auto const flags :
+       {hadesmem::PeFileFlags::kNone, hadesmem::PeFileFlags::kLocalBuffer})
+  {
+    hadesmem::PeFile const pe_file(process,
+                                   buf.data(),
+                                   hadesmem::PeFileType::kData,
+                                   static_cast<DWORD>(buf.size()),
+                                   flags);
+    BOOST_TEST(CheckImportNameViews(process, pe_file) != 0);
+  }
+}
+
 int main()
 {
   TestImportDirList();
+  TestImportNameViews();
   return boost::report_errors();
 }
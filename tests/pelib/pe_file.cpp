@@ -4,16 +4,25 @@
 #include <hadesmem/pelib/pe_file.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
 
+#include <algorithm>
+#include <exception>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/mapped_file.hpp>
+#include <hadesmem/detail/self_path.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/module.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/section.hpp>
+#include <hadesmem/pelib/section_list.hpp>
 #include <hadesmem/process.hpp>
 
 // TODO: More comprehensive PE file testing.
@@ -84,8 +93,360 @@ void TestPeFile()
   BOOST_TEST_NE(test_str_1.str(), test_str_3.str());
 }
 
+void TestPeFileLocalBuffer()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  std::vector<char> buf =
+    hadesmem::detail::PeFileToBuffer(hadesmem::detail::GetSelfPath());
+  auto const buf_size = static_cast<DWORD>(buf.size());
+
+  hadesmem::PeFile const pe_file_remote(
+    process, buf.data(), hadesmem::PeFileType::kData, buf_size);
+  hadesmem::PeFile const pe_file_local(process,
+                                       buf.data(),
+                                       hadesmem::PeFileType::kData,
+                                       buf_size,
+                                       hadesmem::PeFileFlags::kLocalBuffer);
+  BOOST_TEST(!pe_file_remote.IsLocal());
+  BOOST_TEST(pe_file_local.IsLocal());
+  BOOST_TEST_EQ(pe_file_local.Is64(), pe_file_remote.Is64());
+
+  hadesmem::NtHeaders const nt_headers_remote(process, pe_file_remote);
+  hadesmem::NtHeaders const nt_headers_local(process, pe_file_local);
+  BOOST_TEST_EQ(nt_headers_local.GetNumberOfSections(),
+                nt_headers_remote.GetNumberOfSections());
+  BOOST_TEST_EQ(nt_headers_local.GetSizeOfImage(),
+                nt_headers_remote.GetSizeOfImage());
+
+  hadesmem::SectionList const sections(process, pe_file_local);
+  for (auto const& section : sections)
+  {
+    DWORD const rva = section.GetVirtualAddress();
+    BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file_local, rva),
+                  hadesmem::RvaToVa(process, pe_file_remote, rva));
+    DWORD const file_offset = section.GetPointerToRawData();
+    BOOST_TEST_EQ(
+      hadesmem::FileOffsetToRva(process, pe_file_local, file_offset),
+      hadesmem::FileOffsetToRva(process, pe_file_remote, file_offset));
+  }
+
+  // Reads are bounds checked against the buffer rather than relying on the
+  // surrounding memory being inaccessible.
+  auto const& local_span = pe_file_local.GetLocalSpan();
+  BOOST_TEST_EQ(local_span.GetSize(), buf.size());
+  BOOST_TEST_THROWS(local_span.Read<DWORD>(buf.data() + buf.size() - 1),
+                    hadesmem::Error);
+  BOOST_TEST_THROWS(local_span.Read<DWORD>(buf.data() - 1), hadesmem::Error);
+  BOOST_TEST_EQ(local_span.ReadString<char>(buf.data(), buf.data() + 2),
+                std::string("MZ"));
+
+  BOOST_TEST_THROWS(hadesmem::PeFile(process,
+                                     buf.data(),
+                                     hadesmem::PeFileType::kData,
+                                     0,
+                                     hadesmem::PeFileFlags::kLocalBuffer),
+                    hadesmem::Error);
+}
+
+void TestPeFileMapped()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  auto const self_path = hadesmem::detail::GetSelfPath();
+  std::vector<char> buf = hadesmem::detail::PeFileToBuffer(self_path);
+
+  hadesmem::detail::MappedFileView view;
+  {
+    hadesmem::detail::MappedFile const file{self_path};
+    BOOST_TEST_EQ(file.GetSize(), buf.size());
+    // Assume the tests aren't being run from a network share.
+    BOOST_TEST(file.IsLocal());
+    view = file.MapPeView();
+    BOOST_TEST(file.ReadPe() == buf);
+
+    // Unaligned windows, including one which is clamped to the end of the
+    // file.
+    std::size_t const window_size = 0x10;
+    for (std::size_t const offset :
+         {std::size_t{1}, std::size_t{0x1001}, buf.size() - 3})
+    {
+      auto const window = file.MapView(offset, window_size);
+      std::size_t const expected_size =
+        (std::min)(buf.size() - offset, window_size);
+      BOOST_TEST_EQ(window.GetSize(), expected_size);
+      BOOST_TEST(std::equal(static_cast<char const*>(window.GetBase()),
+                            static_cast<char const*>(window.GetBase()) +
+                              window.GetSize(),
+                            buf.data() + offset));
+
+      auto const read = file.Read(offset, window_size);
+      BOOST_TEST_EQ(read.size(), expected_size);
+      BOOST_TEST(std::equal(read.cbegin(), read.cend(), buf.data() + offset));
+    }
+
+    BOOST_TEST_THROWS(file.MapView(buf.size(), 1), hadesmem::Error);
+    BOOST_TEST_THROWS(file.MapView(0, 0), hadesmem::Error);
+    BOOST_TEST_THROWS(file.Read(buf.size(), 1), hadesmem::Error);
+    BOOST_TEST_THROWS(file.Read(0, 0), hadesmem::Error);
+  }
+
+  BOOST_TEST_EQ(view.GetSize(), buf.size());
+  BOOST_TEST(std::equal(buf.cbegin(),
+                        buf.cend(),
+                        static_cast<char const*>(view.GetBase())));
+
+  hadesmem::PeFile const pe_file_mapped(process,
+                                        view.GetBase(),
+                                        hadesmem::PeFileType::kData,
+                                        static_cast<DWORD>(view.GetSize()),
+                                        hadesmem::PeFileFlags::kLocalBuffer);
+  hadesmem::PeFile const pe_file_buf(process,
+                                     buf.data(),
+                                     hadesmem::PeFileType::kData,
+                                     static_cast<DWORD>(buf.size()),
+                                     hadesmem::PeFileFlags::kLocalBuffer);
+  hadesmem::NtHeaders const nt_headers_mapped(process, pe_file_mapped);
+  hadesmem::NtHeaders const nt_headers_buf(process, pe_file_buf);
+  BOOST_TEST_EQ(nt_headers_mapped.GetNumberOfSections(),
+                nt_headers_buf.GetNumberOfSections());
+  BOOST_TEST_EQ(nt_headers_mapped.GetSizeOfImage(),
+                nt_headers_buf.GetSizeOfImage());
+}
+
+// The cached layout must give exactly the same results as parsing the headers
+// on every call, including for malformed files.
+void TestPeFileLayout()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  std::vector<char> const original =
+    hadesmem::detail::PeFileToBuffer(hadesmem::detail::GetSelfPath());
+
+  auto const compare = [&](std::vector<char>& buf, DWORD size) {
+    hadesmem::PeFile const pe_file(process,
+                                   buf.data(),
+                                   hadesmem::PeFileType::kData,
+                                   size,
+                                   hadesmem::PeFileFlags::kLocalBuffer);
+    auto const check = [&](DWORD rva) {
+      bool virtual_va = false;
+      bool virtual_va_uncached = false;
+      void* va = nullptr;
+      void* va_uncached = nullptr;
+      bool threw = false;
+      bool threw_uncached = false;
+      try
+      {
+        va = hadesmem::RvaToVa(process, pe_file, rva, &virtual_va);
+      }
+      catch (std::exception const& /*e*/)
+      {
+        threw = true;
+      }
+      try
+      {
+        va_uncached = hadesmem::detail::RvaToVaUncached(
+          process, pe_file, rva, &virtual_va_uncached);
+      }
+      catch (std::exception const& /*e*/)
+      {
+        threw_uncached = true;
+      }
+      BOOST_TEST_EQ(threw, threw_uncached);
+      BOOST_TEST_EQ(va, va_uncached);
+      BOOST_TEST_EQ(virtual_va, virtual_va_uncached);
+    };
+
+    for (DWORD rva = 0; rva < size + 0x2000; rva += 0x3F)
+    {
+      check(rva);
+    }
+
+    // Section boundaries are where the two are most likely to disagree. The
+    // headers may be too broken to enumerate the sections at all, which is
+    // fine, as the sweep above has already covered that case.
+    std::vector<DWORD> rvas;
+    std::vector<DWORD> file_offsets;
+    try
+    {
+      for (hadesmem::Section const& section :
+           hadesmem::SectionList(process, pe_file))
+      {
+        for (DWORD const delta : {0U, 1U, static_cast<DWORD>(-1)})
+        {
+          rvas.push_back(section.GetVirtualAddress() + delta);
+          rvas.push_back(section.GetVirtualAddress() +
+                         section.GetVirtualSize() + delta);
+          rvas.push_back(section.GetVirtualAddress() +
+                         section.GetSizeOfRawData() + delta);
+          file_offsets.push_back(section.GetPointerToRawData() + delta);
+        }
+      }
+    }
+    catch (std::exception const& /*e*/)
+    {
+    }
+
+    for (auto const rva : rvas)
+    {
+      check(rva);
+    }
+
+    for (auto const file_offset : file_offsets)
+    {
+      BOOST_TEST_EQ(hadesmem::FileOffsetToRva(process, pe_file, file_offset),
+                    hadesmem::detail::FileOffsetToRvaUncached(
+                      process, pe_file, file_offset));
+    }
+  };
+
+  auto const get_file_header = [](std::vector<char>& buf) {
+    auto const dos_header = reinterpret_cast<IMAGE_DOS_HEADER*>(buf.data());
+    return reinterpret_cast<IMAGE_FILE_HEADER*>(
+      buf.data() + dos_header->e_lfanew + sizeof(DWORD));
+  };
+  auto const get_sections = [&](std::vector<char>& buf) {
+    IMAGE_FILE_HEADER* const file_header = get_file_header(buf);
+    return reinterpret_cast<IMAGE_SECTION_HEADER*>(
+      reinterpret_cast<char*>(file_header + 1) +
+      file_header->SizeOfOptionalHeader);
+  };
+
+  // Unmodified.
+  {
+    std::vector<char> buf = original;
+    compare(buf, static_cast<DWORD>(buf.size()));
+  }
+
+  // Overlapping sections, and a zero VirtualSize.
+  {
+    std::vector<char> buf = original;
+    if (get_file_header(buf)->NumberOfSections > 1)
+    {
+      IMAGE_SECTION_HEADER* const sections = get_sections(buf);
+      sections[1].VirtualAddress = sections[0].VirtualAddress;
+      sections[0].Misc.VirtualSize = 0;
+    }
+    compare(buf, static_cast<DWORD>(buf.size()));
+  }
+
+  // Low PointerToRawData, which is rounded down to zero.
+  {
+    std::vector<char> buf = original;
+    get_sections(buf)[0].PointerToRawData = 0x1FF;
+    compare(buf, static_cast<DWORD>(buf.size()));
+  }
+
+  // No sections.
+  {
+    std::vector<char> buf = original;
+    get_file_header(buf)->NumberOfSections = 0;
+    compare(buf, static_cast<DWORD>(buf.size()));
+  }
+
+  // Section table partially outside the file.
+  {
+    std::vector<char> buf = original;
+    auto const table_offset = static_cast<std::size_t>(
+      reinterpret_cast<char*>(get_sections(buf)) - buf.data());
+    DWORD const size = static_cast<DWORD>(
+      table_offset + sizeof(IMAGE_SECTION_HEADER) + 1);
+    compare(buf, size);
+  }
+
+  // Section table entirely outside the file.
+  {
+    std::vector<char> buf = original;
+    get_file_header(buf)->SizeOfOptionalHeader = 0xFFFF;
+    compare(buf, static_cast<DWORD>(buf.size()));
+  }
+
+  // Invalid headers. Not cached at all, so they fail as they always have.
+  {
+    std::vector<char> buf = original;
+    reinterpret_cast<IMAGE_DOS_HEADER*>(buf.data())->e_magic = 0;
+    compare(buf, static_cast<DWORD>(buf.size()));
+  }
+}
+
+// Writing the headers through the PeLib objects must be reflected in the
+// cached layout, as the dumper relies on this when fixing up its output.
+void TestPeFileLayoutRefresh()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  std::vector<char> buf =
+    hadesmem::detail::PeFileToBuffer(hadesmem::detail::GetSelfPath());
+  hadesmem::PeFile const pe_file(process,
+                                 buf.data(),
+                                 hadesmem::PeFileType::kData,
+                                 static_cast<DWORD>(buf.size()));
+  BOOST_TEST(pe_file.GetLayout() != nullptr);
+
+  auto const rva_to_va = [&](DWORD rva) -> void* {
+    try
+    {
+      return hadesmem::RvaToVa(process, pe_file, rva);
+    }
+    catch (std::exception const& /*e*/)
+    {
+      return nullptr;
+    }
+  };
+  auto const rva_to_va_uncached = [&](DWORD rva) -> void* {
+    try
+    {
+      return hadesmem::detail::RvaToVaUncached(process, pe_file, rva, nullptr);
+    }
+    catch (std::exception const& /*e*/)
+    {
+      return nullptr;
+    }
+  };
+
+  // Point the first section at different data in the file.
+  hadesmem::Section section(process, pe_file, static_cast<WORD>(0));
+  DWORD const va = section.GetVirtualAddress();
+  DWORD const old_ptr_raw_data = section.GetPointerToRawData();
+  DWORD const new_ptr_raw_data = old_ptr_raw_data + 0x200;
+  BOOST_TEST(section.GetSizeOfRawData() > 0x210);
+  void* const old_expected_va = buf.data() + old_ptr_raw_data + 0x10;
+  void* const new_expected_va = buf.data() + new_ptr_raw_data + 0x10;
+  BOOST_TEST_EQ(rva_to_va(va + 0x10), old_expected_va);
+
+  section.SetPointerToRawData(new_ptr_raw_data);
+  section.UpdateWrite();
+  BOOST_TEST_EQ(rva_to_va(va + 0x10), new_expected_va);
+  BOOST_TEST_EQ(rva_to_va(va + 0x10), rva_to_va_uncached(va + 0x10));
+  BOOST_TEST_EQ(
+    hadesmem::FileOffsetToRva(process, pe_file, new_ptr_raw_data + 0x10),
+    va + 0x10);
+
+  // Headers written directly need an explicit refresh.
+  auto const raw_section =
+    static_cast<IMAGE_SECTION_HEADER*>(section.GetBase());
+  raw_section->PointerToRawData = old_ptr_raw_data;
+  pe_file.RefreshLayout();
+  BOOST_TEST_EQ(rva_to_va(va + 0x10), old_expected_va);
+  BOOST_TEST_EQ(
+    hadesmem::FileOffsetToRva(process, pe_file, old_ptr_raw_data + 0x10),
+    va + 0x10);
+
+  // Removing every section leaves only the headers mapped.
+  hadesmem::NtHeaders nt_headers(process, pe_file);
+  nt_headers.SetNumberOfSections(0);
+  nt_headers.UpdateWrite();
+  BOOST_TEST_EQ(rva_to_va(va + 0x10), rva_to_va_uncached(va + 0x10));
+  BOOST_TEST(rva_to_va(va + 0x10) != old_expected_va);
+}
+
 int main()
 {
   TestPeFile();
+  TestPeFileLocalBuffer();
+  TestPeFileMapped();
+  TestPeFileLayout();
+  TestPeFileLayoutRefresh();
   return boost::report_errors();
 }
@@ -0,0 +1,207 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/pelib/relocation_block_list.hpp>
+#include <hadesmem/pelib/relocation_block_list.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/self_path.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_list.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/pelib/relocation_block.hpp>
+#include <hadesmem/pelib/relocation_block_span.hpp>
+#include <hadesmem/pelib/relocation_list.hpp>
+#include <hadesmem/process.hpp>
+
+namespace
+{
+// Checks the span against RelocationBlockList/RelocationList, block by block
+// and relocation by relocation, and returns the number of blocks.
+std::size_t
+  CheckRelocationBlockSpan(hadesmem::Process const& process,
+                           hadesmem::PeFile const& pe_file,
+                           hadesmem::RelocationBlockSpan const& span)
+{
+  hadesmem::RelocationBlockList const blocks(process, pe_file);
+  std::size_t i = 0;
+  for (auto const& block : blocks)
+  {
+    BOOST_TEST(i < span.size());
+    if (i >= span.size())
+    {
+      return i;
+    }
+
+    auto const& entry = span[i++];
+    BOOST_TEST_EQ(entry.GetBase(), block.GetBase());
+    BOOST_TEST_EQ(entry.GetVirtualAddress(), block.GetVirtualAddress());
+    BOOST_TEST_EQ(entry.GetSizeOfBlock(), block.GetSizeOfBlock());
+    BOOST_TEST_EQ(entry.GetNumberOfRelocations(),
+                  block.GetNumberOfRelocations());
+    BOOST_TEST_EQ(entry.GetRelocationDataStart(),
+                  block.GetRelocationDataStart());
+
+    hadesmem::RelocationList const relocs(process,
+                                          pe_file,
+                                          block.GetRelocationDataStart(),
+                                          block.GetNumberOfRelocations());
+    auto reloc_entry = entry.begin();
+    for (auto const& reloc : relocs)
+    {
+      BOOST_TEST(reloc_entry != entry.end());
+      if (reloc_entry == entry.end())
+      {
+        break;
+      }
+
+      BOOST_TEST_EQ(static_cast<unsigned int>(reloc_entry->GetType()),
+                    static_cast<unsigned int>(reloc.GetType()));
+      BOOST_TEST_EQ(reloc_entry->GetOffset(), reloc.GetOffset());
+      ++reloc_entry;
+    }
+    BOOST_TEST(reloc_entry == entry.end());
+  }
+  BOOST_TEST_EQ(i, span.size());
+
+  std::size_t num_iterated = 0;
+  for (auto const& entry : span)
+  {
+    (void)entry;
+    ++num_iterated;
+  }
+  BOOST_TEST_EQ(num_iterated, span.size());
+  BOOST_TEST_EQ(span.empty(), !span.size());
+
+  return i;
+}
+}
+
+void TestRelocationBlockSpanModules()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  std::size_t num_blocks = 0;
+  hadesmem::ModuleList modules(process);
+  for (auto const& mod : modules)
+  {
+    hadesmem::PeFile const pe_file(
+      process, mod.GetHandle(), hadesmem::PeFileType::kImage, 0);
+
+    hadesmem::RelocationBlockSpan const span(process, pe_file);
+    num_blocks += CheckRelocationBlockSpan(process, pe_file, span);
+  }
+
+  // Assume at least one module (e.g. this one) has relocations.
+  BOOST_TEST(num_blocks > 0);
+}
+
+void TestRelocationBlockSpanDataFile()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  std::vector<char> buf =
+    hadesmem::detail::PeFileToBuffer(hadesmem::detail::GetSelfPath());
+  hadesmem::PeFile const pe_file(process,
+                                 buf.data(),
+                                 hadesmem::PeFileType::kData,
+                                 static_cast<DWORD>(buf.size()));
+
+  hadesmem::RelocationBlockSpan const span(process, pe_file);
+  BOOST_TEST(!span.empty());
+  CheckRelocationBlockSpan(process, pe_file, span);
+  if (span.empty())
+  {
+    return;
+  }
+
+  // Cut the directory off part way through the second block (or the first,
+  // if there's only one). Termination has to match the lists exactly.
+  hadesmem::NtHeaders nt_headers(process, pe_file);
+  DWORD const dir_size =
+    nt_headers.GetDataDirectorySize(hadesmem::PeDataDir::BaseReloc);
+  DWORD const first_size = span[0].GetSizeOfBlock();
+  for (DWORD const truncated_size : {first_size + 6,
+                                     first_size - 2,
+                                     first_size,
+                                     static_cast<DWORD>(4)})
+  {
+    if (truncated_size >= dir_size)
+    {
+      continue;
+    }
+
+    nt_headers.SetDataDirectorySize(hadesmem::PeDataDir::BaseReloc,
+                                    truncated_size);
+    nt_headers.UpdateWrite();
+    hadesmem::RelocationBlockSpan const truncated_span(process, pe_file);
+    CheckRelocationBlockSpan(process, pe_file, truncated_span);
+    BOOST_TEST(truncated_span.size() <= span.size());
+  }
+  nt_headers.SetDataDirectorySize(hadesmem::PeDataDir::BaseReloc, dir_size);
+  nt_headers.UpdateWrite();
+
+  // A file which ends part way through the directory.
+  auto const dir_beg = static_cast<char*>(span[0].GetBase());
+  auto const truncated_file_size =
+    static_cast<DWORD>(dir_beg - buf.data()) + dir_size / 2;
+  hadesmem::PeFile const truncated_pe_file(process,
+                                           buf.data(),
+                                           hadesmem::PeFileType::kData,
+                                           truncated_file_size);
+  hadesmem::RelocationBlockSpan const truncated_file_span(process,
+                                                          truncated_pe_file);
+  CheckRelocationBlockSpan(process, truncated_pe_file, truncated_file_span);
+}
+
+void TestRelocationBlockSpanMove()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  hadesmem::PeFile const pe_file(
+    process, ::GetModuleHandleW(nullptr), hadesmem::PeFileType::kImage, 0);
+  hadesmem::PeFile const pe_file_ntdll(
+    process, ::GetModuleHandleW(L"ntdll"), hadesmem::PeFileType::kImage, 0);
+
+  // Blocks point into the span's storage, so this checks they still do
+  // after it has moved.
+  hadesmem::RelocationBlockSpan span(process, pe_file);
+  std::size_t const num_blocks = span.size();
+  BOOST_TEST(num_blocks > 0);
+
+  hadesmem::RelocationBlockSpan moved{std::move(span)};
+  BOOST_TEST_EQ(moved.size(), num_blocks);
+  CheckRelocationBlockSpan(process, pe_file, moved);
+  BOOST_TEST(span.empty());
+  BOOST_TEST(span.begin() == span.end());
+
+  hadesmem::RelocationBlockSpan assigned(process, pe_file_ntdll);
+  assigned = std::move(moved);
+  BOOST_TEST_EQ(assigned.size(), num_blocks);
+  CheckRelocationBlockSpan(process, pe_file, assigned);
+
+  // The moved-from spans can be assigned to again.
+  span = std::move(assigned);
+  CheckRelocationBlockSpan(process, pe_file, span);
+  moved = hadesmem::RelocationBlockSpan(process, pe_file_ntdll);
+  CheckRelocationBlockSpan(process, pe_file_ntdll, moved);
+}
+
+int main()
+{
+  TestRelocationBlockSpanModules();
+  TestRelocationBlockSpanDataFile();
+  TestRelocationBlockSpanMove();
+  return boost::report_errors();
+}
@@ -4,20 +4,27 @@
 #include <hadesmem/pelib/section_list.hpp>
 #include <hadesmem/pelib/section_list.hpp>
 
+#include <cstddef>
+#include <cstdint>
 #include <sstream>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/self_path.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/module.hpp>
 #include <hadesmem/module_list.hpp>
 #include <hadesmem/pelib/nt_headers.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
 #include <hadesmem/pelib/section.hpp>
+#include <hadesmem/pelib/section_span.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/read.hpp>
 
@@ -121,8 +128,117 @@ void TestSectionList()
   }
 }
 
+void TestSectionSpan()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  hadesmem::ModuleList modules(process);
+  for (auto const& mod : modules)
+  {
+    hadesmem::PeFile const pe_file(
+      process, mod.GetHandle(), hadesmem::PeFileType::kImage, 0);
+
+    hadesmem::SectionList const sections(process, pe_file);
+    hadesmem::SectionSpan const section_span(process, pe_file);
+    BOOST_TEST(!section_span.empty());
+    std::size_t i = 0;
+    for (auto const& section : sections)
+    {
+      BOOST_TEST(i < section_span.size());
+      if (i >= section_span.size())
+      {
+        break;
+      }
+
+      auto const& entry = section_span[i++];
+      BOOST_TEST_EQ(entry.GetBase(), section.GetBase());
+      BOOST_TEST_EQ(entry.GetName(), section.GetName());
+      BOOST_TEST_EQ(entry.GetVirtualAddress(), section.GetVirtualAddress());
+      BOOST_TEST_EQ(entry.GetVirtualSize(), section.GetVirtualSize());
+      BOOST_TEST_EQ(entry.GetSizeOfRawData(), section.GetSizeOfRawData());
+      BOOST_TEST_EQ(entry.GetPointerToRawData(),
+                    section.GetPointerToRawData());
+      BOOST_TEST_EQ(entry.GetCharacteristics(), section.GetCharacteristics());
+      BOOST_TEST_EQ(entry.IsVirtual(), section.IsVirtual());
+    }
+    BOOST_TEST_EQ(i, section_span.size());
+  }
+}
+
+namespace
+{
+// Section names are copied out along with the rest of the header, so the
+// views are the same no matter how the file is read.
+std::vector<std::string> CheckSectionNameViews(hadesmem::Process const& process,
+                                               hadesmem::PeFile const& pe_file)
+{
+  std::vector<std::string> names;
+  hadesmem::SectionList const sections(process, pe_file);
+  hadesmem::SectionSpan const section_span(process, pe_file);
+  std::size_t i = 0;
+  for (auto const& section : sections)
+  {
+    auto const view = section.GetNameView();
+    BOOST_TEST_EQ(view.to_string(), section.GetName());
+    BOOST_TEST(view.size() <= IMAGE_SIZEOF_SHORT_NAME);
+    names.emplace_back(view.to_string());
+
+    if (i >= section_span.size())
+    {
+      BOOST_TEST(i < section_span.size());
+      break;
+    }
+
+    auto const& entry = section_span[i++];
+    auto const entry_view = entry.GetNameView();
+    BOOST_TEST_EQ(entry_view.to_string(), entry.GetName());
+    BOOST_TEST_EQ(entry_view.to_string(), view.to_string());
+  }
+
+  return names;
+}
+}
+
+void TestSectionNameViews()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  std::vector<std::string> image_names;
+  for (auto const flags :
+       {hadesmem::PeFileFlags::kNone, hadesmem::PeFileFlags::kLocalBuffer})
+  {
+    hadesmem::PeFile const pe_file(process,
+                                   ::GetModuleHandleW(nullptr),
+                                   hadesmem::PeFileType::kImage,
+                                   0,
+                                   flags);
+    auto const names = CheckSectionNameViews(process, pe_file);
+    BOOST_TEST(!names.empty());
+    if (image_names.empty())
+    {
+      image_names = names;
+    }
+    BOOST_TEST(names == image_names);
+  }
+
+  std::vector<char> buf =
+    hadesmem::detail::PeFileToBuffer(hadesmem::detail::GetSelfPath());
+  for (auto const flags :
+       {hadesmem::PeFileFlags::kNone, hadesmem::PeFileFlags::kLocalBuffer})
+  {
+    hadesmem::PeFile const pe_file(process,
+                                   buf.data(),
+                                   hadesmem::PeFileType::kData,
+                                   static_cast<DWORD>(buf.size()),
+                                   flags);
+    BOOST_TEST(CheckSectionNameViews(process, pe_file) == image_names);
+  }
+}
+
 int main()
 {
   TestSectionList();
+  TestSectionSpan();
+  TestSectionNameViews();
   return boost::report_errors();
 }
@@ -0,0 +1,140 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/pointer_scanner.hpp>
+#include <hadesmem/pointer_scanner.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/process.hpp>
+
+struct PointerScanTestTarget
+{
+  std::uint8_t padding[0x30];
+  int value;
+};
+
+PointerScanTestTarget* g_pointer_scan_test_target;
+
+void TestPointerScanner()
+{
+  // Synthetic image of a module and a heap, with the chains:
+  //   module+0x100 -> [+0x20] -> +0x10 = target
+  //   module+0x200 -> +0x8 = target
+  // and a self-referencing heap block which shouldn't lead anywhere.
+  std::uintptr_t const module_base = 0x400000;
+  std::uintptr_t const heap_base = 0x10000000;
+  std::vector<std::uint8_t> module(0x1000);
+  std::vector<std::uint8_t> heap(0x10000);
+  auto const put = [&](std::uintptr_t address, std::uintptr_t value) {
+    auto& buf = address >= heap_base ? heap : module;
+    auto const base = address >= heap_base ? heap_base : module_base;
+    std::memcpy(&buf[address - base], &value, sizeof(value));
+  };
+  std::uintptr_t const target = heap_base + 0x8010;
+  put(module_base + 0x100, heap_base + 0x1000);
+  put(heap_base + 0x1020, heap_base + 0x8000);
+  put(module_base + 0x200, target - 0x8);
+  put(heap_base + 0x2000, heap_base + 0x2000);
+  put(heap_base + 0x2008, heap_base + 0x2000);
+  put(heap_base + 0x3000, 0x12345678);
+
+  auto const read = [&](std::uintptr_t address, void* buf, std::size_t len) {
+    std::pair<std::uintptr_t, std::vector<std::uint8_t>*> const regions[] = {
+      {module_base, &module}, {heap_base, &heap}};
+    for (auto const& region : regions)
+    {
+      if (address >= region.first &&
+          address + len <= region.first + region.second->size())
+      {
+        std::memcpy(buf, &(*region.second)[address - region.first], len);
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  for (std::size_t const num_threads : {1U, 0U})
+  {
+    hadesmem::PointerScanOptions options;
+    options.max_depth = 3;
+    options.max_offset = 0x100;
+    options.chunk_size = 0x100;
+    options.num_threads = num_threads;
+    hadesmem::PointerScanner const scanner{
+      {{module_base, module.size()}, {heap_base, heap.size()}},
+      {{L"game.exe", module_base, module.size()}},
+      read,
+      options};
+    BOOST_TEST_EQ(scanner.GetNumPointers(), 5U);
+
+    auto const results = scanner.Scan(reinterpret_cast<void*>(target));
+    BOOST_TEST_EQ(results.paths.size(), 2U);
+    for (auto const& path : results.paths)
+    {
+      BOOST_TEST_EQ(path.module, 0U);
+      std::uintptr_t address = module_base + path.base_offset;
+      for (auto const offset : path.offsets)
+      {
+        std::uintptr_t value = 0;
+        BOOST_TEST(read(address, &value, sizeof(value)));
+        address = value + offset;
+      }
+      BOOST_TEST_EQ(address, target);
+    }
+
+    BOOST_TEST(
+      scanner.Scan(reinterpret_cast<void*>(heap_base + 0x2000)).paths.empty());
+  }
+
+  // Resolving against a live process, and round tripping through a file.
+  hadesmem::Process const process{::GetCurrentProcessId()};
+  hadesmem::Module const self{process, nullptr};
+  PointerScanTestTarget target_obj{};
+  g_pointer_scan_test_target = &target_obj;
+
+  hadesmem::PointerScanResults results;
+  results.modules.push_back(self.GetName());
+  results.paths.push_back(hadesmem::PointerPath{
+    0,
+    reinterpret_cast<std::uintptr_t>(&g_pointer_scan_test_target) -
+      reinterpret_cast<std::uintptr_t>(self.GetHandle()),
+    {offsetof(PointerScanTestTarget, value)}});
+  results.paths.push_back(hadesmem::PointerPath{0, 0, {0x10, 0x20}});
+
+  std::vector<wchar_t> temp_path(MAX_PATH + 1);
+  BOOST_TEST(::GetTempPathW(static_cast<DWORD>(temp_path.size()),
+                            temp_path.data()) != 0);
+  std::wstring const results_path = hadesmem::detail::CombinePath(
+    temp_path.data(), L"hadesmem_pointer_scan.bin");
+  hadesmem::SavePointerScanResults(results_path, results);
+  auto const loaded = hadesmem::LoadPointerScanResults(results_path);
+  ::DeleteFileW(results_path.c_str());
+  BOOST_TEST(loaded.modules == results.modules);
+  BOOST_TEST_EQ(loaded.paths.size(), results.paths.size());
+
+  auto const filtered =
+    hadesmem::FilterPointerPaths(process, loaded, &target_obj.value);
+  BOOST_TEST_EQ(filtered.paths.size(), 1U);
+  BOOST_TEST(filtered.paths.size() == 1 &&
+             filtered.paths[0].offsets == results.paths[0].offsets);
+}
+
+int main()
+{
+  TestPointerScanner();
+  return boost::report_errors();
+}
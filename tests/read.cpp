@@ -5,6 +5,7 @@
 #include <hadesmem/read.hpp>
 
 #include <array>
+#include <cstdint>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -18,6 +19,7 @@
 #include <hadesmem/detail/winapi.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
+#include <hadesmem/write.hpp>
 
 // TODO: Run tests against known data (e.g. Read tests should be done against
 // a memory mapped file with known values).
@@ -157,11 +159,67 @@ void TestReadCrossRegion()
   BOOST_TEST(buf == zero_buf);
 }
 
+void TestReadCache()
+{
+  hadesmem::Process process(::GetCurrentProcessId());
+  process.EnableReadCache(4);
+  BOOST_TEST(process.IsReadCacheEnabled());
+
+  SYSTEM_INFO const sys_info = hadesmem::detail::GetSystemInfo();
+  DWORD const page_size = sys_info.dwPageSize;
+
+  auto const address = static_cast<std::uint8_t*>(VirtualAlloc(
+    nullptr, page_size * 8, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+  BOOST_TEST(address != 0);
+  std::memcpy(address, "Hello", 6);
+  std::memcpy(address + page_size * 2 - 2, "World", 6);
+
+  BOOST_TEST_EQ(hadesmem::Read<char>(process, address), 'H');
+  BOOST_TEST_EQ(process.GetReadCacheStats().misses, 1U);
+  BOOST_TEST_EQ(hadesmem::ReadString<char>(process, address),
+                std::string("Hello"));
+  BOOST_TEST_EQ(
+    hadesmem::ReadString<char>(process, address + page_size * 2 - 2),
+    std::string("World"));
+  BOOST_TEST(process.GetReadCacheStats().hits >= 2);
+
+  // Changes made behind our back are not seen until invalidated...
+  address[0] = 'J';
+  BOOST_TEST_EQ(hadesmem::Read<char>(process, address), 'H');
+  process.InvalidateReadCache(address, 1);
+  BOOST_TEST_EQ(hadesmem::Read<char>(process, address), 'J');
+
+  // ...but our own writes are.
+  hadesmem::Write(process, address, 'M');
+  BOOST_TEST_EQ(hadesmem::Read<char>(process, address), 'M');
+
+  // Reads larger than the cache still work (and are bounded by it).
+  std::vector<char> const buf =
+    hadesmem::ReadVector<char>(process, address, page_size * 8);
+  BOOST_TEST_EQ(std::memcmp(buf.data(), address, buf.size()), 0);
+  BOOST_TEST(process.GetReadCacheStats().evictions > 0);
+
+  // Guard pages are never cached and still fail as usual.
+  PVOID const guard_page = VirtualAlloc(nullptr,
+                                        sizeof(void*),
+                                        MEM_RESERVE | MEM_COMMIT,
+                                        PAGE_READWRITE | PAGE_GUARD);
+  BOOST_TEST(guard_page != nullptr);
+  BOOST_TEST_THROWS(hadesmem::Read<void*>(process, guard_page),
+                    hadesmem::Error);
+
+  process.InvalidateReadCache();
+  process.DisableReadCache();
+  BOOST_TEST(!process.IsReadCacheEnabled());
+  BOOST_TEST_EQ(hadesmem::Read<char>(process, address), 'M');
+}
+
 int main()
 {
   TestReadPod();
   TestReadString();
   TestReadVector();
   TestReadCrossRegion();
+  TestReadCache();
   return boost::report_errors();
 }
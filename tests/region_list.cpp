@@ -4,15 +4,23 @@
 #include <hadesmem/region_list.hpp>
 #include <hadesmem/region_list.hpp>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <utility>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
+#include <hadesmem/alloc.hpp>
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/region_map.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
+#include <hadesmem/protect.hpp>
 #include <hadesmem/region.hpp>
 
 void TestRegionList()
@@ -96,9 +104,150 @@ void TestRegionListAlgorithm()
   BOOST_TEST(user32_iter != std::end(region_list_1));
 }
 
+MEMORY_BASIC_INFORMATION MakeRegion(std::uintptr_t base,
+                                    std::size_t size,
+                                    DWORD state)
+{
+  MEMORY_BASIC_INFORMATION mbi{};
+  mbi.BaseAddress = reinterpret_cast<PVOID>(base);
+  mbi.AllocationBase =
+    state == MEM_FREE ? nullptr : reinterpret_cast<PVOID>(base);
+  mbi.RegionSize = size;
+  mbi.State = state;
+  mbi.Protect = state == MEM_COMMIT ? PAGE_READWRITE : PAGE_NOACCESS;
+  return mbi;
+}
+
+// Queries a synthetic address space the way VirtualQueryEx would.
+struct SyntheticQuery
+{
+  bool operator()(void const* address, MEMORY_BASIC_INFORMATION* mbi) const
+  {
+    ++*num_queries;
+    auto const address_num = reinterpret_cast<std::uintptr_t>(address);
+    for (auto const& region : *regions)
+    {
+      auto const base = reinterpret_cast<std::uintptr_t>(region.BaseAddress);
+      if (address_num >= base && address_num - base < region.RegionSize)
+      {
+        std::uintptr_t const page_base = address_num & ~std::uintptr_t{0xFFF};
+        *mbi = region;
+        mbi->BaseAddress = reinterpret_cast<PVOID>(page_base);
+        mbi->RegionSize -= page_base - base;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  std::vector<MEMORY_BASIC_INFORMATION> const* regions;
+  std::size_t* num_queries;
+};
+
+void TestRegionMap()
+{
+  std::vector<MEMORY_BASIC_INFORMATION> regions{
+    MakeRegion(0x0, 0x10000, MEM_FREE),
+    MakeRegion(0x10000, 0x3000, MEM_COMMIT),
+    MakeRegion(0x13000, 0xD000, MEM_FREE),
+    MakeRegion(0x20000, 0x1000, MEM_COMMIT)};
+  std::size_t num_queries = 0;
+  SyntheticQuery const query{&regions, &num_queries};
+
+  hadesmem::detail::RegionMap region_map{0x1000};
+  region_map.Capture(query);
+  BOOST_TEST_EQ(region_map.GetRegions().size(), regions.size());
+  // One per region, plus one past the end.
+  BOOST_TEST_EQ(num_queries, regions.size() + 1);
+
+  // Lookups are trimmed to the page, the same as VirtualQueryEx.
+  num_queries = 0;
+  MEMORY_BASIC_INFORMATION mbi{};
+  BOOST_TEST(region_map.Find(reinterpret_cast<void*>(0x11234), &mbi, query));
+  BOOST_TEST_EQ(num_queries, 0U);
+  BOOST_TEST_EQ(mbi.BaseAddress, reinterpret_cast<PVOID>(0x11000));
+  BOOST_TEST_EQ(mbi.RegionSize, 0x2000U);
+  BOOST_TEST_EQ(mbi.AllocationBase, reinterpret_cast<PVOID>(0x10000));
+  BOOST_TEST(!region_map.Find(reinterpret_cast<void*>(0x21000), &mbi, query));
+
+  // Invalidated regions are queried again on demand.
+  region_map.Invalidate(reinterpret_cast<void*>(0x11000), 1);
+  BOOST_TEST(!region_map.Find(reinterpret_cast<void*>(0x11000), &mbi));
+  num_queries = 0;
+  BOOST_TEST(region_map.Find(reinterpret_cast<void*>(0x10000), &mbi, query));
+  BOOST_TEST_EQ(num_queries, 1U);
+  BOOST_TEST(region_map.Find(reinterpret_cast<void*>(0x12000), &mbi, query));
+  BOOST_TEST_EQ(num_queries, 1U);
+  BOOST_TEST_EQ(region_map.GetRegions().size(), regions.size());
+
+  // Splitting a region only needs the affected range refreshed, and the
+  // neighbours are trimmed rather than dropped.
+  regions[1] = MakeRegion(0x10000, 0x1000, MEM_COMMIT);
+  regions.insert(std::begin(regions) + 2,
+                 MakeRegion(0x11000, 0x2000, MEM_FREE));
+  region_map.Refresh(reinterpret_cast<void*>(0x11000), 0x2000, query);
+  auto const refreshed = region_map.GetRegions();
+  BOOST_TEST_EQ(refreshed.size(), regions.size());
+  for (std::size_t i = 0; i < refreshed.size() && i < regions.size(); ++i)
+  {
+    BOOST_TEST_EQ(refreshed[i].BaseAddress, regions[i].BaseAddress);
+    BOOST_TEST_EQ(refreshed[i].RegionSize, regions[i].RegionSize);
+    BOOST_TEST_EQ(refreshed[i].State, regions[i].State);
+  }
+
+  region_map.InvalidateAllocation(reinterpret_cast<void*>(0x20000));
+  BOOST_TEST_EQ(region_map.GetRegions().size(), regions.size() - 1);
+}
+
+void TestRegionListWithRegionMap()
+{
+  hadesmem::Process process(::GetCurrentProcessId());
+
+  std::vector<hadesmem::Region> regions_uncached;
+  hadesmem::RegionList const region_list(process);
+  std::copy(std::begin(region_list),
+            std::end(region_list),
+            std::back_inserter(regions_uncached));
+
+  process.EnableRegionMap();
+  BOOST_TEST(process.IsRegionMapEnabled());
+
+  // Nothing else should be changing our address space right now, so the
+  // snapshot has to match.
+  std::vector<hadesmem::Region> regions_cached;
+  std::copy(std::begin(region_list),
+            std::end(region_list),
+            std::back_inserter(regions_cached));
+  BOOST_TEST_EQ(regions_cached.size(), regions_uncached.size());
+  for (std::size_t i = 0;
+       i < regions_cached.size() && i < regions_uncached.size();
+       ++i)
+  {
+    BOOST_TEST_EQ(regions_cached[i], regions_uncached[i]);
+    BOOST_TEST_EQ(regions_cached[i].GetSize(), regions_uncached[i].GetSize());
+    BOOST_TEST_EQ(regions_cached[i].GetProtect(),
+                  regions_uncached[i].GetProtect());
+  }
+
+  // Our own allocations and protection changes keep it up to date.
+  hadesmem::Allocator const allocator{process, 0x1000};
+  hadesmem::Region const allocated{process, allocator.GetBase()};
+  BOOST_TEST_EQ(allocated.GetState(), static_cast<DWORD>(MEM_COMMIT));
+  hadesmem::Protect(process, allocator.GetBase(), PAGE_READONLY);
+  hadesmem::Region const protected_region{process, allocator.GetBase()};
+  BOOST_TEST_EQ(protected_region.GetProtect(),
+                static_cast<DWORD>(PAGE_READONLY));
+
+  process.DisableRegionMap();
+  BOOST_TEST(!process.IsRegionMapEnabled());
+}
+
 int main()
 {
   TestRegionList();
   TestRegionListAlgorithm();
+  TestRegionMap();
+  TestRegionListWithRegionMap();
   return boost::report_errors();
 }
@@ -0,0 +1,267 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/scanner.hpp>
+#include <hadesmem/scanner.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/scan_kernel.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+
+namespace
+{
+hadesmem::ScanCompare const kAbsoluteCompares[] = {
+  hadesmem::ScanCompare::kEqual,
+  hadesmem::ScanCompare::kNotEqual,
+  hadesmem::ScanCompare::kGreater,
+  hadesmem::ScanCompare::kLess,
+  hadesmem::ScanCompare::kBetween,
+  hadesmem::ScanCompare::kUnknown};
+
+// Mostly values from interesting, so every compare gets a mix of matches and
+// misses (including the edge cases), with random values in between.
+template <typename T, typename Random, std::size_t N>
+std::vector<T> MakeScanValuesInput(std::mt19937_64& rng,
+                                   T const (&interesting)[N],
+                                   Random random)
+{
+  std::vector<T> values(1000 + 7);
+  for (auto& v : values)
+  {
+    v = rng() % 2 ? interesting[rng() % N] : random();
+  }
+
+  return values;
+}
+
+// The vector path has to give exactly the same bits as the scalar one, at
+// every length (so the scalar tail after the last group of lanes is covered)
+// and whether or not the data is 16 byte aligned.
+template <typename T>
+void CheckScanValues(std::vector<T> const& values,
+                     hadesmem::detail::ScanPredicate<T> const& pred)
+{
+  std::vector<std::uint8_t> buf(values.size() * sizeof(T) + 16);
+  for (std::size_t const offset : {0U, 1U, 4U})
+  {
+    std::uint8_t* const data = buf.data() + offset;
+    std::memcpy(data, values.data(), values.size() * sizeof(T));
+    std::size_t const lengths[] = {0, 1, 3, 15, 17, 63, 65, values.size()};
+    for (std::size_t const num_slots : lengths)
+    {
+      std::size_t const num_words = (num_slots + 63) / 64;
+      std::vector<std::uint64_t> simd_bits(num_words);
+      std::vector<std::uint64_t> scalar_bits(num_words);
+      std::size_t const simd_count = hadesmem::detail::ScanValues(
+        data, num_slots, sizeof(T), pred, simd_bits.data(), true);
+      std::size_t const scalar_count = hadesmem::detail::ScanValues(
+        data, num_slots, sizeof(T), pred, scalar_bits.data(), false);
+      BOOST_TEST_EQ(simd_count, scalar_count);
+      BOOST_TEST(simd_bits == scalar_bits);
+
+      std::size_t num_bits = 0;
+      for (auto const word : scalar_bits)
+      {
+        num_bits += hadesmem::detail::PopCount64(word);
+      }
+      BOOST_TEST_EQ(num_bits, scalar_count);
+    }
+  }
+}
+
+template <typename T> void TestScanValuesInt()
+{
+  std::mt19937_64 rng{0x1337};
+  T const min = (std::numeric_limits<T>::min)();
+  T const max = (std::numeric_limits<T>::max)();
+  T const value = static_cast<T>(std::is_signed<T>::value ? -5 : 5);
+  T const value2 = static_cast<T>(100);
+  T const interesting[] = {value,
+                           value2,
+                           static_cast<T>(value - 1),
+                           static_cast<T>(value + 1),
+                           static_cast<T>(value2 + 1),
+                           min,
+                           static_cast<T>(min + 1),
+                           max,
+                           static_cast<T>(max - 1),
+                           static_cast<T>(0),
+                           static_cast<T>(-1)};
+  auto const values = MakeScanValuesInput(
+    rng, interesting, [&]() { return static_cast<T>(rng()); });
+
+  // Includes ranges which are empty or cover everything, and values at the
+  // edges of the type (which is where getting the unsigned bias wrong shows).
+  std::pair<T, T> const operands[] = {
+    {value, value2}, {value2, value}, {min, max}, {max, min}, {0, 0}};
+  for (auto const compare : kAbsoluteCompares)
+  {
+    for (auto const& operand : operands)
+    {
+      CheckScanValues(values,
+                      hadesmem::detail::ScanPredicate<T>{
+                        compare, operand.first, operand.second, T()});
+    }
+  }
+}
+
+template <typename T> void TestScanValuesFloat()
+{
+  std::mt19937_64 rng{0x1337};
+  T const value = static_cast<T>(1.5);
+  T const value2 = static_cast<T>(2.5);
+  T const inf = std::numeric_limits<T>::infinity();
+  T const nan = std::numeric_limits<T>::quiet_NaN();
+  T const interesting[] = {value,
+                           value2,
+                           static_cast<T>(value + 0.005),
+                           static_cast<T>(value - 0.02),
+                           static_cast<T>(0.0),
+                           static_cast<T>(-0.0),
+                           (std::numeric_limits<T>::max)(),
+                           std::numeric_limits<T>::lowest(),
+                           (std::numeric_limits<T>::denorm_min)(),
+                           inf,
+                           -inf,
+                           nan};
+  std::uniform_real_distribution<T> dist{static_cast<T>(-4),
+                                         static_cast<T>(4)};
+  auto const values =
+    MakeScanValuesInput(rng, interesting, [&]() { return dist(rng); });
+
+  // NaN has to fail every compare other than kNotEqual in both paths, and
+  // infinities have to compare (un)equal the same way despite inf - inf
+  // being NaN.
+  std::pair<T, T> const operands[] = {
+    {value, value2},
+    {value2, value},
+    {static_cast<T>(0.0), static_cast<T>(0.0)},
+    {inf, inf},
+    {std::numeric_limits<T>::lowest(), (std::numeric_limits<T>::max)()},
+    {nan, nan}};
+  for (auto const compare : kAbsoluteCompares)
+  {
+    for (auto const& operand : operands)
+    {
+      for (T const epsilon : {static_cast<T>(0.0), static_cast<T>(0.01)})
+      {
+        CheckScanValues(values,
+                        hadesmem::detail::ScanPredicate<T>{
+                          compare, operand.first, operand.second, epsilon});
+      }
+    }
+  }
+}
+}
+
+void TestScanValues()
+{
+  TestScanValuesInt<std::int8_t>();
+  TestScanValuesInt<std::uint8_t>();
+  TestScanValuesInt<std::int16_t>();
+  TestScanValuesInt<std::uint16_t>();
+  TestScanValuesInt<std::int32_t>();
+  TestScanValuesInt<std::uint32_t>();
+  TestScanValuesInt<std::int64_t>();
+  TestScanValuesInt<std::uint64_t>();
+  TestScanValuesFloat<float>();
+  TestScanValuesFloat<double>();
+}
+
+void TestScanner()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  // Small chunks so the results span several blocks.
+  hadesmem::ScannerOptions options;
+  options.chunk_size = 0x1000;
+
+  std::vector<std::int32_t> ints(0x10000);
+  options.start = ints.data();
+  options.end = ints.data() + ints.size();
+  std::int32_t const magic = 0x1337BEEF;
+  ints[1] = magic;
+  ints[0x400] = magic;
+  ints[0x8001] = magic;
+
+  for (std::size_t const num_threads : {1U, 0U})
+  {
+    options.num_threads = num_threads;
+    hadesmem::Scanner<std::int32_t> scanner{process, options};
+    scanner.FirstScan(hadesmem::ScanCompare::kEqual, magic);
+    BOOST_TEST_EQ(scanner.GetCount(), 3U);
+    auto const addresses = scanner.GetAddresses();
+    BOOST_TEST(addresses.size() == 3 && addresses[0] == &ints[1] &&
+               addresses[1] == &ints[0x400] && addresses[2] == &ints[0x8001]);
+
+    ints[0x400] += 5;
+    ints[0x8001] -= 1;
+    scanner.NextScan(hadesmem::ScanCompare::kIncreasedBy, 5);
+    BOOST_TEST_EQ(scanner.GetCount(), 1U);
+    scanner.ForEach([&](void* address, std::int32_t value) {
+      BOOST_TEST_EQ(address, static_cast<void*>(&ints[0x400]));
+      BOOST_TEST_EQ(value, magic + 5);
+    });
+    ints[0x400] = magic;
+    ints[0x8001] = magic;
+
+    BOOST_TEST_THROWS(scanner.FirstScan(hadesmem::ScanCompare::kChanged),
+                      hadesmem::Error);
+  }
+
+  std::vector<float> floats(0x4000, 1.0f);
+  options.start = floats.data();
+  options.end = floats.data() + floats.size();
+  options.epsilon = 0.01;
+  hadesmem::Scanner<float> scanner{process, options};
+  scanner.FirstScan(hadesmem::ScanCompare::kUnknown);
+  BOOST_TEST_EQ(scanner.GetCount(), floats.size());
+  floats[0x123] = 1.005f;
+  floats[0x2345] = 2.0f;
+  scanner.NextScan(hadesmem::ScanCompare::kChanged);
+  BOOST_TEST_EQ(scanner.GetCount(), 1U);
+  BOOST_TEST(scanner.GetAddresses() ==
+             std::vector<void*>{&floats[0x2345]});
+  scanner.NextScan(hadesmem::ScanCompare::kBetween, 1.5f, 2.5f);
+  BOOST_TEST_EQ(scanner.GetCount(), 1U);
+  scanner.NextScan(hadesmem::ScanCompare::kGreater, 2.0f);
+  BOOST_TEST_EQ(scanner.GetCount(), 0U);
+
+  // An unknown value scan which would keep more than the limit fails before
+  // reading anything, and leaves no results behind. Other scans only keep
+  // what matches, so they aren't limited.
+  options.max_snapshot_size = floats.size() * sizeof(float) / 2;
+  hadesmem::Scanner<float> limited_scanner{process, options};
+  BOOST_TEST_THROWS(limited_scanner.FirstScan(hadesmem::ScanCompare::kUnknown),
+                    hadesmem::Error);
+  BOOST_TEST_EQ(limited_scanner.GetCount(), 0U);
+  BOOST_TEST_THROWS(limited_scanner.NextScan(hadesmem::ScanCompare::kChanged),
+                    hadesmem::Error);
+  limited_scanner.FirstScan(hadesmem::ScanCompare::kEqual, 2.0f);
+  BOOST_TEST_EQ(limited_scanner.GetCount(), 1U);
+  options.max_snapshot_size = 0;
+  hadesmem::Scanner<float> unlimited_scanner{process, options};
+  unlimited_scanner.FirstScan(hadesmem::ScanCompare::kUnknown);
+  BOOST_TEST_EQ(unlimited_scanner.GetCount(), floats.size());
+}
+
+int main()
+{
+  TestScanValues();
+  TestScanner();
+  return boost::report_errors();
+}
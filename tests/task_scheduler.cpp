@@ -0,0 +1,353 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/task_scheduler.hpp>
+#include <hadesmem/detail/task_scheduler.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+
+namespace
+{
+// Spins (politely) until pred is true, or gives up after a few seconds so a
+// broken scheduler fails the test rather than hanging it.
+template <typename Pred> bool WaitFor(Pred pred)
+{
+  auto const deadline =
+    std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!pred())
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+    {
+      return false;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return true;
+}
+
+void CountNested(hadesmem::detail::TaskScheduler& scheduler,
+                 std::size_t depth,
+                 std::atomic<std::size_t>& count)
+{
+  ++count;
+  if (!depth)
+  {
+    return;
+  }
+
+  hadesmem::detail::TaskGroup group{scheduler};
+  for (std::size_t i = 0; i < 4; ++i)
+  {
+    group.Run([&]() { CountNested(scheduler, depth - 1, count); });
+  }
+  group.Wait();
+}
+}
+
+void TestTask()
+{
+  std::size_t num_calls = 0;
+
+  // Small callables are stored inline, large ones on the heap. Both have to
+  // survive being moved around, and destroy what they captured exactly once.
+  auto const small_state = std::make_shared<int>(1);
+  std::array<char, hadesmem::detail::Task::kInlineSize * 2> big_buf{};
+  big_buf[0] = 1;
+  {
+    hadesmem::detail::Task small{[small_state, &num_calls]() {
+      BOOST_TEST_EQ(*small_state, 1);
+      ++num_calls;
+    }};
+    hadesmem::detail::Task big{[big_buf, small_state, &num_calls]() {
+      BOOST_TEST_EQ(big_buf[0], 1);
+      ++num_calls;
+    }};
+    BOOST_TEST_EQ(small_state.use_count(), 3);
+
+    hadesmem::detail::Task moved_small{std::move(small)};
+    hadesmem::detail::Task moved_big;
+    moved_big = std::move(big);
+    BOOST_TEST(!small);
+    BOOST_TEST(!big);
+    BOOST_TEST(!!moved_small);
+    BOOST_TEST(!!moved_big);
+    BOOST_TEST_EQ(small_state.use_count(), 3);
+
+    moved_small();
+    moved_big();
+    BOOST_TEST_EQ(num_calls, 2U);
+
+    moved_small.Reset();
+    BOOST_TEST(!moved_small);
+    BOOST_TEST_EQ(small_state.use_count(), 2);
+  }
+  BOOST_TEST_EQ(small_state.use_count(), 1);
+
+  // Move-only callables are fine too.
+  auto owned = std::make_unique<int>(42);
+  hadesmem::detail::Task owning{[owned = std::move(owned), &num_calls]() {
+    BOOST_TEST_EQ(*owned, 42);
+    ++num_calls;
+  }};
+  owning();
+  BOOST_TEST_EQ(num_calls, 3U);
+}
+
+void TestTaskSchedulerBackpressure()
+{
+  std::size_t const kMaxQueued = 4;
+  std::size_t const kNumTasks = 16;
+  hadesmem::detail::TaskScheduler scheduler{1, kMaxQueued};
+  BOOST_TEST_EQ(scheduler.GetNumThreads(), 1U);
+
+  // Keep the only worker busy so nothing is dequeued.
+  std::atomic<bool> gate_started{false};
+  std::atomic<bool> gate_open{false};
+  std::atomic<std::size_t> num_run{0};
+  scheduler.Submit([&]() {
+    gate_started = true;
+    while (!gate_open)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  BOOST_TEST(WaitFor([&]() { return gate_started.load(); }));
+
+  std::atomic<std::size_t> num_submitted{0};
+  std::thread producer{[&]() {
+    for (std::size_t i = 0; i < kNumTasks; ++i)
+    {
+      scheduler.Submit([&]() { ++num_run; });
+      ++num_submitted;
+    }
+  }};
+
+  // The producer gets as far as filling the queue, then blocks.
+  BOOST_TEST(WaitFor([&]() { return num_submitted.load() == kMaxQueued; }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  BOOST_TEST_EQ(num_submitted.load(), kMaxQueued);
+  BOOST_TEST_EQ(num_run.load(), 0U);
+
+  gate_open = true;
+  producer.join();
+  scheduler.WaitForIdle();
+  BOOST_TEST_EQ(num_submitted.load(), kNumTasks);
+  BOOST_TEST_EQ(num_run.load(), kNumTasks);
+
+  // Submitting from a worker must never block, or a task which spawns more
+  // tasks than the limit would deadlock the pool.
+  scheduler.Submit([&]() {
+    for (std::size_t i = 0; i < kMaxQueued * 4; ++i)
+    {
+      scheduler.Submit([&]() { ++num_run; });
+    }
+  });
+  scheduler.WaitForIdle();
+  BOOST_TEST_EQ(num_run.load(), kNumTasks + kMaxQueued * 4);
+}
+
+void TestTaskSchedulerWaitForIdle()
+{
+  hadesmem::detail::TaskScheduler scheduler{4};
+
+  // Nothing submitted.
+  scheduler.WaitForIdle();
+
+  // Work submitted by tasks counts too, so idle means the whole tree is done.
+  std::atomic<std::size_t> count{0};
+  std::atomic<std::size_t> num_destroyed{0};
+  struct Tracker
+  {
+    explicit Tracker(std::atomic<std::size_t>& num_destroyed)
+      : num_destroyed_{&num_destroyed}
+    {
+    }
+
+    Tracker(Tracker&& other) noexcept : num_destroyed_{other.num_destroyed_}
+    {
+      other.num_destroyed_ = nullptr;
+    }
+
+    ~Tracker()
+    {
+      if (num_destroyed_)
+      {
+        ++*num_destroyed_;
+      }
+    }
+
+    std::atomic<std::size_t>* num_destroyed_;
+  };
+
+  for (std::size_t i = 0; i < 8; ++i)
+  {
+    scheduler.Submit(
+      [&, tracker = Tracker{num_destroyed} ]() {
+        ++count;
+        for (std::size_t j = 0; j < 8; ++j)
+        {
+          scheduler.Submit([&]() {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            ++count;
+          });
+        }
+      });
+  }
+
+  scheduler.WaitForIdle();
+  BOOST_TEST_EQ(count.load(), 8U + 8U * 8U);
+  // Captures are destroyed before the task counts as finished.
+  BOOST_TEST_EQ(num_destroyed.load(), 8U);
+}
+
+void TestTaskGroupException()
+{
+  hadesmem::detail::TaskScheduler scheduler{2};
+
+  std::atomic<std::size_t> num_run{0};
+  hadesmem::detail::TaskGroup group{scheduler};
+  for (std::size_t i = 0; i < 32; ++i)
+  {
+    group.Run([&, i]() {
+      ++num_run;
+      if (i % 8 == 3)
+      {
+        throw std::runtime_error{"Task failed."};
+      }
+    });
+  }
+
+  // The rest of the group still runs, and Wait only returns (by throwing the
+  // first exception) once it has.
+  BOOST_TEST_THROWS(group.Wait(), std::runtime_error);
+  BOOST_TEST_EQ(num_run.load(), 32U);
+
+  // The exception is only reported once, and the group can be reused.
+  group.Wait();
+  group.Run([&]() { ++num_run; });
+  group.Wait();
+  BOOST_TEST_EQ(num_run.load(), 33U);
+
+  // The scheduler itself is unaffected.
+  scheduler.Submit([&]() { ++num_run; });
+  scheduler.WaitForIdle();
+  BOOST_TEST_EQ(num_run.load(), 34U);
+}
+
+void TestTaskGroupNested()
+{
+  // A single worker is the worst case, as it has to run everything the tasks
+  // it's running wait on itself.
+  for (std::size_t const num_threads : {1U, 2U, 4U})
+  {
+    hadesmem::detail::TaskScheduler scheduler{num_threads, 2};
+    std::atomic<std::size_t> count{0};
+    hadesmem::detail::TaskGroup group{scheduler};
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+      group.Run([&]() { CountNested(scheduler, 3, count); });
+    }
+    group.Wait();
+    // 4 roots, each with 4 + 16 + 64 descendants.
+    BOOST_TEST_EQ(count.load(), 4U * (1U + 4U + 16U + 64U));
+  }
+}
+
+void TestParallelFor()
+{
+  hadesmem::detail::TaskScheduler scheduler{3};
+
+  struct Range
+  {
+    std::size_t beg;
+    std::size_t end;
+    std::size_t grain;
+  };
+  Range const ranges[] = {{0, 1000, 1},
+                          {0, 1000, 7},
+                          {0, 1000, 1000},
+                          {0, 1000, 5000},
+                          {13, 1000, 64},
+                          {500, 500, 3},
+                          {0, 0, 1}};
+  for (auto const& range : ranges)
+  {
+    std::vector<std::atomic<std::size_t>> hits(1000);
+    std::atomic<bool> bad_chunk{false};
+    hadesmem::detail::ParallelFor(
+      scheduler,
+      range.beg,
+      range.end,
+      range.grain,
+      [&](std::size_t chunk_beg, std::size_t chunk_end) {
+        if (chunk_beg >= chunk_end || chunk_beg < range.beg ||
+            chunk_end > range.end || chunk_end - chunk_beg > range.grain)
+        {
+          bad_chunk = true;
+          return;
+        }
+
+        for (std::size_t i = chunk_beg; i < chunk_end; ++i)
+        {
+          ++hits[i];
+        }
+      });
+
+    BOOST_TEST(!bad_chunk.load());
+    for (std::size_t i = 0; i < hits.size(); ++i)
+    {
+      std::size_t const expected = i >= range.beg && i < range.end ? 1 : 0;
+      BOOST_TEST_EQ(hits[i].load(), expected);
+    }
+  }
+}
+
+void TestSharedTaskScheduler()
+{
+  // Shared for as long as someone holds it.
+  std::weak_ptr<hadesmem::detail::TaskScheduler> weak_scheduler;
+  {
+    auto const scheduler = hadesmem::detail::GetSharedTaskScheduler();
+    BOOST_TEST_EQ(scheduler, hadesmem::detail::GetSharedTaskScheduler());
+    BOOST_TEST_EQ(scheduler->GetNumThreads(),
+                  hadesmem::detail::GetDefaultThreadCount());
+
+    std::atomic<std::size_t> count{0};
+    CountNested(*scheduler, 3, count);
+    BOOST_TEST_EQ(count.load(), 1U + 4U + 16U + 64U);
+
+    weak_scheduler = scheduler;
+  }
+
+  // The last holder destroys it (joining the workers), rather than it being
+  // left for static destruction.
+  BOOST_TEST(weak_scheduler.expired());
+}
+
+int main()
+{
+  TestTask();
+  TestTaskSchedulerBackpressure();
+  TestTaskSchedulerWaitForIdle();
+  TestTaskGroupException();
+  TestTaskGroupNested();
+  TestParallelFor();
+  TestSharedTaskScheduler();
+  return boost::report_errors();
+}